@@ -1,4 +1,5 @@
 #include "globals.glsl"
+#include "virtualTexture.glsl"
 
 layout(early_fragment_tests) in; // Needed for correct transparent pixel occlusion
 
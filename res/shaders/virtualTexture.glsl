@@ -0,0 +1,81 @@
+#ifndef VIRTUAL_TEXTURE_GLSL
+#define VIRTUAL_TEXTURE_GLSL
+
+#ifndef VIRTUAL_TEXTURE_FEEDBACK_BINDING
+#define VIRTUAL_TEXTURE_FEEDBACK_BINDING 7
+#endif
+
+#ifndef VIRTUAL_TEXTURE_FEEDBACK_INTERVAL
+#define VIRTUAL_TEXTURE_FEEDBACK_INTERVAL 4 // One pixel in each 4x4 block writes feedback per frame
+#endif
+
+struct VirtualTexture {
+    sampler2D physicalCache;
+    usampler2D pageTable;
+    int index;
+    ivec2 size;
+    ivec2 physicalSize;
+    int pageSize;
+    int pageBorder;
+    int mipCount;
+};
+
+layout(std430, binding = VIRTUAL_TEXTURE_FEEDBACK_BINDING) buffer VirtualTextureFeedbackBuffer {
+    uint virtualTextureFeedbackCount;
+    uint virtualTextureFeedbackCapacity;
+    uint virtualTextureFeedbackPadding0;
+    uint virtualTextureFeedbackPadding1;
+    uvec2 virtualTextureFeedback[]; // virtual texture index, packed page id
+};
+
+uniform ivec2 virtualTextureFeedbackJitter;
+
+uint packVirtualPage(uvec2 page, uint mip) {
+    return (page.x & 0x3FFFu) | ((page.y & 0x3FFFu) << 14u) | ((mip & 0xFu) << 28u);
+}
+
+float calculateVirtualTextureMip(in VirtualTexture virtualTexture, in vec2 texture) {
+    vec2 texel = texture * vec2(virtualTexture.size);
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+    return clamp(lod, 0.0, float(virtualTexture.mipCount - 1));
+}
+
+void writeVirtualTextureFeedback(in VirtualTexture virtualTexture, in vec2 texture, uint mip) {
+    ivec2 pixel = ivec2(gl_FragCoord.xy) % VIRTUAL_TEXTURE_FEEDBACK_INTERVAL;
+    if (pixel != virtualTextureFeedbackJitter) {
+        return;
+    }
+
+    uvec2 page = uvec2(fract(texture) * vec2(virtualTexture.size)) / uint(virtualTexture.pageSize << mip);
+    uint index = atomicAdd(virtualTextureFeedbackCount, 1u);
+    if (index < virtualTextureFeedbackCapacity) {
+        virtualTextureFeedback[index] = uvec2(uint(virtualTexture.index), packVirtualPage(page, mip));
+    }
+}
+
+vec4 sampleVirtualTexture(in VirtualTexture virtualTexture, in vec2 texture) {
+    texture = fract(texture);
+    uint mip = uint(calculateVirtualTextureMip(virtualTexture, texture));
+    writeVirtualTextureFeedback(virtualTexture, texture, mip);
+
+    uvec2 page = uvec2(texture * vec2(virtualTexture.size)) / uint(virtualTexture.pageSize << mip);
+    uint entry = texelFetch(virtualTexture.pageTable, ivec2(page), int(mip)).r;
+    if ((entry >> 24u) == 0u) {
+        return vec4(0.0); // Nothing resident yet, not even the coarsest mip
+    }
+
+    // The page table entry may point to a coarser ancestor than the requested mip.
+    uint residentMip = (entry >> 16u) & 0xFFu;
+    uvec2 slot = uvec2(entry & 0xFFu, (entry >> 8u) & 0xFFu);
+    vec2 residentTexel = texture * vec2(virtualTexture.size) / float(1u << residentMip);
+    vec2 residentPage = floor(residentTexel / float(virtualTexture.pageSize));
+    vec2 pageTexel = residentTexel - residentPage * float(virtualTexture.pageSize);
+
+    float paddedPageSize = float(virtualTexture.pageSize + virtualTexture.pageBorder * 2);
+    vec2 physicalTexel = vec2(slot) * paddedPageSize + float(virtualTexture.pageBorder) + pageTexel;
+    return textureLod(virtualTexture.physicalCache, physicalTexel / vec2(virtualTexture.physicalSize), 0.0);
+}
+
+#endif
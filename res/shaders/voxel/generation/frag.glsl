@@ -1,6 +1,7 @@
 #include "globals.glsl"
 
-layout (binding = 0) uniform atomic_uint voxelCount;
+layout (binding = 0, offset = 0) uniform atomic_uint voxelCount;
+layout (binding = 0, offset = 4) uniform atomic_uint droppedVoxelCount;
 
 layout (binding = 0, rgba16ui) uniform /*coherent*/ volatile uimageBuffer voxelPositionStorage;
 layout (binding = 1, rgba32ui) uniform /*coherent*/ volatile uimageBuffer voxelDataStorage;
@@ -28,6 +29,7 @@ uniform bool hasMaterial;
 uniform Material material;
 
 uniform bool countVoxels;
+uniform int voxelFragmentCapacity;
 
 vec3 calculateNormalMap(sampler2D normalMap, vec3 surfaceTangent, vec3 surfaceNormal) {
     if (fs_in.hasTangent == 0) {
@@ -156,6 +158,14 @@ void main() {
     uint voxelIndex = atomicCounterIncrement(voxelCount);
     
     if (!countVoxels) {
+        if (voxelIndex >= uint(voxelFragmentCapacity)) {
+            // No room left. The index is given back, so voxelCount ends at the number of stored fragments,
+            // and the fragment is counted separately so the buffers can be grown for the next frame.
+            atomicCounterDecrement(voxelCount);
+            atomicCounterIncrement(droppedVoxelCount);
+            return;
+        }
+
         vec3 surfaceAlbedo = vec3(0.0);
         vec3 surfaceNormal = vec3(0.0);
         vec3 surfaceEmissive = vec3(0.0);
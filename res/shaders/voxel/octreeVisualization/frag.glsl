@@ -1,7 +1,8 @@
 #include "globals.glsl"
 
 #define CHILD_FLAG_BIT 0x80000000
-#define CHILD_INDEX_MASK 0x7FFFFFFF
+#define STATIC_FLAG_BIT 0x40000000
+#define CHILD_INDEX_MASK 0x3FFFFFFF//0x7FFFFFFF // 2^30 indices
 
 #define X_IDX 2
 #define Y_IDX 1
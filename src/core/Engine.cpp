@@ -1,11 +1,19 @@
 #include "core/Engine.h"
+#include "core/JobSystem.h"
 #include "core/InputHandler.h"
 #include "core/ResourceHandler.h"
+#include "core/SessionReplay.h"
 #include "core/profiler/Profiler.h"
 #include "core/renderer/ScreenRenderer.h"
+#include "core/renderer/ShaderProgram.h"
 #include "core/renderer/RaytraceRenderer.h"
+#include "core/renderer/CPUPathTracer.h"
+#include "core/renderer/geometry/GeometryBuffer.h"
 #include "core/renderer/LayeredDepthBuffer.h"
+#include "core/renderer/VoxelGenerator.h"
 #include "core/scene/Scene.h"
+#include "core/scene/Camera.h"
+#include "core/scene/FirstPersonController.h"
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_opengl3.h>
 #include <imgui/imgui_impl_sdl.h>
@@ -39,6 +47,10 @@ Engine* Engine::instance() {
 	return Engine::s_instance;
 }
 
+JobSystem* Engine::jobSystem() {
+	return Engine::instance()->getJobSystem();
+}
+
 InputHandler* Engine::inputHandler() {
 	return Engine::instance()->getInputHandler();
 }
@@ -59,10 +71,15 @@ SceneGraph* Engine::scene() {
 	return Engine::instance()->getScene();
 }
 
+bool Engine::isGLAvailable() {
+	return Engine::instance() != NULL && Engine::instance()->hasGLContext();
+}
+
 
 
 Engine::Engine(int argc, char** argv) {
 	m_stopped = false;
+	m_exitCode = 0;
 	m_debugRenderLighting = true;
 	m_debugRenderVoxelGrid = false;
 	m_debugEnabledImageBasedLighting = true;
@@ -74,30 +91,92 @@ Engine::Engine(int argc, char** argv) {
 	m_window.size.x = 1600;
 	m_window.size.y = 900;
 	m_window.title = "Test Window";
+	m_window.handle = NULL;
+	m_window.context = NULL;
+	m_traceFrameCount = 0;
+	m_traceFrameDelay = 0;
+	m_headless = false;
+	m_maxTickCount = 0;
+	m_totalTickCount = 0;
+	m_updateThreadEnabled = false;
+	m_updateThreadRunning = false;
+	m_updateThreadTickCount = 0;
+	m_jobWorkerCount = -1;
+	m_replayFrameIndex = 0;
+	m_replayTime = 0;
+	m_replayFrameInterval = 1.0 / 60.0;
+	m_pathTraceSampleCount = 64;
+	m_pathTraceBounceCount = 4;
+	m_jobSystem = NULL;
+	m_inputHandler = NULL;
+	m_resourceHandler = NULL;
+	m_screenRenderer = NULL;
+	m_raytraceRenderer = NULL;
+	m_scene = NULL;
+	m_sessionReplay = NULL;
 
 	if (!this->parseLaunchArgs(argc, argv)) {
 		throw std::runtime_error("Failed to parse engine launch arguments\n");
 	}
 	Profiler::startProfiling("Runtime");
+
+	if (!m_traceFilePath.empty()) {
+		Profiler::currentProfiler()->beginCapture(m_traceFilePath, m_traceFrameCount, m_traceFrameDelay);
+	}
+
+	Profiler::currentProfiler()->setStatisticsFilePath(m_statisticsFilePath);
+
+	if (!m_frameTimingsFilePath.empty()) {
+		Profiler::currentProfiler()->setFrameTimingsFilePath(m_frameTimingsFilePath);
+	}
+
+	if (!m_pathTraceFilePath.empty() && m_updateThreadEnabled) {
+		// The reference frame reads the scene geometry between ticks
+		warn("Ticks run on the main thread while a reference frame is path traced\n");
+		m_updateThreadEnabled = false;
+	}
 }
 
 Engine::~Engine() {
-	info("Destroying GUI\n");
-	ImGui_ImplOpenGL3_Shutdown();
-	ImGui_ImplSDL2_Shutdown();
-	ImGui::DestroyContext();
+	if (m_updateThread.joinable()) {
+		m_updateThreadRunning = false;
+		m_updateThread.join();
+	}
+
+	delete m_sessionReplay; // Closes a recording
+
+	Profiler::currentProfiler()->endCapture(); // Needs the GL context to read the remaining GPU times
+
+	info("Stopping job system\n");
+	delete m_jobSystem; // Leftover main thread jobs may still need the GL context
 
-	info("Deleting OpenGL context\n");
-	SDL_GL_DeleteContext(m_window.context);
+	if (!m_headless) {
+		info("Destroying GUI\n");
+		ImGui_ImplOpenGL3_Shutdown();
+		ImGui_ImplSDL2_Shutdown();
+		ImGui::DestroyContext();
 
-	info("Destroying SDL window\n");
-	SDL_DestroyWindow(m_window.handle);
-	SDL_Quit();
+		info("Deleting OpenGL context\n");
+		SDL_GL_DeleteContext(m_window.context);
+
+		info("Destroying SDL window\n");
+		SDL_DestroyWindow(m_window.handle);
+		SDL_Quit();
+	}
 	Profiler::stopProfiling();
 }
 
 bool Engine::init() {
-	if (!this->initWindow()) {
+	if (m_headless) {
+		info("Running headless, the window, renderers and GUI will not be initialized\n");
+	}
+
+	if (!this->initJobSystem()) {
+		error("Failed to initialize job system\n");
+		return false;
+	}
+
+	if (!m_headless && !this->initWindow()) {
 		error("Failed to initialize game window\n");
 		return false;
 	}
@@ -112,7 +191,7 @@ bool Engine::init() {
 		return false;
 	}
 
-	if (!this->initRenderer()) {
+	if (!m_headless && !this->initRenderer()) {
 		error("Failed to initialize renderer\n");
 		return false;
 	}
@@ -122,13 +201,21 @@ bool Engine::init() {
 		return false;
 	}
 
-	if (!this->initGui()) {
+	if (!m_headless && !this->initGui()) {
 		error("Failed to initialize GUI\n");
 		return false;
 	}
 
+	if (!this->initSessionReplay()) {
+		error("Failed to initialize session replay\n");
+		return false;
+	}
+
 	m_startTime = this->getCurrentTime();
-	SDL_ShowWindow(m_window.handle);
+
+	if (!m_headless) {
+		SDL_ShowWindow(m_window.handle);
+	}
 
 	return true;
 }
@@ -156,6 +243,12 @@ bool Engine::parseLaunchArgs(int argc, char** argv) {
 		info("Loaded launch argument " #argname " as %s\n", argv[i]); \
 	}
 
+#define READ_FLAG(argname, assignment) \
+	if (std::strcmp(argv[i], "--" #argname) == 0) { \
+		assignment; \
+		info("Loaded launch flag " #argname "\n"); \
+	}
+
 
 	for (int i = 1; i < argc; i++) {
 		READ_ARG(TO_INTEGER, BETWEEN(0, 100000), updaterate, m_tickState.tickInterval = argval <= 0 ? 0.0 : 1.0 / argval);
@@ -163,6 +256,22 @@ bool Engine::parseLaunchArgs(int argc, char** argv) {
 		READ_ARG(TO_INTEGER, BETWEEN(0, 7680), width, m_window.size.x = argval);
 		READ_ARG(TO_INTEGER, BETWEEN(0, 7680), height, m_window.size.y = argval);
 		READ_ARG(TO_STRING,, resourcedir, m_resourceDirectory = std::string(argval));
+		READ_ARG(TO_STRING,, cachedir, m_cacheDirectory = std::string(argval));
+		READ_ARG(TO_STRING,, tracefile, m_traceFilePath = std::string(argval));
+		READ_ARG(TO_INTEGER, BETWEEN(0, 100000000), traceframes, m_traceFrameCount = argval);
+		READ_ARG(TO_INTEGER, BETWEEN(0, 100000000), tracedelay, m_traceFrameDelay = argval);
+		READ_ARG(TO_STRING,, statsfile, m_statisticsFilePath = std::string(argval));
+		READ_ARG(TO_STRING,, svofile, m_voxelOctreeFilePath = std::string(argval));
+		READ_ARG(TO_STRING,, recordfile, m_recordFilePath = std::string(argval));
+		READ_ARG(TO_STRING,, replayfile, m_replayFilePath = std::string(argval));
+		READ_ARG(TO_STRING,, frametimesfile, m_frameTimingsFilePath = std::string(argval));
+		READ_ARG(TO_STRING,, pathtracefile, m_pathTraceFilePath = std::string(argval));
+		READ_ARG(TO_INTEGER, BETWEEN(1, 1000000), pathtracesamples, m_pathTraceSampleCount = argval);
+		READ_ARG(TO_INTEGER, BETWEEN(1, 1000), pathtracebounces, m_pathTraceBounceCount = argval);
+		READ_ARG(TO_INTEGER, BETWEEN(0, 100000000), tickcount, m_maxTickCount = argval);
+		READ_ARG(TO_INTEGER, BETWEEN(0, 1024), workerthreads, m_jobWorkerCount = argval);
+		READ_FLAG(headless, m_headless = true);
+		READ_FLAG(updatethread, m_updateThreadEnabled = true);
 	}
 
 	return true;
@@ -211,6 +320,13 @@ bool Engine::initWindow() {
 	return true;
 }
 
+bool Engine::initJobSystem() {
+	info("Initializing job system\n");
+	m_jobSystem = new JobSystem(m_jobWorkerCount >= 0 ? (uint32_t)m_jobWorkerCount : JobSystem::getDefaultWorkerCount());
+
+	return true;
+}
+
 bool Engine::initInputHandler() {
 	info("Initializing input handler\n");
 	m_inputHandler = new InputHandler(m_window.handle);
@@ -248,6 +364,15 @@ bool Engine::initRenderer() {
 bool Engine::initScene() {
 	info("Initializing scene\n");
 	m_scene = new SceneGraph();
+
+	if (!m_voxelOctreeFilePath.empty()) {
+		if (m_scene->getVoxelizer() == NULL) {
+			warn("Not loading baked voxel octree \"%s\", there is no renderer to load it into\n", m_voxelOctreeFilePath.c_str());
+		} else if (!m_scene->getVoxelizer()->loadOctree(m_voxelOctreeFilePath)) {
+			error("Failed to load baked voxel octree \"%s\"\n", m_voxelOctreeFilePath.c_str());
+		}
+	}
+
 	return true;
 }
 
@@ -261,6 +386,50 @@ bool Engine::initGui() {
 	return true;
 }
 
+bool Engine::initSessionReplay() {
+	if (m_recordFilePath.empty() && m_replayFilePath.empty())
+		return true;
+
+	if (!m_recordFilePath.empty() && !m_replayFilePath.empty()) {
+		error("A session cannot be recorded and replayed at the same time\n");
+		return false;
+	}
+
+	if (!m_recordFilePath.empty() && m_headless) {
+		warn("Not recording the session to \"%s\", headless sessions have no input to record\n", m_recordFilePath.c_str());
+		return true;
+	}
+
+	if (m_updateThreadEnabled) {
+		// Recorded frames are matched to ticks by running both on the main thread
+		warn("Ticks run on the main thread while a session is recorded or replayed\n");
+		m_updateThreadEnabled = false;
+	}
+
+	info("Initializing session replay\n");
+	m_sessionReplay = new SessionReplay();
+
+	if (!m_recordFilePath.empty()) {
+		return m_sessionReplay->beginRecording(m_recordFilePath, m_tickState.tickInterval);
+	}
+
+	if (!m_sessionReplay->load(m_replayFilePath)) {
+		return false;
+	}
+
+	// Replays tick at the recorded rate and render at the launch frame rate, 60 fps when it is unlimited
+	m_tickState.tickInterval = m_sessionReplay->getTickInterval();
+	m_replayFrameInterval = m_frameState.tickInterval > 0.0 ? m_frameState.tickInterval : 1.0 / 60.0;
+	m_tickState.lastTick = 0;
+	m_frameState.lastTick = 0;
+	m_replayTime = 0;
+	m_replayFrameIndex = 0;
+
+	// The camera follows the recorded path, the controller would otherwise move it on the replayed input too
+	m_scene->setControllerEnabled(false);
+	return true;
+}
+
 
 bool Engine::update() {
 	static const double smoothingFactor = 0.1;
@@ -274,21 +443,43 @@ bool Engine::update() {
 	m_frameState.didUpdate = false;
 	m_debugState.didUpdate = false;
 
-	if (m_tickState.partialTicks >= 1.0) {
-		double prevDeltaTime = m_tickState.deltaTime;
-		m_tickState.deltaTime = (now - m_tickState.lastTick) / 1000000000.0;
-		m_tickState.smoothedDeltaTime = prevDeltaTime * (1.0 - smoothingFactor) + m_tickState.deltaTime * smoothingFactor;
-		m_tickState.tickCount++;
-		m_tickState.partialTicks -= 1.0;
-		m_tickState.lastTick = now;
-		m_tickState.didUpdate = true;
-		
-		if (!this->updateTick(m_tickState.deltaTime)) {
+	if (this->isReplaying()) {
+		return this->updateReplay();
+	}
+
+	{
+		PROFILE_SCOPE("JobSystem::processMainThreadJobs()");
+		m_jobSystem->processMainThreadJobs();
+	}
+
+	if (m_updateThreadEnabled) {
+		if (!m_updateThread.joinable()) {
+			// Started on the first update rather than in init, so the scene is set up before it is ticked
+			m_updateThreadRunning = true;
+			m_updateThread = std::thread(&Engine::updateThread, this, m_tickState); // The thread keeps its own copy of the tick state
+		}
+
+		if (!m_updateThreadRunning) {
 			return false;
 		}
+
+		// Frames interpolate from the tick before the latest published one towards it
+		m_tickState.didUpdate = m_scene->getTransformSnapshots().acquire();
+		m_tickState.tickCount += m_updateThreadTickCount.exchange(0);
+		m_tickState.partialTicks = glm::clamp((double)(int64_t)(now - m_scene->getTransformSnapshots().getReadTickTime()) / (m_tickState.tickInterval * 1000000000.0), 0.0, 1.0);
+
+	} else if (m_tickState.partialTicks >= 1.0) {
+		if (!this->runTick(m_tickState, now)) {
+			return false;
+		}
+	}
+
+	if (m_headless) {
+		// Nothing renders the profiler UI, which would otherwise collect the events every frame
+		Profiler::currentProfiler()->collect();
 	}
 
-	if (m_frameState.partialTicks >= 1.0) {
+	if (!m_headless && m_frameState.partialTicks >= 1.0) {
 		double prevDeltaTime = m_frameState.deltaTime;
 		m_frameState.deltaTime = (now - m_frameState.lastTick) / 1000000000.0;
 		m_frameState.smoothedDeltaTime = prevDeltaTime * (1.0 - smoothingFactor) + m_frameState.deltaTime * smoothingFactor;
@@ -311,10 +502,30 @@ bool Engine::update() {
 
 		char dataStr[50];
 		sprintf(dataStr, "%d fps, %d ups", m_frameState.tickCount, m_tickState.tickCount);
-		SDL_SetWindowTitle(m_window.handle, (m_window.title + " [" + dataStr + "]").c_str());
+		if (m_window.handle != NULL) {
+			SDL_SetWindowTitle(m_window.handle, (m_window.title + " [" + dataStr + "]").c_str());
+		}
 
 		m_frameState.tickCount = 0;
 		m_tickState.tickCount = 0;
+
+		if (Engine::isGLAvailable()) {
+			// Checked once a second rather than every frame, every shader file is looked up on disk
+			ShaderProgram::reloadChangedPrograms();
+		}
+	}
+
+	if (!m_pathTraceFilePath.empty() && m_scene->getStaticGeometryBuffer()->getBVH() != NULL) {
+		// Rendered once the static scene geometry and its BVH are built, the engine stops afterwards
+		if (!this->renderPathTracedFrame()) {
+			m_exitCode = 1;
+		}
+		return false;
+	}
+
+	if (m_headless && !m_tickState.didUpdate && m_tickState.tickInterval > 0.0) {
+		// Nothing is rendered between ticks, so wait for the next one instead of spinning
+		std::this_thread::sleep_for(std::chrono::nanoseconds((uint64_t)((1.0 - m_tickState.partialTicks) * m_tickState.tickInterval * 1000000000.0)));
 	}
 
 	//SDL_Delay(1);
@@ -325,6 +536,10 @@ std::string Engine::getResourceDirectory() const {
 	return m_resourceDirectory;
 }
 
+std::string Engine::getCacheDirectory() const {
+	return m_cacheDirectory.empty() ? m_resourceDirectory + "/cache" : m_cacheDirectory;
+}
+
 uint64_t Engine::getCurrentTime() const {
 	return std::chrono::high_resolution_clock::now().time_since_epoch().count();
 }
@@ -342,7 +557,11 @@ bool Engine::updateFrame(double dt, double partialTicks) {
 
 	PROFILE_EXPR(SDL_GL_SwapWindow(m_window.handle));
 
-	m_inputHandler->update();
+	// Replays hand the recorded events to the input handler themselves, live input is ignored
+	bool replaying = this->isReplaying();
+	if (!replaying) {
+		m_inputHandler->update();
+	}
 
 	{
 		PROFILE_SCOPE("SDL_PollEvent(&event)");
@@ -355,7 +574,13 @@ bool Engine::updateFrame(double dt, double partialTicks) {
 				return false;
 			}
 
-			m_inputHandler->processEvent(event);
+			if (!replaying) {
+				m_inputHandler->processEvent(event);
+			}
+
+			if (m_sessionReplay != NULL) {
+				m_sessionReplay->recordEvent(event);
+			}
 		}
 	}
 
@@ -390,6 +615,10 @@ bool Engine::updateFrame(double dt, double partialTicks) {
 		//m_renderer->drawScene(m_scene);
 	}
 
+	if (m_sessionReplay != NULL) {
+		m_sessionReplay->recordFrame(m_scene->getController()->transform());
+	}
+
 	{
 		PROFILE_SCOPE("ImGui::Render()");
 		glViewport(0, 0, m_window.size.x, m_window.size.y);
@@ -407,10 +636,147 @@ bool Engine::updateTick(double dt) {
 	return true;
 }
 
+bool Engine::updateReplay() {
+	if (m_replayFrameIndex >= m_sessionReplay->getFrameCount()) {
+		info("Replay finished after %u frames\n", m_replayFrameIndex);
+		return false;
+	}
+
+	{
+		PROFILE_SCOPE("Replay Frame");
+
+		{
+			PROFILE_SCOPE("JobSystem::processMainThreadJobs()");
+			m_jobSystem->processMainThreadJobs();
+		}
+
+		const ReplayFrame& frame = m_sessionReplay->getFrame(m_replayFrameIndex);
+
+		// The events are handed over before the ticks, so everything reading input this frame sees them
+		m_inputHandler->update();
+		for (int i = 0; i < frame.events.size(); i++) {
+			m_inputHandler->processEvent(SessionReplay::toSDLEvent(frame.events[i]));
+		}
+
+		// Time advances by the fixed frame step only, and ticks run whenever it passes the next tick
+		uint64_t frameInterval = (uint64_t)(m_replayFrameInterval * 1000000000.0);
+		uint64_t tickInterval = (uint64_t)(m_tickState.tickInterval * 1000000000.0);
+		m_replayTime += frameInterval;
+
+		if (tickInterval == 0) {
+			if (!this->runTick(m_tickState, m_replayTime)) {
+				return false;
+			}
+		} else {
+			while (m_replayTime - m_tickState.lastTick >= tickInterval) {
+				if (!this->runTick(m_tickState, m_tickState.lastTick + tickInterval)) {
+					return false;
+				}
+			}
+		}
+
+		m_tickState.partialTicks = tickInterval == 0 ? 0.0 : (double)(m_replayTime - m_tickState.lastTick) / tickInterval;
+
+		FirstPersonController* controller = m_scene->getController();
+		controller->transform().setTranslation(frame.cameraTranslation);
+		controller->transform().setOrientation(frame.cameraOrientation);
+		controller->applyCamera(m_scene->getCamera());
+
+		if (!m_headless) {
+			m_frameState.deltaTime = m_replayFrameInterval;
+			m_frameState.smoothedDeltaTime = m_replayFrameInterval;
+			m_frameState.tickCount++;
+			m_frameState.partialTicks = 0.0;
+			m_frameState.lastTick = m_replayTime;
+			m_frameState.didUpdate = true;
+
+			if (!this->updateFrame(m_frameState.deltaTime, m_tickState.partialTicks)) {
+				return false;
+			}
+		}
+
+		++m_replayFrameIndex;
+	}
+
+	// The replayed frame's root scope is closed now, so it is accumulated into the statistics and frame timings
+	Profiler::currentProfiler()->collect();
+	return true;
+}
+
+bool Engine::renderPathTracedFrame() {
+	PROFILE_SCOPE("Engine::renderPathTracedFrame()");
+
+	GeometryBuffer* geometryBuffer = m_scene->getStaticGeometryBuffer();
+	std::vector<PackedMaterial> materials = m_scene->getMaterialManager()->getPackedMaterials();
+
+	info("Path tracing a reference frame of %llu triangles, %llu of them emissive\n", (unsigned long long)geometryBuffer->getTriangles().size(), (unsigned long long)geometryBuffer->getEmissiveTriangles().size());
+
+	CPUPathTracer pathTracer(*geometryBuffer, materials);
+	pathTracer.setSamplesPerPixel(m_pathTraceSampleCount);
+	pathTracer.setMaxBounces(m_pathTraceBounceCount);
+
+	// The camera only follows the controller when frames are rendered, so the controller is read directly
+	Transformation& cameraTransform = m_scene->getController()->transform();
+	uvec2 resolution = uvec2(m_window.size);
+
+	std::vector<vec3> pixels;
+	pathTracer.render(cameraTransform.getTranslation(), cameraTransform.getAxisVectors(), m_scene->getCamera()->getFieldOfView(), resolution, pixels);
+	return CPUPathTracer::writePFM(m_pathTraceFilePath, resolution, pixels);
+}
+
+bool Engine::runTick(UpdateState& tickState, uint64_t now) {
+	static const double smoothingFactor = 0.1;
+	PROFILE_SCOPE("Tick");
+
+	double prevDeltaTime = tickState.deltaTime;
+	tickState.deltaTime = (now - tickState.lastTick) / 1000000000.0;
+	tickState.smoothedDeltaTime = prevDeltaTime * (1.0 - smoothingFactor) + tickState.deltaTime * smoothingFactor;
+	tickState.tickCount++;
+	tickState.partialTicks -= 1.0;
+	tickState.lastTick = now;
+	tickState.didUpdate = true;
+
+	if (!this->updateTick(tickState.deltaTime)) {
+		return false;
+	}
+
+	if (m_maxTickCount != 0 && ++m_totalTickCount >= m_maxTickCount) {
+		info("Stopping after %u ticks\n", m_maxTickCount);
+		return false;
+	}
+
+	return true;
+}
+
+void Engine::updateThread(UpdateState tickState) {
+	Profiler::setThreadName("Update Thread");
+	info("Running ticks on the update thread\n");
+
+	while (m_updateThreadRunning) {
+		uint64_t now = this->getCurrentTime();
+		tickState.partialTicks = (now - tickState.lastTick) / (tickState.tickInterval * 1000000000.0);
+
+		if (tickState.partialTicks >= 1.0) {
+			if (!this->runTick(tickState, now)) {
+				m_updateThreadRunning = false;
+				break;
+			}
+
+			m_updateThreadTickCount.fetch_add(1);
+		} else {
+			std::this_thread::sleep_for(std::chrono::nanoseconds((uint64_t)((1.0 - tickState.partialTicks) * tickState.tickInterval * 1000000000.0)));
+		}
+	}
+}
+
 bool Engine::isStopped() const {
 	return m_stopped;
 }
 
+int Engine::getExitCode() const {
+	return m_exitCode;
+}
+
 bool Engine::isDebugRenderWireframeEnabled() const {
 	return m_debugRenderWireframe;
 }
@@ -485,7 +851,8 @@ dvec2 Engine::getWindowCenter() const {
 
 void Engine::setWindowSize(ivec2 size) {
 	if (size.x > 0 && size.y > 0 && size != m_window.size) {
-		SDL_SetWindowSize(m_window.handle, size.x, size.y);
+		if (m_window.handle != NULL)
+			SDL_SetWindowSize(m_window.handle, size.x, size.y);
 		m_window.size = size;
 	}
 }
@@ -494,6 +861,10 @@ double Engine::getWindowAspectRatio() const {
 	return double(m_window.size.x) / double(m_window.size.y);
 }
 
+JobSystem* Engine::getJobSystem() const {
+	return m_jobSystem;
+}
+
 InputHandler* Engine::getInputHandler() const {
 	return m_inputHandler;
 }
@@ -517,3 +888,15 @@ SceneGraph* Engine::getScene() const {
 bool Engine::hasGLContext() const {
 	return m_window.context != NULL;
 }
+
+bool Engine::isHeadless() const {
+	return m_headless;
+}
+
+bool Engine::isUpdateThreadEnabled() const {
+	return m_updateThreadEnabled;
+}
+
+bool Engine::isReplaying() const {
+	return m_sessionReplay != NULL && !m_replayFilePath.empty();
+}
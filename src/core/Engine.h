@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/pch.h"
+#include <atomic>
 
 struct UpdateState {
 	uint64_t lastTick; // Nanosecond timestamp of last tick
@@ -19,11 +20,13 @@ struct Window {
 	std::string title;
 };
 
+class JobSystem;
 class InputHandler;
 class ResourceHandler;
 class ScreenRenderer;
 class RaytraceRenderer;
 class SceneGraph;
+class SessionReplay;
 
 class Engine : private NotCopyable {
 public:
@@ -33,6 +36,8 @@ public:
 
 	static Engine* instance();
 
+	static JobSystem* jobSystem();
+
 	static InputHandler* inputHandler();
 
 	static ResourceHandler* resourceHandler();
@@ -43,10 +48,14 @@ public:
 
 	static SceneGraph* scene();
 
+	static bool isGLAvailable();
+
 	bool update();
 
 	std::string getResourceDirectory() const;
 
+	std::string getCacheDirectory() const;
+
 	uint64_t getCurrentTime() const;
 
 	uint64_t getStartTime() const;
@@ -55,6 +64,9 @@ public:
 
 	bool isStopped() const;
 
+	// Non-zero if a run that stops by itself failed, such as a path traced frame that could not be written
+	int getExitCode() const;
+
 	bool isDebugRenderWireframeEnabled() const;
 
 	void setDebugRenderWireframeEnabled(bool enabled);
@@ -95,6 +107,8 @@ public:
 
 	double getWindowAspectRatio() const;
 
+	JobSystem* getJobSystem() const;
+
 	InputHandler* getInputHandler() const;
 
 	ResourceHandler* getResourceHandler() const;
@@ -106,6 +120,12 @@ public:
 	SceneGraph* getScene() const;
 
 	bool hasGLContext() const;
+
+	bool isHeadless() const;
+
+	bool isUpdateThreadEnabled() const;
+
+	bool isReplaying() const;
 private:
 	Engine(int argc, char** argv);
 
@@ -115,6 +135,8 @@ private:
 
 	bool parseLaunchArgs(int argc, char** argv);
 
+	bool initJobSystem();
+
 	bool initWindow();
 
 	bool initInputHandler();
@@ -127,15 +149,49 @@ private:
 
 	bool initGui();
 
+	bool initSessionReplay();
+
 	bool updateFrame(double dt, double partialTicks);
 
 	bool updateTick(double dt);
 
+	bool updateReplay();
+
+	bool renderPathTracedFrame();
+
+	bool runTick(UpdateState& tickState, uint64_t now);
+
+	void updateThread(UpdateState tickState);
+
 	static Engine* s_instance;
 
 	std::string m_resourceDirectory;
+	std::string m_cacheDirectory; // Precomputed data cached between launches, the cache directory in the resource directory if empty
+	std::string m_traceFilePath; // Profiler capture written from launch, empty for none
+	uint32_t m_traceFrameCount; // Number of frames captured, 0 to capture until shutdown
+	uint32_t m_traceFrameDelay; // Number of frames to skip before the capture starts
+	std::string m_statisticsFilePath; // Profiler statistics CSV written at shutdown, empty for none
+	std::string m_voxelOctreeFilePath; // Baked SVO file loaded instead of voxelizing the scene, empty for none
+	std::string m_recordFilePath; // Session recording of the input and camera path written from launch, empty for none
+	std::string m_replayFilePath; // Session recording replayed instead of live input, empty for none
+	std::string m_frameTimingsFilePath; // Per frame profiler timings CSV written as frames complete, empty for none
+	std::string m_pathTraceFilePath; // CPU path traced reference frame written once the scene geometry is built, empty for none
+	uint32_t m_pathTraceSampleCount; // Samples per pixel of the path traced reference frame
+	uint32_t m_pathTraceBounceCount; // Surface interactions lit per path of the path traced reference frame
+	uint32_t m_replayFrameIndex; // Next recorded frame to replay
+	uint64_t m_replayTime; // Nanoseconds of replayed time, advanced by a fixed step every replayed frame
+	double m_replayFrameInterval; // Fixed frame step of replays in seconds
+	bool m_headless; // Runs without a window, GL context or GUI, only ticking the scene
+	uint32_t m_maxTickCount; // Number of ticks to run before stopping, 0 to run until stopped
+	uint64_t m_totalTickCount;
+	bool m_updateThreadEnabled; // Runs ticks on their own thread, frames render interpolated tick snapshots
+	std::thread m_updateThread;
+	std::atomic<bool> m_updateThreadRunning;
+	std::atomic<uint32_t> m_updateThreadTickCount; // Ticks run since the main thread last counted them
+	int32_t m_jobWorkerCount; // Worker threads of the job system, -1 for one less than the hardware threads
 	uint64_t m_startTime;
 	bool m_stopped;
+	int m_exitCode;
 	bool m_debugRenderWireframe;
 	bool m_debugRenderLighting;
 	bool m_debugRenderVoxelGrid;
@@ -145,9 +201,11 @@ private:
 	UpdateState m_frameState;
 	UpdateState m_debugState;
 	Window m_window;
+	JobSystem* m_jobSystem;
 	InputHandler* m_inputHandler;
 	ResourceHandler* m_resourceHandler;
 	ScreenRenderer* m_screenRenderer;
 	RaytraceRenderer* m_raytraceRenderer;
 	SceneGraph* m_scene;
+	SessionReplay* m_sessionReplay;
 };
\ No newline at end of file
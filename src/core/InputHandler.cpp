@@ -23,6 +23,7 @@ InputHandler::InputHandler(SDL_Window* windowHandle) {
 	m_prevMousePixelCoord = ivec2(0, 0);
 	m_currMousePixelMotion = ivec2(0, 0);
 	m_prevMousePixelMotion = ivec2(0, 0);
+	m_relativeMouseMotion = ivec2(0, 0);
 	m_mouseGrabbed = false;
 }
 
@@ -74,6 +75,7 @@ void InputHandler::processEvent(SDL_Event event) {
 		case SDL_MOUSEMOTION:
 			m_currMousePixelCoord = ivec2(event.motion.x, event.motion.y); // why is this not reset to zero?
 			m_currMousePixelMotion = ivec2(event.motion.xrel, event.motion.yrel);
+			m_relativeMouseMotion += ivec2(event.motion.xrel, event.motion.yrel);
 			for (int i = 0; i < MOUSE_SIZE; i++)
 				m_mouseDragged[i] = m_mouseDown[i];
 			break;
@@ -125,8 +127,13 @@ void InputHandler::setMouseGrabbed(bool grabbed) {
 		this->setMouseScreenCoord(dvec2(0.5, 0.5));
 		m_prevMousePixelCoord = m_currMousePixelCoord;
 		m_prevMousePixelMotion = ivec2(0);
-		SDL_ShowCursor(!grabbed);
-		SDL_SetRelativeMouseMode(grabbed ? SDL_TRUE : SDL_FALSE);
+		m_relativeMouseMotion = ivec2(0);
+
+		// Headless replays grab the mouse as recorded, without a window or SDL video to grab it in
+		if (m_windowHandle != NULL) {
+			SDL_ShowCursor(!grabbed);
+			SDL_SetRelativeMouseMode(grabbed ? SDL_TRUE : SDL_FALSE);
+		}
 	}
 }
 
@@ -139,7 +146,9 @@ bool InputHandler::setMousePixelCoord(ivec2 coord) {
 		return false;
 	}
 
-	SDL_WarpMouseInWindow(m_windowHandle, coord.x, coord.y);
+	if (m_windowHandle != NULL) {
+		SDL_WarpMouseInWindow(m_windowHandle, coord.x, coord.y);
+	}
 	m_currMousePixelCoord = ivec2(coord);
 	return true;
 }
@@ -173,9 +182,10 @@ ivec2 InputHandler::getLastMousePixelMotion() {
 }
 
 ivec2 InputHandler::getRelativeMouseState() {
-	int x, y;
-	SDL_GetRelativeMouseState(&x, &y);
-	return ivec2(x, y);
+	// Summed from the processed events rather than read from SDL, so replayed events move the mouse too
+	ivec2 motion = m_relativeMouseMotion;
+	m_relativeMouseMotion = ivec2(0, 0);
+	return motion;
 }
 
 dvec2 InputHandler::getMouseScreenMotion() {
@@ -81,6 +81,7 @@ private:
 	ivec2 m_prevMousePixelCoord;
 	ivec2 m_currMousePixelMotion;
 	ivec2 m_prevMousePixelMotion;
+	ivec2 m_relativeMouseMotion; // Motion summed over every event since getRelativeMouseState() was last called
 	bool m_mouseGrabbed;
 };
 
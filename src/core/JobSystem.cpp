@@ -0,0 +1,289 @@
+#include "JobSystem.h"
+
+thread_local JobSystem* JobSystem::s_currentJobSystem = NULL;
+thread_local uint32_t JobSystem::s_currentQueueIndex = 0;
+
+
+
+JobCounter::JobCounter():
+	m_count(0) {
+}
+
+JobCounter::~JobCounter() {
+	assert(m_count.load() == 0 && "Job counter destroyed while its jobs are still running");
+}
+
+bool JobCounter::isDone() const {
+	return m_count.load(std::memory_order_acquire) == 0;
+}
+
+uint32_t JobCounter::getCount() const {
+	return m_count.load(std::memory_order_acquire);
+}
+
+
+
+JobSystem::JobSystem(uint32_t workerCount):
+	m_mainThreadId(std::this_thread::get_id()),
+	m_queuedJobCount(0),
+	m_running(true) {
+
+	info("Starting job system with %u worker threads\n", workerCount);
+
+	m_queues.push_back(new JobQueue());
+	for (uint32_t i = 0; i < workerCount; i++) {
+		m_queues.push_back(new JobQueue());
+	}
+
+	for (uint32_t i = 0; i < workerCount; i++) {
+		m_threads.push_back(std::thread(&JobSystem::workerThread, this, i + 1));
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_running = false;
+	}
+
+	m_sleepCondition.notify_all();
+	for (int i = 0; i < m_threads.size(); i++) {
+		m_threads[i].join();
+	}
+
+	// Nothing waits on jobs that never started, run them rather than leaving their counters unfinished
+	while (this->runNextJob());
+	this->processMainThreadJobs();
+
+	for (int i = 0; i < m_queues.size(); i++) {
+		delete m_queues[i];
+	}
+}
+
+void JobSystem::run(std::function<void()> task, JobCounter* counter, JobCounter* dependency) {
+	this->submit(std::move(task), counter, dependency, false);
+}
+
+void JobSystem::runOnMainThread(std::function<void()> task, JobCounter* counter, JobCounter* dependency) {
+	this->submit(std::move(task), counter, dependency, true);
+}
+
+void JobSystem::wait(JobCounter* counter) {
+	if (counter == NULL)
+		return;
+
+	while (!counter->isDone()) {
+		if (!this->runNextJob()) {
+			std::this_thread::yield();
+		}
+	}
+
+	// The last job may still be releasing the counter's lock after its count reached zero
+	std::lock_guard<std::mutex> lock(counter->m_mutex);
+}
+
+void JobSystem::parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& batchTask, uint32_t maxThreadCount) {
+	if (count == 0)
+		return;
+
+	batchSize = glm::max(batchSize, (size_t)1);
+	size_t batchCount = (count + batchSize - 1) / batchSize;
+
+	uint32_t threadCount = this->getThreadCount();
+	if (maxThreadCount != 0)
+		threadCount = glm::min(threadCount, maxThreadCount);
+	threadCount = (uint32_t)glm::min((size_t)threadCount, batchCount);
+
+	// Batches are handed out in order from a shared index rather than split up front, so uneven batches
+	// balance out. Helpers that start after every batch was taken return straight away.
+	std::atomic<size_t> nextBatch(0);
+	auto worker = [count, batchSize, batchCount, &nextBatch, &batchTask]() {
+		size_t batchIndex;
+		while ((batchIndex = nextBatch.fetch_add(1, std::memory_order_relaxed)) < batchCount) {
+			size_t first = batchIndex * batchSize;
+			batchTask(first, glm::min(first + batchSize, count));
+		}
+	};
+
+	// The calling thread works through batches too
+	JobCounter counter;
+	for (uint32_t i = 1; i < threadCount; i++) {
+		this->run(worker, &counter);
+	}
+
+	worker();
+
+	this->wait(&counter);
+}
+
+uint32_t JobSystem::processMainThreadJobs() {
+	assert(this->isMainThread());
+
+	std::deque<Job> jobs;
+	{
+		std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+		jobs.swap(m_mainThreadJobs);
+	}
+
+	// Jobs queued by these jobs run on the next call
+	for (int i = 0; i < jobs.size(); i++) {
+		this->execute(jobs[i]);
+	}
+
+	return (uint32_t)jobs.size();
+}
+
+bool JobSystem::isMainThread() const {
+	return std::this_thread::get_id() == m_mainThreadId;
+}
+
+uint32_t JobSystem::getWorkerCount() const {
+	return (uint32_t)m_threads.size();
+}
+
+uint32_t JobSystem::getThreadCount() const {
+	return (uint32_t)m_threads.size() + 1; // The thread waiting on the jobs runs them as well
+}
+
+uint32_t JobSystem::getDefaultWorkerCount() {
+	uint32_t hardwareThreadCount = std::thread::hardware_concurrency();
+	return hardwareThreadCount > 1 ? hardwareThreadCount - 1 : 0; // Leave one for the main thread
+}
+
+void JobSystem::submit(std::function<void()> task, JobCounter* counter, JobCounter* dependency, bool mainThread) {
+	if (counter != NULL) {
+		counter->m_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (dependency != NULL) {
+		std::lock_guard<std::mutex> lock(dependency->m_mutex);
+		if (dependency->m_count.load(std::memory_order_acquire) != 0) {
+			JobCounter::Continuation continuation;
+			continuation.task = std::move(task);
+			continuation.counter = counter;
+			continuation.mainThread = mainThread;
+			dependency->m_continuations.push_back(std::move(continuation));
+			return;
+		}
+	}
+
+	Job job;
+	job.task = std::move(task);
+	job.counter = counter;
+	job.flow = Profiler::beginFlow();
+	this->enqueue(std::move(job), mainThread);
+}
+
+void JobSystem::enqueue(Job job, bool mainThread) {
+	if (mainThread) {
+		std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+		m_mainThreadJobs.push_back(std::move(job));
+		return;
+	}
+
+	JobQueue* queue = m_queues[this->getCurrentQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->jobs.push_back(std::move(job));
+	}
+
+	m_queuedJobCount.fetch_add(1, std::memory_order_release);
+
+	// Taking the lock orders the count above before any sleeping worker's check of it
+	{ std::lock_guard<std::mutex> lock(m_sleepMutex); }
+	m_sleepCondition.notify_one();
+}
+
+bool JobSystem::runNextJob() {
+	Job job;
+	bool found = false;
+
+	if (this->isMainThread()) {
+		std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+		if (!m_mainThreadJobs.empty()) {
+			job = std::move(m_mainThreadJobs.front());
+			m_mainThreadJobs.pop_front();
+			found = true;
+		}
+	}
+
+	uint32_t queueIndex = this->getCurrentQueueIndex();
+	if (!found) {
+		JobQueue* queue = m_queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (!queue->jobs.empty()) {
+			job = std::move(queue->jobs.back());
+			queue->jobs.pop_back();
+			m_queuedJobCount.fetch_sub(1, std::memory_order_relaxed);
+			found = true;
+		}
+	}
+
+	for (uint32_t i = 1; !found && i < m_queues.size(); i++) {
+		JobQueue* queue = m_queues[(queueIndex + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (!queue->jobs.empty()) {
+			job = std::move(queue->jobs.front());
+			queue->jobs.pop_front();
+			m_queuedJobCount.fetch_sub(1, std::memory_order_relaxed);
+			found = true;
+		}
+	}
+
+	if (found) {
+		this->execute(job);
+	}
+
+	return found;
+}
+
+void JobSystem::execute(Job& job) {
+	Profiler::endFlow(job.flow);
+	job.task();
+
+	if (job.counter != NULL) {
+		this->complete(job.counter);
+	}
+}
+
+void JobSystem::complete(JobCounter* counter) {
+	std::vector<JobCounter::Continuation> continuations;
+	{
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+		if (counter->m_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+
+		continuations.swap(counter->m_continuations);
+	}
+
+	// The counter may be gone from here on, a waiter can return as soon as the lock is released
+	for (int i = 0; i < continuations.size(); i++) {
+		Job job;
+		job.task = std::move(continuations[i].task);
+		job.counter = continuations[i].counter;
+		job.flow = Profiler::beginFlow();
+		this->enqueue(std::move(job), continuations[i].mainThread);
+	}
+}
+
+void JobSystem::workerThread(uint32_t queueIndex) {
+	s_currentJobSystem = this;
+	s_currentQueueIndex = queueIndex;
+	Profiler::setThreadName("Job Worker " + std::to_string(queueIndex));
+
+	while (true) {
+		if (this->runNextJob())
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleepCondition.wait(lock, [this]() { return m_queuedJobCount.load(std::memory_order_acquire) != 0 || !m_running; });
+		if (!m_running)
+			break;
+	}
+
+	s_currentJobSystem = NULL;
+}
+
+uint32_t JobSystem::getCurrentQueueIndex() const {
+	return s_currentJobSystem == this ? s_currentQueueIndex : 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "core/pch.h"
+#include "core/profiler/Profiler.h"
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+class JobSystem;
+
+// Counts the unfinished jobs it was passed to. A job can depend on a counter, it is then only queued once
+// the counter reaches zero, so chains and fan-ins of jobs are expressed by handing the same counter around.
+// A counter must outlive the jobs using it, which JobSystem::wait() guarantees for counters on the stack.
+class JobCounter : private NotCopyable {
+	friend class JobSystem;
+public:
+	JobCounter();
+
+	~JobCounter();
+
+	bool isDone() const;
+
+	uint32_t getCount() const;
+
+private:
+	struct Continuation {
+		std::function<void()> task;
+		JobCounter* counter;
+		bool mainThread;
+	};
+
+	std::atomic<uint32_t> m_count;
+	std::mutex m_mutex;
+	std::vector<Continuation> m_continuations; // Jobs depending on this counter, queued when it reaches zero
+};
+
+// Pool of worker threads shared by the whole engine. Every worker owns a deque of jobs, pushing and popping
+// its own jobs at the back (the most recently queued, and most likely still cached, first) and stealing
+// from the front of the others' deques when it runs out. Threads outside the pool, including the main
+// thread, share one more deque. Idle workers sleep until jobs are queued.
+// Waiting on a counter runs queued jobs in the meantime rather than blocking, so jobs can wait on the jobs
+// they spawn, and parallelFor() can be nested, without starving the pool.
+// Jobs queued with runOnMainThread() only run on the thread that created the job system, inside
+// processMainThreadJobs() or a wait() on that thread, which is where anything touching GL belongs.
+class JobSystem : private NotCopyable {
+public:
+	JobSystem(uint32_t workerCount);
+
+	~JobSystem();
+
+	void run(std::function<void()> task, JobCounter* counter = NULL, JobCounter* dependency = NULL);
+
+	void runOnMainThread(std::function<void()> task, JobCounter* counter = NULL, JobCounter* dependency = NULL);
+
+	void wait(JobCounter* counter);
+
+	void parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& batchTask, uint32_t maxThreadCount = 0);
+
+	uint32_t processMainThreadJobs();
+
+	bool isMainThread() const;
+
+	uint32_t getWorkerCount() const;
+
+	uint32_t getThreadCount() const;
+
+	static uint32_t getDefaultWorkerCount();
+
+private:
+	struct Job {
+		std::function<void()> task;
+		JobCounter* counter;
+		ProfileFlow flow; // Links the scope that queued the job to the job in profiler captures
+	};
+
+	struct JobQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	void submit(std::function<void()> task, JobCounter* counter, JobCounter* dependency, bool mainThread);
+
+	void enqueue(Job job, bool mainThread);
+
+	bool runNextJob();
+
+	void execute(Job& job);
+
+	void complete(JobCounter* counter);
+
+	void workerThread(uint32_t queueIndex);
+
+	uint32_t getCurrentQueueIndex() const;
+
+	std::vector<JobQueue*> m_queues; // One per worker, the first is shared by every thread outside the pool
+	std::vector<std::thread> m_threads;
+	std::thread::id m_mainThreadId;
+
+	std::mutex m_mainThreadMutex;
+	std::deque<Job> m_mainThreadJobs;
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_sleepCondition;
+	std::atomic<uint32_t> m_queuedJobCount; // Jobs in the worker queues, main thread jobs excluded
+	std::atomic<bool> m_running;
+
+	static thread_local JobSystem* s_currentJobSystem;
+	static thread_local uint32_t s_currentQueueIndex;
+};
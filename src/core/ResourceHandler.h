@@ -3,6 +3,7 @@
 #include "core/pch.h"
 #include "core/util/FileUtils.h"
 #include "core/renderer/Texture.h"
+#include "core/Engine.h"
 
 class ResourceBase;
 class ResourceStorageBase;
@@ -422,6 +423,9 @@ namespace ResourceLoaders {
 			if (url == "" || data == NULL)
 				return false;
 
+			if (!Engine::isGLAvailable())
+				return false; // Headless, textures are never sampled
+
 			return Texture2D::load(url, data);
 		}
 	};
@@ -0,0 +1,223 @@
+#include "core/SessionReplay.h"
+
+const uint32_t SessionReplay::FILE_MAGIC = 0x59504C52; // "RLPY"
+const uint32_t SessionReplay::FILE_VERSION = 1;
+
+SessionReplay::SessionReplay():
+	m_tickInterval(0.0),
+	m_recordedFrameCount(0) {
+}
+
+SessionReplay::~SessionReplay() {
+	this->endRecording();
+}
+
+bool SessionReplay::beginRecording(std::string filePath, double tickInterval) {
+	this->endRecording();
+
+	m_recordStream.open(filePath.c_str(), std::ofstream::out | std::ofstream::binary);
+	if (!m_recordStream.is_open()) {
+		error("Failed to open session recording \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	info("Recording session to \"%s\"\n", filePath.c_str());
+	m_filePath = filePath;
+	m_tickInterval = tickInterval;
+	m_recordedFrameCount = 0;
+	m_pendingEvents.clear();
+	m_frames.clear();
+
+	m_recordStream.write(reinterpret_cast<const char*>(&FILE_MAGIC), sizeof(uint32_t));
+	m_recordStream.write(reinterpret_cast<const char*>(&FILE_VERSION), sizeof(uint32_t));
+	m_recordStream.write(reinterpret_cast<const char*>(&m_tickInterval), sizeof(double));
+	return m_recordStream.good();
+}
+
+void SessionReplay::endRecording() {
+	if (!m_recordStream.is_open())
+		return;
+
+	m_recordStream.close();
+	info("Recorded %u frames to \"%s\"\n", m_recordedFrameCount, m_filePath.c_str());
+}
+
+bool SessionReplay::isRecording() const {
+	return m_recordStream.is_open();
+}
+
+void SessionReplay::recordEvent(const SDL_Event& event) {
+	ReplayEvent replayEvent;
+	if (this->isRecording() && SessionReplay::toReplayEvent(event, replayEvent)) {
+		m_pendingEvents.push_back(replayEvent);
+	}
+}
+
+void SessionReplay::recordFrame(const Transformation& cameraTransform) {
+	if (!this->isRecording())
+		return;
+
+	dvec3 translation = cameraTransform.getTranslation();
+	dquat orientation = cameraTransform.getOrientation();
+	uint32_t eventCount = m_pendingEvents.size();
+
+	m_recordStream.write(reinterpret_cast<const char*>(&translation), sizeof(dvec3));
+	m_recordStream.write(reinterpret_cast<const char*>(&orientation), sizeof(dquat));
+	m_recordStream.write(reinterpret_cast<const char*>(&eventCount), sizeof(uint32_t));
+	if (eventCount != 0) {
+		m_recordStream.write(reinterpret_cast<const char*>(&m_pendingEvents[0]), sizeof(ReplayEvent) * eventCount);
+	}
+
+	// Flushed every frame, so the recording survives a crash
+	m_recordStream.flush();
+	m_pendingEvents.clear();
+	++m_recordedFrameCount;
+}
+
+bool SessionReplay::load(std::string filePath) {
+	this->endRecording();
+
+	std::ifstream stream(filePath.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (!stream.is_open()) {
+		error("Failed to open session recording \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	uint32_t magic = 0, version = 0;
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+	stream.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+	if (!stream.good() || magic != FILE_MAGIC) {
+		error("Failed to load session recording \"%s\" - not a session recording\n", filePath.c_str());
+		return false;
+	}
+
+	if (version != FILE_VERSION) {
+		error("Failed to load session recording \"%s\" - unsupported version %u, expected %u\n", filePath.c_str(), version, FILE_VERSION);
+		return false;
+	}
+
+	stream.read(reinterpret_cast<char*>(&m_tickInterval), sizeof(double));
+	if (!stream.good() || !(m_tickInterval > 0.0 && std::isfinite(m_tickInterval))) {
+		error("Failed to load session recording \"%s\" - invalid tick interval\n", filePath.c_str());
+		return false;
+	}
+
+	// Event counts are checked against the rest of the file before allocating, a corrupted one could be anything
+	std::streamoff headerSize = stream.tellg();
+	stream.seekg(0, std::ifstream::end);
+	std::streamoff fileSize = stream.tellg();
+	stream.seekg(headerSize, std::ifstream::beg);
+
+	m_frames.clear();
+	while (stream.good() && stream.tellg() < fileSize) {
+		ReplayFrame frame;
+		uint32_t eventCount = 0;
+		stream.read(reinterpret_cast<char*>(&frame.cameraTranslation), sizeof(dvec3));
+		stream.read(reinterpret_cast<char*>(&frame.cameraOrientation), sizeof(dquat));
+		stream.read(reinterpret_cast<char*>(&eventCount), sizeof(uint32_t));
+		if (!stream.good())
+			break; // A frame cut short by a crash while recording
+
+		uint64_t remainingSize = (uint64_t)(fileSize - stream.tellg());
+		if ((uint64_t)eventCount * sizeof(ReplayEvent) > remainingSize) {
+			stream.setstate(std::ifstream::failbit);
+			break;
+		}
+
+		frame.events.resize(eventCount);
+		if (eventCount != 0) {
+			stream.read(reinterpret_cast<char*>(&frame.events[0]), sizeof(ReplayEvent) * eventCount);
+			if (!stream.good())
+				break;
+		}
+
+		m_frames.push_back(frame);
+	}
+
+	if (stream.bad()) {
+		error("Failed to load session recording \"%s\" - read error after %u frames\n", filePath.c_str(), (uint32_t)m_frames.size());
+		m_frames.clear();
+		return false;
+	}
+
+	if (!stream.good()) {
+		// Only the last frame can be incomplete, the frames before it were flushed as they were recorded
+		warn("Session recording \"%s\" ends with an incomplete frame, replaying the %u frames before it\n", filePath.c_str(), (uint32_t)m_frames.size());
+	}
+
+	m_filePath = filePath;
+	info("Loaded session recording \"%s\" with %u frames\n", filePath.c_str(), (uint32_t)m_frames.size());
+	return true;
+}
+
+uint32_t SessionReplay::getFrameCount() const {
+	return m_frames.size();
+}
+
+const ReplayFrame& SessionReplay::getFrame(uint32_t index) const {
+	assert(index < m_frames.size());
+	return m_frames[index];
+}
+
+double SessionReplay::getTickInterval() const {
+	return m_tickInterval;
+}
+
+bool SessionReplay::toReplayEvent(const SDL_Event& event, ReplayEvent& replayEvent) {
+	replayEvent.type = event.type;
+	replayEvent.code = 0;
+	replayEvent.x = 0;
+	replayEvent.y = 0;
+	replayEvent.xrel = 0;
+	replayEvent.yrel = 0;
+
+	switch (event.type) {
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+			replayEvent.code = event.key.keysym.scancode;
+			return true;
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+			replayEvent.code = event.button.button;
+			replayEvent.x = event.button.x;
+			replayEvent.y = event.button.y;
+			return true;
+		case SDL_MOUSEMOTION:
+			replayEvent.x = event.motion.x;
+			replayEvent.y = event.motion.y;
+			replayEvent.xrel = event.motion.xrel;
+			replayEvent.yrel = event.motion.yrel;
+			return true;
+		default:
+			return false; // Not read by the input handler
+	}
+}
+
+SDL_Event SessionReplay::toSDLEvent(const ReplayEvent& replayEvent) {
+	SDL_Event event;
+	memset(&event, 0, sizeof(SDL_Event));
+	event.type = replayEvent.type;
+
+	switch (replayEvent.type) {
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+			event.key.keysym.scancode = (SDL_Scancode)replayEvent.code;
+			event.key.state = replayEvent.type == SDL_KEYDOWN ? SDL_PRESSED : SDL_RELEASED;
+			break;
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+			event.button.button = (uint8_t)replayEvent.code;
+			event.button.state = replayEvent.type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED;
+			event.button.x = replayEvent.x;
+			event.button.y = replayEvent.y;
+			break;
+		case SDL_MOUSEMOTION:
+			event.motion.x = replayEvent.x;
+			event.motion.y = replayEvent.y;
+			event.motion.xrel = replayEvent.xrel;
+			event.motion.yrel = replayEvent.yrel;
+			break;
+	}
+
+	return event;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "core/pch.h"
+#include "core/scene/Transformation.h"
+
+// The parts of an SDL event the input handler reads. SDL_Event itself is a union holding pointers for
+// some event types, so it is not written to recordings as is.
+struct ReplayEvent {
+	uint32_t type; // SDL_EventType
+	uint32_t code; // Scancode of key events, button of mouse button events
+	int32_t x;
+	int32_t y;
+	int32_t xrel;
+	int32_t yrel;
+};
+
+struct ReplayFrame {
+	dvec3 cameraTranslation;
+	dquat cameraOrientation;
+	std::vector<ReplayEvent> events; // Input events processed at the start of the frame, oldest first
+};
+
+// A recorded session, one entry per rendered frame holding the input events processed in that frame and
+// the camera transform the first person controller produced from them. While recording, frames are
+// streamed to the file as they complete, so a session that crashes still leaves a usable recording.
+// Replaying feeds the recorded events back to the input handler and puts the camera on the recorded
+// path, with ticks and frames stepped at fixed intervals rather than by the clock, so a replay runs the
+// same ticks and frames in every build regardless of how fast it renders.
+class SessionReplay : private NotCopyable {
+public:
+	SessionReplay();
+
+	~SessionReplay();
+
+	bool beginRecording(std::string filePath, double tickInterval);
+
+	void endRecording();
+
+	bool isRecording() const;
+
+	void recordEvent(const SDL_Event& event);
+
+	void recordFrame(const Transformation& cameraTransform);
+
+	bool load(std::string filePath);
+
+	uint32_t getFrameCount() const;
+
+	const ReplayFrame& getFrame(uint32_t index) const;
+
+	double getTickInterval() const;
+
+	static bool toReplayEvent(const SDL_Event& event, ReplayEvent& replayEvent);
+
+	static SDL_Event toSDLEvent(const ReplayEvent& replayEvent);
+
+	static const uint32_t FILE_MAGIC;
+	static const uint32_t FILE_VERSION;
+
+private:
+	std::ofstream m_recordStream;
+	std::string m_filePath;
+	double m_tickInterval; // Tick interval of the recorded session, replays tick at the same rate
+	uint32_t m_recordedFrameCount;
+	std::vector<ReplayEvent> m_pendingEvents; // Events of the frame being recorded
+	std::vector<ReplayFrame> m_frames; // Loaded frames, empty while recording
+};
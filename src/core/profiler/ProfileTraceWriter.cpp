@@ -0,0 +1,142 @@
+#include "ProfileTraceWriter.h"
+#include "Profiler.h"
+
+#define TRACE_CPU_PROCESS_ID 1
+#define TRACE_GPU_PROCESS_ID 2
+
+ProfileTraceWriter::ProfileTraceWriter():
+	m_file(NULL),
+	m_eventCount(0),
+	m_gpuTimeOffset(0),
+	m_hasGPUTimeOffset(false) {
+}
+
+ProfileTraceWriter::~ProfileTraceWriter() {
+	this->close();
+}
+
+bool ProfileTraceWriter::open(std::string filePath, std::string processName) {
+	this->close();
+
+	m_file = fopen(filePath.c_str(), "wb");
+	if (m_file == NULL) {
+		error("Failed to open trace file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	m_filePath = filePath;
+	m_eventCount = 0;
+	m_hasGPUTimeOffset = false;
+
+	fprintf(m_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	this->writeEventPrefix();
+	fprintf(m_file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":", TRACE_CPU_PROCESS_ID);
+	this->writeString(processName.c_str());
+	fprintf(m_file, "}}");
+
+	this->writeEventPrefix();
+	fprintf(m_file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"GPU\"}}", TRACE_GPU_PROCESS_ID);
+
+	info("Writing profiler trace to \"%s\"\n", filePath.c_str());
+	return true;
+}
+
+void ProfileTraceWriter::close() {
+	if (m_file == NULL)
+		return;
+
+	fprintf(m_file, "\n]}\n");
+	fclose(m_file);
+	m_file = NULL;
+
+	info("Finished writing profiler trace \"%s\", %llu events\n", m_filePath.c_str(), (unsigned long long)m_eventCount);
+}
+
+bool ProfileTraceWriter::isOpen() const {
+	return m_file != NULL;
+}
+
+void ProfileTraceWriter::writeThreadName(uint32_t thread, const std::string& name) {
+	if (m_file == NULL)
+		return;
+
+	this->writeEventPrefix();
+	fprintf(m_file, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":", TRACE_CPU_PROCESS_ID, thread);
+	this->writeString(name.c_str());
+	fprintf(m_file, "}}");
+}
+
+void ProfileTraceWriter::writeFrame(ProfileFrame* frame, uint32_t thread) {
+	if (m_file == NULL)
+		return;
+
+	// Timestamps are written in microseconds, durations are the complete ("X") event form so each
+	// profile is a single record.
+	for (int i = 0; i < frame->profiles.size(); i++) {
+		Profile& profile = frame->profiles[i];
+
+		this->writeEventPrefix();
+		fprintf(m_file, "{\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":", TRACE_CPU_PROCESS_ID, thread,
+			profile.startTimeCPU / 1000.0, (profile.endTimeCPU - profile.startTimeCPU) / 1000.0);
+		this->writeString(Profiler::getName(profile.name));
+		fprintf(m_file, "}");
+	}
+
+	for (int i = 0; i < frame->flows.size(); i++) {
+		ProfileFlowPoint& flowPoint = frame->flows[i];
+
+		this->writeEventPrefix();
+		fprintf(m_file, "{\"ph\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"id\":%u,\"cat\":\"flow\",\"name\":\"flow\"%s}",
+			flowPoint.begin ? "s" : "f", TRACE_CPU_PROCESS_ID, thread, flowPoint.time / 1000.0, flowPoint.flow, flowPoint.begin ? "" : ",\"bp\":\"e\"");
+	}
+}
+
+void ProfileTraceWriter::writeGPUProfile(Profile* profile) {
+	if (m_file == NULL)
+		return;
+
+	if (!m_hasGPUTimeOffset) {
+		// GPU timestamps use their own clock. The first one is aligned with the CPU time at which its
+		// query was issued, which is close enough for reading the GPU lane next to the CPU threads.
+		m_gpuTimeOffset = (int64_t)profile->startTimeCPU - (int64_t)profile->startTimeGPU;
+		m_hasGPUTimeOffset = true;
+	}
+
+	this->writeEventPrefix();
+	fprintf(m_file, "{\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"name\":", TRACE_GPU_PROCESS_ID,
+		((int64_t)profile->startTimeGPU + m_gpuTimeOffset) / 1000.0, (profile->endTimeGPU - profile->startTimeGPU) / 1000.0);
+	this->writeString(Profiler::getName(profile->name));
+	fprintf(m_file, "}");
+}
+
+uint64_t ProfileTraceWriter::getEventCount() const {
+	return m_eventCount;
+}
+
+std::string ProfileTraceWriter::getFilePath() const {
+	return m_filePath;
+}
+
+void ProfileTraceWriter::writeEventPrefix() {
+	fprintf(m_file, m_eventCount == 0 ? "\n" : ",\n");
+	++m_eventCount;
+}
+
+void ProfileTraceWriter::writeString(const char* str) {
+	fputc('"', m_file);
+
+	for (; *str != '\0'; ++str) {
+		char c = *str;
+		if (c == '"' || c == '\\') {
+			fputc('\\', m_file);
+			fputc(c, m_file);
+		} else if ((uint8_t)c < 0x20) {
+			fprintf(m_file, "\\u%04x", (uint32_t)c);
+		} else {
+			fputc(c, m_file);
+		}
+	}
+
+	fputc('"', m_file);
+}
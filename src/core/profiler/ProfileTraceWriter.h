@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core/pch.h"
+
+struct Profile;
+struct ProfileFrame;
+
+// Streams profiles to a Chrome Trace Event JSON file, which can be opened in chrome://tracing or
+// ui.perfetto.dev. Events are written as soon as they are handed over, nothing is kept in memory
+// between calls, so the length of a capture is only limited by disk space.
+class ProfileTraceWriter : private NotCopyable {
+public:
+	ProfileTraceWriter();
+
+	~ProfileTraceWriter();
+
+	bool open(std::string filePath, std::string processName);
+
+	void close();
+
+	bool isOpen() const;
+
+	void writeThreadName(uint32_t thread, const std::string& name);
+
+	void writeFrame(ProfileFrame* frame, uint32_t thread);
+
+	void writeGPUProfile(Profile* profile);
+
+	uint64_t getEventCount() const;
+
+	std::string getFilePath() const;
+
+private:
+	void writeEventPrefix();
+
+	void writeString(const char* str);
+
+	FILE* m_file;
+	std::string m_filePath;
+	uint64_t m_eventCount;
+	int64_t m_gpuTimeOffset; // Added to GPU timestamps to bring them into the CPU clock domain
+	bool m_hasGPUTimeOffset;
+};
@@ -1,65 +1,463 @@
 #include "Profiler.h"
+#include "ProfileTraceWriter.h"
 #include "core/Engine.h"
 #include <imgui/imgui.h>
 #include <imgui/imgui_internal.h>
 
-Profiler* Profiler::s_currentProfiler = NULL;
+std::atomic<Profiler*> Profiler::s_currentProfiler(NULL);
+std::atomic<std::thread::id> Profiler::s_glThreadId;
+thread_local ProfileThread* Profiler::s_currentThread = NULL;
+thread_local std::vector<bool> Profiler::s_pushedScopes;
 
+static uint32_t s_eventBufferCapacity = 1 << 16; // 16 bytes per event, 1 MiB per thread
+static std::atomic<ProfileFlow> s_nextFlow(1);
 
-ScopedProfile::ScopedProfile(std::string name) {
-	m_profile = Profiler::push(name);
+#define PROFILE_HISTOGRAM_BIN_WIDTH 0.5 // Milliseconds
+#define PROFILE_HISTOGRAM_BIN_COUNT 200
+
+// Every thread event buffer ever registered. Buffers are never freed, a buffer whose thread has
+// exited is handed to the next thread that registers once the profiler has drained it.
+static std::mutex& threadRegistryMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+static std::vector<ProfileThread*>& threadRegistry() {
+	static std::vector<ProfileThread*> threads;
+	return threads;
 }
 
-ScopedProfile::~ScopedProfile() {
-	assert(Profiler::pop() == m_profile);
+static std::mutex& nameRegistryMutex() {
+	static std::mutex mutex;
+	return mutex;
 }
 
+static std::unordered_map<ProfileName, std::string>& nameRegistry() {
+	static std::unordered_map<ProfileName, std::string> names;
+	return names;
+}
+
+// Marks the event buffer of the owning thread as retired when the thread exits.
+struct ProfileThreadRetirer {
+	ProfileThread* thread = NULL;
+
+	~ProfileThreadRetirer() {
+		if (thread != NULL) {
+			thread->retired.store(true, std::memory_order_release);
+		}
+	}
+};
+
+static thread_local ProfileThreadRetirer s_threadRetirer;
+
+
 Profiler::Profiler(std::string name):
-	m_name(name) {
+	m_name(name),
+	m_maxFrameHistory(600),
+	m_mainThreadIndex(0),
+	m_gpuProfilingEnabled(true),
+	m_traceWriter(NULL),
+	m_captureFrameDelay(0),
+	m_captureFrameCount(0),
+	m_statisticsFrameCount(0),
+	m_frameTimingsFile(NULL) {
+
+	m_frameTimeHistogram.resize(PROFILE_HISTOGRAM_BIN_COUNT, 0);
 
 	info("Starting profiler \"%s\"\n", m_name.c_str());
 }
 
 Profiler::~Profiler() {
 	info("Stopping profiler \"%s\"\n", m_name.c_str());
+
+	// Events since the last collect are still in the thread rings. The GL context may already be gone
+	this->collect(false);
+	this->closeCapture();
+
+	if (!m_statisticsFilePath.empty()) {
+		this->exportStatistics(m_statisticsFilePath);
+	}
+
+	this->setFrameTimingsFilePath("");
+
+	for (int i = 0; i < m_timelines.size(); i++) {
+		ProfileTimeline& timeline = m_timelines[i];
+		for (int j = 0; j < timeline.frames.size(); j++) {
+			delete timeline.frames[j];
+		}
+		delete timeline.currentFrame;
+	}
+
+	for (int i = 0; i < m_freeFrames.size(); i++) {
+		delete m_freeFrames[i];
+	}
+
+	if (Engine::isGLAvailable()) {
+		for (int i = 0; i < m_gpuQueries.size(); i++) {
+			glDeleteQueries(1, &m_gpuQueries[i].startQueryHandle);
+			glDeleteQueries(1, &m_gpuQueries[i].endQueryHandle);
+		}
+	}
+}
+
+void Profiler::beginScope(ProfileName name) {
+	ProfileThread* thread = Profiler::currentThread();
+	uint32_t depth = thread->depth++;
+
+	if (thread->droppedDepth != 0)
+		return; // Inside a dropped scope
+
+	Profiler* profiler = s_currentProfiler.load(std::memory_order_relaxed);
+	uint32_t gpuQuery = 0;
+
+	if (profiler != NULL && profiler->m_gpuProfilingEnabled && depth < 64 && thread->threadId == s_glThreadId.load(std::memory_order_relaxed)) {
+		gpuQuery = profiler->allocateGPUQuery();
+	}
+
+	ProfileEvent event;
+	event.time = clock::now().time_since_epoch().count();
+	event.name = name;
+	event.data = (uint32_t)ProfileEventType::BEGIN | (gpuQuery << 4);
+
+	if (!thread->write(event, depth + 1)) {
+		// The buffer is full, drop this scope and everything inside it.
+		thread->droppedDepth = depth + 1;
+		if (gpuQuery != 0) {
+			profiler->m_freeGPUQueries.push_back(gpuQuery - 1);
+		}
+		return;
+	}
+
+	if (depth < 64) {
+		thread->gpuQueryStack[depth] = gpuQuery;
+	}
+}
+
+void Profiler::endScope() {
+	uint64_t time = clock::now().time_since_epoch().count();
+
+	ProfileThread* thread = Profiler::currentThread();
+	if (thread->depth == 0)
+		return; // Unbalanced pop
+
+	uint32_t depth = --thread->depth;
+
+	if (thread->droppedDepth != 0) {
+		if (depth + 1 == thread->droppedDepth) {
+			thread->droppedDepth = 0; // Leaving the outermost dropped scope
+		}
+		return;
+	}
+
+	if (depth < 64 && thread->gpuQueryStack[depth] != 0) {
+		uint32_t gpuQuery = thread->gpuQueryStack[depth];
+		Profiler* profiler = s_currentProfiler.load(std::memory_order_relaxed);
+		if (profiler != NULL && gpuQuery <= profiler->m_gpuQueries.size()) {
+			glQueryCounter(profiler->m_gpuQueries[gpuQuery - 1].endQueryHandle, GL_TIMESTAMP);
+		}
+		thread->gpuQueryStack[depth] = 0;
+	}
+
+	ProfileEvent event;
+	event.time = time;
+	event.name = 0;
+	event.data = (uint32_t)ProfileEventType::END;
+	thread->write(event, 0); // Space for this event was reserved by the matching BEGIN
+}
+
+void Profiler::recordFlow(ProfileEventType type, ProfileFlow flow) {
+	ProfileThread* thread = Profiler::currentThread();
+
+	if (thread->droppedDepth != 0)
+		return; // Inside a dropped scope
+
+	ProfileEvent event;
+	event.time = clock::now().time_since_epoch().count();
+	event.name = flow;
+	event.data = (uint32_t)type;
+	thread->write(event, thread->depth); // Keep the END slots of all open scopes
+}
+
+ProfileThread* Profiler::registerThread() {
+	std::lock_guard<std::mutex> lock(threadRegistryMutex());
+	std::vector<ProfileThread*>& threads = threadRegistry();
+
+	ProfileThread* thread = NULL;
+
+	for (int i = 0; i < threads.size(); i++) {
+		ProfileThread* retiredThread = threads[i];
+		if (retiredThread->retired.load(std::memory_order_acquire) && retiredThread->tail.load(std::memory_order_acquire) == retiredThread->head.load(std::memory_order_relaxed)) {
+			thread = retiredThread;
+			break;
+		}
+	}
+
+	if (thread == NULL) {
+		uint32_t capacity = 1;
+		while (capacity < s_eventBufferCapacity)
+			capacity <<= 1;
+
+		thread = new ProfileThread();
+		thread->events.resize(capacity);
+		thread->mask = capacity - 1;
+		thread->head.store(0);
+		thread->tail.store(0);
+		thread->cachedTail = 0;
+		thread->index = threads.size();
+		threads.push_back(thread);
+	}
+
+	thread->droppedEventCount.store(0);
+	thread->threadId = std::this_thread::get_id();
+	thread->name.clear();
+	thread->depth = 0;
+	thread->droppedDepth = 0;
+	memset(thread->gpuQueryStack, 0, sizeof(thread->gpuQueryStack));
+	thread->retired.store(false, std::memory_order_release);
+
+	s_currentThread = thread;
+	s_threadRetirer.thread = thread;
+	return thread;
+}
+
+void Profiler::collect() {
+	this->collect(true);
+}
+
+void Profiler::collect(bool resolveGPUTimes) {
+	std::vector<ProfileThread*> threads;
+	{
+		std::lock_guard<std::mutex> lock(threadRegistryMutex());
+		threads = threadRegistry();
+
+		if (m_timelines.size() < threads.size()) {
+			m_timelines.resize(threads.size());
+		}
+
+		for (int i = 0; i < threads.size(); i++) {
+			m_timelines[threads[i]->index].index = threads[i]->index;
+			m_timelines[threads[i]->index].threadName = threads[i]->name;
+		}
+	}
+
+	for (int i = 0; i < threads.size(); i++) {
+		this->collectEvents(threads[i], m_timelines[threads[i]->index]);
+	}
+
+	if (resolveGPUTimes) {
+		this->resolveGPUQueries();
+	}
+	this->accumulateStatistics();
+}
+
+void Profiler::collectEvents(ProfileThread* thread, ProfileTimeline& timeline) {
+	uint64_t tail = thread->tail.load(std::memory_order_relaxed);
+	uint64_t head = thread->head.load(std::memory_order_acquire);
+
+	for (; tail != head; ++tail) {
+		this->processEvent(thread->events[tail & thread->mask], timeline);
+	}
+
+	thread->tail.store(tail, std::memory_order_release);
 }
 
-uint32_t Profiler::pushProfile(std::string name) {
-	uint32_t parentIndex = m_currentProfile;
-	uint32_t profileIndex = this->createProfile(name, parentIndex);
+void Profiler::processEvent(const ProfileEvent& event, ProfileTimeline& timeline) {
+	ProfileEventType type = (ProfileEventType)(event.data & 0xF);
 
-	if (parentIndex != 0) {
-		// The current profile is not NULL, push this profile as a child
-		this->getProfile(parentIndex)->children.emplace_back(profileIndex);
+	if (type == ProfileEventType::BEGIN) {
+		if (timeline.currentFrame == NULL) {
+			// No open profile on this thread, this is a new root (new frame)
+			timeline.currentFrame = this->createFrame(timeline);
+		}
+
+		ProfileFrame* frame = timeline.currentFrame;
+		uint32_t parentIndex = timeline.openProfiles.empty() ? 0 : timeline.openProfiles.back();
+
+		frame->profiles.emplace_back();
+		uint32_t profileIndex = frame->profiles.size(); // Offset by 1 so that 0 can represent NULL
+
+		Profile* profile = frame->get(profileIndex);
+		profile->name = event.name;
+		profile->startTimeCPU = event.time;
+		profile->endTimeCPU = 0;
+		profile->startTimeGPU = 0;
+		profile->endTimeGPU = 0;
+		profile->gpuQuery = event.data >> 4;
+		profile->parent = parentIndex;
+		profile->firstChild = 0;
+		profile->lastChild = 0;
+		profile->nextSibling = 0;
+		profile->layerIndex = 0;
+		profile->depth = timeline.openProfiles.size();
+		frame->maxDepth = glm::max(frame->maxDepth, profile->depth);
+
+		if (parentIndex != 0) {
+			// The current profile is not NULL, push this profile as a child
+			Profile* parent = frame->get(parentIndex);
+			if (parent->lastChild != 0) {
+				frame->get(parent->lastChild)->nextSibling = profileIndex;
+			} else {
+				parent->firstChild = profileIndex;
+			}
+			parent->lastChild = profileIndex;
+		}
+
+		if (profile->gpuQuery != 0) {
+			m_unresolvedGPUProfiles.push_back(std::make_pair(frame, profileIndex));
+			++frame->unresolvedGPUProfileCount;
+		}
+
+		timeline.openProfiles.push_back(profileIndex);
+
+	} else if (type == ProfileEventType::FLOW_BEGIN || type == ProfileEventType::FLOW_END) {
+		if (timeline.openProfiles.empty())
+			return; // Flows are only tracked inside a scope
+
+		ProfileFlowPoint flowPoint;
+		flowPoint.flow = event.name;
+		flowPoint.profile = timeline.openProfiles.back();
+		flowPoint.time = event.time;
+		flowPoint.begin = type == ProfileEventType::FLOW_BEGIN;
+		timeline.currentFrame->flows.push_back(flowPoint);
+
+	} else if (type == ProfileEventType::END) {
+		if (timeline.openProfiles.empty())
+			return; // The matching BEGIN was recorded before this profiler started
+
+		ProfileFrame* frame = timeline.currentFrame;
+		frame->get(timeline.openProfiles.back())->endTimeCPU = event.time;
+		timeline.openProfiles.pop_back();
+
+		if (timeline.openProfiles.empty()) {
+			// The root profile ended, the frame is complete
+			frame->complete = true;
+			timeline.frames.push_back(frame);
+			timeline.currentFrame = NULL;
+
+			if (timeline.index == m_mainThreadIndex && m_traceWriter == NULL && !m_captureFilePath.empty()) {
+				if (m_captureFrameDelay == 0 || --m_captureFrameDelay == 0) {
+					this->openCapture();
+				}
+			} else if (m_traceWriter != NULL) {
+				m_traceWriter->writeFrame(frame, timeline.index);
+				frame->captured = true;
+
+				if (timeline.index == m_mainThreadIndex && m_captureFrameCount != 0 && --m_captureFrameCount == 0) {
+					this->closeCapture();
+				}
+			}
+
+			while (timeline.frames.size() > m_maxFrameHistory) {
+				this->releaseFrame(timeline.frames.front());
+				timeline.frames.pop_front();
+			}
+		}
+	}
+}
+
+ProfileFrame* Profiler::createFrame(ProfileTimeline& timeline) {
+	ProfileFrame* frame;
+
+	if (!m_freeFrames.empty()) {
+		frame = m_freeFrames.back();
+		m_freeFrames.pop_back();
 	} else {
-		// The current profile was NULL, push this profile as a new root (new frame)
-		m_frames.emplace_back(profileIndex);
+		frame = new ProfileFrame();
 	}
 
-	m_currentProfile = profileIndex;
-	return profileIndex;
+	frame->profiles.clear();
+	frame->flows.clear();
+	frame->maxDepth = 0;
+	frame->complete = false;
+	frame->captured = false;
+	frame->accumulated = false;
+	frame->unresolvedGPUProfileCount = 0;
+	return frame;
 }
 
-uint32_t Profiler::popProfile() {
-	uint32_t profileIndex = m_currentProfile;
-	Profile* profile = this->getProfile(profileIndex);
-	profile->endTimeCPU = clock::now().time_since_epoch().count();
+void Profiler::releaseFrame(ProfileFrame* frame) {
+	// Queries still in flight for this frame are abandoned, their results are never read.
+	for (auto it = m_unresolvedGPUProfiles.begin(); it != m_unresolvedGPUProfiles.end();) {
+		if (it->first == frame) {
+			m_freeGPUQueries.push_back(frame->get(it->second)->gpuQuery - 1);
+			--frame->unresolvedGPUProfileCount;
+			it = m_unresolvedGPUProfiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	m_freeFrames.push_back(frame);
+}
 
-	m_currentProfile = profile->parent;
+uint32_t Profiler::allocateGPUQuery() {
+	if (!Engine::isGLAvailable())
+		return 0;
 
-	if (profile->gpuQuery != NULL) {
-		glQueryCounter(profile->gpuQuery->endQueryHandle, GL_TIMESTAMP);
-		m_unfreedGPUProfiles.push_back(profileIndex);
+	uint32_t index;
+
+	if (!m_freeGPUQueries.empty()) {
+		index = m_freeGPUQueries.back();
+		m_freeGPUQueries.pop_back();
+	} else {
+		GPUQuery query;
+		glGenQueries(1, &query.startQueryHandle);
+		glGenQueries(1, &query.endQueryHandle);
+		index = m_gpuQueries.size();
+		m_gpuQueries.push_back(query);
 	}
 
-	return profileIndex;
+	glQueryCounter(m_gpuQueries[index].startQueryHandle, GL_TIMESTAMP);
+	return index + 1;
+}
+
+void Profiler::resolveGPUQueries(bool wait) {
+	if (!Engine::isGLAvailable())
+		return;
+
+	for (auto it = m_unresolvedGPUProfiles.begin(); it != m_unresolvedGPUProfiles.end();) {
+		Profile* profile = it->first->get(it->second);
+
+		if (profile->endTimeCPU == 0) {
+			++it; // The scope is still open, the end query has not been issued yet
+			continue;
+		}
+
+		GPUQuery& query = m_gpuQueries[profile->gpuQuery - 1];
+
+		int flag = GL_FALSE;
+		if (wait && it->first->captured) {
+			flag = GL_TRUE; // Reading the result blocks until it is available
+		} else {
+			glGetQueryObjectiv(query.endQueryHandle, GL_QUERY_RESULT_AVAILABLE, &flag);
+		}
+
+		if (flag == GL_TRUE) {
+			// The query result is now available, retrieve it and return the query pair to the pool
+			glGetQueryObjectui64v(query.startQueryHandle, GL_QUERY_RESULT, &profile->startTimeGPU);
+			glGetQueryObjectui64v(query.endQueryHandle, GL_QUERY_RESULT, &profile->endTimeGPU);
+			m_freeGPUQueries.push_back(profile->gpuQuery - 1);
+			profile->gpuQuery = 0;
+			--it->first->unresolvedGPUProfileCount;
+
+			if (m_traceWriter != NULL && it->first->captured) {
+				m_traceWriter->writeGPUProfile(profile);
+			}
+
+			it = m_unresolvedGPUProfiles.erase(it);
+		} else {
+			++it;
+		}
+	}
 }
 
 Profile* Profiler::getCurrentFrame() {
-	if (m_frames.empty())
+	ProfileTimeline& timeline = this->getMainTimeline();
+
+	if (timeline.frames.empty())
 		return NULL;
 
-	return this->getProfile(m_frames.back());
+	return timeline.frames.back()->get(1);
 }
 
 double Profiler::getElapsedTime(Profile* profile, ProfileSide side) {
@@ -69,9 +467,7 @@ double Profiler::getElapsedTime(Profile* profile, ProfileSide side) {
 		return (profile->endTimeGPU - profile->startTimeGPU) / 1000000.0;
 }
 
-void Profiler::buildProfileTree(Profile* root, Profile* profile) {
-
-	Profile* parent = this->getProfile(profile->parent);
+void Profiler::buildProfileTree(ProfileFrame* frame, Profile* root, Profile* profile) {
 	ProfileLayer* layer = &m_layers[profile->layerIndex];
 
 	ImGuiTreeNodeFlags treeNodeFlags = ImGuiTreeNodeFlags_FramePadding;
@@ -83,10 +479,11 @@ void Profiler::buildProfileTree(Profile* root, Profile* profile) {
 			ImGui::SetNextTreeNodeOpen(true);
 	}
 
-	if (profile->children.empty())
+	if (profile->firstChild == 0)
 		treeNodeFlags |= ImGuiTreeNodeFlags_Leaf;
 
-	layer->expanded = ImGui::TreeNodeEx(profile->name.c_str(), treeNodeFlags);
+	const char* name = Profiler::getName(profile->name);
+	layer->expanded = ImGui::TreeNodeEx(name, treeNodeFlags);
 
 	double elapsedCPU = getElapsedTime(profile, ProfileSide::CPU);
 	double elapsedGPU = getElapsedTime(profile, ProfileSide::GPU);
@@ -101,6 +498,11 @@ void Profiler::buildProfileTree(Profile* root, Profile* profile) {
 		ImGui::Text("%.2f %%", elapsedCPU / getElapsedTime(root, ProfileSide::CPU) * 100.0);
 	}
 
+	ImGui::NextColumn(); // CPU percentiles
+	if (layer->cpuTime.getCount() > 0.0) {
+		ImGui::Text("%.2f / %.2f / %.2f", layer->cpuTime.quantile(0.50), layer->cpuTime.quantile(0.95), layer->cpuTime.quantile(0.99));
+	}
+
 	ImGui::NextColumn(); // GPU time
 
 	ImGui::Text("%.2f msec", elapsedGPU);
@@ -111,13 +513,13 @@ void Profiler::buildProfileTree(Profile* root, Profile* profile) {
 	}
 
 	ImGui::NextColumn(); // Colour
-	ImGui::ColorEdit3(profile->name.c_str(), &layer->colour[0], ImGuiColorEditFlags_NoLabel | ImGuiColorEditFlags_NoInputs);
+	ImGui::ColorEdit3(name, &layer->colour[0], ImGuiColorEditFlags_NoLabel | ImGuiColorEditFlags_NoInputs);
 
 	ImGui::NextColumn();
 
 	if (layer->expanded) {
-		for (int i = 0; i < profile->children.size(); i++) {
-			buildProfileTree(root, this->getProfile(profile->children[i]));
+		for (uint32_t childIndex = profile->firstChild; childIndex != 0; childIndex = frame->get(childIndex)->nextSibling) {
+			buildProfileTree(frame, root, frame->get(childIndex));
 		}
 
 		ImGui::TreePop();
@@ -171,11 +573,13 @@ void Profiler::renderFrameGraph(int frameCount, int graphHeight, ProfileSide sid
 
 	ImGui::PushClipRect(bbminInner, bbmaxInner, true);
 	for (int i = 0; i < frameCount + 50; i++) {
-		Profile* profile = this->getFrame(i);
+		ProfileFrame* frame = this->getFrame(i);
 
-		if (profile == NULL)
+		if (frame == NULL)
 			break;
 
+		Profile* profile = frame->get(1);
+
 		double elapsed = getElapsedTime(profile, side);
 
 		double x1 = bbmax.x - (i * (frameWidth + segmentSpacing) + padding);
@@ -184,7 +588,7 @@ void Profiler::renderFrameGraph(int frameCount, int graphHeight, ProfileSide sid
 		double y0 = y1 - elapsed / maxFrameTime * graphHeight;
 
 		if (x1 >= bbminInner.x) { // don't render segment if it is beyond the boundary
-			if (this->renderFrameSegment(profile, side, x0, y0, x1, y1, bbmin.x, bbmin.y, bbmax.x, bbmax.y, segmentSpacing)) {
+			if (this->renderFrameSegment(frame, profile, side, x0, y0, x1, y1, bbmin.x, bbmin.y, bbmax.x, bbmax.y, segmentSpacing)) {
 				hoveringFrameTime = elapsed;
 			}
 		}
@@ -242,19 +646,19 @@ void Profiler::renderFrameTimeOverlay(const char* str, double x, double y, doubl
 	ImGui::Text(str);
 }
 
-bool Profiler::renderFrameSegment(Profile* profile, ProfileSide side, double x0, double y0, double x1, double y1, double xmin, double ymin, double xmax, double ymax, double segmentSpacing) {
+bool Profiler::renderFrameSegment(ProfileFrame* frame, Profile* profile, ProfileSide side, double x0, double y0, double x1, double y1, double xmin, double ymin, double xmax, double ymax, double segmentSpacing) {
 	ProfileLayer* layer = &m_layers[profile->layerIndex];
 
 	bool hoveringSegment = false;
 	double h = y1 - y0;
 	double y = y1;
 
-	if (!profile->children.empty() && layer->expanded) {
+	if (profile->firstChild != 0 && layer->expanded) {
 
 		double tp = getElapsedTime(profile, side);
 
-		for (int i = 0; i < profile->children.size(); i++) {
-			Profile* child = this->getProfile(profile->children[i]);
+		for (uint32_t childIndex = profile->firstChild; childIndex != 0; childIndex = frame->get(childIndex)->nextSibling) {
+			Profile* child = frame->get(childIndex);
 
 			double tc = getElapsedTime(child, side);
 
@@ -263,7 +667,7 @@ bool Profiler::renderFrameSegment(Profile* profile, ProfileSide side, double x0,
 			y -= h * frac;
 			double t0 = y;
 
-			if (this->renderFrameSegment(child, side, x0, t0, x1, t1, xmin, ymin, xmax, ymax, segmentSpacing)) {
+			if (this->renderFrameSegment(frame, child, side, x0, t0, x1, t1, xmin, ymin, xmax, ymax, segmentSpacing)) {
 				hoveringSegment = true;
 			}
 		}
@@ -289,7 +693,114 @@ bool Profiler::renderFrameSegment(Profile* profile, ProfileSide side, double x0,
 	return hoveringSegment;
 }
 
-void Profiler::initializeProfileLayers(Profile* profile, std::string treePath) {
+void Profiler::renderThreadTracks(ProfileFrame* mainFrame, int rowHeight) {
+	ImGuiWindow* window = ImGui::GetCurrentWindow();
+
+	ImGui::PushItemWidth(-1); // auto calculate width
+	double width = ImGui::CalcItemWidth();
+	ImGui::PopItemWidth();
+
+	Profile* mainProfile = mainFrame->get(1);
+	double startTime = mainProfile->startTimeCPU;
+	double endTime = mainProfile->endTimeCPU;
+	double timeScale = width / glm::max(endTime - startTime, 1.0);
+
+	ImDrawList* dl = ImGui::GetWindowDrawList();
+
+	std::unordered_map<ProfileFlow, ImVec2> flowBegins;
+	std::vector<std::pair<ProfileFlow, ImVec2>> flowEnds;
+
+	for (uint32_t i = 0; i < m_timelines.size(); i++) {
+		ProfileTimeline& timeline = m_timelines[i];
+
+		// Frames complete in order on each thread, so only the most recent ones can overlap the main frame.
+		int32_t firstFrame = timeline.frames.size();
+		uint32_t maxDepth = 0;
+		while (firstFrame > 0 && timeline.frames[firstFrame - 1]->get(1)->endTimeCPU >= startTime) {
+			--firstFrame;
+			maxDepth = glm::max(maxDepth, timeline.frames[firstFrame]->maxDepth);
+		}
+
+		if (firstFrame == timeline.frames.size())
+			continue; // Nothing recorded on this thread during the main frame
+
+		ImGui::Text("%s", this->getTimelineName(i).c_str());
+
+		ImVec2 cursor = window->DC.CursorPos;
+		int trackHeight = (maxDepth + 1) * rowHeight;
+
+		dl->AddRectFilled(cursor, ImVec2(cursor.x + width, cursor.y + trackHeight), 0x44000000);
+
+		for (int32_t j = firstFrame; j < timeline.frames.size(); j++) {
+			ProfileFrame* frame = timeline.frames[j];
+
+			if (frame->get(1)->startTimeCPU > endTime)
+				break;
+
+			this->renderTrackSegment(frame, frame->get(1), 0, startTime, timeScale, cursor.x, cursor.y, cursor.x + width, rowHeight);
+
+			for (int k = 0; k < frame->flows.size(); k++) {
+				ProfileFlowPoint& flowPoint = frame->flows[k];
+				ImVec2 point;
+				point.x = cursor.x + (flowPoint.time - startTime) * timeScale;
+				point.y = cursor.y + (frame->get(flowPoint.profile)->depth + 0.5) * rowHeight;
+
+				if (flowPoint.begin) {
+					flowBegins[flowPoint.flow] = point;
+				} else {
+					flowEnds.push_back(std::make_pair(flowPoint.flow, point));
+				}
+			}
+		}
+
+		ImGui::Dummy(ImVec2(width, trackHeight));
+	}
+
+	// Link each scope that continued a flow back to the scope that started it.
+	const ImU32 flowCol = ImGui::ColorConvertFloat4ToU32(ImVec4(1.0F, 1.0F, 1.0F, 0.8F));
+
+	for (int i = 0; i < flowEnds.size(); i++) {
+		auto it = flowBegins.find(flowEnds[i].first);
+		if (it == flowBegins.end())
+			continue; // Started before the main frame
+
+		dl->AddLine(it->second, flowEnds[i].second, flowCol, 1.0F);
+		dl->AddCircleFilled(flowEnds[i].second, 2.5F, flowCol);
+	}
+}
+
+void Profiler::renderTrackSegment(ProfileFrame* frame, Profile* profile, uint32_t depth, double startTime, double timeScale, double x, double y, double xmax, int rowHeight) {
+	double x0 = x + (profile->startTimeCPU - startTime) * timeScale;
+	double x1 = x + (profile->endTimeCPU - startTime) * timeScale;
+
+	if (x1 < x || x0 > xmax)
+		return; // Entirely outside the main frame
+
+	x0 = glm::max(x0, x);
+	x1 = glm::min(glm::max(x1, x0 + 1.0), xmax);
+	double y0 = y + depth * rowHeight;
+	double y1 = y0 + rowHeight - 1;
+
+	// Profiles on other threads have no layer, so the colour is derived from the name instead.
+	ImVec4 colour;
+	colour.x = 0.3F + 0.7F * ((profile->name >> 0) & 0xFF) / 255.0F;
+	colour.y = 0.3F + 0.7F * ((profile->name >> 8) & 0xFF) / 255.0F;
+	colour.z = 0.3F + 0.7F * ((profile->name >> 16) & 0xFF) / 255.0F;
+	colour.w = 1.0F;
+
+	ImDrawList* dl = ImGui::GetWindowDrawList();
+	dl->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), ImGui::ColorConvertFloat4ToU32(colour));
+
+	if (ImGui::IsMouseHoveringRect(ImVec2(x0, y0), ImVec2(x1, y1), true)) {
+		ImGui::SetTooltip("%s\n%.3f msec", Profiler::getName(profile->name), getElapsedTime(profile, ProfileSide::CPU));
+	}
+
+	for (uint32_t childIndex = profile->firstChild; childIndex != 0; childIndex = frame->get(childIndex)->nextSibling) {
+		this->renderTrackSegment(frame, frame->get(childIndex), depth + 1, startTime, timeScale, x, y, xmax, rowHeight);
+	}
+}
+
+void Profiler::initializeProfileLayers(ProfileFrame* frame, Profile* profile, std::string treePath) {
 	typedef std::map<std::string, uint32_t> M;
 	std::pair<M::iterator, bool> r = m_frameLayers.insert(M::value_type(treePath, m_layers.size()));
 	M::iterator& it = r.first;
@@ -298,6 +809,12 @@ void Profiler::initializeProfileLayers(Profile* profile, std::string treePath) {
 	if (inserted) {
 		// If this profile layer did not previously exist, initialize a random colour
 		ProfileLayer layer;
+		layer.path = treePath;
+		layer.expanded = false;
+		layer.hovering = false;
+		layer.frameTimeCPU = 0.0;
+		layer.frameTimeGPU = 0.0;
+		layer.hasFrameTimeGPU = false;
 		layer.colour.r = (float)rand() / RAND_MAX;
 		layer.colour.g = (float)rand() / RAND_MAX;
 		layer.colour.b = (float)rand() / RAND_MAX;
@@ -307,86 +824,358 @@ void Profiler::initializeProfileLayers(Profile* profile, std::string treePath) {
 	profile->layerIndex = it->second;
 	m_layers[profile->layerIndex].hovering = false;
 
-	for (int i = 0; i < profile->children.size(); i++) {
+	for (uint32_t childIndex = profile->firstChild; childIndex != 0; childIndex = frame->get(childIndex)->nextSibling) {
 		// Recurse on child nodes
-		Profile* child = this->getProfile(profile->children[i]);
-		this->initializeProfileLayers(child, treePath + "." + child->name);
+		Profile* child = frame->get(childIndex);
+		this->initializeProfileLayers(frame, child, treePath + "." + Profiler::getName(child->name));
 	}
 }
 
-bool Profiler::tryFreeGPUQuery(Profile* profile) {
-	if (!Engine::instance()->hasGLContext())
-		return false; // No GL context, not freed
+ProfileFrame* Profiler::getFrame(uint32_t index) {
+	ProfileTimeline& timeline = this->getMainTimeline();
+	int32_t backIndex = (int32_t)timeline.frames.size() - (int32_t)(index + 5); // Offset 5 frames to give GPU queries a chance to be resolved - TODO: better solution
 
-	if (profile == NULL || profile->gpuQuery == NULL)
-		return true; // Profile was already freed
+	if (backIndex < 0)
+		return NULL;
 
-	int flag = GL_FALSE;
-	glGetQueryObjectiv(profile->gpuQuery->endQueryHandle, GL_QUERY_RESULT_AVAILABLE, &flag);
+	return timeline.frames[backIndex];
+}
 
-	if (flag == GL_TRUE) {
-		// The query result is now available, retrieve the result and delete the query
-		glGetQueryObjectui64v(profile->gpuQuery->startQueryHandle, GL_QUERY_RESULT, &profile->startTimeGPU);
-		glGetQueryObjectui64v(profile->gpuQuery->endQueryHandle, GL_QUERY_RESULT, &profile->endTimeGPU);
-		glDeleteQueries(1, &profile->gpuQuery->startQueryHandle);
-		glDeleteQueries(1, &profile->gpuQuery->endQueryHandle);
-		delete profile->gpuQuery;
-		profile->gpuQuery = NULL;
-		return true;
+bool Profiler::openCapture() {
+	m_traceWriter = new ProfileTraceWriter();
+
+	if (!m_traceWriter->open(m_captureFilePath, m_name)) {
+		delete m_traceWriter;
+		m_traceWriter = NULL;
+		m_captureFilePath.clear();
+		return false;
 	}
 
-	// The query result was not available, so this profile was not freed.
-	return false;
+	return true;
 }
 
-uint32_t Profiler::createProfile(std::string name, uint32_t parentIndex) {
-	// Initialize a new profile
-	m_profiles.emplace_back(Profile());
-	Profile* profile = &m_profiles.back();
+std::string Profiler::getTimelineName(uint32_t index) {
+	if (!m_timelines[index].threadName.empty())
+		return m_timelines[index].threadName;
+
+	if (index == m_mainThreadIndex)
+		return "Main Thread";
 
-	profile->name = name;
-	profile->parent = parentIndex;
+	return "Thread " + std::to_string(index);
+}
 
-	profile->startTimeCPU = clock::now().time_since_epoch().count();
+void Profiler::accumulateStatistics() {
+	ProfileTimeline& timeline = this->getMainTimeline();
 
-	if (Engine::instance()->hasGLContext()) {
-		// Generate the GPU start and end queries, and record the start query timestamp
-		profile->gpuQuery = new GPUQuery();
-		glGenQueries(1, &profile->gpuQuery->startQueryHandle);
-		glGenQueries(1, &profile->gpuQuery->endQueryHandle);
-		glQueryCounter(profile->gpuQuery->startQueryHandle, GL_TIMESTAMP);
+	// Frames are accumulated oldest first, once their GPU times are known. Frames that are not resolved
+	// within the 5 frames the UI waits for are accumulated without them.
+	int32_t first = timeline.frames.size();
+	while (first > 0 && !timeline.frames[first - 1]->accumulated) {
+		--first;
 	}
 
-	return m_profiles.size(); // Return the next profile index, all indices are offset by 1 so that 0 can represent NULL
+	for (int32_t i = first; i < timeline.frames.size(); i++) {
+		ProfileFrame* frame = timeline.frames[i];
+		if (frame->unresolvedGPUProfileCount != 0 && timeline.frames.size() - i < 5)
+			break;
+
+		this->accumulateFrameStatistics(frame);
+	}
 }
 
-Profile* Profiler::getProfile(uint32_t index) {
-	return &m_profiles[index - 1];
+void Profiler::accumulateFrameStatistics(ProfileFrame* frame) {
+	Profile* root = frame->get(1);
+	this->initializeProfileLayers(frame, root, Profiler::getName(root->name));
+
+	m_statisticsLayers.clear();
+
+	for (int i = 0; i < frame->profiles.size(); i++) {
+		Profile& profile = frame->profiles[i];
+		ProfileLayer& layer = m_layers[profile.layerIndex];
+
+		if (std::find(m_statisticsLayers.begin(), m_statisticsLayers.end(), profile.layerIndex) == m_statisticsLayers.end()) {
+			m_statisticsLayers.push_back(profile.layerIndex);
+			layer.frameTimeCPU = 0.0;
+			layer.frameTimeGPU = 0.0;
+			layer.hasFrameTimeGPU = false;
+		}
+
+		layer.frameTimeCPU += getElapsedTime(&profile, ProfileSide::CPU);
+
+		if (profile.gpuQuery == 0 && profile.endTimeGPU != 0) {
+			layer.frameTimeGPU += getElapsedTime(&profile, ProfileSide::GPU);
+			layer.hasFrameTimeGPU = true;
+		}
+	}
+
+	for (int i = 0; i < m_statisticsLayers.size(); i++) {
+		ProfileLayer& layer = m_layers[m_statisticsLayers[i]];
+		layer.cpuTime.add(layer.frameTimeCPU);
+
+		if (layer.hasFrameTimeGPU) {
+			layer.gpuTime.add(layer.frameTimeGPU);
+		}
+
+		if (m_frameTimingsFile != NULL) {
+			if (layer.hasFrameTimeGPU)
+				fprintf(m_frameTimingsFile, "%llu,\"%s\",%.4f,%.4f\n", (unsigned long long)m_statisticsFrameCount, layer.path.c_str(), layer.frameTimeCPU, layer.frameTimeGPU);
+			else
+				fprintf(m_frameTimingsFile, "%llu,\"%s\",%.4f,\n", (unsigned long long)m_statisticsFrameCount, layer.path.c_str(), layer.frameTimeCPU);
+		}
+	}
+
+	uint32_t bin = (uint32_t)(getElapsedTime(root, ProfileSide::CPU) / PROFILE_HISTOGRAM_BIN_WIDTH);
+	++m_frameTimeHistogram[glm::min(bin, (uint32_t)PROFILE_HISTOGRAM_BIN_COUNT - 1)];
+
+	++m_statisticsFrameCount;
+	frame->accumulated = true;
 }
 
-Profile* Profiler::getFrame(uint32_t index) {
-	int32_t backIndex = m_frames.size() - (index + 5); // Offset 5 frames to give GPU queries a chance to be freed - TODO: better solution
-	if (backIndex < 0)
-		return NULL;
+ProfileTimeline& Profiler::getMainTimeline() {
+	if (m_timelines.size() <= m_mainThreadIndex) {
+		m_timelines.resize(m_mainThreadIndex + 1);
+	}
 
-	return this->getProfile(m_frames[backIndex]);
+	return m_timelines[m_mainThreadIndex];
 }
 
-void Profiler::renderUI() {
-	for (auto it = m_unfreedGPUProfiles.begin(); it != m_unfreedGPUProfiles.end();) {
-		if (this->tryFreeGPUQuery(this->getProfile(*it))) {
-			it = m_unfreedGPUProfiles.erase(it);
-		} else {
-			++it;
+uint32_t Profiler::getMaxFrameHistory() const {
+	return m_maxFrameHistory;
+}
+
+void Profiler::setMaxFrameHistory(uint32_t maxFrameHistory) {
+	m_maxFrameHistory = glm::max(maxFrameHistory, 6u); // The UI reads 5 frames behind the most recent one
+}
+
+uint64_t Profiler::getDroppedEventCount() const {
+	std::lock_guard<std::mutex> lock(threadRegistryMutex());
+	std::vector<ProfileThread*>& threads = threadRegistry();
+
+	uint64_t count = 0;
+	for (int i = 0; i < threads.size(); i++) {
+		count += threads[i]->droppedEventCount.load(std::memory_order_relaxed);
+	}
+
+	return count;
+}
+
+bool Profiler::exportTrace(std::string filePath) {
+	this->collect();
+
+	ProfileTraceWriter writer;
+	if (!writer.open(filePath, m_name)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < m_timelines.size(); i++) {
+		ProfileTimeline& timeline = m_timelines[i];
+		writer.writeThreadName(i, this->getTimelineName(i));
+
+		for (int j = 0; j < timeline.frames.size(); j++) {
+			ProfileFrame* frame = timeline.frames[j];
+			writer.writeFrame(frame, i);
+
+			for (int k = 0; k < frame->profiles.size(); k++) {
+				Profile& profile = frame->profiles[k];
+				if (profile.gpuQuery == 0 && profile.endTimeGPU != 0) {
+					writer.writeGPUProfile(&profile);
+				}
+			}
 		}
 	}
-	
-	Profile* frameProfile = this->getFrame(0); // most recent frame
 
-	if (frameProfile == NULL)
+	writer.close();
+	return true;
+}
+
+bool Profiler::beginCapture(std::string filePath, uint32_t frameCount, uint32_t frameDelay) {
+	if (!m_captureFilePath.empty()) {
+		warn("Unable to begin profiler capture \"%s\", capture \"%s\" is already running\n", filePath.c_str(), m_captureFilePath.c_str());
+		return false;
+	}
+
+	m_captureFilePath = filePath;
+	m_captureFrameCount = frameCount;
+	m_captureFrameDelay = frameDelay;
+
+	if (frameDelay == 0) {
+		return this->openCapture();
+	}
+
+	return true;
+}
+
+void Profiler::endCapture() {
+	if (m_traceWriter != NULL) {
+		this->collect(); // Frames completed since the last collect are written to the capture
+	}
+
+	this->closeCapture();
+}
+
+void Profiler::closeCapture() {
+	if (m_traceWriter != NULL) {
+		// Wait for the GPU times of captured frames, and name every thread that was seen.
+		this->resolveGPUQueries(true);
+
+		for (uint32_t i = 0; i < m_timelines.size(); i++) {
+			m_traceWriter->writeThreadName(i, this->getTimelineName(i));
+		}
+
+		m_traceWriter->close();
+		delete m_traceWriter;
+		m_traceWriter = NULL;
+	}
+
+	m_captureFilePath.clear();
+	m_captureFrameCount = 0;
+	m_captureFrameDelay = 0;
+}
+
+bool Profiler::isCapturing() const {
+	return m_traceWriter != NULL;
+}
+
+bool Profiler::getStatistics(std::string treePath, ProfileSide side, ProfileStatistics* dstStatistics) {
+	auto it = m_frameLayers.find(treePath);
+	if (it == m_frameLayers.end())
+		return false;
+
+	ProfileLayer& layer = m_layers[it->second];
+	TDigest& digest = side == ProfileSide::CPU ? layer.cpuTime : layer.gpuTime;
+
+	if (digest.getCount() == 0.0)
+		return false;
+
+	dstStatistics->count = digest.getCount();
+	dstStatistics->min = digest.getMin();
+	dstStatistics->max = digest.getMax();
+	dstStatistics->mean = digest.getMean();
+	dstStatistics->p50 = digest.quantile(0.50);
+	dstStatistics->p90 = digest.quantile(0.90);
+	dstStatistics->p95 = digest.quantile(0.95);
+	dstStatistics->p99 = digest.quantile(0.99);
+	return true;
+}
+
+double Profiler::getPercentile(std::string treePath, ProfileSide side, double percentile) {
+	auto it = m_frameLayers.find(treePath);
+	if (it == m_frameLayers.end())
+		return NAN;
+
+	ProfileLayer& layer = m_layers[it->second];
+	TDigest& digest = side == ProfileSide::CPU ? layer.cpuTime : layer.gpuTime;
+	return digest.quantile(percentile / 100.0);
+}
+
+const std::vector<uint32_t>& Profiler::getFrameTimeHistogram() const {
+	return m_frameTimeHistogram;
+}
+
+double Profiler::getFrameTimeHistogramBinWidth() const {
+	return PROFILE_HISTOGRAM_BIN_WIDTH;
+}
+
+uint64_t Profiler::getStatisticsFrameCount() const {
+	return m_statisticsFrameCount;
+}
+
+bool Profiler::exportStatistics(std::string filePath) {
+	FILE* file = fopen(filePath.c_str(), "w");
+	if (file == NULL) {
+		error("Failed to open profiler statistics file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	fprintf(file, "path,side,frames,min_ms,max_ms,mean_ms,p50_ms,p90_ms,p95_ms,p99_ms\n");
+
+	for (auto it = m_frameLayers.begin(); it != m_frameLayers.end(); ++it) {
+		for (int i = 0; i < 2; i++) {
+			ProfileSide side = i == 0 ? ProfileSide::CPU : ProfileSide::GPU;
+
+			ProfileStatistics statistics;
+			if (!this->getStatistics(it->first, side, &statistics))
+				continue;
+
+			fprintf(file, "\"%s\",%s,%.0f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", it->first.c_str(), i == 0 ? "CPU" : "GPU", statistics.count,
+				statistics.min, statistics.max, statistics.mean, statistics.p50, statistics.p90, statistics.p95, statistics.p99);
+		}
+	}
+
+	// Frame time histogram as a second table
+	fprintf(file, "\nframe_time_ms,frames\n");
+	for (int i = 0; i < m_frameTimeHistogram.size(); i++) {
+		fprintf(file, "%s%.1f,%u\n", i == m_frameTimeHistogram.size() - 1 ? ">=" : "", i * PROFILE_HISTOGRAM_BIN_WIDTH, m_frameTimeHistogram[i]);
+	}
+
+	fclose(file);
+	info("Wrote profiler statistics for %llu frames to \"%s\"\n", (unsigned long long)m_statisticsFrameCount, filePath.c_str());
+	return true;
+}
+
+void Profiler::resetStatistics() {
+	for (int i = 0; i < m_layers.size(); i++) {
+		m_layers[i].cpuTime.clear();
+		m_layers[i].gpuTime.clear();
+	}
+
+	std::fill(m_frameTimeHistogram.begin(), m_frameTimeHistogram.end(), 0);
+	m_statisticsFrameCount = 0;
+}
+
+std::string Profiler::getStatisticsFilePath() const {
+	return m_statisticsFilePath;
+}
+
+void Profiler::setStatisticsFilePath(std::string filePath) {
+	m_statisticsFilePath = filePath;
+}
+
+bool Profiler::setFrameTimingsFilePath(std::string filePath) {
+	if (m_frameTimingsFile != NULL) {
+		fclose(m_frameTimingsFile);
+		m_frameTimingsFile = NULL;
+		info("Wrote profiler frame timings to \"%s\"\n", m_frameTimingsFilePath.c_str());
+	}
+
+	m_frameTimingsFilePath = filePath;
+	if (filePath.empty())
+		return true;
+
+	m_frameTimingsFile = fopen(filePath.c_str(), "w");
+	if (m_frameTimingsFile == NULL) {
+		error("Failed to open profiler frame timings file \"%s\"\n", filePath.c_str());
+		m_frameTimingsFilePath = "";
+		return false;
+	}
+
+	// One row per layer per frame, frames count from the last statistics reset
+	fprintf(m_frameTimingsFile, "frame,path,cpu_ms,gpu_ms\n");
+	return true;
+}
+
+std::string Profiler::getFrameTimingsFilePath() const {
+	return m_frameTimingsFilePath;
+}
+
+bool Profiler::isGPUProfilingEnabled() const {
+	return m_gpuProfilingEnabled;
+}
+
+void Profiler::setGPUProfilingEnabled(bool enabled) {
+	m_gpuProfilingEnabled = enabled;
+}
+
+void Profiler::renderUI() {
+	this->collect();
+
+	ProfileFrame* frame = this->getFrame(0); // most recent frame
+
+	if (frame == NULL)
 		return;
 
-	this->initializeProfileLayers(frameProfile, frameProfile->name);
+	Profile* frameProfile = frame->get(1);
+	this->initializeProfileLayers(frame, frameProfile, Profiler::getName(frameProfile->name));
 
 	ImGui::Begin("Profiler");
 
@@ -394,20 +1183,30 @@ void Profiler::renderUI() {
 	{
 		int availableHeight = ImGui::GetContentRegionMaxAbs().y - ImGui::GetCurrentWindow()->DC.CursorPos.y;
 
-		this->renderFrameGraph(-1, availableHeight / 2, ProfileSide::CPU);
-		this->renderFrameGraph(-1, availableHeight / 2, ProfileSide::GPU);
+		this->renderFrameGraph(-1, availableHeight / 3, ProfileSide::CPU);
+		this->renderFrameGraph(-1, availableHeight / 3, ProfileSide::GPU);
+
+		std::vector<float> histogram(m_frameTimeHistogram.begin(), m_frameTimeHistogram.end());
+		ImGui::PushItemWidth(-1);
+		ImGui::PlotHistogram("##frameTimeHistogram", &histogram[0], histogram.size(), 0, "FRAME TIME HISTOGRAM", FLT_MAX, FLT_MAX, ImVec2(0, 60));
+		ImGui::PopItemWidth();
+
+		ImGui::BeginChild("threadTracks");
+		this->renderThreadTracks(frame, 12);
+		ImGui::EndChild();
 
 		ImGui::NextColumn();
 
 		ImGui::BeginChild("profileTree");
-		ImGui::BeginColumns("profileTree", 6, ImGuiColumnsFlags_NoPreserveWidths);
+		ImGui::BeginColumns("profileTree", 7, ImGuiColumnsFlags_NoPreserveWidths);
 		{
-			if (m_frames.size() <= 5) {
+			if (this->getMainTimeline().frames.size() <= 6) {
 				// Initialize column sizes only on first frame
 				float x = ImGui::GetWindowContentRegionMax().x;
-				ImGui::SetColumnOffset(6, x); x -= 60;
-				ImGui::SetColumnOffset(5, x); x -= 80;
-				ImGui::SetColumnOffset(4, x); x -= 100;
+				ImGui::SetColumnOffset(7, x); x -= 60;
+				ImGui::SetColumnOffset(6, x); x -= 80;
+				ImGui::SetColumnOffset(5, x); x -= 100;
+				ImGui::SetColumnOffset(4, x); x -= 160;
 				ImGui::SetColumnOffset(3, x); x -= 80;
 				ImGui::SetColumnOffset(2, x); x -= 100;
 				ImGui::SetColumnOffset(1, x);
@@ -419,6 +1218,8 @@ void Profiler::renderUI() {
 			ImGui::NextColumn();
 			ImGui::Text("CPU %");
 			ImGui::NextColumn();
+			ImGui::Text("CPU p50 / p95 / p99");
+			ImGui::NextColumn();
 			ImGui::Text("GPU Time");
 			ImGui::NextColumn();
 			ImGui::Text("GPU %");
@@ -426,7 +1227,7 @@ void Profiler::renderUI() {
 			ImGui::Text("Colour");
 			ImGui::NextColumn();
 
-			this->buildProfileTree(frameProfile, frameProfile);
+			this->buildProfileTree(frame, frameProfile, frameProfile);
 		}
 		ImGui::EndColumns();
 		ImGui::EndChild();
@@ -439,32 +1240,111 @@ void Profiler::renderUI() {
 Profiler* Profiler::startProfiling(std::string name) {
 	assert(!Profiler::isProfiling());
 
-	s_currentProfiler = new Profiler(name);
-	return s_currentProfiler;
+	// The thread that starts profiling owns the GL context, and its root scopes are the engine frames.
+	s_glThreadId.store(std::this_thread::get_id());
+
+	Profiler* profiler = new Profiler(name);
+	profiler->m_mainThreadIndex = Profiler::currentThread()->index;
+	s_currentProfiler.store(profiler);
+	return profiler;
 }
 
 Profiler* Profiler::currentProfiler() {
-	return s_currentProfiler;
+	return s_currentProfiler.load(std::memory_order_relaxed);
 }
 
 bool Profiler::isProfiling() {
-	return s_currentProfiler != NULL;
+	return s_currentProfiler.load(std::memory_order_relaxed) != NULL;
 }
 
 void Profiler::stopProfiling() {
 	assert(Profiler::isProfiling());
-	delete s_currentProfiler;
-	s_currentProfiler = NULL;
+
+	Profiler* profiler = s_currentProfiler.exchange(NULL);
+	delete profiler;
+}
+
+void Profiler::push(std::string name) {
+	Profiler::push(Profiler::internName(Profiler::hashName(name.c_str()), name.c_str()));
 }
 
-uint32_t Profiler::push(std::string name) {
-	return currentProfiler()->pushProfile(name);
+void Profiler::push(ProfileName name) {
+	bool active = Profiler::isProfiling();
+	s_pushedScopes.push_back(active);
+	if (active) {
+		Profiler::beginScope(name);
+	}
 }
 
-uint32_t Profiler::pop() {
-	return currentProfiler()->popProfile();
+void Profiler::pop() {
+	if (s_pushedScopes.empty())
+		return; // Unbalanced pop
+
+	// A push made while profiling was stopped opened no scope, popping anyway would end an enclosing one
+	bool active = s_pushedScopes.back();
+	s_pushedScopes.pop_back();
+	if (active) {
+		Profiler::endScope();
+	}
 }
 
 Profile* Profiler::currentFrame() {
 	return currentProfiler()->getCurrentFrame();
-}
\ No newline at end of file
+}
+
+ProfileFlow Profiler::beginFlow() {
+	if (!Profiler::isProfiling())
+		return 0;
+
+	ProfileFlow flow = s_nextFlow.fetch_add(1, std::memory_order_relaxed);
+	if (flow == 0) {
+		flow = s_nextFlow.fetch_add(1, std::memory_order_relaxed); // Wrapped around
+	}
+
+	Profiler::recordFlow(ProfileEventType::FLOW_BEGIN, flow);
+	return flow;
+}
+
+void Profiler::endFlow(ProfileFlow flow) {
+	if (flow == 0 || !Profiler::isProfiling())
+		return;
+
+	Profiler::recordFlow(ProfileEventType::FLOW_END, flow);
+}
+
+void Profiler::setThreadName(std::string name) {
+	ProfileThread* thread = Profiler::currentThread();
+
+	std::lock_guard<std::mutex> lock(threadRegistryMutex());
+	thread->name = name;
+}
+
+ProfileName Profiler::internName(ProfileName id, const char* name) {
+	std::lock_guard<std::mutex> lock(nameRegistryMutex());
+	auto result = nameRegistry().emplace(id, name);
+
+	if (!result.second && result.first->second != name) {
+		warn("Profile name \"%s\" collides with \"%s\" (0x%08X)\n", name, result.first->second.c_str(), id);
+	}
+
+	return id;
+}
+
+const char* Profiler::getName(ProfileName id) {
+	std::lock_guard<std::mutex> lock(nameRegistryMutex());
+	auto it = nameRegistry().find(id);
+
+	if (it == nameRegistry().end())
+		return "<unknown>";
+
+	return it->second.c_str(); // Entries are never removed, so the string outlives the lock
+}
+
+uint32_t Profiler::getEventBufferCapacity() {
+	return s_eventBufferCapacity;
+}
+
+void Profiler::setEventBufferCapacity(uint32_t capacity) {
+	// Only affects threads that register after this call
+	s_eventBufferCapacity = glm::max(capacity, 256u);
+}
@@ -1,21 +1,50 @@
 #pragma once
 
 #include "core/pch.h"
-
-#define PROFILE_SCOPE(name) ScopedProfile VAR(profile_)##VAR(__LINE__)(name);
+#include "core/util/TDigest.h"
+#include <atomic>
+#include <mutex>
+#include <deque>
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+// The name is hashed at compile time and registered once per call site, entering the scope only
+// records a timestamp and the 32-bit name id into the calling thread's event buffer.
+#define PROFILE_SCOPE(name) \
+	static const ProfileName PROFILE_CONCAT(profileName_, __LINE__) = Profiler::internName(std::integral_constant<ProfileName, Profiler::hashName(name)>::value, name); \
+	ScopedProfile PROFILE_CONCAT(profile_, __LINE__)(PROFILE_CONCAT(profileName_, __LINE__));
 #define PROFILE_EXPR(expr) { PROFILE_SCOPE(#expr); expr; }
 
 class Profiler;
 struct Profile;
+struct ProfileFrame;
+struct ProfileFlowPoint;
+struct ProfileEvent;
+struct ProfileThread;
+struct ProfileTimeline;
 struct GPUQuery;
 struct ProfileLayer;
+struct ProfileStatistics;
 class ScopedProfile;
+class ProfileTraceWriter;
+
+typedef uint32_t ProfileName;
+typedef uint32_t ProfileFlow; // Links a scope on one thread to the scope that continues its work, 0 is no flow
 
 enum class ProfileSide {
 	CPU, GPU
 };
 
+enum class ProfileEventType {
+	BEGIN = 0,
+	END = 1,
+	FLOW_BEGIN = 2,
+	FLOW_END = 3,
+};
+
 class Profiler {
+	friend class ScopedProfile;
 public:
 	using clock = std::chrono::high_resolution_clock;
 
@@ -27,66 +56,232 @@ public:
 
 	static void stopProfiling();
 
-	static uint32_t push(std::string name);
+	static void push(std::string name);
 
-	static uint32_t pop();
+	static void push(ProfileName name);
+
+	static void pop();
 
 	static Profile* currentFrame();
 
+	static ProfileFlow beginFlow();
+
+	static void endFlow(ProfileFlow flow);
+
+	static void setThreadName(std::string name);
+
+	static constexpr ProfileName hashName(const char* name);
+
+	static ProfileName internName(ProfileName id, const char* name);
+
+	static const char* getName(ProfileName id);
+
+	static uint32_t getEventBufferCapacity();
+
+	static void setEventBufferCapacity(uint32_t capacity);
+
+	void collect();
+
 	void renderUI();
 
+	bool exportTrace(std::string filePath);
+
+	bool beginCapture(std::string filePath, uint32_t frameCount = 0, uint32_t frameDelay = 0);
+
+	void endCapture();
+
+	bool isCapturing() const;
+
+	bool getStatistics(std::string treePath, ProfileSide side, ProfileStatistics* dstStatistics);
+
+	double getPercentile(std::string treePath, ProfileSide side, double percentile);
+
+	const std::vector<uint32_t>& getFrameTimeHistogram() const;
+
+	double getFrameTimeHistogramBinWidth() const;
+
+	uint64_t getStatisticsFrameCount() const;
+
+	bool exportStatistics(std::string filePath);
+
+	void resetStatistics();
+
+	std::string getStatisticsFilePath() const;
+
+	void setStatisticsFilePath(std::string filePath);
+
+	bool setFrameTimingsFilePath(std::string filePath);
+
+	std::string getFrameTimingsFilePath() const;
+
+	uint32_t getMaxFrameHistory() const;
+
+	void setMaxFrameHistory(uint32_t maxFrameHistory);
+
+	uint64_t getDroppedEventCount() const;
+
+	bool isGPUProfilingEnabled() const;
+
+	void setGPUProfilingEnabled(bool enabled);
+
 private:
 	Profiler(std::string name);
 
 	~Profiler();
 
-	uint32_t pushProfile(std::string name);
+	static void beginScope(ProfileName name);
+
+	static void endScope();
+
+	static void recordFlow(ProfileEventType type, ProfileFlow flow);
+
+	static ProfileThread* currentThread();
+
+	static ProfileThread* registerThread();
+
+	void collect(bool resolveGPUTimes);
+
+	void collectEvents(ProfileThread* thread, ProfileTimeline& timeline);
+
+	void processEvent(const ProfileEvent& event, ProfileTimeline& timeline);
+
+	ProfileFrame* createFrame(ProfileTimeline& timeline);
+
+	void releaseFrame(ProfileFrame* frame);
+
+	uint32_t allocateGPUQuery();
+
+	void resolveGPUQueries(bool wait = false);
+
+	bool openCapture();
+
+	void closeCapture();
+
+	std::string getTimelineName(uint32_t index);
 
-	uint32_t popProfile();
+	void accumulateStatistics();
+
+	void accumulateFrameStatistics(ProfileFrame* frame);
 
 	Profile* getCurrentFrame();
 
 	double getElapsedTime(Profile* profile, ProfileSide side);
 
-	void buildProfileTree(Profile* root, Profile* profile);
+	void buildProfileTree(ProfileFrame* frame, Profile* root, Profile* profile);
 
 	void renderFrameGraph(int frameCount, int graphHeight, ProfileSide side);
 
 	void renderFrameTimeOverlay(const char* str, double x, double y, double xmin, double ymin, double xmax, double ymax);
 
-	bool renderFrameSegment(Profile* profile, ProfileSide side, double x0, double y0, double x1, double y1, double xmin, double ymin, double xmax, double ymax, double segmentSpacing);
+	bool renderFrameSegment(ProfileFrame* frame, Profile* profile, ProfileSide side, double x0, double y0, double x1, double y1, double xmin, double ymin, double xmax, double ymax, double segmentSpacing);
 
-	void initializeProfileLayers(Profile* profile, std::string treePath);
+	void renderThreadTracks(ProfileFrame* mainFrame, int rowHeight);
 
-	bool tryFreeGPUQuery(Profile* profile);
+	void renderTrackSegment(ProfileFrame* frame, Profile* profile, uint32_t depth, double startTime, double timeScale, double x, double y, double xmax, int rowHeight);
 
-	uint32_t createProfile(std::string name, uint32_t parentIndex);
+	void initializeProfileLayers(ProfileFrame* frame, Profile* profile, std::string treePath);
 
-	Profile* getProfile(uint32_t index);
+	ProfileFrame* getFrame(uint32_t index);
 
-	Profile* getFrame(uint32_t index);
+	ProfileTimeline& getMainTimeline();
 
 	std::string m_name;
-	std::vector<Profile> m_profiles; // Vector of all existing profiles - nothing should ever store a pointer, only an index, since this vector may be reallocated and pointers invalidated.
-	std::vector<uint32_t> m_frames; // Index of all root profiles (representing entire frames)
+	std::vector<ProfileTimeline> m_timelines; // Frames reconstructed from each thread's event buffer, indexed by ProfileThread::index
+	std::vector<ProfileFrame*> m_freeFrames; // Recycled frames, so steady-state profiling does not allocate
 	std::vector<ProfileLayer> m_layers; // All profile layers, referenced internally by all profiles
 	std::map<std::string, uint32_t> m_frameLayers; // Map of unique profile tree paths to a layer index
-	std::vector<uint32_t> m_unfreedGPUProfiles; // Vector of profilers with unfreed GPU queries - Will get freed as soon as the query result is available
-	uint32_t m_currentProfile; // The index of the root profile for the current frame
-
-	static Profiler* s_currentProfiler;
+	std::vector<GPUQuery> m_gpuQueries; // Pool of GPU timestamp query pairs, only touched from the GL thread
+	std::vector<uint32_t> m_freeGPUQueries; // Indices of unused query pairs in m_gpuQueries
+	std::vector<std::pair<ProfileFrame*, uint32_t>> m_unresolvedGPUProfiles; // Profiles waiting on a GPU query result - resolved as soon as the result is available
+	uint32_t m_maxFrameHistory; // Number of completed frames kept per thread, older frames are recycled
+	uint32_t m_mainThreadIndex; // Index of the timeline whose root scopes are the engine frames
+	bool m_gpuProfilingEnabled;
+	ProfileTraceWriter* m_traceWriter; // Open while a capture is running, completed frames are streamed to it
+	std::string m_captureFilePath; // Set while a capture is pending or running
+	uint32_t m_captureFrameDelay; // Main thread frames left before a pending capture starts
+	uint32_t m_captureFrameCount; // Main thread frames left before the capture ends, 0 to capture until endCapture
+	std::vector<uint32_t> m_frameTimeHistogram; // Main thread frame CPU times, the last bin counts every frame beyond the range
+	std::vector<uint32_t> m_statisticsLayers; // Scratch list of the layers touched by the frame being accumulated
+	uint64_t m_statisticsFrameCount; // Number of main thread frames accumulated into the layer statistics
+	std::string m_statisticsFilePath; // Layer statistics are written here when the profiler stops, empty for none
+	std::string m_frameTimingsFilePath;
+	FILE* m_frameTimingsFile; // The times of every layer of every main thread frame are streamed here as frames are accumulated, NULL for none
+
+	static std::atomic<Profiler*> s_currentProfiler;
+	static std::atomic<std::thread::id> s_glThreadId; // GPU queries are only issued from the thread that owns the GL context. Read by every thread entering a scope
+	static thread_local ProfileThread* s_currentThread;
+	static thread_local std::vector<bool> s_pushedScopes; // Whether each push on this thread not yet popped opened a scope
 };
 
 struct Profile {
-	std::string name; // The name of this profile, displayed in the UI tree
+	ProfileName name; // The interned name of this profile, displayed in the UI tree
 	uint64_t startTimeCPU; // The CPU start time in nanoseconds
 	uint64_t endTimeCPU; // The CPU end time in nanoseconds
 	uint64_t startTimeGPU; // The GPU start time in nanoseconds - only assigned once the async GPU query result is available
 	uint64_t endTimeGPU; // The GPU end time in nanoseconds - only assigned once the async GPU query result is available
-	GPUQuery* gpuQuery; // The async GPU Query object - If not NULL, the query has not yet been resolved
-	std::vector<uint32_t> children; // The index of all child nodes to this profile
-	uint32_t parent; // The index of the parent node of this profile
+	uint32_t gpuQuery; // The index of the async GPU query pair, offset by 1 - If not 0, the query has not yet been resolved
+	uint32_t parent; // The index of the parent profile within the frame, offset by 1
+	uint32_t firstChild; // The index of the first child profile within the frame, offset by 1
+	uint32_t lastChild; // The index of the last child profile within the frame, offset by 1
+	uint32_t nextSibling; // The index of the next sibling profile within the frame, offset by 1
 	uint32_t layerIndex; // The layer index of this profile
+	uint32_t depth; // The number of ancestors of this profile within the frame
+};
+
+struct ProfileFrame {
+	std::vector<Profile> profiles; // All profiles for one root scope, the root is always the first. Capacity is kept when the frame is recycled.
+	std::vector<ProfileFlowPoint> flows; // Flow events recorded inside this frame
+	uint32_t maxDepth; // The deepest profile in this frame
+	bool complete; // The root profile has ended
+	bool captured; // Written to the running trace capture, its GPU profiles are written as they resolve
+	bool accumulated; // Added to the layer statistics
+	uint32_t unresolvedGPUProfileCount; // Profiles in this frame still waiting on a GPU query result
+
+	Profile* get(uint32_t index) {
+		return index == 0 ? NULL : &profiles[index - 1];
+	}
+};
+
+struct ProfileFlowPoint {
+	ProfileFlow flow;
+	uint32_t profile; // The index of the enclosing profile within the frame, offset by 1
+	uint64_t time; // The CPU timestamp in nanoseconds
+	bool begin; // True for the scope that started the flow, false for the scope that continued it
+};
+
+struct ProfileEvent {
+	uint64_t time; // The CPU timestamp in nanoseconds
+	ProfileName name; // The interned name for BEGIN events, the flow id for FLOW_BEGIN and FLOW_END events
+	uint32_t data; // The event type in the low 4 bits, the GPU query pair index offset by 1 in the upper 28 bits
+};
+
+// Events recorded by one thread. The owning thread is the only producer and the profiler the only
+// consumer, so the head and tail indices are the only synchronization needed. When the buffer is
+// full, new scopes are dropped (along with their matching END) rather than blocking the producer.
+struct ProfileThread {
+	std::vector<ProfileEvent> events; // Fixed power of two capacity
+	uint32_t mask;
+	std::atomic<uint64_t> head; // Written by the producer
+	std::atomic<uint64_t> tail; // Written by the consumer
+	uint64_t cachedTail; // Producer copy of tail, refreshed only when the buffer looks full
+	std::atomic<uint64_t> droppedEventCount;
+	std::atomic<bool> retired; // The owning thread has exited, the buffer is reused by the next thread to register once drained
+	uint32_t index; // Index into Profiler::m_timelines
+	std::thread::id threadId;
+	std::string name; // Display name of the track, guarded by the thread registry lock
+	uint32_t depth; // Producer scope depth
+	uint32_t droppedDepth; // Depth of the outermost dropped scope, plus 1. Everything inside it is dropped too.
+	uint32_t gpuQueryStack[64]; // GPU query pair of each open scope on the GL thread, offset by 1
+
+	bool write(const ProfileEvent& event, uint32_t reserve);
+};
+
+struct ProfileTimeline {
+	uint32_t index = 0; // Index of this timeline in Profiler::m_timelines, used as the trace thread id
+	std::deque<ProfileFrame*> frames; // Completed frames, oldest first
+	ProfileFrame* currentFrame = NULL; // The frame whose root scope is still open
+	std::vector<uint32_t> openProfiles; // Consumer scope stack within currentFrame, offset by 1
+	std::string threadName; // Copied from the thread registry on each collect
 };
 
 struct GPUQuery {
@@ -95,19 +290,83 @@ struct GPUQuery {
 };
 
 struct ProfileLayer {
+	std::string path; // The unique tree path of this layer, e.g. "Frame.RenderStage"
 	glm::vec3 colour; // The colour of all profilesi n this profile layer.
 	bool expanded; // Is this profile layer expanded, revealing all child profiles
 	bool hovering; // Is the mouse hovering over this profile layer
+	TDigest cpuTime; // Per frame CPU time in milliseconds, summed over every occurrence of this layer within the frame
+	TDigest gpuTime; // Per frame GPU time in milliseconds, summed over every occurrence of this layer within the frame
+	double frameTimeCPU; // Scratch sums while a frame is accumulated
+	double frameTimeGPU;
+	bool hasFrameTimeGPU;
+};
+
+struct ProfileStatistics {
+	double count; // Number of frames this layer appeared in
+	double min; // All times in milliseconds
+	double max;
+	double mean;
+	double p50;
+	double p90;
+	double p95;
+	double p99;
 };
 
 class ScopedProfile {
 public:
 	// When this object is instantiated, a profile is pushed
-	ScopedProfile(std::string name);
+	ScopedProfile(ProfileName name);
 
 	// When this object is destroyed (deleted or went out of scope), the profile is popped.
 	~ScopedProfile();
 
 private:
-	uint32_t m_profile; // The index of the profile
+	bool m_active; // False if profiling was not running when the scope was entered
 };
+
+constexpr ProfileName Profiler::hashName(const char* name) {
+	// 32-bit FNV-1a
+	uint32_t hash = 2166136261u;
+	for (; *name != '\0'; ++name) {
+		hash = (hash ^ (uint8_t)(*name)) * 16777619u;
+	}
+	return hash;
+}
+
+inline bool ProfileThread::write(const ProfileEvent& event, uint32_t reserve) {
+	// reserve is the number of slots that must stay free after this event. Every open scope keeps a
+	// slot for its END event, so an END is never dropped once its BEGIN was written.
+	uint64_t h = head.load(std::memory_order_relaxed);
+	if (h - cachedTail + reserve > mask) {
+		cachedTail = tail.load(std::memory_order_acquire);
+		if (h - cachedTail + reserve > mask) {
+			droppedEventCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	events[h & mask] = event;
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+inline ProfileThread* Profiler::currentThread() {
+	ProfileThread* thread = s_currentThread;
+	if (thread == NULL) {
+		thread = Profiler::registerThread();
+	}
+	return thread;
+}
+
+inline ScopedProfile::ScopedProfile(ProfileName name) {
+	m_active = Profiler::isProfiling();
+	if (m_active) {
+		Profiler::beginScope(name);
+	}
+}
+
+inline ScopedProfile::~ScopedProfile() {
+	if (m_active) {
+		Profiler::endScope();
+	}
+}
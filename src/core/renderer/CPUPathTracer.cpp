@@ -0,0 +1,565 @@
+#include "CPUPathTracer.h"
+#include "core/renderer/geometry/GeometryBuffer.h"
+#include "core/Engine.h"
+#include "core/JobSystem.h"
+#include <glm/gtc/packing.hpp>
+
+#define TRAVERSAL_STACK_DEPTH 128
+#define TRIANGLE_EPSILON 1e-8F
+#define RAY_OFFSET 1e-4F // Relative to the magnitude of the surface position
+#define MIN_ROUGHNESS 0.03F // Keeps the GGX distribution of mirror materials finite
+#define DIELECTRIC_BASE_REFLECTIVITY vec3(0.04F)
+#define RUSSIAN_ROULETTE_BOUNCE 3
+
+static float nextRandom(uint32_t& state) {
+	// xorshift32, the top 24 bits give a float in [0, 1)
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return (state >> 8) * (1.0F / 16777216.0F);
+}
+
+static uint32_t hashSeed(uint32_t x) {
+	x = (x ^ 61) ^ (x >> 16);
+	x *= 9;
+	x = x ^ (x >> 4);
+	x *= 0x27D4EB2D;
+	x = x ^ (x >> 15);
+	return x != 0 ? x : 1; // xorshift never leaves zero
+}
+
+static vec3 orientToNormal(vec3 v, vec3 N) {
+	vec3 W = abs(N.z) < 0.999F ? vec3(0.0F, 0.0F, 1.0F) : vec3(1.0F, 0.0F, 0.0F);
+	vec3 U = normalize(cross(W, N));
+	vec3 V = cross(N, U);
+	return v.x * U + v.y * V + v.z * N;
+}
+
+static vec3 hemisphereSampleCos(float u, float v) {
+	float phi = v * 2.0F * glm::pi<float>();
+	float cosTheta = sqrt(1.0F - u);
+	float sinTheta = sqrt(1.0F - cosTheta * cosTheta);
+	return vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+}
+
+static float normalDistributionGGX(float NDotH2, float a2) {
+	float f = NDotH2 * (a2 - 1.0F) + 1.0F;
+	return a2 / (glm::pi<float>() * f * f);
+}
+
+static float geometrySchlickGGX(float cosTheta, float k) {
+	return cosTheta / (cosTheta * (1.0F - k) + k);
+}
+
+static vec3 fresnelSchlick(float VDotH, vec3 f0, vec3 f90) {
+	float f = 1.0F - VDotH;
+	float f2 = f * f;
+	return f0 + (f90 - f0) * (f2 * f2 * f);
+}
+
+static bool rayIntersectsNode(const BVHBinaryNode& node, const vec3& origin, const vec3& invDirection, float maxDistance, float& distance) {
+	vec3 t0 = (vec3(node.xmin, node.ymin, node.zmin) - origin) * invDirection;
+	vec3 t1 = (vec3(node.xmax, node.ymax, node.zmax) - origin) * invDirection;
+	vec3 tMin = min(t0, t1);
+	vec3 tMax = max(t0, t1);
+	float tNear = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.0F));
+	float tFar = glm::min(glm::min(tMax.x, tMax.y), glm::min(tMax.z, maxDistance));
+	distance = tNear;
+	return tNear <= tFar;
+}
+
+static bool rayIntersectsTriangle(const vec3& origin, const vec3& direction, const vec3& v0, const vec3& v1, const vec3& v2, float& distance, vec3& barycentric) {
+	// Moller-Trumbore, as rayIntersectsTriangle in intersection.glsl
+	vec3 e1 = v1 - v0;
+	vec3 e2 = v2 - v0;
+	vec3 h = cross(direction, e2);
+	float a = dot(e1, h);
+	if (abs(a) < TRIANGLE_EPSILON)
+		return false;
+
+	float f = 1.0F / a;
+	vec3 s = origin - v0;
+	float u = f * dot(s, h);
+	if (u < 0.0F || u > 1.0F)
+		return false;
+
+	vec3 q = cross(s, e1);
+	float v = f * dot(direction, q);
+	if (v < 0.0F || u + v > 1.0F)
+		return false;
+
+	float t = f * dot(e2, q);
+	if (t <= TRIANGLE_EPSILON || t >= distance)
+		return false;
+
+	distance = t;
+	barycentric = vec3(1.0F - u - v, u, v);
+	return true;
+}
+
+
+
+CPUPathTracer::CPUPathTracer(const std::vector<Mesh::vertex>& vertices, const std::vector<Mesh::triangle>& triangles, const std::vector<BVHBinaryNode>& nodes, const std::vector<BVH::PrimitiveReference>& primitiveReferences, const std::vector<uint32_t>& emissiveTriangles, const std::vector<PackedMaterial>& materials):
+	m_vertices(vertices),
+	m_triangles(triangles),
+	m_primitiveReferences(primitiveReferences),
+	m_emissiveTriangles(emissiveTriangles),
+	m_nodes(nodes),
+	m_emissiveArea(0.0F),
+	m_samplesPerPixel(64),
+	m_maxBounces(4),
+	m_backgroundRadiance(0.0F),
+	m_tileSize(16),
+	m_threadCount(0) {
+
+	m_defaultMaterial.albedo = vec3(1.0F);
+	m_defaultMaterial.emission = vec3(0.0F);
+	m_defaultMaterial.roughness = 1.0F;
+	m_defaultMaterial.metalness = 0.0F;
+
+	m_materials.resize(materials.size());
+	for (int i = 0; i < materials.size(); i++) {
+		m_materials[i] = CPUPathTracer::unpackMaterial(materials[i]);
+	}
+
+	m_emissiveAreaCDF.resize(emissiveTriangles.size());
+	for (int i = 0; i < emissiveTriangles.size(); i++) {
+		const Mesh::triangle& triangle = triangles[emissiveTriangles[i]];
+		vec3 e1 = vertices[triangle.i1].position - vertices[triangle.i0].position;
+		vec3 e2 = vertices[triangle.i2].position - vertices[triangle.i0].position;
+		m_emissiveArea += 0.5F * length(cross(e1, e2));
+		m_emissiveAreaCDF[i] = m_emissiveArea;
+	}
+
+	if (m_nodes.empty() && !triangles.empty()) {
+		error("Unable to path trace %llu triangles without a BVH\n", (unsigned long long)triangles.size());
+	}
+}
+
+CPUPathTracer::CPUPathTracer(const GeometryBuffer& geometryBuffer, const std::vector<PackedMaterial>& materials):
+	CPUPathTracer(geometryBuffer.getVertices(), geometryBuffer.getTriangles(), geometryBuffer.getBVH()->createLinearNodes(), geometryBuffer.getBVH()->getPrimitiveReferences(), geometryBuffer.getEmissiveTriangles(), materials) {
+}
+
+CPUPathTracer::~CPUPathTracer() {
+}
+
+bool CPUPathTracer::traceRay(const PathTraceRay& ray, PathTraceHit& hit) const {
+	hit = PathTraceHit();
+	return this->traverse<false>(ray, hit);
+}
+
+bool CPUPathTracer::isOccluded(const PathTraceRay& ray) const {
+	PathTraceHit hit;
+	return this->traverse<true>(ray, hit);
+}
+
+vec3 CPUPathTracer::traceRadiance(const PathTraceRay& primaryRay, uint32_t& seed) const {
+	vec3 radiance = vec3(0.0F);
+	vec3 throughput = vec3(1.0F);
+	PathTraceRay ray = primaryRay;
+
+	for (uint32_t bounce = 0; bounce < m_maxBounces; bounce++) {
+		PathTraceHit hit;
+		if (!this->traceRay(ray, hit)) {
+			radiance += throughput * m_backgroundRadiance;
+			break;
+		}
+
+		SurfacePoint surface;
+		this->getSurfacePoint(ray, hit, surface);
+
+		if (bounce == 0) {
+			radiance += surface.material.emission; // Emitters reached by later bounces are counted by the light samples
+		}
+
+		vec3 V = -ray.direction;
+		vec3 magnitude = abs(surface.position);
+		float offset = RAY_OFFSET * glm::max(glm::max(1.0F, magnitude.x), glm::max(magnitude.y, magnitude.z));
+		vec3 origin = surface.position + surface.geometricNormal * offset;
+
+		radiance += throughput * this->sampleDirectLight(surface, V, origin, seed);
+
+		if (bounce + 1 >= m_maxBounces)
+			break;
+
+		vec3 L;
+		float pdf;
+		if (!this->sampleBRDF(surface, V, seed, L, pdf))
+			break;
+
+		throughput *= CPUPathTracer::evaluateBRDF(surface, V, L, false) * dot(surface.normal, L) / pdf;
+
+		if (bounce >= RUSSIAN_ROULETTE_BOUNCE) {
+			float survival = glm::clamp(glm::max(glm::max(throughput.x, throughput.y), throughput.z), 0.05F, 1.0F);
+			if (nextRandom(seed) >= survival)
+				break;
+
+			throughput /= survival;
+		}
+
+		ray.origin = origin;
+		ray.direction = L;
+		ray.maxDistance = INFINITY;
+	}
+
+	return radiance;
+}
+
+void CPUPathTracer::render(dvec3 cameraPosition, dmat3 cameraAxes, double fieldOfView, uvec2 resolution, std::vector<vec3>& pixels) const {
+	pixels.assign((size_t)resolution.x * resolution.y, vec3(0.0F));
+
+	if (resolution.x == 0 || resolution.y == 0)
+		return;
+
+	// Same view basis as Camera::render, which looks along the z axis with y up
+	vec3 forward = vec3(normalize(cameraAxes[2]));
+	vec3 right = normalize(cross(forward, vec3(normalize(cameraAxes[1]))));
+	vec3 up = cross(right, forward);
+	float tanHalfFov = (float)tan(fieldOfView * 0.5);
+	float aspect = (float)resolution.x / (float)resolution.y;
+	vec3 origin = vec3(cameraPosition);
+
+	uint32_t tileCountX = (resolution.x + m_tileSize - 1) / m_tileSize;
+	uint32_t tileCountY = (resolution.y + m_tileSize - 1) / m_tileSize;
+
+	uint64_t t0 = Engine::instance()->getCurrentTime();
+
+	Engine::jobSystem()->parallelFor(tileCountX * tileCountY, 1, [this, &pixels, resolution, tileCountX, origin, forward, right, up, tanHalfFov, aspect](size_t first, size_t last) {
+		for (size_t tile = first; tile < last; tile++) {
+			uint32_t x0 = (tile % tileCountX) * m_tileSize;
+			uint32_t y0 = (tile / tileCountX) * m_tileSize;
+			uint32_t x1 = glm::min(x0 + m_tileSize, resolution.x);
+			uint32_t y1 = glm::min(y0 + m_tileSize, resolution.y);
+
+			for (uint32_t y = y0; y < y1; y++) {
+				for (uint32_t x = x0; x < x1; x++) {
+					uint32_t pixelIndex = y * resolution.x + x;
+					vec3 colour = vec3(0.0F);
+
+					for (uint32_t i = 0; i < m_samplesPerPixel; i++) {
+						uint32_t seed = hashSeed(pixelIndex * 9781u + hashSeed(i));
+						vec2 ndc = vec2((x + nextRandom(seed)) / resolution.x, (y + nextRandom(seed)) / resolution.y) * 2.0F - 1.0F;
+
+						PathTraceRay ray;
+						ray.origin = origin;
+						ray.direction = normalize(forward + right * (ndc.x * tanHalfFov * aspect) + up * (ndc.y * tanHalfFov));
+						colour += this->traceRadiance(ray, seed);
+					}
+
+					pixels[pixelIndex] = colour / (float)glm::max(m_samplesPerPixel, 1u);
+				}
+			}
+		}
+	}, m_threadCount);
+
+	uint64_t t1 = Engine::instance()->getCurrentTime();
+	info("Path traced %u x %u pixels at %u samples per pixel - Took %.2f msec\n", resolution.x, resolution.y, m_samplesPerPixel, (t1 - t0) / 1000000.0);
+}
+
+bool CPUPathTracer::writePFM(std::string filePath, uvec2 resolution, const std::vector<vec3>& pixels) {
+	if (pixels.size() != (size_t)resolution.x * resolution.y) {
+		error("Unable to write %llu pixels as a %u x %u image\n", (unsigned long long)pixels.size(), resolution.x, resolution.y);
+		return false;
+	}
+
+	std::ofstream stream(filePath.c_str(), std::ofstream::out | std::ofstream::binary);
+	if (!stream.is_open()) {
+		error("Failed to open image file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	// Rows of a PFM are stored bottom to top, and a negative scale marks them as little endian
+	stream << "PF\n" << resolution.x << " " << resolution.y << "\n-1.0\n";
+	stream.write(reinterpret_cast<const char*>(&pixels[0]), sizeof(vec3) * pixels.size());
+
+	if (!stream.good()) {
+		error("Failed to write image file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	info("Wrote %u x %u image to \"%s\"\n", resolution.x, resolution.y, filePath.c_str());
+	return true;
+}
+
+uint32_t CPUPathTracer::getSamplesPerPixel() const {
+	return m_samplesPerPixel;
+}
+
+void CPUPathTracer::setSamplesPerPixel(uint32_t samplesPerPixel) {
+	m_samplesPerPixel = glm::max(samplesPerPixel, 1u);
+}
+
+uint32_t CPUPathTracer::getMaxBounces() const {
+	return m_maxBounces;
+}
+
+void CPUPathTracer::setMaxBounces(uint32_t maxBounces) {
+	m_maxBounces = glm::max(maxBounces, 1u);
+}
+
+vec3 CPUPathTracer::getBackgroundRadiance() const {
+	return m_backgroundRadiance;
+}
+
+void CPUPathTracer::setBackgroundRadiance(vec3 backgroundRadiance) {
+	m_backgroundRadiance = backgroundRadiance;
+}
+
+uint32_t CPUPathTracer::getTileSize() const {
+	return m_tileSize;
+}
+
+void CPUPathTracer::setTileSize(uint32_t tileSize) {
+	m_tileSize = glm::max(tileSize, 1u);
+}
+
+uint32_t CPUPathTracer::getThreadCount() const {
+	return m_threadCount;
+}
+
+void CPUPathTracer::setThreadCount(uint32_t threadCount) {
+	m_threadCount = threadCount;
+}
+
+template <bool AnyHit>
+bool CPUPathTracer::traverse(const PathTraceRay& ray, PathTraceHit& hit) const {
+	if (m_nodes.empty())
+		return false;
+
+	vec3 invDirection;
+	for (int i = 0; i < 3; i++) {
+		invDirection[i] = 1.0F / (ray.direction[i] != 0.0F ? ray.direction[i] : 1e-30F);
+	}
+
+	float closestDistance = ray.maxDistance;
+	float rootDistance;
+	if (!rayIntersectsNode(m_nodes[0], ray.origin, invDirection, closestDistance, rootDistance))
+		return false;
+
+	uint32_t stack[TRAVERSAL_STACK_DEPTH];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		uint32_t index = stack[--stackSize];
+		const BVHBinaryNode& node = m_nodes[index];
+
+		if ((node.primitiveCount_splitAxis_flags & 0x1) != 0) {
+			uint32_t primitiveOffset = node.dataOffset;
+			uint32_t primitiveCount = (node.primitiveCount_splitAxis_flags >> 3) & 0x1FFFFFFF;
+
+			for (uint32_t i = primitiveOffset; i < primitiveOffset + primitiveCount; i++) {
+				uint32_t triangleIndex = m_primitiveReferences[i];
+				const Mesh::triangle& triangle = m_triangles[triangleIndex];
+
+				if (rayIntersectsTriangle(ray.origin, ray.direction, m_vertices[triangle.i0].position, m_vertices[triangle.i1].position, m_vertices[triangle.i2].position, closestDistance, hit.barycentric)) {
+					hit.hit = true;
+					hit.distance = closestDistance;
+					hit.triangleIndex = triangleIndex;
+
+					if (AnyHit)
+						return true;
+				}
+			}
+			continue;
+		}
+
+		// The left child follows its parent, the right child is at the data offset
+		uint32_t leftIndex = index + 1;
+		uint32_t rightIndex = node.dataOffset;
+		float leftDistance, rightDistance;
+		bool leftHit = rayIntersectsNode(m_nodes[leftIndex], ray.origin, invDirection, closestDistance, leftDistance);
+		bool rightHit = rayIntersectsNode(m_nodes[rightIndex], ray.origin, invDirection, closestDistance, rightDistance);
+
+		assert(stackSize + 2 <= TRAVERSAL_STACK_DEPTH);
+
+		// The nearer child is pushed last, so it is visited first
+		if (leftHit && rightHit) {
+			if (leftDistance < rightDistance) {
+				stack[stackSize++] = rightIndex;
+				stack[stackSize++] = leftIndex;
+			} else {
+				stack[stackSize++] = leftIndex;
+				stack[stackSize++] = rightIndex;
+			}
+		} else if (leftHit) {
+			stack[stackSize++] = leftIndex;
+		} else if (rightHit) {
+			stack[stackSize++] = rightIndex;
+		}
+	}
+
+	return hit.hit;
+}
+
+void CPUPathTracer::getSurfacePoint(const PathTraceRay& ray, const PathTraceHit& hit, SurfacePoint& surface) const {
+	const Mesh::triangle& triangle = m_triangles[hit.triangleIndex];
+	const Mesh::vertex& v0 = m_vertices[triangle.i0];
+	const Mesh::vertex& v1 = m_vertices[triangle.i1];
+	const Mesh::vertex& v2 = m_vertices[triangle.i2];
+
+	surface.position = ray.origin + ray.direction * hit.distance;
+	surface.geometricNormal = normalize(cross(v1.position - v0.position, v2.position - v0.position));
+	if (dot(surface.geometricNormal, ray.direction) > 0.0F) {
+		surface.geometricNormal = -surface.geometricNormal;
+	}
+
+	surface.normal = v0.normal * hit.barycentric.x + v1.normal * hit.barycentric.y + v2.normal * hit.barycentric.z;
+	float normalLength = length(surface.normal);
+	if (normalLength < 1e-6F) {
+		surface.normal = surface.geometricNormal;
+	} else {
+		surface.normal /= normalLength;
+		if (dot(surface.normal, surface.geometricNormal) < 0.0F) {
+			surface.normal = -surface.normal;
+		}
+	}
+
+	surface.material = this->getTriangleMaterial(hit.triangleIndex);
+}
+
+const CPUPathTracer::SurfaceMaterial& CPUPathTracer::getTriangleMaterial(uint32_t triangleIndex) const {
+	// The material of the first vertex is used for the whole triangle, as in getInterpolatedTriangleFragment
+	int32_t materialIndex = m_vertices[m_triangles[triangleIndex].i0].material;
+	if (materialIndex < 0 || materialIndex >= m_materials.size())
+		return m_defaultMaterial;
+
+	return m_materials[materialIndex];
+}
+
+vec3 CPUPathTracer::sampleDirectLight(const SurfacePoint& surface, vec3 V, vec3 origin, uint32_t& seed) const {
+	if (m_emissiveAreaCDF.empty() || m_emissiveArea <= 0.0F)
+		return vec3(0.0F);
+
+	// Pick a triangle with probability proportional to its area, then a uniform point on it
+	float areaSample = nextRandom(seed) * m_emissiveArea;
+	size_t emissiveIndex = std::upper_bound(m_emissiveAreaCDF.begin(), m_emissiveAreaCDF.end(), areaSample) - m_emissiveAreaCDF.begin();
+	emissiveIndex = glm::min(emissiveIndex, m_emissiveAreaCDF.size() - 1);
+
+	uint32_t triangleIndex = m_emissiveTriangles[emissiveIndex];
+	const Mesh::triangle& triangle = m_triangles[triangleIndex];
+	vec3 p0 = m_vertices[triangle.i0].position;
+	vec3 p1 = m_vertices[triangle.i1].position;
+	vec3 p2 = m_vertices[triangle.i2].position;
+
+	float r0 = sqrt(nextRandom(seed));
+	float r1 = nextRandom(seed);
+	vec3 lightPosition = p0 * (1.0F - r0) + p1 * (r0 * (1.0F - r1)) + p2 * (r0 * r1);
+	vec3 lightNormal = normalize(cross(p1 - p0, p2 - p0));
+
+	vec3 toLight = lightPosition - origin;
+	float distanceSquared = dot(toLight, toLight);
+	float distance = sqrt(distanceSquared);
+	if (distance < 1e-6F)
+		return vec3(0.0F);
+
+	vec3 L = toLight / distance;
+	float NDotL = dot(surface.normal, L);
+	float lightCosTheta = abs(dot(lightNormal, L)); // Emissive triangles emit from both faces
+	if (NDotL <= 0.0F || lightCosTheta < 1e-6F || dot(surface.geometricNormal, L) <= 0.0F)
+		return vec3(0.0F);
+
+	PathTraceRay shadowRay;
+	shadowRay.origin = origin;
+	shadowRay.direction = L;
+	shadowRay.maxDistance = distance * (1.0F - 1e-3F);
+	if (this->isOccluded(shadowRay))
+		return vec3(0.0F);
+
+	// Convert the area density of the sample to a solid angle density
+	float pdf = distanceSquared / (lightCosTheta * m_emissiveArea);
+	vec3 emission = this->getTriangleMaterial(triangleIndex).emission;
+	return CPUPathTracer::evaluateBRDF(surface, V, L, true) * emission * NDotL / pdf;
+}
+
+bool CPUPathTracer::sampleBRDF(const SurfacePoint& surface, vec3 V, uint32_t& seed, vec3& L, float& pdf) const {
+	// Same lobe selection as sampleBRDF in UE4BRDF.glsl, the pdf is that of both lobes combined
+	const vec3 N = surface.normal;
+	float diffuseRatio = 0.5F * (1.0F - surface.material.metalness);
+	float a = glm::max(surface.material.roughness, MIN_ROUGHNESS);
+	a = a * a;
+	float a2 = a * a;
+
+	float u = nextRandom(seed);
+	float v = nextRandom(seed);
+
+	if (nextRandom(seed) < diffuseRatio) {
+		L = orientToNormal(hemisphereSampleCos(u, v), N);
+	} else {
+		float phi = 2.0F * glm::pi<float>() * u;
+		float cosTheta = sqrt((1.0F - v) / (v * (a2 - 1.0F) + 1.0F));
+		float sinTheta = sqrt(glm::max(1.0F - cosTheta * cosTheta, 0.0F));
+		vec3 H = orientToNormal(vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta), N);
+		L = 2.0F * dot(V, H) * H - V;
+	}
+
+	float NDotL = dot(N, L);
+	if (NDotL <= 0.0F || dot(surface.geometricNormal, L) <= 0.0F)
+		return false;
+
+	vec3 H = normalize(V + L);
+	float NDotH = glm::max(dot(N, H), 0.0F);
+	float VDotH = glm::max(dot(V, H), 1e-6F);
+	float specularPDF = normalDistributionGGX(NDotH * NDotH, a2) * NDotH / (4.0F * VDotH);
+	float diffusePDF = NDotL / glm::pi<float>();
+
+	pdf = diffuseRatio * diffusePDF + (1.0F - diffuseRatio) * specularPDF;
+	return pdf > 1e-8F;
+}
+
+vec3 CPUPathTracer::evaluateBRDF(const SurfacePoint& surface, vec3 V, vec3 L, bool analyticLightSource) {
+	// Port of evaluateBRDF in UE4BRDF.glsl
+	const vec3 N = surface.normal;
+	const SurfaceMaterial& material = surface.material;
+
+	float NDotV = dot(N, V);
+	float NDotL = dot(N, L);
+	if (NDotV <= 0.0F || NDotL <= 0.0F)
+		return vec3(0.0F);
+
+	vec3 H = normalize(V + L);
+	float NDotH = dot(N, H);
+	float VDotH = glm::max(dot(V, H), 0.0F);
+
+	float a = glm::max(material.roughness, MIN_ROUGHNESS);
+	a = a * a;
+	float a2 = a * a;
+
+	float k;
+	if (analyticLightSource) {
+		k = a + 1.0F;
+		k = k * k * 0.125F;
+	} else {
+		k = a2 * 0.5F;
+	}
+
+	vec3 f0 = mix(DIELECTRIC_BASE_REFLECTIVITY, material.albedo, material.metalness);
+	vec3 f90 = vec3(1.0F - a);
+
+	float D = normalDistributionGGX(NDotH * NDotH, a2);
+	float G = geometrySchlickGGX(NDotL, k) * geometrySchlickGGX(NDotV, k);
+	vec3 F = fresnelSchlick(VDotH, f0, f90);
+
+	vec3 specular = vec3(D * G / (4.0F * NDotV * NDotL));
+	vec3 diffuse = material.albedo / glm::pi<float>();
+
+	vec3 kS = F;
+	vec3 kD = (1.0F - kS) * (1.0F - material.metalness);
+
+	return kD * diffuse + kS * specular;
+}
+
+CPUPathTracer::SurfaceMaterial CPUPathTracer::unpackMaterial(const PackedMaterial& packedMaterial) {
+	// Same unpacking as unpackMaterial in globals.glsl
+	SurfaceMaterial material;
+	material.albedo = vec3(unpackUnorm4x8(packedMaterial.packedAlbedoRGBA));
+
+	vec2 emissionRG = unpackUnorm2x16(packedMaterial.packedEmissionRG);
+	vec2 emissionB = unpackUnorm2x16(packedMaterial.packedEmissionB_roughnessR_metalnessR);
+	material.emission = vec3(emissionRG, emissionB.x) * 256.0F;
+
+	vec4 roughnessMetalness = unpackUnorm4x8(packedMaterial.packedEmissionB_roughnessR_metalnessR);
+	material.roughness = roughnessMetalness.z;
+	material.metalness = roughnessMetalness.w;
+	return material;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "core/pch.h"
+#include "core/renderer/MaterialManager.h"
+#include "core/scene/BVH.h"
+
+class GeometryBuffer;
+
+struct PathTraceRay {
+	vec3 origin;
+	vec3 direction; // Must be normalized
+	float maxDistance = INFINITY;
+};
+
+struct PathTraceHit {
+	bool hit = false;
+	float distance = INFINITY;
+	uint32_t triangleIndex = 0;
+	vec3 barycentric = vec3(0.0F);
+};
+
+// Reference path tracer over the same buffers the GPU raytracer reads: the flattened BVH nodes and
+// primitive references, the scene vertices and triangles, the emissive triangle list and the packed
+// materials. Used to render ground truth frames on machines without a GPU, and to check the GPU
+// output against. The vertex, triangle, reference and emissive triangle buffers are not copied, they
+// must outlive the tracer.
+// The BVH is traversed with the same stack traversal as intersection.glsl, near child first. Surfaces
+// are shaded with the UE4 BRDF from UE4BRDF.glsl. Direct light is sampled from the emissive triangles,
+// picked in proportion to their area, and paths continue by importance sampling the BRDF. Emission is
+// only added by the camera ray hit and by the light samples, so emitters are never counted twice.
+// Material textures are bindless GPU handles, so only the constant material values are used.
+// Frames are split into tiles that threads claim one at a time. Every pixel seeds its own random
+// numbers from its coordinate and sample index, so the image does not depend on the thread count.
+class CPUPathTracer : private NotCopyable {
+public:
+	CPUPathTracer(const std::vector<Mesh::vertex>& vertices, const std::vector<Mesh::triangle>& triangles, const std::vector<BVHBinaryNode>& nodes, const std::vector<BVH::PrimitiveReference>& primitiveReferences, const std::vector<uint32_t>& emissiveTriangles, const std::vector<PackedMaterial>& materials);
+
+	// The geometry buffer must have built its BVH
+	CPUPathTracer(const GeometryBuffer& geometryBuffer, const std::vector<PackedMaterial>& materials);
+
+	~CPUPathTracer();
+
+	bool traceRay(const PathTraceRay& ray, PathTraceHit& hit) const;
+
+	bool isOccluded(const PathTraceRay& ray) const;
+
+	vec3 traceRadiance(const PathTraceRay& ray, uint32_t& seed) const;
+
+	// Pixels are written row by row from the bottom of the frame up, in the same order as GL images
+	void render(dvec3 cameraPosition, dmat3 cameraAxes, double fieldOfView, uvec2 resolution, std::vector<vec3>& pixels) const;
+
+	static bool writePFM(std::string filePath, uvec2 resolution, const std::vector<vec3>& pixels);
+
+	uint32_t getSamplesPerPixel() const;
+
+	void setSamplesPerPixel(uint32_t samplesPerPixel);
+
+	uint32_t getMaxBounces() const;
+
+	void setMaxBounces(uint32_t maxBounces);
+
+	vec3 getBackgroundRadiance() const;
+
+	void setBackgroundRadiance(vec3 backgroundRadiance);
+
+	uint32_t getTileSize() const;
+
+	void setTileSize(uint32_t tileSize);
+
+	uint32_t getThreadCount() const;
+
+	void setThreadCount(uint32_t threadCount);
+
+private:
+	struct SurfaceMaterial {
+		vec3 albedo;
+		vec3 emission;
+		float roughness;
+		float metalness;
+	};
+
+	struct SurfacePoint {
+		vec3 position;
+		vec3 normal; // Interpolated vertex normal, facing the incoming ray
+		vec3 geometricNormal; // Triangle normal, facing the incoming ray
+		SurfaceMaterial material;
+	};
+
+	template <bool AnyHit>
+	bool traverse(const PathTraceRay& ray, PathTraceHit& hit) const;
+
+	void getSurfacePoint(const PathTraceRay& ray, const PathTraceHit& hit, SurfacePoint& surface) const;
+
+	const SurfaceMaterial& getTriangleMaterial(uint32_t triangleIndex) const;
+
+	vec3 sampleDirectLight(const SurfacePoint& surface, vec3 V, vec3 origin, uint32_t& seed) const;
+
+	bool sampleBRDF(const SurfacePoint& surface, vec3 V, uint32_t& seed, vec3& L, float& pdf) const;
+
+	static vec3 evaluateBRDF(const SurfacePoint& surface, vec3 V, vec3 L, bool analyticLightSource);
+
+	static SurfaceMaterial unpackMaterial(const PackedMaterial& packedMaterial);
+
+	const std::vector<Mesh::vertex>& m_vertices;
+	const std::vector<Mesh::triangle>& m_triangles;
+	const std::vector<BVH::PrimitiveReference>& m_primitiveReferences;
+	const std::vector<uint32_t>& m_emissiveTriangles;
+	std::vector<BVHBinaryNode> m_nodes;
+	std::vector<SurfaceMaterial> m_materials;
+	SurfaceMaterial m_defaultMaterial; // Used by triangles without a material, as in calculateFragment
+	std::vector<float> m_emissiveAreaCDF; // Running sum of the emissive triangle areas
+	float m_emissiveArea;
+
+	uint32_t m_samplesPerPixel;
+	uint32_t m_maxBounces; // Surface interactions lit per path, 1 for direct light only
+	vec3 m_backgroundRadiance; // Radiance of rays leaving the scene
+	uint32_t m_tileSize; // Width and height of the tiles in pixels
+	uint32_t m_threadCount; // 0 uses every thread of the job system
+};
@@ -157,6 +157,17 @@ void CubeMap::upload(void* data[6], uint32_t width, uint32_t height) {
 	CubeMap::uploadCubeFaces(this, data, width, height);
 }
 
+void CubeMap::uploadMipLevel(void* data[6], uint32_t level, uint32_t width, uint32_t height) {
+	OpenGLTextureFormat format = Texture::getOpenGLTextureFormat(m_format);
+
+	this->bind();
+	for (int i = 0; i < 6; i++) {
+		OpenGLTextureTarget target = CubeMap::getOpenGLFaceTarget((CubeMapFace)i);
+		glTexImage2D(target.target, level, format.internalFormat, width, height, 0, format.externalFormat, format.type, data[i]);
+	}
+	this->unbind();
+}
+
 void CubeMap::bind(uint32_t textureUnit) {
 	OpenGLTextureTarget target = Texture::getOpenGLTextureTarget(m_target);
 	glActiveTexture(GL_TEXTURE0 + textureUnit);
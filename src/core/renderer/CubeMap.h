@@ -56,6 +56,9 @@ public:
 	// Upload individual data for individual faces. NULL data will be ignored.
 	virtual void upload(void* data[6], uint32_t width = 0, uint32_t height = 0);
 
+	// Upload individual data for individual faces to a mip level. The width and height are those of the level.
+	void uploadMipLevel(void* data[6], uint32_t level, uint32_t width, uint32_t height);
+
 	virtual void bind(uint32_t textureUnit = 0) override;
 	
 	virtual void unbind() override;
@@ -1,134 +1,147 @@
 #include "core/renderer/EnvironmentMap.h"
-#include "core/renderer/ShaderProgram.h"
+#include "core/Engine.h"
+#include "core/util/FileUtils.h"
+#include "core/util/Hash.h"
 
 Texture2D* LightProbe::s_BRDFIntegrationMap = NULL;
-ShaderProgram* LightProbe::s_diffuseIrradianceConvolutionShader = NULL;
-ShaderProgram* LightProbe::s_specularIrradianceConvolutionShader = NULL;
-ShaderProgram* LightProbe::s_specularRoughnessConvolutionShader = NULL;
-ShaderProgram* LightProbe::s_BRDFIntegrationShader = NULL;
 
-LightProbe::LightProbe(CubeMap* environmentMap) {
+LightProbe::LightProbe(CubeMap* environmentMap):
+	m_environmentMap(NULL),
+	m_diffuseIrradianceMap(NULL),
+	m_specularReflectionMap(NULL),
+	m_precomputed(false),
+	m_sourceHash(0) {
 	this->setEnvironmentMap(environmentMap);
 }
 
-LightProbe::LightProbe(CubemapConfiguration environmentMapConfig) {
+LightProbe::LightProbe(CubemapConfiguration environmentMapConfig):
+	m_environmentMap(NULL),
+	m_diffuseIrradianceMap(NULL),
+	m_specularReflectionMap(NULL),
+	m_precomputed(false),
+	m_sourceHash(0) {
 	this->setEnvironmentMap(environmentMapConfig);
 }
 
 LightProbe::~LightProbe() {
 	delete this->m_environmentMap;
 	delete this->m_diffuseIrradianceMap;
+	delete this->m_specularReflectionMap;
 }
 
 bool LightProbe::setEnvironmentMap(CubeMap* environmentMap) {
 	m_environmentMap = environmentMap;
+	m_environmentImage = CubeMapImage(); // Read back from the new map if it needs precomputing
+	m_precomputed = false;
+	m_sourceHash = 0;
 	return true;
 }
 
 bool LightProbe::setEnvironmentMap(CubemapConfiguration environmentMapConfig) {
-	CubeMap* environmentMap = NULL;
-	if (CubeMap::load(environmentMapConfig, &environmentMap)) {
-		return this->setEnvironmentMap(environmentMap);
+	uint64_t sourceHash = 0;
+	if (LightProbeBaker::hashEnvironmentSource(environmentMapConfig, sourceHash)) {
+		LightProbeBaker baker;
+		uint64_t key = baker.getCacheKey(sourceHash);
+		std::string cacheFilePath = LightProbe::getCacheFilePath("lightprobe_" + Hash::toHexString(key) + ".bin");
+
+		LightProbeData probeData;
+		if (LightProbeBaker::loadCache(cacheFilePath, key, probeData) && !probeData.environmentMap.empty()) {
+			this->uploadEnvironmentMap(probeData.environmentMap);
+			probeData.environmentMap = CubeMapImage();
+			m_precomputedData = std::move(probeData);
+			m_precomputed = true;
+			m_sourceHash = sourceHash;
+			return true;
+		}
 	}
-	return false;
+
+	// The images are loaded once on the CPU, and uploaded from there rather than loaded again by CubeMap::load
+	CubeMapImage environmentImage;
+	if (!LightProbeBaker::loadEnvironmentMap(environmentMapConfig, environmentImage)) {
+		return false;
+	}
+
+	this->uploadEnvironmentMap(environmentImage);
+	m_environmentImage = std::move(environmentImage);
+	m_sourceHash = sourceHash;
+	return true;
 }
 
 LightProbe* LightProbe::calculateDiffuseIrradianceMap() {
-	if (s_diffuseIrradianceConvolutionShader == NULL) {
-		s_diffuseIrradianceConvolutionShader = new ShaderProgram();
-		s_diffuseIrradianceConvolutionShader->addShader(GL_COMPUTE_SHADER, "shaders/compute/irradiance/diffuse/comp.glsl");
-		s_diffuseIrradianceConvolutionShader->completeProgram();
+	if (!this->precompute() || !Engine::isGLAvailable()) {
+		return this;
 	}
 
-	int envMapWidth = (int) m_environmentMap->getWidth();
-	int envMapHeight = (int) m_environmentMap->getHeight();
-	int irrMapWidth = 32;
-	int irrMapHeight = 32;
+	const CubeMapImage& irradianceMap = m_precomputedData.diffuseIrradianceMap;
+	void* data[6];
+	for (int i = 0; i < 6; i++) {
+		data[i] = (void*)&irradianceMap.faces[i][0];
+	}
 
 	if (m_diffuseIrradianceMap == NULL) {
 		m_diffuseIrradianceMap = new CubeMap(
-			irrMapWidth,
-			irrMapHeight,
-			m_environmentMap->getFormat(), 
-			TextureFilter::LINEAR_PIXEL,//m_environmentMap->getMinificationFilterMode(), 
-			TextureFilter::LINEAR_PIXEL,//m_environmentMap->getMagnificationFilterMode(), 
-			m_environmentMap->getUWrapFilterMode(),
-			m_environmentMap->getVWrapFilterMode(), 
-			m_environmentMap->getWWrapFilterMode()
+			irradianceMap.size,
+			irradianceMap.size,
+			TextureFormat::R32_G32_B32_FLOAT,
+			TextureFilter::LINEAR_PIXEL,
+			TextureFilter::LINEAR_PIXEL,
+			TextureWrap::CLAMP_TO_EDGE,
+			TextureWrap::CLAMP_TO_EDGE,
+			TextureWrap::CLAMP_TO_EDGE
 		);
-		m_diffuseIrradianceMap->setSize(irrMapWidth, irrMapHeight, GL_RGBA);
 	}
 
-	OpenGLTextureFormat format = Texture::getOpenGLTextureFormat(m_environmentMap->getFormat());
-	ShaderProgram::use(s_diffuseIrradianceConvolutionShader);
-	s_diffuseIrradianceConvolutionShader->setUniform("srcMapSize", envMapWidth, envMapHeight);
-	s_diffuseIrradianceConvolutionShader->setUniform("dstMapSize", irrMapWidth, irrMapHeight);
-	glBindImageTexture(0, m_environmentMap->getTextureName(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
-	glBindImageTexture(1, m_diffuseIrradianceMap->getTextureName(), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-	glDispatchCompute((int)ceil(irrMapWidth), (int)ceil(irrMapHeight), 6);
-	ShaderProgram::use(NULL);
-
+	m_diffuseIrradianceMap->setSize(irradianceMap.size, irradianceMap.size);
+	m_diffuseIrradianceMap->upload(data, irradianceMap.size, irradianceMap.size);
 	return this;
 }
 
 LightProbe* LightProbe::calculateSpecularReflectionMap() {
-	if (s_specularIrradianceConvolutionShader == NULL) {
-		s_specularIrradianceConvolutionShader = new ShaderProgram();
-		s_specularIrradianceConvolutionShader->addShader(GL_COMPUTE_SHADER, "shaders/compute/irradiance/specular/comp.glsl");
-		s_specularIrradianceConvolutionShader->completeProgram();
+	if (!this->precompute() || !Engine::isGLAvailable()) {
+		return this;
 	}
 
-	if (s_specularRoughnessConvolutionShader == NULL) {
-		s_specularRoughnessConvolutionShader = new ShaderProgram();
-		s_specularRoughnessConvolutionShader->addShader(GL_COMPUTE_SHADER, "shaders/compute/irradiance/roughnessFilter/comp.glsl");
-		s_specularRoughnessConvolutionShader->completeProgram();
+	const std::vector<CubeMapImage>& reflectionMips = m_precomputedData.specularReflectionMips;
+	if (reflectionMips.empty()) {
+		return this;
 	}
 
-	int envMapWidth = (int)m_environmentMap->getWidth();
-	int envMapHeight = (int)m_environmentMap->getHeight();
-	int prfMapWidth = 256;
-	int prfMapHeight = 256;
-
-	int levels = 5;
-
+	uint32_t size = reflectionMips[0].size;
 	if (m_specularReflectionMap == NULL) {
 		m_specularReflectionMap = new CubeMap(
-			prfMapWidth,
-			prfMapHeight,
-			m_environmentMap->getFormat(),
-			TextureFilter::LINEAR_MIPMAP_LINEAR_PIXEL,//m_environmentMap->getMinificationFilterMode(), 
-			TextureFilter::LINEAR_PIXEL,//m_environmentMap->getMagnificationFilterMode(), 
-			m_environmentMap->getUWrapFilterMode(),
-			m_environmentMap->getVWrapFilterMode(),
-			m_environmentMap->getWWrapFilterMode()
+			size,
+			size,
+			TextureFormat::R32_G32_B32_FLOAT,
+			TextureFilter::LINEAR_MIPMAP_LINEAR_PIXEL,
+			TextureFilter::LINEAR_PIXEL,
+			TextureWrap::CLAMP_TO_EDGE,
+			TextureWrap::CLAMP_TO_EDGE,
+			TextureWrap::CLAMP_TO_EDGE
 		);
-		m_specularReflectionMap->setSize(prfMapWidth, prfMapHeight, GL_RGBA);
 	}
 
-	m_specularReflectionMap->generateMipmap(levels);
-	m_environmentMap->generateMipmap(levels);
+	m_specularReflectionMap->setSize(size, size);
+	m_specularReflectionMap->generateMipmap((int32_t)reflectionMips.size() - 1);
 
-	for (int i = 0; i <= levels; i++) {
-		int scale = 1 << i;
-		int srcMapWidth = envMapWidth;
-		int srcMapHeight = envMapHeight;
-		int dstMapWidth = prfMapWidth / scale;
-		int dstMapHeight = prfMapHeight / scale;
-		float roughness = (float) i / (levels);
-
-		ShaderProgram::use(s_specularRoughnessConvolutionShader);
-		s_specularRoughnessConvolutionShader->setUniform("srcMapSize", srcMapWidth, srcMapHeight);
-		s_specularRoughnessConvolutionShader->setUniform("dstMapSize", dstMapWidth, dstMapHeight);
-		s_specularRoughnessConvolutionShader->setUniform("roughness", roughness);
-		glBindImageTexture(0, m_environmentMap->getTextureName(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
-		glBindImageTexture(1, m_specularReflectionMap->getTextureName(), i, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-		glDispatchCompute((int)ceil(dstMapWidth), (int)ceil(dstMapWidth), 6);
+	for (uint32_t i = 0; i < reflectionMips.size(); i++) {
+		void* data[6];
+		for (int j = 0; j < 6; j++) {
+			data[j] = (void*)&reflectionMips[i].faces[j][0];
+		}
+		m_specularReflectionMap->uploadMipLevel(data, i, reflectionMips[i].size, reflectionMips[i].size);
 	}
 
-	ShaderProgram::use(NULL);
 	return this;
 }
 
+const SphericalHarmonics9& LightProbe::getIrradianceCoefficients() const {
+	return m_precomputedData.irradianceCoefficients;
+}
+
+const LightProbeData& LightProbe::getPrecomputedData() const {
+	return m_precomputedData;
+}
+
 CubeMap* LightProbe::getEnvironmentMap() const {
 	return m_environmentMap;
 }
@@ -167,24 +180,91 @@ bool LightProbe::bindSpecularReflectionMap(uint32_t textureUnit) const {
 
 Texture2D* LightProbe::getBRDFIntegrationMap() {
 	if (s_BRDFIntegrationMap == NULL) {
-		if (s_BRDFIntegrationShader == NULL) {
-			s_BRDFIntegrationShader = new ShaderProgram();
-			s_BRDFIntegrationShader->addShader(GL_COMPUTE_SHADER, "shaders/compute/irradiance/BRDFIntegrationMap/comp.glsl");
-			s_BRDFIntegrationShader->completeProgram();
+		LightProbeBaker baker;
+		uint32_t size = baker.getBRDFIntegrationMapSize();
+		uint64_t key = baker.getBRDFIntegrationCacheKey();
+		std::string cacheFilePath = LightProbe::getCacheFilePath("brdf_" + Hash::toHexString(key) + ".bin");
+
+		std::vector<vec2> integrationMap;
+		if (!LightProbeBaker::loadBRDFIntegrationCache(cacheFilePath, key, size, integrationMap)) {
+			baker.calculateBRDFIntegrationMap(integrationMap);
+			if (!cacheFilePath.empty()) {
+				LightProbeBaker::saveBRDFIntegrationCache(cacheFilePath, key, size, integrationMap);
+			}
 		}
 
-		s_BRDFIntegrationMap = new Texture2D(1024, 1024, TextureFormat::R32_G32_FLOAT, TextureFilter::LINEAR_PIXEL, TextureFilter::LINEAR_PIXEL, TextureWrap::CLAMP_TO_EDGE, TextureWrap::CLAMP_TO_EDGE);
-		//s_BRDFIntegrationMap->setSize(1024, 1024, GL_RGBA);
+		s_BRDFIntegrationMap = new Texture2D(size, size, TextureFormat::R32_G32_FLOAT, TextureFilter::LINEAR_PIXEL, TextureFilter::LINEAR_PIXEL, TextureWrap::CLAMP_TO_EDGE, TextureWrap::CLAMP_TO_EDGE);
+		s_BRDFIntegrationMap->upload(&integrationMap[0]);
+	}
 
-		int w = (int)s_BRDFIntegrationMap->getWidth();
-		int h = (int)s_BRDFIntegrationMap->getHeight();
+	return s_BRDFIntegrationMap;
+}
 
-		ShaderProgram::use(s_BRDFIntegrationShader);
-		s_BRDFIntegrationShader->setUniform("mapSize", w, h);
-		glBindImageTexture(0, s_BRDFIntegrationMap->getTextureName(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
-		glDispatchCompute(w / 8, h / 8, 1);
-		ShaderProgram::use(NULL);
+bool LightProbe::precompute() {
+	if (m_precomputed) {
+		return true;
 	}
 
-	return s_BRDFIntegrationMap;
+	if (m_environmentImage.empty() && !LightProbe::readEnvironmentMap(m_environmentMap, m_environmentImage)) {
+		error("Unable to precompute light probe without an environment map\n");
+		return false;
+	}
+
+	LightProbeBaker baker;
+	uint64_t key = baker.getCacheKey(m_sourceHash != 0 ? m_sourceHash : LightProbeBaker::hashEnvironmentMap(m_environmentImage));
+	std::string cacheFilePath = LightProbe::getCacheFilePath("lightprobe_" + Hash::toHexString(key) + ".bin");
+
+	if (!LightProbeBaker::loadCache(cacheFilePath, key, m_precomputedData)) {
+		baker.bake(m_environmentImage, m_precomputedData);
+		if (!cacheFilePath.empty()) {
+			// Only probes keyed by their source images load the environment map from the cache
+			if (m_sourceHash != 0) {
+				m_precomputedData.environmentMap = std::move(m_environmentImage);
+			}
+			LightProbeBaker::saveCache(cacheFilePath, key, m_precomputedData);
+		}
+	}
+
+	m_precomputedData.environmentMap = CubeMapImage();
+	m_environmentImage = CubeMapImage();
+	m_precomputed = true;
+	return true;
+}
+
+void LightProbe::uploadEnvironmentMap(const CubeMapImage& environmentImage) {
+	CubeMap* environmentMap = NULL;
+	if (Engine::isGLAvailable()) {
+		void* data[6];
+		for (int i = 0; i < 6; i++) {
+			data[i] = (void*)&environmentImage.faces[i][0];
+		}
+
+		environmentMap = new CubeMap(environmentImage.size, environmentImage.size, TextureFormat::R32_G32_B32_FLOAT);
+		environmentMap->upload(data, environmentImage.size, environmentImage.size);
+	}
+
+	m_environmentMap = environmentMap;
+}
+
+bool LightProbe::readEnvironmentMap(CubeMap* environmentMap, CubeMapImage& environmentImage) {
+	if (environmentMap == NULL || !Engine::isGLAvailable() || environmentMap->getWidth() != environmentMap->getHeight()) {
+		return false;
+	}
+
+	environmentImage.resize(environmentMap->getWidth());
+	environmentMap->bind();
+	for (int i = 0; i < 6; i++) {
+		OpenGLTextureTarget target = CubeMap::getOpenGLFaceTarget((CubeMapFace)i);
+		glGetTexImage(target.target, 0, GL_RGB, GL_FLOAT, &environmentImage.faces[i][0]);
+	}
+	environmentMap->unbind();
+	return true;
+}
+
+std::string LightProbe::getCacheFilePath(std::string fileName) {
+	std::string directory = Engine::instance()->getCacheDirectory() + "/lightprobes";
+	if (!FileUtils::createDirectories(directory)) {
+		return ""; // Probes are still precomputed, only not cached
+	}
+	return directory + "/" + fileName;
 }
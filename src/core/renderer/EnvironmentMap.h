@@ -1,9 +1,14 @@
 #pragma once
 #include "core/pch.h"
 #include "core/renderer/CubeMap.h"
-
-class ShaderProgram;
-
+#include "core/renderer/LightProbeBaker.h"
+
+// Environment map with the image based lighting maps precomputed from it. The maps are baked on the CPU by
+// LightProbeBaker, or loaded from the cache directory when a probe was baked from the same environment map
+// before, and only uploaded when a GL context is available. The spherical harmonic irradiance is kept, so
+// irradiance can also be evaluated on the CPU.
+// Probes loaded from image files also cache their converted environment faces, so once cached the images
+// are never decoded again.
 class LightProbe {
 public:
 	LightProbe(CubeMap* environmentMap);
@@ -20,6 +25,10 @@ public:
 
 	LightProbe* calculateSpecularReflectionMap();
 
+	const SphericalHarmonics9& getIrradianceCoefficients() const;
+
+	const LightProbeData& getPrecomputedData() const;
+
 	CubeMap* getEnvironmentMap() const;
 
 	CubeMap* getDiffuseIrradianceMap() const;
@@ -35,14 +44,22 @@ public:
 	static Texture2D* getBRDFIntegrationMap();
 
 private:
+	bool precompute();
+
+	void uploadEnvironmentMap(const CubeMapImage& environmentImage);
+
+	static bool readEnvironmentMap(CubeMap* environmentMap, CubeMapImage& environmentImage);
+
+	static std::string getCacheFilePath(std::string fileName);
+
 	CubeMap* m_environmentMap; // Direct environment map
 	CubeMap* m_diffuseIrradianceMap; // Irradiance map, each pixel represents the total diffuse light received from that direction
 	CubeMap* m_specularReflectionMap; // Environment map pre-filtered based on the reflection for various roughness values.
+	CubeMapImage m_environmentImage; // CPU copy of the environment map, released once the maps are precomputed
+	LightProbeData m_precomputedData;
+	bool m_precomputed;
+	uint64_t m_sourceHash; // Hash of the source images, the cache is keyed by the decoded texels instead if 0
 
 	static Texture2D* s_BRDFIntegrationMap;
-	static ShaderProgram* s_diffuseIrradianceConvolutionShader;
-	static ShaderProgram* s_specularIrradianceConvolutionShader;
-	static ShaderProgram* s_specularRoughnessConvolutionShader;
-	static ShaderProgram* s_BRDFIntegrationShader;
 };
 
@@ -0,0 +1,854 @@
+#include "LightProbeBaker.h"
+#include "core/Engine.h"
+#include "core/JobSystem.h"
+#include "core/util/FileUtils.h"
+#include "core/util/Hash.h"
+#include <emmintrin.h>
+#include <glm/gtc/packing.hpp>
+
+#define MAX_HALF_FLOAT 65504.0F
+#define HALF_FLOAT_BATCH_SIZE 16384 // Texels converted per job
+
+const uint32_t LightProbeBaker::CACHE_FILE_MAGIC = 0x4250434C; // "LCPB"
+const uint32_t LightProbeBaker::CACHE_FILE_VERSION = 2;
+
+static float radicalInverse(uint32_t bits) {
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return (float)bits * 2.3283064365386963e-10F; // 0x100000000
+}
+
+static vec2 hammersley(uint32_t i, uint32_t n) {
+	return vec2((float)i / (float)n, radicalInverse(i));
+}
+
+// GGX distributed half vector around +z, as sampleSpecularBRDF in UE4BRDF.glsl
+static vec3 sampleGGX(vec2 Xi, float a2) {
+	float phi = 2.0F * glm::pi<float>() * Xi.x;
+	float cosTheta = sqrt((1.0F - Xi.y) / (Xi.y * (a2 - 1.0F) + 1.0F));
+	float sinTheta = sqrt(1.0F - cosTheta * cosTheta);
+	return vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+}
+
+static float getTexelAreaElement(float x, float y) {
+	return atan2(x * y, sqrt(x * x + y * y + 1.0F));
+}
+
+static vec3 getImagePixel(const Image& image, bool floatingPoint, uint32_t x, uint32_t y) {
+	size_t index = ((size_t)y * image.width + x) * image.channels;
+	vec3 pixel = vec3(0.0F);
+	for (uint32_t i = 0; i < glm::min((uint32_t)image.channels, 3u); i++) {
+		pixel[i] = floatingPoint ? reinterpret_cast<const float*>(image.data)[index + i] : image.data[index + i] / 255.0F;
+	}
+	return image.channels == 1 ? vec3(pixel.x) : pixel;
+}
+
+static void packHalfFloats(const std::vector<vec3>& texels, std::vector<uint16_t>& halfFloats) {
+	halfFloats.resize(texels.size() * 3);
+	Engine::jobSystem()->parallelFor(texels.size(), HALF_FLOAT_BATCH_SIZE, [&texels, &halfFloats](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			// Clamped, as the brightest texels of HDR images can be out of the half float range
+			vec3 texel = glm::clamp(texels[i], -MAX_HALF_FLOAT, MAX_HALF_FLOAT);
+			halfFloats[i * 3 + 0] = glm::packHalf1x16(texel.x);
+			halfFloats[i * 3 + 1] = glm::packHalf1x16(texel.y);
+			halfFloats[i * 3 + 2] = glm::packHalf1x16(texel.z);
+		}
+	});
+}
+
+static void unpackHalfFloats(const std::vector<uint16_t>& halfFloats, std::vector<vec3>& texels) {
+	texels.resize(halfFloats.size() / 3);
+	Engine::jobSystem()->parallelFor(texels.size(), HALF_FLOAT_BATCH_SIZE, [&texels, &halfFloats](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			texels[i] = vec3(glm::unpackHalf1x16(halfFloats[i * 3 + 0]), glm::unpackHalf1x16(halfFloats[i * 3 + 1]), glm::unpackHalf1x16(halfFloats[i * 3 + 2]));
+		}
+	});
+}
+
+static void writeCubeMapImage(std::ofstream& stream, const CubeMapImage& image) {
+	std::vector<uint16_t> halfFloats;
+	stream.write(reinterpret_cast<const char*>(&image.size), sizeof(uint32_t));
+	for (int i = 0; i < 6 && image.size != 0; i++) {
+		packHalfFloats(image.faces[i], halfFloats);
+		stream.write(reinterpret_cast<const char*>(&halfFloats[0]), sizeof(uint16_t) * halfFloats.size());
+	}
+}
+
+static bool readCubeMapImage(std::ifstream& stream, CubeMapImage& image) {
+	uint32_t size = 0;
+	stream.read(reinterpret_cast<char*>(&size), sizeof(uint32_t));
+	if (!stream.good() || size > 16384)
+		return false;
+
+	std::vector<uint16_t> halfFloats((size_t)size * size * 3);
+	image.resize(size);
+	for (int i = 0; i < 6 && size != 0; i++) {
+		stream.read(reinterpret_cast<char*>(&halfFloats[0]), sizeof(uint16_t) * halfFloats.size());
+		unpackHalfFloats(halfFloats, image.faces[i]);
+	}
+	return stream.good();
+}
+
+
+
+void CubeMapImage::resize(uint32_t size) {
+	this->size = size;
+	for (int i = 0; i < 6; i++) {
+		faces[i].resize((size_t)size * size);
+		faces[i].shrink_to_fit();
+	}
+}
+
+bool CubeMapImage::empty() const {
+	return size == 0;
+}
+
+vec3& CubeMapImage::at(uint32_t face, uint32_t x, uint32_t y) {
+	return faces[face][(size_t)y * size + x];
+}
+
+const vec3& CubeMapImage::at(uint32_t face, uint32_t x, uint32_t y) const {
+	return faces[face][(size_t)y * size + x];
+}
+
+const vec3& CubeMapImage::sample(vec3 direction) const {
+	vec3 coord = CubeMapImage::getFaceCoordinate(direction);
+	uint32_t x = glm::min((uint32_t)glm::max(coord.x * size, 0.0F), size - 1);
+	uint32_t y = glm::min((uint32_t)glm::max(coord.y * size, 0.0F), size - 1);
+	return this->at((uint32_t)coord.z, x, y);
+}
+
+vec3 CubeMapImage::getDirection(uint32_t face, vec2 textureCoord) {
+	float sc = textureCoord.x * 2.0F - 1.0F;
+	float tc = textureCoord.y * 2.0F - 1.0F;
+	switch ((CubeMapFace)face) {
+		case CubeMapFace::POSITIVE_X: return normalize(vec3(+1.0F, -tc, -sc));
+		case CubeMapFace::NEGATIVE_X: return normalize(vec3(-1.0F, -tc, +sc));
+		case CubeMapFace::POSITIVE_Y: return normalize(vec3(+sc, +1.0F, +tc));
+		case CubeMapFace::NEGATIVE_Y: return normalize(vec3(+sc, -1.0F, -tc));
+		case CubeMapFace::POSITIVE_Z: return normalize(vec3(+sc, -tc, +1.0F));
+		default: return normalize(vec3(-sc, -tc, -1.0F));
+	}
+}
+
+vec3 CubeMapImage::getFaceCoordinate(vec3 direction) {
+	vec3 absDirection = abs(direction);
+	float sc, tc, ma, face;
+
+	if (absDirection.x > absDirection.y && absDirection.x > absDirection.z) { // major axis = x
+		ma = absDirection.x;
+		if (direction.x > 0.0F)
+			sc = -direction.z, tc = -direction.y, face = 0.0F; // positive x
+		else
+			sc = direction.z, tc = -direction.y, face = 1.0F; // negative x
+	} else if (absDirection.y > absDirection.z) { // major axis = y
+		ma = absDirection.y;
+		if (direction.y > 0.0F)
+			sc = direction.x, tc = direction.z, face = 2.0F; // positive y
+		else
+			sc = direction.x, tc = -direction.z, face = 3.0F; // negative y
+	} else { // major axis = z
+		ma = absDirection.z;
+		if (direction.z > 0.0F)
+			sc = direction.x, tc = -direction.y, face = 4.0F; // positive z
+		else
+			sc = -direction.x, tc = -direction.y, face = 5.0F; // negative z
+	}
+
+	return vec3((sc / ma) * 0.5F + 0.5F, (tc / ma) * 0.5F + 0.5F, face);
+}
+
+
+
+void SphericalHarmonics9::getBasis(vec3 direction, float basis[9]) {
+	float x = direction.x, y = direction.y, z = direction.z;
+	basis[0] = 0.282095F;
+	basis[1] = 0.488603F * y;
+	basis[2] = 0.488603F * z;
+	basis[3] = 0.488603F * x;
+	basis[4] = 1.092548F * x * y;
+	basis[5] = 1.092548F * y * z;
+	basis[6] = 0.315392F * (3.0F * z * z - 1.0F);
+	basis[7] = 1.092548F * x * z;
+	basis[8] = 0.546274F * (x * x - y * y);
+}
+
+vec3 SphericalHarmonics9::evaluate(vec3 direction) const {
+	float basis[9];
+	SphericalHarmonics9::getBasis(direction, basis);
+
+	vec3 radiance = vec3(0.0F);
+	for (int i = 0; i < 9; i++) {
+		radiance += coefficients[i] * basis[i];
+	}
+	return radiance;
+}
+
+vec3 SphericalHarmonics9::evaluateIrradiance(vec3 normal) const {
+	// Each band convolved with the clamped cosine lobe (Ramamoorthi and Hanrahan)
+	const float bandScale[3] = { glm::pi<float>(), glm::pi<float>() * 2.0F / 3.0F, glm::pi<float>() * 0.25F };
+
+	float basis[9];
+	SphericalHarmonics9::getBasis(normal, basis);
+
+	vec3 irradiance = coefficients[0] * (basis[0] * bandScale[0]);
+	for (int i = 1; i < 4; i++) {
+		irradiance += coefficients[i] * (basis[i] * bandScale[1]);
+	}
+	for (int i = 4; i < 9; i++) {
+		irradiance += coefficients[i] * (basis[i] * bandScale[2]);
+	}
+	return glm::max(irradiance, vec3(0.0F));
+}
+
+
+
+LightProbeBaker::LightProbeBaker():
+	m_irradianceMapSize(32),
+	m_reflectionMapSize(256),
+	m_reflectionMipCount(6),
+	m_reflectionSampleCount(1024),
+	m_BRDFIntegrationMapSize(1024),
+	m_BRDFIntegrationSampleCount(1024),
+	m_threadCount(0) {
+}
+
+LightProbeBaker::~LightProbeBaker() {
+}
+
+bool LightProbeBaker::loadEnvironmentMap(const CubemapConfiguration& config, CubeMapImage& environmentMap) {
+	if (!config.equirectangularFilePath.empty()) {
+		Image image;
+		if (!FileUtils::loadImage(config.equirectangularFilePath, image, config.verticallyFlip, config.floatingPoint)) {
+			info("Failed to load image file \"%s\"\n", config.equirectangularFilePath.c_str());
+			return false;
+		}
+
+		if (image.channels < 1 || image.channels > 4) {
+			error("Loaded image with unsupported channel configuration\n");
+			return false;
+		}
+
+		LightProbeBaker::convertEquirectangular(image, config.floatingPoint, image.width / 4, environmentMap);
+		return true;
+	}
+
+	std::string filePaths[6];
+	filePaths[(int)CubeMapFace::RIGHT] = config.rightFilePath;
+	filePaths[(int)CubeMapFace::LEFT] = config.leftFilePath;
+	filePaths[(int)CubeMapFace::TOP] = config.topFilePath;
+	filePaths[(int)CubeMapFace::BOTTOM] = config.bottomFilePath;
+	filePaths[(int)CubeMapFace::BACK] = config.backFilePath;
+	filePaths[(int)CubeMapFace::FRONT] = config.frontFilePath;
+
+	for (int i = 0; i < 6; i++) {
+		Image image;
+		if (filePaths[i].empty() || !FileUtils::loadImage(filePaths[i], image, config.verticallyFlip, config.floatingPoint)) {
+			info("Could not load cubemap - face %d was not found\n", i);
+			return false;
+		}
+
+		if (i == 0) {
+			environmentMap.resize(image.width);
+		}
+
+		if (image.width != environmentMap.size || image.height != environmentMap.size || image.channels < 1 || image.channels > 4) {
+			info("Could not load cubemap - face %d is not square or does not match previous faces\n", i);
+			return false;
+		}
+
+		for (uint32_t y = 0; y < image.height; y++) {
+			for (uint32_t x = 0; x < image.width; x++) {
+				environmentMap.at(i, x, y) = getImagePixel(image, config.floatingPoint, x, y);
+			}
+		}
+	}
+
+	return true;
+}
+
+void LightProbeBaker::convertEquirectangular(const Image& image, bool floatingPoint, uint32_t faceSize, CubeMapImage& environmentMap) {
+	const vec2 invAtan = vec2(0.15915494309F, 0.31830988618F);
+	environmentMap.resize(glm::max(faceSize, 1u));
+
+	// Every face texel takes the nearest pixel along its direction, as the equirectangular compute shader
+	uint32_t size = environmentMap.size;
+	Engine::jobSystem()->parallelFor(6 * size, 1, [&image, &environmentMap, floatingPoint, size, invAtan](size_t first, size_t last) {
+		for (size_t row = first; row < last; row++) {
+			uint32_t face = (uint32_t)(row / size);
+			uint32_t y = (uint32_t)(row % size);
+			for (uint32_t x = 0; x < size; x++) {
+				vec3 direction = CubeMapImage::getDirection(face, (vec2(x, y) + 0.5F) / (float)size);
+				vec2 coord = (vec2(atan2(direction.z, direction.x), asin(-direction.y)) * invAtan + 0.5F) * vec2(image.width, image.height);
+				uint32_t px = glm::min((uint32_t)glm::max(coord.x, 0.0F), image.width - 1);
+				uint32_t py = glm::min((uint32_t)glm::max(coord.y, 0.0F), image.height - 1);
+				environmentMap.at(face, x, y) = getImagePixel(image, floatingPoint, px, py);
+			}
+		}
+	});
+}
+
+void LightProbeBaker::downsample(const CubeMapImage& src, CubeMapImage& dst) {
+	if (src.size <= 1) {
+		dst = src;
+		return;
+	}
+
+	dst.resize(src.size / 2);
+	for (uint32_t i = 0; i < 6; i++) {
+		for (uint32_t y = 0; y < dst.size; y++) {
+			for (uint32_t x = 0; x < dst.size; x++) {
+				vec3 sum = src.at(i, x * 2, y * 2) + src.at(i, x * 2 + 1, y * 2) + src.at(i, x * 2, y * 2 + 1) + src.at(i, x * 2 + 1, y * 2 + 1);
+				dst.at(i, x, y) = sum * 0.25F;
+			}
+		}
+	}
+}
+
+uint64_t LightProbeBaker::hashEnvironmentMap(const CubeMapImage& environmentMap) {
+	uint64_t hash = Hash::hashValue(environmentMap.size);
+	for (int i = 0; i < 6; i++) {
+		hash = Hash::hashWords(&environmentMap.faces[i][0], sizeof(vec3) * environmentMap.faces[i].size(), hash);
+	}
+	return hash;
+}
+
+bool LightProbeBaker::hashEnvironmentSource(const CubemapConfiguration& config, uint64_t& hash) {
+	std::vector<std::string> filePaths;
+	if (!config.equirectangularFilePath.empty()) {
+		filePaths.push_back(config.equirectangularFilePath);
+	} else {
+		filePaths = { config.rightFilePath, config.leftFilePath, config.topFilePath, config.bottomFilePath, config.backFilePath, config.frontFilePath };
+	}
+
+	hash = Hash::hashValue((uint32_t)filePaths.size());
+	hash = Hash::hashValue(config.floatingPoint, hash);
+	hash = Hash::hashValue(config.verticallyFlip, hash);
+
+	std::vector<char> buffer(1 << 20);
+	for (size_t i = 0; i < filePaths.size(); i++) {
+		std::ifstream stream(filePaths[i].c_str(), std::ifstream::in | std::ifstream::binary);
+		if (!stream.is_open()) {
+			return false;
+		}
+
+		// Chunks are a multiple of the hashed word size, so the hash does not depend on the chunk size
+		while (stream.good()) {
+			stream.read(&buffer[0], buffer.size());
+			hash = Hash::hashWords(&buffer[0], (size_t)stream.gcount(), hash);
+		}
+	}
+
+	return true;
+}
+
+void LightProbeBaker::bake(const CubeMapImage& environmentMap, LightProbeData& probeData) const {
+	uint64_t t0 = Engine::instance()->getCurrentTime();
+	this->projectSphericalHarmonics(environmentMap, probeData.irradianceCoefficients);
+	this->calculateDiffuseIrradianceMap(probeData.irradianceCoefficients, probeData.diffuseIrradianceMap);
+
+	uint64_t t1 = Engine::instance()->getCurrentTime();
+	this->calculateSpecularReflectionMips(environmentMap, probeData.specularReflectionMips);
+
+	uint64_t t2 = Engine::instance()->getCurrentTime();
+	info("Baked light probe from %u x %u environment map - irradiance took %.2f msec, reflections took %.2f msec\n", environmentMap.size, environmentMap.size, (t1 - t0) / 1000000.0, (t2 - t1) / 1000000.0);
+}
+
+void LightProbeBaker::projectSphericalHarmonics(const CubeMapImage& environmentMap, SphericalHarmonics9& coefficients) const {
+	uint32_t size = environmentMap.size;
+	std::vector<SphericalHarmonics9> rowSums(6 * size);
+	std::vector<float> rowSolidAngles(6 * size);
+
+	// Summed per row and then in row order, so the result does not depend on how rows were split between threads
+	Engine::jobSystem()->parallelFor(6 * size, 1, [&environmentMap, &rowSums, &rowSolidAngles, size](size_t first, size_t last) {
+		float texelSize = 1.0F / size; // Half the texel width in face coordinates, which span [-1, 1]
+		float basis[9];
+
+		for (size_t row = first; row < last; row++) {
+			uint32_t face = (uint32_t)(row / size);
+			uint32_t y = (uint32_t)(row % size);
+			SphericalHarmonics9& sum = rowSums[row];
+			float solidAngleSum = 0.0F;
+			for (int i = 0; i < 9; i++) {
+				sum.coefficients[i] = vec3(0.0F);
+			}
+
+			for (uint32_t x = 0; x < size; x++) {
+				vec2 textureCoord = (vec2(x, y) + 0.5F) / (float)size;
+				float u = textureCoord.x * 2.0F - 1.0F;
+				float v = textureCoord.y * 2.0F - 1.0F;
+				float solidAngle =
+					getTexelAreaElement(u - texelSize, v - texelSize) - getTexelAreaElement(u - texelSize, v + texelSize) -
+					getTexelAreaElement(u + texelSize, v - texelSize) + getTexelAreaElement(u + texelSize, v + texelSize);
+
+				vec3 radiance = environmentMap.at(face, x, y) * solidAngle;
+				SphericalHarmonics9::getBasis(CubeMapImage::getDirection(face, textureCoord), basis);
+				for (int i = 0; i < 9; i++) {
+					sum.coefficients[i] += radiance * basis[i];
+				}
+				solidAngleSum += solidAngle;
+			}
+
+			rowSolidAngles[row] = solidAngleSum;
+		}
+	}, m_threadCount);
+
+	dvec3 sums[9];
+	double solidAngleSum = 0.0;
+	for (int i = 0; i < 9; i++) {
+		sums[i] = dvec3(0.0);
+	}
+
+	for (size_t row = 0; row < rowSums.size(); row++) {
+		for (int i = 0; i < 9; i++) {
+			sums[i] += dvec3(rowSums[row].coefficients[i]);
+		}
+		solidAngleSum += rowSolidAngles[row];
+	}
+
+	// The texel solid angles sum to 4 PI up to rounding, normalizing removes the accumulated error
+	double normalization = solidAngleSum > 0.0 ? 4.0 * glm::pi<double>() / solidAngleSum : 0.0;
+	for (int i = 0; i < 9; i++) {
+		coefficients.coefficients[i] = vec3(sums[i] * normalization);
+	}
+}
+
+void LightProbeBaker::calculateDiffuseIrradianceMap(const SphericalHarmonics9& coefficients, CubeMapImage& irradianceMap) const {
+	const float invPi2 = 1.0F / (glm::pi<float>() * glm::pi<float>());
+	irradianceMap.resize(m_irradianceMapSize);
+
+	for (uint32_t i = 0; i < 6; i++) {
+		for (uint32_t y = 0; y < irradianceMap.size; y++) {
+			for (uint32_t x = 0; x < irradianceMap.size; x++) {
+				vec3 normal = CubeMapImage::getDirection(i, (vec2(x, y) + 0.5F) / (float)irradianceMap.size);
+				irradianceMap.at(i, x, y) = coefficients.evaluateIrradiance(normal) * invPi2;
+			}
+		}
+	}
+}
+
+void LightProbeBaker::calculateSpecularReflectionMips(const CubeMapImage& environmentMap, std::vector<CubeMapImage>& reflectionMips) const {
+	// Filtered importance sampling reads from the whole mip chain of the environment map
+	std::vector<CubeMapImage> downsampledMips;
+	downsampledMips.reserve(32);
+	const CubeMapImage* src = &environmentMap;
+	while (src->size > 1) {
+		downsampledMips.emplace_back();
+		LightProbeBaker::downsample(*src, downsampledMips.back());
+		src = &downsampledMips.back();
+	}
+
+	std::vector<const CubeMapImage*> environmentMips;
+	environmentMips.push_back(&environmentMap);
+	for (size_t i = 0; i < downsampledMips.size(); i++) {
+		environmentMips.push_back(&downsampledMips[i]);
+	}
+
+	reflectionMips.resize(m_reflectionMipCount);
+	for (uint32_t i = 0; i < m_reflectionMipCount; i++) {
+		float roughness = m_reflectionMipCount > 1 ? (float)i / (m_reflectionMipCount - 1) : 0.0F;
+		reflectionMips[i].resize(glm::max(m_reflectionMapSize >> i, 1u));
+		this->prefilterMip(environmentMips, roughness, reflectionMips[i]);
+	}
+}
+
+void LightProbeBaker::prefilterMip(const std::vector<const CubeMapImage*>& environmentMips, float roughness, CubeMapImage& reflectionMip) const {
+	uint32_t size = reflectionMip.size;
+	uint32_t maxLod = (uint32_t)environmentMips.size() - 1;
+
+	if (roughness <= 0.0F) {
+		// A mirror reflects the environment as is, read from the mip closest to the size of this one
+		uint32_t lod = 0;
+		while (lod < maxLod && environmentMips[lod + 1]->size >= size) {
+			++lod;
+		}
+
+		const CubeMapImage& src = *environmentMips[lod];
+		for (uint32_t i = 0; i < 6; i++) {
+			for (uint32_t y = 0; y < size; y++) {
+				for (uint32_t x = 0; x < size; x++) {
+					reflectionMip.at(i, x, y) = src.sample(CubeMapImage::getDirection(i, (vec2(x, y) + 0.5F) / (float)size));
+				}
+			}
+		}
+		return;
+	}
+
+	// Reflected sample directions around +z, with N = V = +z as the shader assumes. Every texel rotates the
+	// same samples to its normal, so their weights and source mips are only calculated once per mip.
+	float a = roughness * roughness;
+	float a2 = a * a;
+	float environmentTexelSolidAngle = 4.0F * glm::pi<float>() / (6.0F * environmentMips[0]->size * environmentMips[0]->size);
+
+	std::vector<float> sampleX, sampleY, sampleZ, sampleWeight;
+	std::vector<uint32_t> sampleLod;
+	float weightSum = 0.0F;
+
+	for (uint32_t i = 0; i < m_reflectionSampleCount; i++) {
+		vec3 H = sampleGGX(hammersley(i, m_reflectionSampleCount), a2);
+		vec3 L = 2.0F * H.z * H - vec3(0.0F, 0.0F, 1.0F);
+		if (L.z <= 0.0F)
+			continue;
+
+		// pdf of L is D(H) * NDotH / (4 * VDotH), which is D(H) / 4 with N = V
+		float f = H.z * H.z * (a2 - 1.0F) + 1.0F;
+		float pdf = a2 / (glm::pi<float>() * f * f) * 0.25F;
+		float sampleSolidAngle = 1.0F / (m_reflectionSampleCount * pdf + 1e-6F);
+		float lod = 0.5F * log2(sampleSolidAngle / environmentTexelSolidAngle) + 1.0F;
+
+		sampleX.push_back(L.x);
+		sampleY.push_back(L.y);
+		sampleZ.push_back(L.z);
+		sampleWeight.push_back(L.z);
+		sampleLod.push_back((uint32_t)glm::clamp(lod + 0.5F, 0.0F, (float)maxLod));
+		weightSum += L.z;
+	}
+
+	// Padding samples point along the normal with no weight, so every block of four is complete
+	while (sampleX.size() % 4 != 0) {
+		sampleX.push_back(0.0F);
+		sampleY.push_back(0.0F);
+		sampleZ.push_back(1.0F);
+		sampleWeight.push_back(0.0F);
+		sampleLod.push_back(0);
+	}
+
+	float invWeightSum = weightSum > 0.0F ? 1.0F / weightSum : 0.0F;
+	size_t sampleCount = sampleX.size();
+
+	Engine::jobSystem()->parallelFor(6 * size, 1, [&environmentMips, &reflectionMip, &sampleX, &sampleY, &sampleZ, &sampleWeight, &sampleLod, size, sampleCount, invWeightSum](size_t first, size_t last) {
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 half = _mm_set1_ps(0.5F);
+		const __m128 one = _mm_set1_ps(1.0F);
+		const __m128 signMask = _mm_set1_ps(-0.0F);
+		alignas(16) float s[4], t[4], face[4];
+
+		for (size_t row = first; row < last; row++) {
+			uint32_t faceIndex = (uint32_t)(row / size);
+			uint32_t y = (uint32_t)(row % size);
+
+			for (uint32_t x = 0; x < size; x++) {
+				vec3 N = CubeMapImage::getDirection(faceIndex, (vec2(x, y) + 0.5F) / (float)size);
+				vec3 W = abs(N.z) < 0.999F ? vec3(0.0F, 0.0F, 1.0F) : vec3(1.0F, 0.0F, 0.0F);
+				vec3 U = normalize(cross(W, N));
+				vec3 V = cross(N, U);
+
+				const __m128 Ux = _mm_set1_ps(U.x), Uy = _mm_set1_ps(U.y), Uz = _mm_set1_ps(U.z);
+				const __m128 Vx = _mm_set1_ps(V.x), Vy = _mm_set1_ps(V.y), Vz = _mm_set1_ps(V.z);
+				const __m128 Nx = _mm_set1_ps(N.x), Ny = _mm_set1_ps(N.y), Nz = _mm_set1_ps(N.z);
+				vec3 sum = vec3(0.0F);
+
+				for (size_t i = 0; i < sampleCount; i += 4) {
+					__m128 lx = _mm_loadu_ps(&sampleX[i]);
+					__m128 ly = _mm_loadu_ps(&sampleY[i]);
+					__m128 lz = _mm_loadu_ps(&sampleZ[i]);
+
+					// Rotate the samples to the texel normal
+					__m128 dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, Ux), _mm_mul_ps(ly, Vx)), _mm_mul_ps(lz, Nx));
+					__m128 dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, Uy), _mm_mul_ps(ly, Vy)), _mm_mul_ps(lz, Ny));
+					__m128 dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, Uz), _mm_mul_ps(ly, Vz)), _mm_mul_ps(lz, Nz));
+
+					// Select the major axis and face coordinates as CubeMapImage::getFaceCoordinate does
+					__m128 ax = _mm_andnot_ps(signMask, dx);
+					__m128 ay = _mm_andnot_ps(signMask, dy);
+					__m128 az = _mm_andnot_ps(signMask, dz);
+					__m128 isX = _mm_and_ps(_mm_cmpgt_ps(ax, ay), _mm_cmpgt_ps(ax, az));
+					__m128 isY = _mm_andnot_ps(isX, _mm_cmpgt_ps(ay, az));
+					__m128 isZ = _mm_andnot_ps(_mm_or_ps(isX, isY), _mm_cmpeq_ps(zero, zero));
+					__m128 posX = _mm_cmpgt_ps(dx, zero);
+					__m128 posY = _mm_cmpgt_ps(dy, zero);
+					__m128 posZ = _mm_cmpgt_ps(dz, zero);
+
+					__m128 ma = _mm_or_ps(_mm_or_ps(_mm_and_ps(isX, ax), _mm_and_ps(isY, ay)), _mm_and_ps(isZ, az));
+					__m128 scX = _mm_xor_ps(dz, _mm_and_ps(posX, signMask)); // -z for +x, z for -x
+					__m128 scZ = _mm_xor_ps(dx, _mm_andnot_ps(posZ, signMask)); // x for +z, -x for -z
+					__m128 sc = _mm_or_ps(_mm_or_ps(_mm_and_ps(isX, scX), _mm_and_ps(isY, dx)), _mm_and_ps(isZ, scZ));
+					__m128 tcY = _mm_xor_ps(dz, _mm_andnot_ps(posY, signMask)); // z for +y, -z for -y
+					__m128 tc = _mm_or_ps(_mm_and_ps(isY, tcY), _mm_andnot_ps(isY, _mm_xor_ps(dy, signMask)));
+					__m128 faceX = _mm_andnot_ps(posX, one);
+					__m128 faceY = _mm_add_ps(_mm_set1_ps(2.0F), _mm_andnot_ps(posY, one));
+					__m128 faceZ = _mm_add_ps(_mm_set1_ps(4.0F), _mm_andnot_ps(posZ, one));
+
+					__m128 invMa = _mm_div_ps(half, ma);
+					_mm_store_ps(s, _mm_add_ps(_mm_mul_ps(sc, invMa), half));
+					_mm_store_ps(t, _mm_add_ps(_mm_mul_ps(tc, invMa), half));
+					_mm_store_ps(face, _mm_or_ps(_mm_or_ps(_mm_and_ps(isX, faceX), _mm_and_ps(isY, faceY)), _mm_and_ps(isZ, faceZ)));
+
+					for (int j = 0; j < 4; j++) {
+						const CubeMapImage& src = *environmentMips[sampleLod[i + j]];
+						uint32_t sx = glm::min((uint32_t)glm::max(s[j] * src.size, 0.0F), src.size - 1);
+						uint32_t sy = glm::min((uint32_t)glm::max(t[j] * src.size, 0.0F), src.size - 1);
+						sum += src.at((uint32_t)face[j], sx, sy) * sampleWeight[i + j];
+					}
+				}
+
+				reflectionMip.at(faceIndex, x, y) = sum * invWeightSum;
+			}
+		}
+	}, m_threadCount);
+}
+
+void LightProbeBaker::calculateBRDFIntegrationMap(std::vector<vec2>& integrationMap) const {
+	uint32_t size = m_BRDFIntegrationMapSize;
+	uint32_t sampleCount = m_BRDFIntegrationSampleCount;
+	integrationMap.resize((size_t)size * size);
+
+	uint64_t t0 = Engine::instance()->getCurrentTime();
+
+	Engine::jobSystem()->parallelFor(size, 1, [&integrationMap, size, sampleCount](size_t first, size_t last) {
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0F);
+		const __m128 two = _mm_set1_ps(2.0F);
+
+		// Half vectors only matter in the plane of V and N, padded with zero vectors which never reflect above the surface
+		size_t paddedSampleCount = (sampleCount + 3) & ~3u;
+		std::vector<float> halfX(paddedSampleCount, 0.0F);
+		std::vector<float> halfZ(paddedSampleCount, 0.0F);
+		alignas(16) float scaleSums[4], biasSums[4];
+
+		for (size_t row = first; row < last; row++) {
+			float a = (row + 0.5F) / size; // Not squared here, the x coordinate is squared when sampling this LUT
+			float a2 = a * a;
+			float k = a2 * 0.5F;
+
+			for (uint32_t i = 0; i < sampleCount; i++) {
+				vec3 H = sampleGGX(hammersley(i, sampleCount), a2);
+				halfX[i] = H.x;
+				halfZ[i] = H.z;
+			}
+
+			const __m128 k4 = _mm_set1_ps(k);
+			const __m128 oneMinusK = _mm_set1_ps(1.0F - k);
+
+			for (uint32_t x = 0; x < size; x++) {
+				float NDotV = (x + 0.5F) / size;
+				float GV = NDotV / (NDotV * (1.0F - k) + k);
+				const __m128 Vx = _mm_set1_ps(sqrt(1.0F - NDotV * NDotV));
+				const __m128 Vz = _mm_set1_ps(NDotV);
+				const __m128 GVOverNDotV = _mm_set1_ps(GV / NDotV);
+				__m128 scale = zero;
+				__m128 bias = zero;
+
+				for (size_t i = 0; i < paddedSampleCount; i += 4) {
+					__m128 Hx = _mm_loadu_ps(&halfX[i]);
+					__m128 Hz = _mm_loadu_ps(&halfZ[i]);
+					__m128 VDotH = _mm_add_ps(_mm_mul_ps(Vx, Hx), _mm_mul_ps(Vz, Hz));
+					__m128 NDotL = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(two, VDotH), Hz), Vz);
+					__m128 mask = _mm_cmpgt_ps(NDotL, zero);
+					VDotH = _mm_max_ps(VDotH, zero);
+
+					// G_Vis = G * VDotH / (NDotH * NDotV), with the NDotV half of G factored out
+					__m128 GL = _mm_div_ps(NDotL, _mm_add_ps(_mm_mul_ps(NDotL, oneMinusK), k4));
+					__m128 GVis = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(GL, GVOverNDotV), VDotH), _mm_or_ps(Hz, _mm_andnot_ps(mask, one)));
+					__m128 f1 = _mm_sub_ps(one, VDotH);
+					__m128 f2 = _mm_mul_ps(f1, f1);
+					__m128 Fc = _mm_mul_ps(_mm_mul_ps(f2, f2), f1);
+
+					scale = _mm_add_ps(scale, _mm_and_ps(mask, _mm_mul_ps(_mm_sub_ps(one, Fc), GVis)));
+					bias = _mm_add_ps(bias, _mm_and_ps(mask, _mm_mul_ps(Fc, GVis)));
+				}
+
+				_mm_store_ps(scaleSums, scale);
+				_mm_store_ps(biasSums, bias);
+				vec2 texel = vec2(scaleSums[0] + scaleSums[1] + scaleSums[2] + scaleSums[3], biasSums[0] + biasSums[1] + biasSums[2] + biasSums[3]);
+				integrationMap[row * size + x] = texel / (float)sampleCount;
+			}
+		}
+	}, m_threadCount);
+
+	uint64_t t1 = Engine::instance()->getCurrentTime();
+	info("Integrated %u x %u BRDF map - Took %.2f msec\n", size, size, (t1 - t0) / 1000000.0);
+}
+
+uint64_t LightProbeBaker::getCacheKey(uint64_t environmentMapHash) const {
+	uint64_t hash = Hash::hashValue(CACHE_FILE_VERSION);
+	hash = Hash::hashValue(environmentMapHash, hash);
+	hash = Hash::hashValue(m_irradianceMapSize, hash);
+	hash = Hash::hashValue(m_reflectionMapSize, hash);
+	hash = Hash::hashValue(m_reflectionMipCount, hash);
+	hash = Hash::hashValue(m_reflectionSampleCount, hash);
+	return hash;
+}
+
+uint64_t LightProbeBaker::getBRDFIntegrationCacheKey() const {
+	uint64_t hash = Hash::hashString("BRDFIntegrationMap", Hash::hashValue(CACHE_FILE_VERSION));
+	hash = Hash::hashValue(m_BRDFIntegrationMapSize, hash);
+	hash = Hash::hashValue(m_BRDFIntegrationSampleCount, hash);
+	return hash;
+}
+
+bool LightProbeBaker::loadCache(std::string filePath, uint64_t key, LightProbeData& probeData) {
+	std::ifstream stream(filePath.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (!stream.is_open()) {
+		return false; // Not cached yet
+	}
+
+	uint32_t magic = 0, version = 0;
+	uint64_t fileKey = 0;
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+	stream.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+	stream.read(reinterpret_cast<char*>(&fileKey), sizeof(uint64_t));
+	if (!stream.good() || magic != CACHE_FILE_MAGIC || version != CACHE_FILE_VERSION || fileKey != key) {
+		warn("Ignoring stale light probe cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	uint32_t mipCount = 0;
+	bool loaded = readCubeMapImage(stream, probeData.environmentMap);
+	stream.read(reinterpret_cast<char*>(&probeData.irradianceCoefficients.coefficients[0]), sizeof(vec3) * 9);
+	loaded = loaded && readCubeMapImage(stream, probeData.diffuseIrradianceMap);
+	stream.read(reinterpret_cast<char*>(&mipCount), sizeof(uint32_t));
+	loaded = loaded && stream.good() && mipCount <= 32;
+
+	probeData.specularReflectionMips.resize(loaded ? mipCount : 0);
+	for (uint32_t i = 0; loaded && i < mipCount; i++) {
+		loaded = readCubeMapImage(stream, probeData.specularReflectionMips[i]);
+	}
+
+	if (!loaded) {
+		warn("Ignoring truncated light probe cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	info("Loaded light probe from cache \"%s\"\n", filePath.c_str());
+	return true;
+}
+
+bool LightProbeBaker::saveCache(std::string filePath, uint64_t key, const LightProbeData& probeData) {
+	std::ofstream stream(filePath.c_str(), std::ofstream::out | std::ofstream::binary);
+	if (!stream.is_open()) {
+		error("Failed to open light probe cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	uint32_t mipCount = probeData.specularReflectionMips.size();
+	stream.write(reinterpret_cast<const char*>(&CACHE_FILE_MAGIC), sizeof(uint32_t));
+	stream.write(reinterpret_cast<const char*>(&CACHE_FILE_VERSION), sizeof(uint32_t));
+	stream.write(reinterpret_cast<const char*>(&key), sizeof(uint64_t));
+	writeCubeMapImage(stream, probeData.environmentMap);
+	stream.write(reinterpret_cast<const char*>(&probeData.irradianceCoefficients.coefficients[0]), sizeof(vec3) * 9);
+	writeCubeMapImage(stream, probeData.diffuseIrradianceMap);
+	stream.write(reinterpret_cast<const char*>(&mipCount), sizeof(uint32_t));
+	for (uint32_t i = 0; i < mipCount; i++) {
+		writeCubeMapImage(stream, probeData.specularReflectionMips[i]);
+	}
+
+	if (!stream.good()) {
+		error("Failed to write light probe cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool LightProbeBaker::loadBRDFIntegrationCache(std::string filePath, uint64_t key, uint32_t size, std::vector<vec2>& integrationMap) {
+	std::ifstream stream(filePath.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (!stream.is_open()) {
+		return false; // Not cached yet
+	}
+
+	uint32_t magic = 0, version = 0, fileSize = 0;
+	uint64_t fileKey = 0;
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+	stream.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+	stream.read(reinterpret_cast<char*>(&fileKey), sizeof(uint64_t));
+	stream.read(reinterpret_cast<char*>(&fileSize), sizeof(uint32_t));
+	if (!stream.good() || magic != CACHE_FILE_MAGIC || version != CACHE_FILE_VERSION || fileKey != key || fileSize != size) {
+		warn("Ignoring stale BRDF integration map cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	integrationMap.resize((size_t)size * size);
+	stream.read(reinterpret_cast<char*>(&integrationMap[0]), sizeof(vec2) * integrationMap.size());
+	if (!stream.good()) {
+		warn("Ignoring truncated BRDF integration map cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool LightProbeBaker::saveBRDFIntegrationCache(std::string filePath, uint64_t key, uint32_t size, const std::vector<vec2>& integrationMap) {
+	if (integrationMap.size() != (size_t)size * size) {
+		error("Unable to write %llu texels as a %u x %u BRDF integration map\n", (unsigned long long)integrationMap.size(), size, size);
+		return false;
+	}
+
+	std::ofstream stream(filePath.c_str(), std::ofstream::out | std::ofstream::binary);
+	if (!stream.is_open()) {
+		error("Failed to open BRDF integration map cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	stream.write(reinterpret_cast<const char*>(&CACHE_FILE_MAGIC), sizeof(uint32_t));
+	stream.write(reinterpret_cast<const char*>(&CACHE_FILE_VERSION), sizeof(uint32_t));
+	stream.write(reinterpret_cast<const char*>(&key), sizeof(uint64_t));
+	stream.write(reinterpret_cast<const char*>(&size), sizeof(uint32_t));
+	stream.write(reinterpret_cast<const char*>(&integrationMap[0]), sizeof(vec2) * integrationMap.size());
+
+	if (!stream.good()) {
+		error("Failed to write BRDF integration map cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t LightProbeBaker::getIrradianceMapSize() const {
+	return m_irradianceMapSize;
+}
+
+void LightProbeBaker::setIrradianceMapSize(uint32_t irradianceMapSize) {
+	m_irradianceMapSize = glm::max(irradianceMapSize, 1u);
+}
+
+uint32_t LightProbeBaker::getReflectionMapSize() const {
+	return m_reflectionMapSize;
+}
+
+void LightProbeBaker::setReflectionMapSize(uint32_t reflectionMapSize) {
+	m_reflectionMapSize = glm::max(reflectionMapSize, 1u);
+}
+
+uint32_t LightProbeBaker::getReflectionMipCount() const {
+	return m_reflectionMipCount;
+}
+
+void LightProbeBaker::setReflectionMipCount(uint32_t reflectionMipCount) {
+	m_reflectionMipCount = glm::max(reflectionMipCount, 1u);
+}
+
+uint32_t LightProbeBaker::getReflectionSampleCount() const {
+	return m_reflectionSampleCount;
+}
+
+void LightProbeBaker::setReflectionSampleCount(uint32_t reflectionSampleCount) {
+	m_reflectionSampleCount = glm::max(reflectionSampleCount, 1u);
+}
+
+uint32_t LightProbeBaker::getBRDFIntegrationMapSize() const {
+	return m_BRDFIntegrationMapSize;
+}
+
+void LightProbeBaker::setBRDFIntegrationMapSize(uint32_t BRDFIntegrationMapSize) {
+	m_BRDFIntegrationMapSize = glm::max(BRDFIntegrationMapSize, 1u);
+}
+
+uint32_t LightProbeBaker::getBRDFIntegrationSampleCount() const {
+	return m_BRDFIntegrationSampleCount;
+}
+
+void LightProbeBaker::setBRDFIntegrationSampleCount(uint32_t BRDFIntegrationSampleCount) {
+	m_BRDFIntegrationSampleCount = glm::max(BRDFIntegrationSampleCount, 1u);
+}
+
+uint32_t LightProbeBaker::getThreadCount() const {
+	return m_threadCount;
+}
+
+void LightProbeBaker::setThreadCount(uint32_t threadCount) {
+	m_threadCount = threadCount;
+}
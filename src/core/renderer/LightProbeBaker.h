@@ -0,0 +1,152 @@
+#pragma once
+
+#include "core/pch.h"
+#include "core/renderer/CubeMap.h"
+
+struct Image;
+
+// Cube map held in memory as RGB floats. Faces are in CubeMapFace order and their rows are in the order
+// they are uploaded to GL, so face texel (x, y) looks along the direction GL samples it at.
+struct CubeMapImage {
+	uint32_t size = 0; // Width and height of every face
+	std::vector<vec3> faces[6];
+
+	void resize(uint32_t size);
+
+	bool empty() const;
+
+	vec3& at(uint32_t face, uint32_t x, uint32_t y);
+
+	const vec3& at(uint32_t face, uint32_t x, uint32_t y) const;
+
+	const vec3& sample(vec3 direction) const;
+
+	// Normalized direction through the given texture coordinate of a face
+	static vec3 getDirection(uint32_t face, vec2 textureCoord);
+
+	// Texture coordinate (x, y) and face index (z) the direction passes through, as in getCubemapCoordinate
+	static vec3 getFaceCoordinate(vec3 direction);
+};
+
+// Order 2 (9 coefficient) spherical harmonic projection of the radiance of an environment map.
+struct SphericalHarmonics9 {
+	vec3 coefficients[9];
+
+	static void getBasis(vec3 direction, float basis[9]);
+
+	// Radiance in the direction, band limited to the projection
+	vec3 evaluate(vec3 direction) const;
+
+	// Irradiance reaching a surface facing the normal, the radiance convolved with the clamped cosine lobe
+	vec3 evaluateIrradiance(vec3 normal) const;
+};
+
+// Everything a light probe precomputes from its environment map, as stored in the cache.
+struct LightProbeData {
+	CubeMapImage environmentMap; // Converted environment faces, only cached for probes keyed by their source images
+	SphericalHarmonics9 irradianceCoefficients;
+	CubeMapImage diffuseIrradianceMap;
+	std::vector<CubeMapImage> specularReflectionMips; // Mip 0 first, mip i filtered for roughness i / (count - 1)
+};
+
+// CPU precomputation of the image based lighting maps of light probes, replacing the compute shader
+// convolutions so probes can be built without a GPU and loaded back from the disk cache instantly.
+// Diffuse irradiance is projected onto 9 spherical harmonic coefficients, which makes irradiance a
+// constant time evaluation rather than a hemisphere integral per texel. The irradiance map is only
+// evaluated from the coefficients, and stores irradiance / PI^2, the convolution lighting.glsl expects
+// (it multiplies by albedo * PI).
+// The specular reflection mips are filtered with GGX importance sampling, reading every sample from the
+// mip of the environment map whose texels cover about the solid angle of the sample (filtered importance
+// sampling), so far fewer samples than the shader used converge without fireflies. Four samples are
+// rotated to the texel and projected to cube map coordinates at once with SSE. The BRDF integration map
+// is integrated the same way, four samples at once.
+// Rows of texels are split between the job system threads. Results do not depend on the thread count.
+// The probe cache holds the converted environment faces and every precomputed map of a probe in one file,
+// as half floats. Keyed by a hash of the source image files rather than their decoded texels, a cached
+// probe is read and uploaded without decoding the images at all.
+class LightProbeBaker : private NotCopyable {
+public:
+	LightProbeBaker();
+
+	~LightProbeBaker();
+
+	// Loads the environment map images on the CPU, converting equirectangular images to faces a quarter of
+	// the image width in size, as CubeMap::loadEquirectangular does on the GPU
+	static bool loadEnvironmentMap(const CubemapConfiguration& config, CubeMapImage& environmentMap);
+
+	static void convertEquirectangular(const Image& image, bool floatingPoint, uint32_t faceSize, CubeMapImage& environmentMap);
+
+	// Halves the size of every face, averaging 2x2 texel blocks
+	static void downsample(const CubeMapImage& src, CubeMapImage& dst);
+
+	static uint64_t hashEnvironmentMap(const CubeMapImage& environmentMap);
+
+	// Hashes the bytes of the image files the configuration loads, and the options they are loaded with
+	static bool hashEnvironmentSource(const CubemapConfiguration& config, uint64_t& hash);
+
+	void bake(const CubeMapImage& environmentMap, LightProbeData& probeData) const;
+
+	void projectSphericalHarmonics(const CubeMapImage& environmentMap, SphericalHarmonics9& coefficients) const;
+
+	void calculateDiffuseIrradianceMap(const SphericalHarmonics9& coefficients, CubeMapImage& irradianceMap) const;
+
+	void calculateSpecularReflectionMips(const CubeMapImage& environmentMap, std::vector<CubeMapImage>& reflectionMips) const;
+
+	// Row major, NDotV along x and GGX alpha along y, scale and bias of F0 in each texel
+	void calculateBRDFIntegrationMap(std::vector<vec2>& integrationMap) const;
+
+	// Key of the probe data baked from the environment map with the current settings
+	uint64_t getCacheKey(uint64_t environmentMapHash) const;
+
+	uint64_t getBRDFIntegrationCacheKey() const;
+
+	static bool loadCache(std::string filePath, uint64_t key, LightProbeData& probeData);
+
+	static bool saveCache(std::string filePath, uint64_t key, const LightProbeData& probeData);
+
+	static bool loadBRDFIntegrationCache(std::string filePath, uint64_t key, uint32_t size, std::vector<vec2>& integrationMap);
+
+	static bool saveBRDFIntegrationCache(std::string filePath, uint64_t key, uint32_t size, const std::vector<vec2>& integrationMap);
+
+	uint32_t getIrradianceMapSize() const;
+
+	void setIrradianceMapSize(uint32_t irradianceMapSize);
+
+	uint32_t getReflectionMapSize() const;
+
+	void setReflectionMapSize(uint32_t reflectionMapSize);
+
+	uint32_t getReflectionMipCount() const;
+
+	void setReflectionMipCount(uint32_t reflectionMipCount);
+
+	uint32_t getReflectionSampleCount() const;
+
+	void setReflectionSampleCount(uint32_t reflectionSampleCount);
+
+	uint32_t getBRDFIntegrationMapSize() const;
+
+	void setBRDFIntegrationMapSize(uint32_t BRDFIntegrationMapSize);
+
+	uint32_t getBRDFIntegrationSampleCount() const;
+
+	void setBRDFIntegrationSampleCount(uint32_t BRDFIntegrationSampleCount);
+
+	uint32_t getThreadCount() const;
+
+	void setThreadCount(uint32_t threadCount);
+
+	static const uint32_t CACHE_FILE_MAGIC;
+	static const uint32_t CACHE_FILE_VERSION;
+
+private:
+	void prefilterMip(const std::vector<const CubeMapImage*>& environmentMips, float roughness, CubeMapImage& reflectionMip) const;
+
+	uint32_t m_irradianceMapSize;
+	uint32_t m_reflectionMapSize; // Size of reflection mip 0
+	uint32_t m_reflectionMipCount;
+	uint32_t m_reflectionSampleCount; // GGX samples per texel of the rough reflection mips
+	uint32_t m_BRDFIntegrationMapSize;
+	uint32_t m_BRDFIntegrationSampleCount;
+	uint32_t m_threadCount; // 0 uses every thread of the job system
+};
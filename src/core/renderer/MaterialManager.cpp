@@ -1,11 +1,60 @@
 #include "MaterialManager.h"
+#include "core/renderer/VirtualTexture.h"
+#include "core/renderer/ShaderProgram.h"
+#include "core/Engine.h"
+
+#define VIRTUAL_TEXTURE_FEEDBACK_READBACK_COUNT 3
 
 MaterialManager::MaterialManager() {
+	m_virtualTextureFeedbackCapacity = 65536;
+	m_virtualTextureFrame = 0;
+	m_materialBuffer = 0;
+	m_virtualTextureFeedbackBuffer = 0;
+
+	if (!Engine::isGLAvailable())
+		return; // Headless, materials are loaded but never uploaded
+
 	glGenBuffers(1, &m_materialBuffer);
+
+	// Header of 4 uints (count, capacity, padding) followed by uvec2(virtualTextureIndex, pageId) entries.
+	std::vector<uint32_t> feedbackHeader = { 0, m_virtualTextureFeedbackCapacity, 0, 0 };
+	uint32_t feedbackBufferSize = sizeof(uint32_t) * (4 + 2 * m_virtualTextureFeedbackCapacity);
+	glGenBuffers(1, &m_virtualTextureFeedbackBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_virtualTextureFeedbackBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, feedbackBufferSize, NULL, GL_DYNAMIC_COPY);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t) * 4, &feedbackHeader[0]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	m_virtualTextureFeedbackReadbacks.resize(VIRTUAL_TEXTURE_FEEDBACK_READBACK_COUNT);
+	for (int i = 0; i < m_virtualTextureFeedbackReadbacks.size(); i++) {
+		VirtualTextureFeedbackReadback& readback = m_virtualTextureFeedbackReadbacks[i];
+		readback.fence = NULL;
+		readback.frame = 0;
+		glGenBuffers(1, &readback.buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, feedbackBufferSize, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 }
 
 MaterialManager::~MaterialManager() {
-	glDeleteBuffers(1, &m_materialBuffer);
+	if (m_materialBuffer != 0) {
+		glDeleteBuffers(1, &m_materialBuffer);
+		glDeleteBuffers(1, &m_virtualTextureFeedbackBuffer);
+	}
+
+	for (int i = 0; i < m_virtualTextureFeedbackReadbacks.size(); i++) {
+		if (m_virtualTextureFeedbackReadbacks[i].fence != NULL) {
+			glDeleteSync(m_virtualTextureFeedbackReadbacks[i].fence);
+		}
+		glDeleteBuffers(1, &m_virtualTextureFeedbackReadbacks[i].buffer);
+	}
+
+	for (int i = 0; i < m_virtualTextures.size(); i++) {
+		delete m_virtualTextures[i].virtualTexture;
+		delete m_virtualTextures[i].physicalCache;
+		glDeleteTextures(1, &m_virtualTextures[i].pageTableTexture);
+	}
 }
 
 uint32_t MaterialManager::loadNamedMaterial(std::string materialName, MaterialConfiguration& materialConfiguration) {
@@ -38,6 +87,61 @@ uint32_t MaterialManager::getMaterialCount() const {
 	return m_materials.size();
 }
 
+PackedMaterial MaterialManager::packMaterial(uint32_t materialIndex) const {
+	assert(materialIndex < m_materials.size());
+
+	PackedMaterial packedMaterial;
+	memset(&packedMaterial, 0, sizeof(PackedMaterial));
+	Material* material = m_materials[materialIndex];
+
+	bool hasAlbedoTexture = material->getAlbedoMap() != NULL;
+	bool hasNormalTexture = material->getNormalMap() != NULL;
+	bool hasRoughnessTexture = material->getRoughnessMap() != NULL;
+	bool hasMetalnessTexture = material->getMetalnessMap() != NULL;
+	bool hasAmbientOcclusionTexture = material->getAmbientOcclusionMap() != NULL;
+	bool hasAlphaTexture = material->getAlphaMap() != NULL;
+
+	if (Engine::isGLAvailable()) { // Bindless handles only exist with a GL context, the flags are still set without one
+		if (hasAlbedoTexture) packedMaterial.albedoTextureHandle = material->getAlbedoMap()->getTextureHandle();
+		if (hasNormalTexture) packedMaterial.normalTextureHandle = material->getNormalMap()->getTextureHandle();
+		if (hasRoughnessTexture) packedMaterial.roughnessTextureHandle = material->getRoughnessMap()->getTextureHandle();
+		if (hasMetalnessTexture) packedMaterial.metalnessTextureHandle = material->getMetalnessMap()->getTextureHandle();
+		if (hasAmbientOcclusionTexture) packedMaterial.ambientOcclusionTextureHandle = material->getAmbientOcclusionMap()->getTextureHandle();
+		if (hasAlphaTexture) packedMaterial.alphaTextureHandle = material->getAlphaMap()->getTextureHandle();
+	}
+
+	packedMaterial.albedoRGBA = u8vec4(clamp(dvec4(material->getAlbedo(), 1.0) * 255.0, 0.0, 255.0));
+	packedMaterial.transmissionRGBA = u8vec4(clamp(dvec4(material->getTransmission(), 1.0) * 255.0, 0.0, 255.0));
+	packedMaterial.emissionR16 = u16vec1(clamp(material->getEmission().r * 256.0, 0.0, 65535.0));
+	packedMaterial.emissionG16 = u16vec1(clamp(material->getEmission().g * 256.0, 0.0, 65535.0));
+	packedMaterial.emissionB16 = u16vec1(clamp(material->getEmission().b * 256.0, 0.0, 65535.0));
+	packedMaterial.roughnessR8 = u8vec1(clamp(material->getRoughness() * 255.0, 0.0, 255.0));
+	packedMaterial.metalnessR8 = u8vec1(clamp(material->getMetalness() * 255.0, 0.0, 255.0));
+
+	packedMaterial.flags = 0u;
+	packedMaterial.flags |= (hasAlbedoTexture ? 1 : 0) << 0;
+	packedMaterial.flags |= (hasNormalTexture ? 1 : 0) << 1;
+	packedMaterial.flags |= (hasRoughnessTexture ? 1 : 0) << 2;
+	packedMaterial.flags |= (hasMetalnessTexture ? 1 : 0) << 3;
+	packedMaterial.flags |= (hasAmbientOcclusionTexture ? 1 : 0) << 4;
+	packedMaterial.flags |= (hasAlphaTexture ? 1 : 0) << 5;
+	packedMaterial.flags |= (material->isTransparent() ? 1 : 0) << 6;
+	packedMaterial.flags |= (material->isRoughnessInverted() ? 1 : 0) << 7;
+
+	return packedMaterial;
+}
+
+std::vector<PackedMaterial> MaterialManager::getPackedMaterials() const {
+	std::vector<PackedMaterial> packedMaterials;
+	packedMaterials.resize(m_materials.size());
+
+	for (int i = 0; i < m_materials.size(); i++) {
+		packedMaterials[i] = this->packMaterial(i);
+	}
+
+	return packedMaterials;
+}
+
 void MaterialManager::bindMaterialBuffer(uint32_t index) {
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_materialBuffer);
 }
@@ -48,60 +152,192 @@ void MaterialManager::render(double dt, double partialTicks) {
 	for (int i = 0; i < m_materials.size(); i++) {
 		m_materials[i]->makeResident(true);
 	}
+
+	this->updateVirtualTextures();
 }
 
 void MaterialManager::applyUniforms(ShaderProgram* shaderProgram) {
 	
 }
 
+uint32_t MaterialManager::loadVirtualTexture(std::string pageFilePath, uint32_t physicalSlotsX, uint32_t physicalSlotsY) {
+	if (!Engine::isGLAvailable())
+		return (uint32_t)(-1);
+
+	VirtualTexture* virtualTexture = NULL;
+	if (!VirtualTexture::load(pageFilePath, &virtualTexture, physicalSlotsX, physicalSlotsY)) {
+		return (uint32_t)(-1);
+	}
+
+	VirtualTexturePageFile* pageFile = virtualTexture->getPageFile();
+	uint32_t paddedPageSize = pageFile->getPaddedPageSize();
+
+	VirtualTextureResources resources;
+	resources.virtualTexture = virtualTexture;
+	resources.physicalCache = new Texture2D(physicalSlotsX * paddedPageSize, physicalSlotsY * paddedPageSize, TextureFormat::R8_G8_B8_A8_UNORM, TextureFilter::LINEAR_PIXEL, TextureFilter::LINEAR_PIXEL, TextureWrap::CLAMP_TO_EDGE, TextureWrap::CLAMP_TO_EDGE);
+
+	glGenTextures(1, &resources.pageTableTexture);
+	glBindTexture(GL_TEXTURE_2D, resources.pageTableTexture);
+	glTexStorage2D(GL_TEXTURE_2D, pageFile->getMipCount(), GL_R32UI, pageFile->getPageCountX(0), pageFile->getPageCountY(0));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_virtualTextures.push_back(resources);
+	return m_virtualTextures.size() - 1;
+}
+
+VirtualTexture* MaterialManager::getVirtualTexture(uint32_t virtualTextureIndex) {
+	assert(virtualTextureIndex < m_virtualTextures.size());
+	return m_virtualTextures[virtualTextureIndex].virtualTexture;
+}
+
+uint32_t MaterialManager::getVirtualTextureCount() const {
+	return m_virtualTextures.size();
+}
+
+void MaterialManager::bindVirtualTexture(ShaderProgram* shaderProgram, std::string uniformName, uint32_t virtualTextureIndex, int32_t textureUnit) {
+	assert(virtualTextureIndex < m_virtualTextures.size());
+	VirtualTextureResources& resources = m_virtualTextures[virtualTextureIndex];
+	VirtualTexturePageFile* pageFile = resources.virtualTexture->getPageFile();
+
+	resources.physicalCache->bind(textureUnit + 0);
+	glActiveTexture(GL_TEXTURE0 + textureUnit + 1);
+	glBindTexture(GL_TEXTURE_2D, resources.pageTableTexture);
+
+	shaderProgram->setUniform(uniformName + ".physicalCache", textureUnit + 0);
+	shaderProgram->setUniform(uniformName + ".pageTable", textureUnit + 1);
+	shaderProgram->setUniform(uniformName + ".index", (int32_t)virtualTextureIndex);
+	shaderProgram->setUniform(uniformName + ".size", ivec2(pageFile->getWidth(), pageFile->getHeight()));
+	shaderProgram->setUniform(uniformName + ".physicalSize", ivec2(resources.physicalCache->getWidth(), resources.physicalCache->getHeight()));
+	shaderProgram->setUniform(uniformName + ".pageSize", (int32_t)pageFile->getPageSize());
+	shaderProgram->setUniform(uniformName + ".pageBorder", (int32_t)pageFile->getPageBorder());
+	shaderProgram->setUniform(uniformName + ".mipCount", (int32_t)pageFile->getMipCount());
+	shaderProgram->setUniform("virtualTextureFeedbackJitter", ivec2(m_virtualTextureFrame % 4, (m_virtualTextureFrame / 4) % 4));
+}
+
+void MaterialManager::bindVirtualTextureFeedbackBuffer(uint32_t index) {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_virtualTextureFeedbackBuffer);
+}
+
 void MaterialManager::initializeMaterialBuffer() {
 	if (m_materialCount != m_materials.size()) {
 		m_materialCount = m_materials.size();
 
-		std::vector<PackedMaterial> packedMaterials;
-		packedMaterials.resize(m_materials.size());
-
-		for (int i = 0; i < m_materials.size(); i++) {
-			PackedMaterial packedMaterial;
-			Material* material = m_materials[i];
-
-			bool hasAlbedoTexture = material->getAlbedoMap() != NULL;
-			bool hasNormalTexture = material->getNormalMap() != NULL;
-			bool hasRoughnessTexture = material->getRoughnessMap() != NULL;
-			bool hasMetalnessTexture = material->getMetalnessMap() != NULL;
-			bool hasAmbientOcclusionTexture = material->getAmbientOcclusionMap() != NULL;
-			bool hasAlphaTexture = material->getAlphaMap() != NULL;
-
-			if (hasAlbedoTexture) packedMaterial.albedoTextureHandle = material->getAlbedoMap()->getTextureHandle();
-			if (hasNormalTexture) packedMaterial.normalTextureHandle = material->getNormalMap()->getTextureHandle();
-			if (hasRoughnessTexture) packedMaterial.roughnessTextureHandle = material->getRoughnessMap()->getTextureHandle();
-			if (hasMetalnessTexture) packedMaterial.metalnessTextureHandle = material->getMetalnessMap()->getTextureHandle();
-			if (hasAmbientOcclusionTexture) packedMaterial.ambientOcclusionTextureHandle = material->getAmbientOcclusionMap()->getTextureHandle();
-			if (hasAlphaTexture) packedMaterial.alphaTextureHandle = material->getAlphaMap()->getTextureHandle();
-
-			packedMaterial.albedoRGBA = u8vec4(clamp(dvec4(material->getAlbedo(), 1.0) * 255.0, 0.0, 255.0));
-			packedMaterial.transmissionRGBA = u8vec4(clamp(dvec4(material->getTransmission(), 1.0) * 255.0, 0.0, 255.0));
-			packedMaterial.emissionR16 = u16vec1(clamp(material->getEmission().r * 256.0, 0.0, 65535.0));
-			packedMaterial.emissionG16 = u16vec1(clamp(material->getEmission().g * 256.0, 0.0, 65535.0));
-			packedMaterial.emissionB16 = u16vec1(clamp(material->getEmission().b * 256.0, 0.0, 65535.0));
-			packedMaterial.roughnessR8 = u8vec1(clamp(material->getRoughness() * 255.0, 0.0, 255.0));
-			packedMaterial.metalnessR8 = u8vec1(clamp(material->getMetalness() * 255.0, 0.0, 255.0));
-
-			packedMaterial.flags = 0u;
-			packedMaterial.flags |= (hasAlbedoTexture ? 1 : 0) << 0;
-			packedMaterial.flags |= (hasNormalTexture ? 1 : 0) << 1;
-			packedMaterial.flags |= (hasRoughnessTexture ? 1 : 0) << 2;
-			packedMaterial.flags |= (hasMetalnessTexture ? 1 : 0) << 3;
-			packedMaterial.flags |= (hasAmbientOcclusionTexture ? 1 : 0) << 4;
-			packedMaterial.flags |= (hasAlphaTexture ? 1 : 0) << 5;
-			packedMaterial.flags |= (material->isTransparent() ? 1 : 0) << 6;
-			packedMaterial.flags |= (material->isRoughnessInverted() ? 1 : 0) << 7;
-
-			packedMaterials[i] = packedMaterial;
-		}
+		std::vector<PackedMaterial> packedMaterials = this->getPackedMaterials();
 
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_materialBuffer);
 		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PackedMaterial) * packedMaterials.size(), &packedMaterials[0], GL_STATIC_DRAW);
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 	}
 }
+
+void MaterialManager::updateVirtualTextures() {
+	if (m_virtualTextures.empty()) {
+		return;
+	}
+
+	++m_virtualTextureFrame;
+
+	std::vector<uvec2> feedback;
+	this->readVirtualTextureFeedback(feedback);
+
+	std::vector<std::vector<uint32_t>> texturePages(m_virtualTextures.size());
+	for (int i = 0; i < feedback.size(); i++) {
+		if (feedback[i].x < texturePages.size()) {
+			texturePages[feedback[i].x].push_back(feedback[i].y);
+		}
+	}
+
+	for (int i = 0; i < m_virtualTextures.size(); i++) {
+		const std::vector<uint32_t>& pages = texturePages[i];
+		m_virtualTextures[i].virtualTexture->update(pages.empty() ? NULL : &pages[0], pages.size(), m_virtualTextureFrame);
+		this->uploadVirtualTexturePages(m_virtualTextures[i]);
+	}
+}
+
+void MaterialManager::readVirtualTextureFeedback(std::vector<uvec2>& feedback) {
+	// Reading the feedback buffer directly would wait for the GPU to finish the frame that wrote it. It is
+	// copied to a readback instead, and the readbacks are only mapped once their fence has been signalled,
+	// so the CPU never waits. Feedback arrives a frame or two late, which only delays the page requests.
+	uint32_t feedbackBufferSize = sizeof(uint32_t) * (4 + 2 * m_virtualTextureFeedbackCapacity);
+	std::vector<VirtualTextureFeedbackReadback*> completed;
+
+	for (int i = 0; i < m_virtualTextureFeedbackReadbacks.size(); i++) {
+		VirtualTextureFeedbackReadback& readback = m_virtualTextureFeedbackReadbacks[i];
+		if (readback.fence != NULL) {
+			GLenum status = glClientWaitSync(readback.fence, 0, 0);
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+				completed.push_back(&readback);
+			}
+		}
+	}
+
+	std::sort(completed.begin(), completed.end(), [](const VirtualTextureFeedbackReadback* lhs, const VirtualTextureFeedbackReadback* rhs) {
+		return lhs->frame < rhs->frame;
+	});
+
+	for (int i = 0; i < completed.size(); i++) {
+		glBindBuffer(GL_COPY_READ_BUFFER, completed[i]->buffer);
+		const uint32_t* data = (const uint32_t*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, feedbackBufferSize, GL_MAP_READ_BIT);
+		if (data != NULL) {
+			uint32_t feedbackCount = glm::min(data[0], m_virtualTextureFeedbackCapacity);
+			const uvec2* entries = (const uvec2*)(data + 4);
+			feedback.insert(feedback.end(), entries, entries + feedbackCount);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+		}
+
+		glDeleteSync(completed[i]->fence);
+		completed[i]->fence = NULL;
+	}
+
+	// The feedback written during the previous frame goes to a free readback. When the GPU is so far
+	// behind that none is free, that frame's feedback is dropped rather than waited for.
+	VirtualTextureFeedbackReadback* target = NULL;
+	for (int i = 0; i < m_virtualTextureFeedbackReadbacks.size() && target == NULL; i++) {
+		if (m_virtualTextureFeedbackReadbacks[i].fence == NULL) {
+			target = &m_virtualTextureFeedbackReadbacks[i];
+		}
+	}
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT); // The feedback was written with shader storage atomics
+	glBindBuffer(GL_COPY_READ_BUFFER, m_virtualTextureFeedbackBuffer);
+	if (target != NULL) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, target->buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, feedbackBufferSize);
+		target->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		target->frame = m_virtualTextureFrame - 1;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	// Reset the count for this frame's shaders, ordered after the copy on the GPU
+	uint32_t zero = 0;
+	glClearBufferSubData(GL_COPY_READ_BUFFER, GL_R32UI, 0, sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void MaterialManager::uploadVirtualTexturePages(VirtualTextureResources& resources) {
+	VirtualTexture* virtualTexture = resources.virtualTexture;
+	VirtualTexturePageFile* pageFile = virtualTexture->getPageFile();
+	uint32_t paddedPageSize = pageFile->getPaddedPageSize();
+
+	std::vector<VirtualTexturePage>& uploads = virtualTexture->getPendingUploads();
+	for (int i = 0; i < uploads.size(); i++) {
+		uvec2 slotCoord = virtualTexture->getSlotCoord(uploads[i].slot);
+		resources.physicalCache->upload(&uploads[i].data[0], paddedPageSize, paddedPageSize, slotCoord.x * paddedPageSize, slotCoord.y * paddedPageSize);
+	}
+	virtualTexture->clearPendingUploads();
+
+	if (virtualTexture->isIndirectionDirty()) {
+		std::vector<uint32_t> indirection;
+		glBindTexture(GL_TEXTURE_2D, resources.pageTableTexture);
+		for (uint32_t mip = 0; mip < pageFile->getMipCount(); mip++) {
+			virtualTexture->buildIndirection(mip, indirection);
+			glTexSubImage2D(GL_TEXTURE_2D, mip, 0, 0, pageFile->getPageCountX(mip), pageFile->getPageCountY(mip), GL_RED_INTEGER, GL_UNSIGNED_INT, &indirection[0]);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+		virtualTexture->clearIndirectionDirty();
+	}
+}
@@ -4,6 +4,7 @@
 #include "core/renderer/Material.h"
 
 class ShaderProgram;
+class VirtualTexture;
 
 struct PackedMaterial {
 	union {
@@ -71,6 +72,18 @@ struct PackedMaterial {
 	uint32_t padding2;
 };
 
+struct VirtualTextureFeedbackReadback {
+	uint32_t buffer; // Copy of the feedback buffer, mapped once the copy has completed
+	GLsync fence; // Signalled when the copy has completed, NULL while the readback is unused
+	uint64_t frame; // The frame whose feedback was copied
+};
+
+struct VirtualTextureResources {
+	VirtualTexture* virtualTexture;
+	Texture2D* physicalCache; // RGBA8 atlas of physical page slots, including the page borders
+	uint32_t pageTableTexture; // R32UI indirection texture, one mip level per virtual mip level
+};
+
 class MaterialManager {
 public:
 	MaterialManager();
@@ -85,19 +98,45 @@ public:
 
 	uint32_t getMaterialCount() const;
 
+	PackedMaterial packMaterial(uint32_t materialIndex) const;
+
+	std::vector<PackedMaterial> getPackedMaterials() const;
+
 	void bindMaterialBuffer(uint32_t index);
 
 	void render(double dt, double partialTicks);
 
 	void applyUniforms(ShaderProgram* shaderProgram);
 
+	uint32_t loadVirtualTexture(std::string pageFilePath, uint32_t physicalSlotsX = 16, uint32_t physicalSlotsY = 16);
+
+	VirtualTexture* getVirtualTexture(uint32_t virtualTextureIndex);
+
+	uint32_t getVirtualTextureCount() const;
+
+	void bindVirtualTexture(ShaderProgram* shaderProgram, std::string uniformName, uint32_t virtualTextureIndex, int32_t textureUnit = 0);
+
+	void bindVirtualTextureFeedbackBuffer(uint32_t index);
+
 private:
 	void initializeMaterialBuffer();
+
+	void updateVirtualTextures();
+
+	void readVirtualTextureFeedback(std::vector<uvec2>& feedback);
+
+	void uploadVirtualTexturePages(VirtualTextureResources& resources);
 	
 	std::vector<Material*> m_materials;
 	std::map<std::string, uint32_t> m_namedMaterialIndexes;
 
 	uint32_t m_materialBuffer;
 	uint32_t m_materialCount;
+
+	std::vector<VirtualTextureResources> m_virtualTextures;
+	uint32_t m_virtualTextureFeedbackBuffer; // Written by shaders during the frame, copied to a readback at the start of the next
+	std::vector<VirtualTextureFeedbackReadback> m_virtualTextureFeedbackReadbacks; // Read by the CPU once their copy has completed, usually one or two frames later
+	uint32_t m_virtualTextureFeedbackCapacity;
+	uint64_t m_virtualTextureFrame;
 };
 
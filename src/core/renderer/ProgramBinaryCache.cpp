@@ -0,0 +1,110 @@
+#include "core/renderer/ProgramBinaryCache.h"
+#include "core/Engine.h"
+#include "core/util/FileUtils.h"
+#include "core/util/Hash.h"
+
+const uint32_t ProgramBinaryCache::FILE_MAGIC = 0x4E425250; // "PRBN"
+const uint32_t ProgramBinaryCache::FILE_VERSION = 1;
+
+uint64_t ProgramBinaryCache::getProgramKey(const std::map<uint32_t, std::string>& shaderSources, const std::map<std::string, int32_t>& attributes, const std::map<std::string, int32_t>& dataLocations, std::string driverVersion) {
+	uint64_t hash = Hash::hashValue(FILE_VERSION);
+	hash = Hash::hashString(driverVersion, hash);
+
+	hash = Hash::hashValue((uint64_t)shaderSources.size(), hash);
+	for (auto it = shaderSources.begin(); it != shaderSources.end(); ++it) {
+		hash = Hash::hashValue(it->first, hash);
+		hash = Hash::hashString(it->second, hash);
+	}
+
+	hash = Hash::hashValue((uint64_t)attributes.size(), hash);
+	for (auto it = attributes.begin(); it != attributes.end(); ++it) {
+		hash = Hash::hashString(it->first, hash);
+		hash = Hash::hashValue(it->second, hash);
+	}
+
+	hash = Hash::hashValue((uint64_t)dataLocations.size(), hash);
+	for (auto it = dataLocations.begin(); it != dataLocations.end(); ++it) {
+		hash = Hash::hashString(it->first, hash);
+		hash = Hash::hashValue(it->second, hash);
+	}
+
+	return hash;
+}
+
+bool ProgramBinaryCache::load(std::string filePath, uint64_t key, uint32_t& binaryFormat, std::vector<uint8_t>& binary) {
+	std::ifstream stream(filePath.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (!stream.is_open()) {
+		return false; // Not cached yet
+	}
+
+	uint32_t magic = 0, version = 0;
+	uint64_t fileKey = 0, binarySize = 0, binaryHash = 0;
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+	stream.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+	stream.read(reinterpret_cast<char*>(&fileKey), sizeof(uint64_t));
+	stream.read(reinterpret_cast<char*>(&binaryFormat), sizeof(uint32_t));
+	stream.read(reinterpret_cast<char*>(&binarySize), sizeof(uint64_t));
+	stream.read(reinterpret_cast<char*>(&binaryHash), sizeof(uint64_t));
+	if (!stream.good() || magic != FILE_MAGIC || version != FILE_VERSION || fileKey != key || binarySize == 0) {
+		warn("Ignoring stale program binary cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	// The size is checked against the rest of the file before allocating, a corrupted one could be anything
+	std::streamoff headerSize = stream.tellg();
+	stream.seekg(0, std::ifstream::end);
+	std::streamoff fileSize = stream.tellg();
+	stream.seekg(headerSize, std::ifstream::beg);
+	if (headerSize < 0 || fileSize < headerSize || binarySize != (uint64_t)(fileSize - headerSize)) {
+		warn("Ignoring corrupted program binary cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	binary.resize(binarySize);
+	stream.read(reinterpret_cast<char*>(&binary[0]), binarySize);
+	if (!stream.good() || Hash::hashWords(&binary[0], binary.size()) != binaryHash) {
+		warn("Ignoring corrupted program binary cache \"%s\"\n", filePath.c_str());
+		binary.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool ProgramBinaryCache::save(std::string filePath, uint64_t key, uint32_t binaryFormat, const std::vector<uint8_t>& binary) {
+	if (binary.empty()) {
+		error("Unable to cache an empty program binary\n");
+		return false;
+	}
+
+	std::ofstream stream(filePath.c_str(), std::ofstream::out | std::ofstream::binary);
+	if (!stream.is_open()) {
+		error("Failed to open program binary cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	uint64_t binarySize = binary.size();
+	uint64_t binaryHash = Hash::hashWords(&binary[0], binary.size());
+	stream.write(reinterpret_cast<const char*>(&FILE_MAGIC), sizeof(uint32_t));
+	stream.write(reinterpret_cast<const char*>(&FILE_VERSION), sizeof(uint32_t));
+	stream.write(reinterpret_cast<const char*>(&key), sizeof(uint64_t));
+	stream.write(reinterpret_cast<const char*>(&binaryFormat), sizeof(uint32_t));
+	stream.write(reinterpret_cast<const char*>(&binarySize), sizeof(uint64_t));
+	stream.write(reinterpret_cast<const char*>(&binaryHash), sizeof(uint64_t));
+	stream.write(reinterpret_cast<const char*>(&binary[0]), binarySize);
+
+	if (!stream.good()) {
+		error("Failed to write program binary cache \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+std::string ProgramBinaryCache::getCacheFilePath(uint64_t key) {
+	std::string directory = Engine::instance()->getCacheDirectory() + "/programs";
+	if (!FileUtils::createDirectories(directory)) {
+		return ""; // Programs are still linked, only not cached
+	}
+	return directory + "/program_" + Hash::toHexString(key) + ".bin";
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "core/pch.h"
+
+// On-disk store of linked program binaries, as returned by glGetProgramBinary. Programs are keyed by
+// the hash of the preprocessed source of each shader stage, the attribute and fragment data locations
+// bound before linking, and the driver, since binaries are only valid for the driver that wrote them.
+// The version and extension lines are part of the preprocessed source, so any defines prepended to it
+// change the key as well. A hash of the binary is stored with it, so a truncated or corrupted file is
+// rejected before it reaches the driver.
+// No GL calls are made here, ShaderProgram reads and uploads the binaries.
+class ProgramBinaryCache {
+public:
+	static uint64_t getProgramKey(const std::map<uint32_t, std::string>& shaderSources, const std::map<std::string, int32_t>& attributes, const std::map<std::string, int32_t>& dataLocations, std::string driverVersion);
+
+	static bool load(std::string filePath, uint64_t key, uint32_t& binaryFormat, std::vector<uint8_t>& binary);
+
+	static bool save(std::string filePath, uint64_t key, uint32_t binaryFormat, const std::vector<uint8_t>& binary);
+
+	// Returns an empty path if the cache directory could not be created
+	static std::string getCacheFilePath(uint64_t key);
+
+private:
+	static const uint32_t FILE_MAGIC;
+	static const uint32_t FILE_VERSION;
+};
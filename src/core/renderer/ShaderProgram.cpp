@@ -1,23 +1,32 @@
 #include "core/renderer/ShaderProgram.h"
+#include "core/renderer/ShaderSourceCache.h"
+#include "core/renderer/ProgramBinaryCache.h"
 #include "core/util/FileUtils.h"
 #include "core/util/StringUtils.h"
 #include "core/Engine.h"
 #include <GL/glew.h>
 
+std::set<ShaderProgram*> ShaderProgram::s_programs;
+
 ShaderProgram::ShaderProgram(FragmentOutput fragmentOutput) :
 	m_programID(0), m_completed(false) {
 	this->setDataLocations(fragmentOutput);
+	s_programs.insert(this);
 }
 
 
 ShaderProgram::~ShaderProgram() {
+	s_programs.erase(this);
+
 	for (int i = 0; i < m_shaders.size(); i++) {
 		if (m_shaders[i] != NULL) {
 			delete m_shaders[i];
 		}
 	}
 
-	glDeleteProgram(m_programID);
+	if (m_programID != 0) {
+		glDeleteProgram(m_programID);
+	}
 }
 
 void ShaderProgram::addShader(Shader* shader) {
@@ -70,7 +79,22 @@ void ShaderProgram::completeProgram() {
 		error("Cannot complete shader program, the program has already been linked\n");
 	}
 
+	if (!Engine::isGLAvailable()) {
+		return; // Headless, there is nothing to link the shaders into
+	}
+
 	m_programID = glCreateProgram();
+
+	// Compiling and linking is skipped entirely when the driver accepts a cached binary of this program
+	uint64_t key = this->getProgramBinaryKey();
+	std::string cacheFilePath = ProgramBinaryCache::getCacheFilePath(key);
+	if (!cacheFilePath.empty() && this->loadProgramBinary(cacheFilePath, key)) {
+		m_completed = true;
+		return;
+	}
+
+	glProgramParameteri(m_programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	info("Attaching shaders\n");
 	for (std::pair<uint32, Shader*> entry : m_shaders) {
 		entry.second->attachTo(m_programID);
@@ -119,7 +143,137 @@ void ShaderProgram::completeProgram() {
 		}
 	}
 
+	if (!cacheFilePath.empty()) {
+		this->saveProgramBinary(cacheFilePath, key);
+	}
+
+	m_completed = true;
+}
+
+bool ShaderProgram::reload() {
+	if (!m_completed || !Engine::isGLAvailable()) {
+		return false;
+	}
+
+	std::map<uint32, Shader*> shaders;
+	try {
+		for (std::pair<uint32, Shader*> entry : m_shaders) {
+			shaders.insert(std::make_pair(entry.first, new Shader(entry.first, entry.second->getFile())));
+		}
+	} catch (std::exception e) {
+		for (std::pair<uint32, Shader*> entry : shaders) {
+			delete entry.second;
+		}
+		warn("Failed to reload shader program %d, keeping the current program\n", m_programID);
+		return false;
+	}
+
+	std::map<uint32, Shader*> previousShaders = m_shaders;
+	uint32 previousProgramID = m_programID;
+	m_shaders = shaders;
+	m_programID = 0;
+	m_completed = false;
+	this->completeProgram();
+
+	int32 status = GL_FALSE;
+	glGetProgramiv(m_programID, GL_LINK_STATUS, &status);
+
+	// The program that failed to link, or the replaced one, is deleted along with its shaders
+	std::map<uint32, Shader*> deleteShaders = status ? previousShaders : shaders;
+	for (std::pair<uint32, Shader*> entry : deleteShaders) {
+		delete entry.second;
+	}
+	glDeleteProgram(status ? previousProgramID : m_programID);
+
 	m_completed = true;
+	if (!status) {
+		warn("Failed to reload shader program %d, keeping the current program\n", previousProgramID);
+		m_shaders = previousShaders;
+		m_programID = previousProgramID;
+		return false;
+	}
+
+	m_uniforms.clear(); // Locations may differ in the new program
+	return true;
+}
+
+uint32_t ShaderProgram::reloadChangedPrograms() {
+	std::vector<std::string> changedFiles;
+	Shader::getSourceCache().update(&changedFiles);
+	if (changedFiles.empty()) {
+		return 0;
+	}
+
+	uint32_t reloadedCount = 0;
+	for (auto it = s_programs.begin(); it != s_programs.end(); ++it) {
+		ShaderProgram* program = *it;
+		bool changed = false;
+		std::string files = "";
+		for (std::pair<uint32, Shader*> entry : program->m_shaders) {
+			changed |= std::find(changedFiles.begin(), changedFiles.end(), entry.second->getFile()) != changedFiles.end();
+			files += (files.empty() ? "" : ", ") + entry.second->getFile();
+		}
+
+		if (changed && program->reload()) {
+			info("Reloaded shader program %u [%s]\n", program->m_programID, files.c_str());
+			++reloadedCount;
+		}
+	}
+
+	return reloadedCount;
+}
+
+uint64_t ShaderProgram::getProgramBinaryKey() const {
+	std::map<uint32_t, std::string> shaderSources;
+	for (std::pair<uint32, Shader*> entry : m_shaders) {
+		shaderSources.insert(std::make_pair(entry.first, entry.second->getPreprocessedSource()));
+	}
+
+	// Sorted, so the key does not depend on the order the locations were added in
+	std::map<std::string, int32_t> attributes(m_attributes.begin(), m_attributes.end());
+	std::map<std::string, int32_t> dataLocations(m_dataLocations.begin(), m_dataLocations.end());
+	return ProgramBinaryCache::getProgramKey(shaderSources, attributes, dataLocations, ShaderProgram::getDriverVersion());
+}
+
+bool ShaderProgram::loadProgramBinary(std::string filePath, uint64_t key) {
+	uint32_t binaryFormat = 0;
+	std::vector<uint8_t> binary;
+	if (!ProgramBinaryCache::load(filePath, key, binaryFormat, binary)) {
+		return false;
+	}
+
+	int32 status = GL_FALSE;
+	glProgramBinary(m_programID, binaryFormat, &binary[0], (GLsizei)binary.size());
+	glGetProgramiv(m_programID, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE) {
+		// Drivers may reject binaries for reasons not covered by the key, the program is linked from source instead
+		warn("Cached program binary \"%s\" was rejected by the driver, recompiling\n", filePath.c_str());
+		glDeleteProgram(m_programID);
+		m_programID = glCreateProgram();
+		return false;
+	}
+
+	info("Loaded cached program binary \"%s\"\n", filePath.c_str());
+	return true;
+}
+
+void ShaderProgram::saveProgramBinary(std::string filePath, uint64_t key) {
+	int32 status = GL_FALSE;
+	int32 binaryLength = 0;
+	glGetProgramiv(m_programID, GL_LINK_STATUS, &status);
+	glGetProgramiv(m_programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if (status == GL_FALSE || binaryLength <= 0) {
+		return; // Failed programs are never cached, and some drivers do not support program binaries
+	}
+
+	GLenum binaryFormat = 0;
+	std::vector<uint8_t> binary(binaryLength);
+	glGetProgramBinary(m_programID, binaryLength, &binaryLength, &binaryFormat, &binary[0]);
+	binary.resize(binaryLength);
+
+	if (!binary.empty()) {
+		ProgramBinaryCache::save(filePath, key, binaryFormat, binary);
+	}
 }
 
 void ShaderProgram::useProgram(bool use) const {
@@ -557,6 +711,17 @@ void ShaderProgram::use(const ShaderProgram* program) {
 	}
 }
 
+std::string ShaderProgram::getDriverVersion() {
+	static std::string driverVersion;
+	if (driverVersion.empty() && Engine::isGLAvailable()) {
+		const char* vendor = (const char*)glGetString(GL_VENDOR);
+		const char* renderer = (const char*)glGetString(GL_RENDERER);
+		const char* version = (const char*)glGetString(GL_VERSION);
+		driverVersion = std::string(vendor != NULL ? vendor : "") + "\n" + (renderer != NULL ? renderer : "") + "\n" + (version != NULL ? version : "");
+	}
+	return driverVersion;
+}
+
 Shader::Shader(uint32 type, std::string file) {
 	info("Loading shader file %s\n", file.c_str());
 	if (type != GL_VERTEX_SHADER && 
@@ -571,72 +736,36 @@ Shader::Shader(uint32 type, std::string file) {
 		throw std::invalid_argument("Invalid shader type");
 	}
 
-	int32 flag = GL_FALSE;
-	int logLength;
-
-
+	// Files shared between shaders, like globals.glsl, are only read once, and again when they change
 	std::string fileRaw;
-	if (!Shader::loadShaderFile(file, fileRaw)) {
+	std::string preprocessedSource;
+	if (!Shader::getSourceCache().getPreprocessedSource(file, fileRaw, preprocessedSource)) {
 		warn("An error occurred while loading this shader\n");
-		throw std::exception("Failed to open shader source file");
+		throw std::exception("Failed to load shader source file");
 	}
 
 	std::stringstream parsedSource;
 	parsedSource << "#version 440 core\n";
 	parsedSource << "#extension GL_ARB_bindless_texture : require\n";
 	parsedSource << "#line 1\n";
+	parsedSource << preprocessedSource;
 
-	std::vector<std::string> includes;
-	int count = Shader::parseIncludes(fileRaw, parsedSource, includes);
-	if (count < 0) {
-		warn("An error occurred while parsing this shader\n");
-		throw std::exception("Failed to parse shader source file");
-	}
-
-	parsedSource << "\0"; // NUL
-
-	std::string glslSrcStr = parsedSource.str(); // needed otherwise garbage memory
-	const char* glslSrc = glslSrcStr.c_str();
-
-	info("Compiling shader\n");
-	uint32 shaderID = glCreateShader(type);
-	glShaderSource(shaderID, 1, &glslSrc, nullptr);
-	glCompileShader(shaderID);
-	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &flag);
-	glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &logLength);
-	char* shaderLog = new char[logLength];
-	glGetShaderInfoLog(shaderID, logLength, nullptr, shaderLog);
-
-	if (flag == GL_FALSE) { // error
-		error("Failed to compile shader: %s\n", shaderLog);
-		int lineNum = 0;
-		for (std::string line; std::getline(parsedSource, line); ) {
-			info("[%d]\t%s\n", lineNum, line.c_str());
-			if (line.rfind("#line ", 0) == 0) {
-				line = line.substr(6);
-				line = StringUtils::trim(line);
-				lineNum = std::stoi(line);
-			} else {
-				lineNum++;
-			}
-		}
-		glDeleteShader(shaderID);
-	} else if (logLength > 0) { // warning or info about shader, not necessarily a failure.
-		info("%s\n", shaderLog);
-	}
-
+	m_program = 0;
+	m_id = 0; // Compiled when first attached, which is skipped when the program binary is cached
 	m_type = type;
-	m_id = shaderID;
 	m_file = file;
 	m_source = fileRaw;
+	m_preprocessedSource = parsedSource.str();
 }
 
 Shader::Shader(uint32 type, uint32 id, std::string file, std::string source) :
-	m_program(0), m_id(id), m_type(type), m_file(file), m_source(source) {}
+	m_program(0), m_id(id), m_type(type), m_file(file), m_source(source), m_preprocessedSource(source) {}
 
 Shader::~Shader() {
-	glDetachShader(m_program, m_id);
-	glDeleteShader(m_id);
+	if (m_id != 0) {
+		glDetachShader(m_program, m_id);
+		glDeleteShader(m_id);
+	}
 }
 
 uint32 Shader::getPorgram() const {
@@ -659,8 +788,68 @@ std::string Shader::getSource() const {
 	return m_source;
 }
 
+std::string Shader::getPreprocessedSource() const {
+	return m_preprocessedSource;
+}
+
+bool Shader::compile() {
+	if (m_id != 0) {
+		return true;
+	}
+
+	if (!Engine::isGLAvailable()) {
+		return false; // Headless, the source is parsed but never compiled
+	}
+
+	int32 flag = GL_FALSE;
+	int logLength;
+
+	const char* glslSrc = m_preprocessedSource.c_str();
+
+	info("Compiling shader %s\n", m_file.c_str());
+	uint32 shaderID = glCreateShader(m_type);
+	glShaderSource(shaderID, 1, &glslSrc, nullptr);
+	glCompileShader(shaderID);
+	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &flag);
+	glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &logLength);
+
+	std::string shaderLog;
+	if (logLength > 0) {
+		shaderLog.resize(logLength);
+		glGetShaderInfoLog(shaderID, logLength, nullptr, &shaderLog[0]);
+	}
+
+	if (flag == GL_FALSE) { // error
+		error("Failed to compile shader: %s\n", shaderLog.c_str());
+		std::istringstream parsedSource(m_preprocessedSource);
+		int lineNum = 0;
+		for (std::string line; std::getline(parsedSource, line); ) {
+			info("[%d]\t%s\n", lineNum, line.c_str());
+			if (line.rfind("#line ", 0) == 0) {
+				line = line.substr(6);
+				line = StringUtils::trim(line);
+				lineNum = std::stoi(line);
+			} else {
+				lineNum++;
+			}
+		}
+		glDeleteShader(shaderID);
+		return false;
+	} else if (logLength > 0) { // warning or info about shader, not necessarily a failure.
+		info("%s\n", shaderLog.c_str());
+	}
+
+	m_id = shaderID;
+	return true;
+}
+
 void Shader::attachTo(uint32 program) {
+	if (!this->compile()) {
+		return;
+	}
+
 	m_program = program;
+
 	glAttachShader(program, m_id);
 }
 
@@ -675,62 +864,7 @@ std::string Shader::getShaderAsString(uint32 type) {
 	return "INVALID_SHADER_TYPE";
 }
 
-bool Shader::loadShaderFile(std::string filePath, std::string& dest) {
-	std::vector<std::string> paths = {
-		filePath,
-		filePath + ".glsl",
-		RESOURCE_PATH(filePath),
-		RESOURCE_PATH(filePath + ".glsl"),
-		RESOURCE_PATH("res/" + filePath),
-		RESOURCE_PATH("res/" + filePath + ".glsl"),
-		RESOURCE_PATH("shaders/" + filePath),
-		RESOURCE_PATH("shaders/" + filePath + ".glsl"),
-		RESOURCE_PATH("res/shaders/" + filePath),
-		RESOURCE_PATH("res/shaders/" + filePath + ".glsl"),
-	};
-
-	if (!FileUtils::loadFileAttemptPaths(paths, dest)) {
-		return false;
-	}
-
-	return true;
-}
-
-int Shader::parseIncludes(std::string source, std::stringstream& parsedSource, std::vector<std::string>& includes) {
-	std::istringstream ss(source);
-	int count = 0;
-
-	for (std::string line; std::getline(ss, line); ) {
-		std::string include = StringUtils::trim(line);
-		if (include.rfind("#include ", 0) == 0) { // line is an include
-			include = include.substr(9); // remove "#include "
-			include = StringUtils::trim(include); // remove white space
-			include = include.substr(1, include.size() - 2); // remove quotation marks
-
-			if (std::find(includes.begin(), includes.end(), include) == includes.end()) { // not already included
-				includes.push_back(include);
-
-				std::string includedSource;
-				if (!Shader::loadShaderFile(include, includedSource)) {
-					error("Could not include shader source \"%s\"\n", include.c_str());
-					return -1;
-				}
-
-				int c = Shader::parseIncludes(includedSource, parsedSource, includes);
-				if (c < 0) {
-					return -1;
-				}
-
-				count += c;
-
-				parsedSource << "#line 2\n"; // reset line number for correct error logs. Set to 2 to account for this "#include" line
-				count++;
-			}
-		} else {
-			parsedSource << line << "\n";
-			count++;
-		}
-	}
-
-	return count;
+ShaderSourceCache& Shader::getSourceCache() {
+	static ShaderSourceCache sourceCache;
+	return sourceCache;
 }
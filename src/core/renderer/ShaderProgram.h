@@ -5,6 +5,7 @@
 
 class ShaderProgram;
 class Shader;
+class ShaderSourceCache;
 struct FragmentDataLocation;
 struct FragmentOutput;
 
@@ -47,6 +48,9 @@ public:
 
 	void completeProgram();
 
+	// Loads and links every shader of this program again. The current program is kept if that fails
+	bool reload();
+
 	void useProgram(bool use) const;
 
 	uint32 getProgramID() const;
@@ -162,13 +166,27 @@ public:
 	int32 getUniform(std::string uniform);
 
 	static void use(const ShaderProgram* program);
+
+	// Identifies the driver that program binaries were compiled by, they are only valid for the same driver
+	static std::string getDriverVersion();
+
+	// Reads the shader files that changed on disk again, and reloads the programs using them
+	static uint32_t reloadChangedPrograms();
 private:
+	uint64_t getProgramBinaryKey() const;
+
+	bool loadProgramBinary(std::string filePath, uint64_t key);
+
+	void saveProgramBinary(std::string filePath, uint64_t key);
+
 	std::map<uint32, Shader*> m_shaders; // TODO: not store pointers. This is a memory leak, since they aren't deleted.
 	std::unordered_map<std::string, int32> m_uniforms;
 	std::unordered_map<std::string, int32> m_attributes;
 	std::unordered_map<std::string, int32> m_dataLocations;
 	uint32 m_programID;
 	bool m_completed;
+
+	static std::set<ShaderProgram*> s_programs; // Every program that exists, to be reloaded when its shaders change
 };
 
 
@@ -196,18 +214,29 @@ public:
 	 */
 	std::string getSource() const;
 
+	/**
+	 * The source code for this shader with its includes expanded, as it is compiled
+	 */
+	std::string getPreprocessedSource() const;
+
+	/**
+	 * Compiles this shader if it has not been compiled yet. Returns false if compiling failed
+	 */
+	bool compile();
+
 	void attachTo(uint32 program);
 
 	static std::string getShaderAsString(uint32 type);
 
-private:
-	static bool loadShaderFile(std::string filePath, std::string& dest);
+	// The shader sources loaded so far, shared by every shader
+	static ShaderSourceCache& getSourceCache();
 
-	static int parseIncludes(std::string source, std::stringstream& parsedSource, std::vector<std::string>& includes);
+private:
 
 	uint32 m_program;
 	uint32 m_type;
 	uint32 m_id;
 	std::string m_file;
 	std::string m_source;
+	std::string m_preprocessedSource;
 };
\ No newline at end of file
@@ -0,0 +1,248 @@
+#include "core/renderer/ShaderSourceCache.h"
+#include "core/util/FileUtils.h"
+#include "core/util/StringUtils.h"
+#include "core/Engine.h"
+
+ShaderSourceCache::ShaderSourceCache():
+	m_fileReadCount(0) {
+}
+
+ShaderSourceCache::~ShaderSourceCache() {
+}
+
+bool ShaderSourceCache::getPreprocessedSource(std::string file, std::string& source, std::string& preprocessedSource) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	SourceFile* sourceFile = this->loadFile(file);
+	if (sourceFile == NULL) {
+		return false;
+	}
+
+	if (sourceFile->preprocessed) {
+		// Any of the includes may have changed since, which invalidates this file when it is read again
+		std::vector<std::string> dependencies = sourceFile->dependencies;
+		for (int i = 1; i < dependencies.size(); i++) {
+			if (this->loadFile(dependencies[i]) == NULL) {
+				sourceFile->preprocessed = false;
+			}
+		}
+	}
+
+	if (!sourceFile->preprocessed) {
+		std::stringstream stream;
+		std::vector<std::string> included;
+		if (!this->appendSource(sourceFile, stream, included)) {
+			return false;
+		}
+
+		sourceFile->preprocessedSource = stream.str();
+		sourceFile->dependencies.clear();
+		sourceFile->dependencies.push_back(file);
+		sourceFile->dependencies.insert(sourceFile->dependencies.end(), included.begin(), included.end());
+		sourceFile->preprocessed = true;
+		m_changedShaders.erase(file);
+	}
+
+	source = sourceFile->source;
+	preprocessedSource = sourceFile->preprocessedSource;
+	return true;
+}
+
+uint32_t ShaderSourceCache::update(std::vector<std::string>* changedShaders) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::vector<std::string> names;
+	for (auto it = m_files.begin(); it != m_files.end(); ++it) {
+		names.push_back(it->first);
+	}
+
+	uint64_t fileReadCount = m_fileReadCount;
+	for (int i = 0; i < names.size(); i++) {
+		this->loadFile(names[i]);
+	}
+
+	if (changedShaders != NULL) {
+		changedShaders->insert(changedShaders->end(), m_changedShaders.begin(), m_changedShaders.end());
+	}
+	m_changedShaders.clear();
+
+	return (uint32_t)(m_fileReadCount - fileReadCount);
+}
+
+void ShaderSourceCache::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_files.clear();
+	m_dependents.clear();
+	m_changedShaders.clear();
+}
+
+uint32_t ShaderSourceCache::getFileCount() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_files.size();
+}
+
+uint64_t ShaderSourceCache::getFileReadCount() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_fileReadCount;
+}
+
+std::vector<std::string> ShaderSourceCache::getSearchPaths(std::string file) {
+	return {
+		file,
+		file + ".glsl",
+		RESOURCE_PATH(file),
+		RESOURCE_PATH(file + ".glsl"),
+		RESOURCE_PATH("res/" + file),
+		RESOURCE_PATH("res/" + file + ".glsl"),
+		RESOURCE_PATH("shaders/" + file),
+		RESOURCE_PATH("shaders/" + file + ".glsl"),
+		RESOURCE_PATH("res/shaders/" + file),
+		RESOURCE_PATH("res/shaders/" + file + ".glsl"),
+	};
+}
+
+ShaderSourceCache::SourceFile* ShaderSourceCache::loadFile(std::string name) {
+	std::error_code errorCode;
+
+	auto it = m_files.find(name);
+	if (it != m_files.end()) {
+		std::filesystem::file_time_type lastWriteTime = std::filesystem::last_write_time(it->second.path, errorCode);
+		if (!errorCode && lastWriteTime == it->second.lastWriteTime) {
+			return &it->second; // Unchanged
+		}
+	}
+
+	std::vector<std::string> paths = ShaderSourceCache::getSearchPaths(name);
+	std::string path;
+	for (int i = 0; i < paths.size() && path.empty(); i++) {
+		if (std::filesystem::is_regular_file(paths[i], errorCode)) {
+			path = paths[i];
+		}
+	}
+
+	SourceFile sourceFile;
+	sourceFile.path = path;
+	sourceFile.preprocessed = false;
+	sourceFile.lastWriteTime = std::filesystem::last_write_time(path, errorCode);
+	if (path.empty() || errorCode || !FileUtils::loadFile(path, sourceFile.source, false)) {
+		warn("Failed to load shader file %s\n", paths[0].c_str());
+		for (int i = 1; i < paths.size(); i++) {
+			warn("Searched in directory %s\n", paths[i].c_str());
+		}
+		return NULL; // A previously cached version is kept, to be replaced once the file can be read again
+	}
+
+	++m_fileReadCount;
+	ShaderSourceCache::parseSegments(sourceFile.source, sourceFile.segments, sourceFile.includes);
+
+	if (it != m_files.end()) {
+		info("Shader file %s changed, reloading\n", name.c_str());
+		for (int i = 0; i < it->second.includes.size(); i++) {
+			m_dependents[it->second.includes[i]].erase(name);
+		}
+		it->second = std::move(sourceFile);
+		this->invalidate(name);
+	} else {
+		it = m_files.insert(std::make_pair(name, std::move(sourceFile))).first;
+	}
+
+	for (int i = 0; i < it->second.includes.size(); i++) {
+		m_dependents[it->second.includes[i]].insert(name);
+	}
+
+	return &it->second;
+}
+
+bool ShaderSourceCache::appendSource(SourceFile* file, std::stringstream& stream, std::vector<std::string>& included) {
+	// Copied, since including a changed file can replace the segments of files including it
+	std::vector<SourceSegment> segments = file->segments;
+
+	for (int i = 0; i < segments.size(); i++) {
+		const std::string& include = segments[i].include;
+		if (include.empty()) {
+			stream << segments[i].text;
+			continue;
+		}
+
+		if (std::find(included.begin(), included.end(), include) != included.end()) {
+			continue; // Already included
+		}
+
+		included.push_back(include);
+
+		SourceFile* includedFile = this->loadFile(include);
+		if (includedFile == NULL) {
+			error("Could not include shader source \"%s\"\n", include.c_str());
+			return false;
+		}
+
+		if (!this->appendSource(includedFile, stream, included)) {
+			return false;
+		}
+
+		stream << "#line 2\n"; // reset line number for correct error logs. Set to 2 to account for this "#include" line
+	}
+
+	return true;
+}
+
+void ShaderSourceCache::invalidate(std::string name) {
+	std::set<std::string> visited;
+	std::stack<std::string> stack;
+	stack.push(name);
+
+	while (!stack.empty()) {
+		std::string current = stack.top();
+		stack.pop();
+
+		if (!visited.insert(current).second) {
+			continue; // Include cycles are visited once
+		}
+
+		auto it = m_files.find(current);
+		if (it != m_files.end() && it->second.preprocessed) {
+			it->second.preprocessed = false;
+			m_changedShaders.insert(current);
+		}
+
+		auto dependents = m_dependents.find(current);
+		if (dependents != m_dependents.end()) {
+			for (auto jt = dependents->second.begin(); jt != dependents->second.end(); ++jt) {
+				stack.push(*jt);
+			}
+		}
+	}
+}
+
+void ShaderSourceCache::parseSegments(const std::string& source, std::vector<SourceSegment>& segments, std::vector<std::string>& includes) {
+	std::istringstream ss(source);
+	SourceSegment text;
+
+	for (std::string line; std::getline(ss, line); ) {
+		std::string include = StringUtils::trim(line);
+		if (include.rfind("#include ", 0) == 0) { // line is an include
+			include = include.substr(9); // remove "#include "
+			include = StringUtils::trim(include); // remove white space
+			include = include.substr(1, include.size() - 2); // remove quotation marks
+
+			if (!text.text.empty()) {
+				segments.push_back(text);
+				text.text.clear();
+			}
+
+			SourceSegment segment;
+			segment.include = include;
+			segments.push_back(segment);
+
+			if (std::find(includes.begin(), includes.end(), include) == includes.end()) {
+				includes.push_back(include);
+			}
+		} else {
+			text.text += line + "\n";
+		}
+	}
+
+	if (!text.text.empty()) {
+		segments.push_back(text);
+	}
+}
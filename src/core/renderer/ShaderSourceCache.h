@@ -0,0 +1,68 @@
+#pragma once
+
+#include "core/pch.h"
+#include <filesystem>
+#include <mutex>
+
+// Cache of shader source files with their includes expanded in place. Files are keyed by the name they
+// are loaded or included by, and are only read again when their last write time on disk changes.
+// Every file keeps the files it includes, and the files including it, so a changed file invalidates
+// the expanded source of everything depending on it, and nothing else. Each file is included at most
+// once per shader, as Shader has always done, so the expanded source is cached per requested shader
+// file rather than per include.
+// No GL calls are made, the cache only deals with the source text.
+class ShaderSourceCache : private NotCopyable {
+public:
+	ShaderSourceCache();
+
+	~ShaderSourceCache();
+
+	// Gets the raw source of the file, and the source with its includes expanded. Returns false if the
+	// file or any of its includes could not be loaded
+	bool getPreprocessedSource(std::string file, std::string& source, std::string& preprocessedSource);
+
+	// Checks every cached file for changes on disk, reading only the changed files again. The shader
+	// files whose expanded source changed and was not requested since are added to changedShaders, to
+	// be recompiled. Returns the number of files read again
+	uint32_t update(std::vector<std::string>* changedShaders = NULL);
+
+	void clear();
+
+	uint32_t getFileCount();
+
+	// The number of times any file was read from disk
+	uint64_t getFileReadCount();
+
+	static std::vector<std::string> getSearchPaths(std::string file);
+
+private:
+	struct SourceSegment {
+		std::string text; // Consecutive lines without includes
+		std::string include; // Name of the included file, empty for text
+	};
+
+	struct SourceFile {
+		std::string path; // The path the file was found at
+		std::filesystem::file_time_type lastWriteTime;
+		std::string source;
+		std::vector<SourceSegment> segments;
+		std::vector<std::string> includes; // Files directly included by this file
+		std::vector<std::string> dependencies; // This file and every file it includes, when preprocessed
+		std::string preprocessedSource;
+		bool preprocessed;
+	};
+
+	SourceFile* loadFile(std::string name);
+
+	bool appendSource(SourceFile* file, std::stringstream& stream, std::vector<std::string>& included);
+
+	void invalidate(std::string name);
+
+	static void parseSegments(const std::string& source, std::vector<SourceSegment>& segments, std::vector<std::string>& includes);
+
+	std::map<std::string, SourceFile> m_files;
+	std::map<std::string, std::set<std::string>> m_dependents; // Files directly including each file
+	std::set<std::string> m_changedShaders; // Invalidated files, until they are preprocessed again
+	uint64_t m_fileReadCount;
+	std::mutex m_mutex;
+};
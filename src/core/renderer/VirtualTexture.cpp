@@ -0,0 +1,931 @@
+#include "core/renderer/VirtualTexture.h"
+#include "core/util/FileUtils.h"
+
+VirtualTexturePageFile::VirtualTexturePageFile():
+	m_file(NULL) {
+	memset(&m_header, 0, sizeof(VirtualTextureFileHeader));
+}
+
+VirtualTexturePageFile::~VirtualTexturePageFile() {
+	this->close();
+}
+
+bool VirtualTexturePageFile::build(std::string filePath, const uint8_t* data, uint32_t width, uint32_t height, uint32_t pageSize, uint32_t pageBorder) {
+	if (data == NULL || width == 0 || height == 0) {
+		error("Unable to build virtual texture page file \"%s\": No source image data\n", filePath.c_str());
+		return false;
+	}
+
+	if (pageSize == 0 || pageBorder * 2 >= pageSize) {
+		error("Unable to build virtual texture page file \"%s\": Invalid page size %u with border %u\n", filePath.c_str(), pageSize, pageBorder);
+		return false;
+	}
+
+	const uint32_t channels = 4;
+	const uint32_t paddedPageSize = pageSize + pageBorder * 2;
+	const uint64_t pageDataSize = (uint64_t)paddedPageSize * paddedPageSize * channels;
+
+	VirtualTextureFileHeader header;
+	memset(&header, 0, sizeof(VirtualTextureFileHeader));
+	header.magic = VIRTUAL_TEXTURE_FILE_MAGIC;
+	header.version = VIRTUAL_TEXTURE_FILE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.pageSize = pageSize;
+	header.pageBorder = pageBorder;
+	header.channels = channels;
+	header.mipCount = VirtualTexturePageFile::calculateMipCount(width, height, pageSize);
+
+	if (header.mipCount > 16) {
+		error("Unable to build virtual texture page file \"%s\": %u mip levels exceeds the page identifier range\n", filePath.c_str(), header.mipCount);
+		return false;
+	}
+
+	uint32_t pageCountX = (width + pageSize - 1) / pageSize;
+	uint32_t pageCountY = (height + pageSize - 1) / pageSize;
+
+	// Box filtered mip chain, each level is (width >> mip) x (height >> mip) clamped to 1.
+	std::vector<std::vector<uint8_t>> levels(header.mipCount);
+	std::vector<uvec2> levelSizes(header.mipCount);
+	levels[0].assign(data, data + (uint64_t)width * height * channels);
+	levelSizes[0] = uvec2(width, height);
+
+	for (uint32_t mip = 1; mip < header.mipCount; mip++) {
+		uvec2 srcSize = levelSizes[mip - 1];
+		uvec2 dstSize = uvec2(glm::max(srcSize.x >> 1, 1u), glm::max(srcSize.y >> 1, 1u));
+		const std::vector<uint8_t>& src = levels[mip - 1];
+		std::vector<uint8_t>& dst = levels[mip];
+		dst.resize((uint64_t)dstSize.x * dstSize.y * channels);
+
+		for (uint32_t y = 0; y < dstSize.y; y++) {
+			uint32_t y0 = glm::min(y * 2 + 0, srcSize.y - 1);
+			uint32_t y1 = glm::min(y * 2 + 1, srcSize.y - 1);
+			for (uint32_t x = 0; x < dstSize.x; x++) {
+				uint32_t x0 = glm::min(x * 2 + 0, srcSize.x - 1);
+				uint32_t x1 = glm::min(x * 2 + 1, srcSize.x - 1);
+				for (uint32_t c = 0; c < channels; c++) {
+					uint32_t sum = 2; // Round to nearest
+					sum += src[((uint64_t)y0 * srcSize.x + x0) * channels + c];
+					sum += src[((uint64_t)y0 * srcSize.x + x1) * channels + c];
+					sum += src[((uint64_t)y1 * srcSize.x + x0) * channels + c];
+					sum += src[((uint64_t)y1 * srcSize.x + x1) * channels + c];
+					dst[((uint64_t)y * dstSize.x + x) * channels + c] = (uint8_t)(sum / 4);
+				}
+			}
+		}
+
+		levelSizes[mip] = dstSize;
+	}
+
+	std::vector<VirtualTexturePageEntry> entries;
+	for (uint32_t mip = 0; mip < header.mipCount; mip++) {
+		uint32_t mipPageCountX = glm::max((pageCountX + (1u << mip) - 1) >> mip, 1u);
+		uint32_t mipPageCountY = glm::max((pageCountY + (1u << mip) - 1) >> mip, 1u);
+		for (uint32_t y = 0; y < mipPageCountY; y++) {
+			for (uint32_t x = 0; x < mipPageCountX; x++) {
+				VirtualTexturePageEntry entry;
+				entry.page = VirtualPage::pack(x, y, mip);
+				entry.size = (uint32_t)pageDataSize;
+				entry.offset = 0;
+				entries.push_back(entry);
+			}
+		}
+	}
+
+	header.pageCount = entries.size();
+
+	uint64_t dataOffset = sizeof(VirtualTextureFileHeader) + sizeof(VirtualTexturePageEntry) * entries.size();
+	for (int i = 0; i < entries.size(); i++) {
+		entries[i].offset = dataOffset + pageDataSize * i;
+	}
+
+	FILE* file = fopen(filePath.c_str(), "wb");
+	if (file == NULL) {
+		error("Unable to build virtual texture page file \"%s\": Failed to open file for writing\n", filePath.c_str());
+		return false;
+	}
+
+	fwrite(&header, sizeof(VirtualTextureFileHeader), 1, file);
+	fwrite(&entries[0], sizeof(VirtualTexturePageEntry), entries.size(), file);
+
+	std::vector<uint8_t> pageData(pageDataSize);
+	for (int i = 0; i < entries.size(); i++) {
+		uint32_t mip = VirtualPage::mip(entries[i].page);
+		const std::vector<uint8_t>& level = levels[mip];
+		uvec2 levelSize = levelSizes[mip];
+		int32_t left = (int32_t)(VirtualPage::x(entries[i].page) * pageSize) - (int32_t)pageBorder;
+		int32_t top = (int32_t)(VirtualPage::y(entries[i].page) * pageSize) - (int32_t)pageBorder;
+
+		for (uint32_t y = 0; y < paddedPageSize; y++) {
+			uint32_t sy = (uint32_t)glm::clamp(top + (int32_t)y, 0, (int32_t)levelSize.y - 1);
+			for (uint32_t x = 0; x < paddedPageSize; x++) {
+				uint32_t sx = (uint32_t)glm::clamp(left + (int32_t)x, 0, (int32_t)levelSize.x - 1);
+				memcpy(&pageData[((uint64_t)y * paddedPageSize + x) * channels], &level[((uint64_t)sy * levelSize.x + sx) * channels], channels);
+			}
+		}
+
+		fwrite(&pageData[0], 1, pageDataSize, file);
+	}
+
+	bool success = ferror(file) == 0;
+	fclose(file);
+
+	if (!success) {
+		error("Unable to build virtual texture page file \"%s\": Failed to write page data\n", filePath.c_str());
+		return false;
+	}
+
+	info("Built virtual texture page file \"%s\" - %u x %u texels, %u mips, %u pages\n", filePath.c_str(), width, height, header.mipCount, header.pageCount);
+	return true;
+}
+
+bool VirtualTexturePageFile::buildFromImage(std::string imagePath, std::string filePath, uint32_t pageSize, uint32_t pageBorder) {
+	Image image;
+	if (!FileUtils::loadImage(imagePath, image, true)) {
+		return false;
+	}
+
+	return VirtualTexturePageFile::build(filePath, image.data, image.width, image.height, pageSize, pageBorder);
+}
+
+bool VirtualTexturePageFile::open(std::string filePath) {
+	this->close();
+
+	FILE* file = fopen(filePath.c_str(), "rb");
+	if (file == NULL) {
+		error("Unable to open virtual texture page file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	VirtualTextureFileHeader header;
+	if (fread(&header, sizeof(VirtualTextureFileHeader), 1, file) != 1 || header.magic != VIRTUAL_TEXTURE_FILE_MAGIC) {
+		error("Unable to open virtual texture page file \"%s\": Invalid header\n", filePath.c_str());
+		fclose(file);
+		return false;
+	}
+
+	if (header.version != VIRTUAL_TEXTURE_FILE_VERSION) {
+		error("Unable to open virtual texture page file \"%s\": Unsupported version %u\n", filePath.c_str(), header.version);
+		fclose(file);
+		return false;
+	}
+
+	std::vector<VirtualTexturePageEntry> entries(header.pageCount);
+	if (header.pageCount == 0 || fread(&entries[0], sizeof(VirtualTexturePageEntry), header.pageCount, file) != header.pageCount) {
+		error("Unable to open virtual texture page file \"%s\": Truncated page index\n", filePath.c_str());
+		fclose(file);
+		return false;
+	}
+
+	m_file = file;
+	m_header = header;
+	m_pageEntries.swap(entries);
+
+	m_mipPageOffsets.resize(m_header.mipCount);
+	uint32_t offset = 0;
+	for (uint32_t mip = 0; mip < m_header.mipCount; mip++) {
+		m_mipPageOffsets[mip] = offset;
+		offset += this->getPageCountX(mip) * this->getPageCountY(mip);
+	}
+
+	if (offset != m_header.pageCount) {
+		error("Unable to open virtual texture page file \"%s\": Page index does not match the mip layout\n", filePath.c_str());
+		this->close();
+		return false;
+	}
+
+	return true;
+}
+
+void VirtualTexturePageFile::close() {
+	std::lock_guard<std::mutex> lock(m_fileMutex);
+	if (m_file != NULL) {
+		fclose(m_file);
+		m_file = NULL;
+	}
+
+	m_pageEntries.clear();
+	m_mipPageOffsets.clear();
+}
+
+bool VirtualTexturePageFile::isOpen() const {
+	return m_file != NULL;
+}
+
+bool VirtualTexturePageFile::readPage(VirtualPageId page, std::vector<uint8_t>& dst) {
+	uint32_t index = this->getPageIndex(page);
+	if (index == VIRTUAL_PAGE_INVALID) {
+		return false;
+	}
+
+	const VirtualTexturePageEntry& entry = m_pageEntries[index];
+	dst.resize(entry.size);
+
+	std::lock_guard<std::mutex> lock(m_fileMutex);
+	if (m_file == NULL) {
+		return false;
+	}
+
+	if (fseek64(m_file, entry.offset, SEEK_SET) != 0 || fread(&dst[0], 1, entry.size, m_file) != entry.size) {
+		error("Failed to read virtual texture page [%u, %u] at mip %u\n", VirtualPage::x(page), VirtualPage::y(page), VirtualPage::mip(page));
+		return false;
+	}
+
+	return true;
+}
+
+bool VirtualTexturePageFile::isValidPage(VirtualPageId page) const {
+	return this->getPageIndex(page) != VIRTUAL_PAGE_INVALID;
+}
+
+uint32_t VirtualTexturePageFile::getPageIndex(VirtualPageId page) const {
+	uint32_t mip = VirtualPage::mip(page);
+	if (mip >= m_mipPageOffsets.size()) {
+		return VIRTUAL_PAGE_INVALID;
+	}
+
+	uint32_t x = VirtualPage::x(page);
+	uint32_t y = VirtualPage::y(page);
+	uint32_t pageCountX = this->getPageCountX(mip);
+	if (x >= pageCountX || y >= this->getPageCountY(mip)) {
+		return VIRTUAL_PAGE_INVALID;
+	}
+
+	return m_mipPageOffsets[mip] + y * pageCountX + x;
+}
+
+uint32_t VirtualTexturePageFile::getWidth() const {
+	return m_header.width;
+}
+
+uint32_t VirtualTexturePageFile::getHeight() const {
+	return m_header.height;
+}
+
+uint32_t VirtualTexturePageFile::getPageSize() const {
+	return m_header.pageSize;
+}
+
+uint32_t VirtualTexturePageFile::getPageBorder() const {
+	return m_header.pageBorder;
+}
+
+uint32_t VirtualTexturePageFile::getPaddedPageSize() const {
+	return m_header.pageSize + m_header.pageBorder * 2;
+}
+
+uint32_t VirtualTexturePageFile::getChannels() const {
+	return m_header.channels;
+}
+
+uint32_t VirtualTexturePageFile::getMipCount() const {
+	return m_header.mipCount;
+}
+
+uint32_t VirtualTexturePageFile::getPageCount() const {
+	return m_header.pageCount;
+}
+
+uint32_t VirtualTexturePageFile::getPageCountX(uint32_t mip) const {
+	if (m_header.pageSize == 0) return 0;
+	uint32_t pageCount = (m_header.width + m_header.pageSize - 1) / m_header.pageSize;
+	return glm::max((pageCount + (1u << mip) - 1) >> mip, 1u);
+}
+
+uint32_t VirtualTexturePageFile::getPageCountY(uint32_t mip) const {
+	if (m_header.pageSize == 0) return 0;
+	uint32_t pageCount = (m_header.height + m_header.pageSize - 1) / m_header.pageSize;
+	return glm::max((pageCount + (1u << mip) - 1) >> mip, 1u);
+}
+
+uint64_t VirtualTexturePageFile::getPageDataSize() const {
+	return (uint64_t)this->getPaddedPageSize() * this->getPaddedPageSize() * m_header.channels;
+}
+
+uint32_t VirtualTexturePageFile::calculateMipCount(uint32_t width, uint32_t height, uint32_t pageSize) {
+	uint32_t pageCount = glm::max((width + pageSize - 1) / pageSize, (height + pageSize - 1) / pageSize);
+	uint32_t mipCount = 1;
+	while ((1u << (mipCount - 1)) < pageCount) {
+		mipCount++;
+	}
+	return mipCount;
+}
+
+
+
+VirtualTexturePageTable::VirtualTexturePageTable(uint32_t pageCountX, uint32_t pageCountY, uint32_t mipCount):
+	m_pageCountX(pageCountX),
+	m_pageCountY(pageCountY),
+	m_mipCount(mipCount),
+	m_dirty(true) {
+
+	uint32_t entryCount = 0;
+	m_mipOffsets.resize(mipCount);
+	for (uint32_t mip = 0; mip < mipCount; mip++) {
+		m_mipOffsets[mip] = entryCount;
+		entryCount += this->getPageCountX(mip) * this->getPageCountY(mip);
+	}
+
+	m_slots.resize(entryCount, VIRTUAL_PAGE_INVALID);
+}
+
+VirtualTexturePageTable::~VirtualTexturePageTable() {
+}
+
+void VirtualTexturePageTable::setResident(VirtualPageId page, uint32_t slot) {
+	uint32_t index = this->getEntryIndex(page);
+	assert(index != VIRTUAL_PAGE_INVALID);
+	m_slots[index] = slot;
+	m_dirty = true;
+}
+
+void VirtualTexturePageTable::setNonResident(VirtualPageId page) {
+	uint32_t index = this->getEntryIndex(page);
+	if (index != VIRTUAL_PAGE_INVALID && m_slots[index] != VIRTUAL_PAGE_INVALID) {
+		m_slots[index] = VIRTUAL_PAGE_INVALID;
+		m_dirty = true;
+	}
+}
+
+bool VirtualTexturePageTable::isResident(VirtualPageId page) const {
+	return this->getSlot(page) != VIRTUAL_PAGE_INVALID;
+}
+
+uint32_t VirtualTexturePageTable::getSlot(VirtualPageId page) const {
+	uint32_t index = this->getEntryIndex(page);
+	if (index == VIRTUAL_PAGE_INVALID) {
+		return VIRTUAL_PAGE_INVALID;
+	}
+	return m_slots[index];
+}
+
+VirtualPageId VirtualTexturePageTable::findResidentPage(VirtualPageId page) const {
+	while (VirtualPage::mip(page) < m_mipCount) {
+		if (this->isResident(page)) {
+			return page;
+		}
+		page = VirtualPage::parent(page);
+	}
+	return VIRTUAL_PAGE_INVALID;
+}
+
+void VirtualTexturePageTable::buildIndirection(uint32_t mip, uint32_t slotsPerRow, std::vector<uint32_t>& dst) const {
+	// One R32UI texel per page: physical slot x in bits 0-7, slot y in bits 8-15, the mip level of the
+	// resident page in bits 16-23 and 0xFF in bits 24-31 when any ancestor is resident.
+	uint32_t pageCountX = this->getPageCountX(mip);
+	uint32_t pageCountY = this->getPageCountY(mip);
+	dst.resize(pageCountX * pageCountY);
+
+	for (uint32_t y = 0; y < pageCountY; y++) {
+		for (uint32_t x = 0; x < pageCountX; x++) {
+			uint32_t& texel = dst[y * pageCountX + x];
+			VirtualPageId residentPage = this->findResidentPage(VirtualPage::pack(x, y, mip));
+			if (residentPage == VIRTUAL_PAGE_INVALID) {
+				texel = 0;
+			} else {
+				uint32_t slot = this->getSlot(residentPage);
+				texel = ((slot % slotsPerRow) & 0xFF) | (((slot / slotsPerRow) & 0xFF) << 8) | ((VirtualPage::mip(residentPage) & 0xFF) << 16) | (0xFFu << 24);
+			}
+		}
+	}
+}
+
+uint32_t VirtualTexturePageTable::getPageCountX(uint32_t mip) const {
+	return glm::max((m_pageCountX + (1u << mip) - 1) >> mip, 1u);
+}
+
+uint32_t VirtualTexturePageTable::getPageCountY(uint32_t mip) const {
+	return glm::max((m_pageCountY + (1u << mip) - 1) >> mip, 1u);
+}
+
+uint32_t VirtualTexturePageTable::getMipCount() const {
+	return m_mipCount;
+}
+
+bool VirtualTexturePageTable::isDirty() const {
+	return m_dirty;
+}
+
+void VirtualTexturePageTable::clearDirty() {
+	m_dirty = false;
+}
+
+uint32_t VirtualTexturePageTable::getEntryIndex(VirtualPageId page) const {
+	uint32_t mip = VirtualPage::mip(page);
+	if (mip >= m_mipCount) {
+		return VIRTUAL_PAGE_INVALID;
+	}
+
+	uint32_t x = VirtualPage::x(page);
+	uint32_t y = VirtualPage::y(page);
+	uint32_t pageCountX = this->getPageCountX(mip);
+	if (x >= pageCountX || y >= this->getPageCountY(mip)) {
+		return VIRTUAL_PAGE_INVALID;
+	}
+
+	return m_mipOffsets[mip] + y * pageCountX + x;
+}
+
+
+
+VirtualTexturePageCache::VirtualTexturePageCache(uint32_t slotCount) {
+	m_slots.resize(slotCount);
+	this->clear();
+}
+
+VirtualTexturePageCache::~VirtualTexturePageCache() {
+}
+
+uint32_t VirtualTexturePageCache::find(VirtualPageId page) const {
+	auto it = m_residentPages.find(page);
+	if (it == m_residentPages.end()) {
+		return VIRTUAL_PAGE_INVALID;
+	}
+	return it->second;
+}
+
+bool VirtualTexturePageCache::touch(VirtualPageId page, uint64_t frame) {
+	uint32_t slotIndex = this->find(page);
+	if (slotIndex == VIRTUAL_PAGE_INVALID) {
+		return false;
+	}
+
+	Slot& slot = m_slots[slotIndex];
+	slot.lastUsedFrame = frame;
+	m_lru.splice(m_lru.begin(), m_lru, slot.lruIterator);
+	return true;
+}
+
+uint32_t VirtualTexturePageCache::allocate(VirtualPageId page, uint64_t frame, VirtualPageId* evictedPage) {
+	if (evictedPage != NULL) {
+		*evictedPage = VIRTUAL_PAGE_INVALID;
+	}
+
+	uint32_t slotIndex = this->find(page);
+	if (slotIndex != VIRTUAL_PAGE_INVALID) {
+		this->touch(page, frame);
+		return slotIndex;
+	}
+
+	// Walk from the least recently used end, skipping locked slots. Pages used this frame are never
+	// evicted, otherwise a working set larger than the cache would thrash every frame.
+	for (auto it = m_lru.rbegin(); it != m_lru.rend(); ++it) {
+		Slot& slot = m_slots[*it];
+		if (slot.locked) {
+			continue;
+		}
+
+		if (slot.page != VIRTUAL_PAGE_INVALID) {
+			if (slot.lastUsedFrame >= frame) {
+				return VIRTUAL_PAGE_INVALID;
+			}
+
+			if (evictedPage != NULL) {
+				*evictedPage = slot.page;
+			}
+			m_residentPages.erase(slot.page);
+		}
+
+		slotIndex = *it;
+		slot.page = page;
+		slot.lastUsedFrame = frame;
+		m_lru.splice(m_lru.begin(), m_lru, slot.lruIterator);
+		m_residentPages[page] = slotIndex;
+		return slotIndex;
+	}
+
+	return VIRTUAL_PAGE_INVALID;
+}
+
+void VirtualTexturePageCache::evict(VirtualPageId page) {
+	uint32_t slotIndex = this->find(page);
+	if (slotIndex == VIRTUAL_PAGE_INVALID) {
+		return;
+	}
+
+	Slot& slot = m_slots[slotIndex];
+	slot.page = VIRTUAL_PAGE_INVALID;
+	slot.lastUsedFrame = 0;
+	slot.locked = false;
+	m_lru.splice(m_lru.end(), m_lru, slot.lruIterator);
+	m_residentPages.erase(page);
+}
+
+void VirtualTexturePageCache::lock(VirtualPageId page) {
+	uint32_t slotIndex = this->find(page);
+	if (slotIndex != VIRTUAL_PAGE_INVALID) {
+		m_slots[slotIndex].locked = true;
+	}
+}
+
+void VirtualTexturePageCache::unlock(VirtualPageId page) {
+	uint32_t slotIndex = this->find(page);
+	if (slotIndex != VIRTUAL_PAGE_INVALID) {
+		m_slots[slotIndex].locked = false;
+	}
+}
+
+void VirtualTexturePageCache::clear() {
+	m_lru.clear();
+	m_residentPages.clear();
+	for (uint32_t i = 0; i < m_slots.size(); i++) {
+		m_slots[i].page = VIRTUAL_PAGE_INVALID;
+		m_slots[i].lastUsedFrame = 0;
+		m_slots[i].locked = false;
+		m_slots[i].lruIterator = m_lru.insert(m_lru.end(), i);
+	}
+}
+
+uint32_t VirtualTexturePageCache::getSlotCount() const {
+	return m_slots.size();
+}
+
+uint32_t VirtualTexturePageCache::getResidentCount() const {
+	return m_residentPages.size();
+}
+
+uint32_t VirtualTexturePageCache::getAvailableCount(uint64_t frame) const {
+	// Slots that allocate() could hand out this frame. The LRU list is ordered by last use, so the walk
+	// stops at the first slot already used this frame.
+	uint32_t count = 0;
+	for (auto it = m_lru.rbegin(); it != m_lru.rend(); ++it) {
+		const Slot& slot = m_slots[*it];
+		if (slot.locked) {
+			continue;
+		}
+		if (slot.page != VIRTUAL_PAGE_INVALID && slot.lastUsedFrame >= frame) {
+			break;
+		}
+		++count;
+	}
+	return count;
+}
+
+
+
+void VirtualTextureFeedback::analyse(const uint32_t* feedback, size_t count, std::vector<VirtualTexturePageRequest>& dstRequests) {
+	std::unordered_map<VirtualPageId, uint32_t> pageCounts;
+	for (size_t i = 0; i < count; i++) {
+		if (feedback[i] != VIRTUAL_PAGE_INVALID) {
+			pageCounts[feedback[i]]++;
+		}
+	}
+
+	dstRequests.clear();
+	dstRequests.reserve(pageCounts.size());
+	for (auto it = pageCounts.begin(); it != pageCounts.end(); ++it) {
+		VirtualTexturePageRequest request;
+		request.page = it->first;
+		request.count = it->second;
+		dstRequests.push_back(request);
+	}
+
+	VirtualTextureFeedback::sortRequests(dstRequests);
+}
+
+void VirtualTextureFeedback::sortRequests(std::vector<VirtualTexturePageRequest>& requests) {
+	// Coarse pages first, since a missing coarse page leaves everything below it without a fallback.
+	// Within a mip level, the most sampled pages win. The page id breaks ties so the order is stable.
+	std::sort(requests.begin(), requests.end(), [](const VirtualTexturePageRequest& lhs, const VirtualTexturePageRequest& rhs) {
+		uint32_t lhsMip = VirtualPage::mip(lhs.page);
+		uint32_t rhsMip = VirtualPage::mip(rhs.page);
+		if (lhsMip != rhsMip) return lhsMip > rhsMip;
+		if (lhs.count != rhs.count) return lhs.count > rhs.count;
+		return lhs.page < rhs.page;
+	});
+}
+
+
+
+VirtualTexturePageLoader::VirtualTexturePageLoader(VirtualTexturePageFile* pageFile, uint32_t threadCount):
+	m_pageFile(pageFile),
+	m_activeLoads(0),
+	m_running(true) {
+	for (uint32_t i = 0; i < threadCount; i++) {
+		m_threads.push_back(std::thread(&VirtualTexturePageLoader::workerThread, this));
+	}
+}
+
+VirtualTexturePageLoader::~VirtualTexturePageLoader() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+		m_requests.clear();
+	}
+
+	m_requestCondition.notify_all();
+	for (int i = 0; i < m_threads.size(); i++) {
+		m_threads[i].join();
+	}
+}
+
+bool VirtualTexturePageLoader::request(VirtualPageId page) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_pendingPages.insert(page).second) {
+			return false; // Already queued or loading
+		}
+		m_requests.push_back(std::make_pair(page, Profiler::beginFlow()));
+	}
+
+	m_requestCondition.notify_one();
+	return true;
+}
+
+void VirtualTexturePageLoader::collect(std::vector<VirtualTexturePage>& dstPages) {
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (m_threads.empty()) {
+		while (this->loadNext(lock));
+	}
+
+	for (int i = 0; i < m_completedPages.size(); i++) {
+		m_pendingPages.erase(m_completedPages[i].page);
+		dstPages.push_back(std::move(m_completedPages[i]));
+	}
+	m_completedPages.clear();
+}
+
+void VirtualTexturePageLoader::flush() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (m_threads.empty()) {
+		while (this->loadNext(lock));
+	} else {
+		m_idleCondition.wait(lock, [this]() { return m_requests.empty() && m_activeLoads == 0; });
+	}
+}
+
+bool VirtualTexturePageLoader::isPending(VirtualPageId page) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pendingPages.count(page) != 0;
+}
+
+uint32_t VirtualTexturePageLoader::getPendingCount() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pendingPages.size();
+}
+
+void VirtualTexturePageLoader::workerThread() {
+	Profiler::setThreadName("VirtualTexture Loader");
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_requestCondition.wait(lock, [this]() { return !m_running || !m_requests.empty(); });
+		if (!m_running) {
+			break;
+		}
+
+		this->loadNext(lock);
+
+		if (m_requests.empty() && m_activeLoads == 0) {
+			m_idleCondition.notify_all();
+		}
+	}
+}
+
+bool VirtualTexturePageLoader::loadNext(std::unique_lock<std::mutex>& lock) {
+	if (m_requests.empty()) {
+		return false;
+	}
+
+	VirtualTexturePage page;
+	page.page = m_requests.front().first;
+	page.slot = VIRTUAL_PAGE_INVALID;
+	ProfileFlow flow = m_requests.front().second;
+	m_requests.pop_front();
+	++m_activeLoads;
+
+	// The page file serializes its own reads, so the loader lock is released for the duration of the read.
+	lock.unlock();
+	bool loaded;
+	{
+		PROFILE_SCOPE("VirtualTexturePageLoader::loadPage");
+		Profiler::endFlow(flow);
+		loaded = m_pageFile->readPage(page.page, page.data);
+	}
+	lock.lock();
+
+	--m_activeLoads;
+	if (loaded) {
+		m_completedPages.push_back(std::move(page));
+	} else {
+		m_pendingPages.erase(page.page);
+	}
+	return true;
+}
+
+
+
+VirtualTexture::VirtualTexture(VirtualTexturePageFile* pageFile, uint32_t physicalSlotsX, uint32_t physicalSlotsY, uint32_t loaderThreadCount):
+	m_pageFile(pageFile),
+	m_pageTable(pageFile->getPageCountX(0), pageFile->getPageCountY(0), pageFile->getMipCount()),
+	m_pageCache(physicalSlotsX * physicalSlotsY),
+	m_physicalSlotsX(physicalSlotsX),
+	m_physicalSlotsY(physicalSlotsY),
+	m_maxRequestsPerFrame(32),
+	m_maxUploadsPerFrame(16),
+	m_requestedPageCount(0),
+	m_evictedPageCount(0) {
+
+	assert(physicalSlotsX <= 256 && physicalSlotsY <= 256); // Indirection texels store 8 bit slot coordinates
+
+	m_loader = new VirtualTexturePageLoader(m_pageFile, loaderThreadCount);
+
+	// The coarsest mip is always requested and locked once resident, so every lookup has a fallback.
+	uint32_t topMip = m_pageFile->getMipCount() - 1;
+	for (uint32_t y = 0; y < m_pageFile->getPageCountY(topMip); y++) {
+		for (uint32_t x = 0; x < m_pageFile->getPageCountX(topMip); x++) {
+			m_loader->request(VirtualPage::pack(x, y, topMip));
+		}
+	}
+}
+
+VirtualTexture::~VirtualTexture() {
+	delete m_loader; // Joins the loader threads before the page file goes away
+	delete m_pageFile;
+}
+
+bool VirtualTexture::load(std::string filePath, VirtualTexture** dstVirtualTexturePtr, uint32_t physicalSlotsX, uint32_t physicalSlotsY, uint32_t loaderThreadCount) {
+	assert(dstVirtualTexturePtr != NULL);
+
+	VirtualTexturePageFile* pageFile = new VirtualTexturePageFile();
+	if (!pageFile->open(filePath)) {
+		delete pageFile;
+		return false;
+	}
+
+	*dstVirtualTexturePtr = new VirtualTexture(pageFile, physicalSlotsX, physicalSlotsY, loaderThreadCount);
+	return true;
+}
+
+void VirtualTexture::update(const uint32_t* feedback, size_t feedbackCount, uint64_t frame) {
+	VirtualTextureFeedback::analyse(feedback, feedbackCount, m_feedbackRequests);
+
+	std::vector<VirtualPageId> requests;
+	for (int i = 0; i < m_feedbackRequests.size(); i++) {
+		VirtualPageId page = m_feedbackRequests[i].page;
+		if (!m_pageFile->isValidPage(page)) {
+			continue;
+		}
+
+		this->requestPage(page, requests);
+	}
+
+	// Everything actually visible this frame gets touched before anything is allocated, so none of
+	// it is evicted by the pages arriving below.
+	for (int i = 0; i < m_feedbackRequests.size(); i++) {
+		VirtualPageId residentPage = m_pageTable.findResidentPage(m_feedbackRequests[i].page);
+		if (residentPage != VIRTUAL_PAGE_INVALID) {
+			m_pageCache.touch(residentPage, frame);
+		}
+	}
+
+	// Never request more than the cache can take this frame, pages that arrive without a free slot
+	// would only be read from disk again next frame.
+	uint32_t requestBudget = glm::min(m_maxRequestsPerFrame, m_pageCache.getAvailableCount(frame));
+	uint32_t pendingCount = m_loader->getPendingCount() + m_loadedPages.size();
+	requestBudget = pendingCount >= requestBudget ? 0 : requestBudget - pendingCount;
+
+	for (int i = 0; i < requests.size() && requestBudget > 0; i++) {
+		if (m_loader->request(requests[i])) {
+			++m_requestedPageCount;
+			--requestBudget;
+		}
+	}
+
+	m_loader->collect(m_loadedPages);
+
+	// Coarse pages are made resident first, for the same reason they are requested first.
+	std::stable_sort(m_loadedPages.begin(), m_loadedPages.end(), [](const VirtualTexturePage& lhs, const VirtualTexturePage& rhs) {
+		return VirtualPage::mip(lhs.page) > VirtualPage::mip(rhs.page);
+	});
+
+	uint32_t uploadCount = 0;
+	auto it = m_loadedPages.begin();
+	for (; it != m_loadedPages.end() && uploadCount < m_maxUploadsPerFrame; ++it, ++uploadCount) {
+		this->makeResident(*it, frame);
+	}
+	m_loadedPages.erase(m_loadedPages.begin(), it);
+}
+
+std::vector<VirtualTexturePage>& VirtualTexture::getPendingUploads() {
+	return m_pendingUploads;
+}
+
+void VirtualTexture::clearPendingUploads() {
+	m_pendingUploads.clear();
+}
+
+void VirtualTexture::buildIndirection(uint32_t mip, std::vector<uint32_t>& dst) const {
+	m_pageTable.buildIndirection(mip, m_physicalSlotsX, dst);
+}
+
+bool VirtualTexture::isIndirectionDirty() const {
+	return m_pageTable.isDirty();
+}
+
+void VirtualTexture::clearIndirectionDirty() {
+	m_pageTable.clearDirty();
+}
+
+void VirtualTexture::flushLoader() {
+	m_loader->flush();
+}
+
+uvec2 VirtualTexture::getSlotCoord(uint32_t slot) const {
+	return uvec2(slot % m_physicalSlotsX, slot / m_physicalSlotsX);
+}
+
+VirtualTexturePageFile* VirtualTexture::getPageFile() const {
+	return m_pageFile;
+}
+
+const VirtualTexturePageTable& VirtualTexture::getPageTable() const {
+	return m_pageTable;
+}
+
+const VirtualTexturePageCache& VirtualTexture::getPageCache() const {
+	return m_pageCache;
+}
+
+uint32_t VirtualTexture::getPhysicalSlotsX() const {
+	return m_physicalSlotsX;
+}
+
+uint32_t VirtualTexture::getPhysicalSlotsY() const {
+	return m_physicalSlotsY;
+}
+
+uint32_t VirtualTexture::getMaxRequestsPerFrame() const {
+	return m_maxRequestsPerFrame;
+}
+
+void VirtualTexture::setMaxRequestsPerFrame(uint32_t maxRequestsPerFrame) {
+	m_maxRequestsPerFrame = maxRequestsPerFrame;
+}
+
+uint32_t VirtualTexture::getMaxUploadsPerFrame() const {
+	return m_maxUploadsPerFrame;
+}
+
+void VirtualTexture::setMaxUploadsPerFrame(uint32_t maxUploadsPerFrame) {
+	m_maxUploadsPerFrame = maxUploadsPerFrame;
+}
+
+uint64_t VirtualTexture::getRequestedPageCount() const {
+	return m_requestedPageCount;
+}
+
+uint64_t VirtualTexture::getEvictedPageCount() const {
+	return m_evictedPageCount;
+}
+
+void VirtualTexture::requestPage(VirtualPageId page, std::vector<VirtualPageId>& dstRequests) {
+	// Request the page and any missing ancestors, coarsest first, so the fallback chain fills in
+	// from the top while the detailed page is still on its way.
+	std::vector<VirtualPageId> chain;
+	while (VirtualPage::mip(page) < m_pageTable.getMipCount() && !m_pageTable.isResident(page)) {
+		chain.push_back(page);
+		page = VirtualPage::parent(page);
+	}
+
+	for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+		if (std::find(dstRequests.begin(), dstRequests.end(), *it) == dstRequests.end()) {
+			dstRequests.push_back(*it);
+		}
+	}
+}
+
+void VirtualTexture::makeResident(VirtualTexturePage& page, uint64_t frame) {
+	if (m_pageTable.isResident(page.page)) {
+		return;
+	}
+
+	VirtualPageId evictedPage = VIRTUAL_PAGE_INVALID;
+	uint32_t slot = m_pageCache.allocate(page.page, frame, &evictedPage);
+	if (slot == VIRTUAL_PAGE_INVALID) {
+		return; // Every slot is locked or in use this frame, the page will be requested again by later feedback
+	}
+
+	if (evictedPage != VIRTUAL_PAGE_INVALID) {
+		m_pageTable.setNonResident(evictedPage);
+		++m_evictedPageCount;
+
+		// The slot may still have an upload queued for the evicted page.
+		for (auto it = m_pendingUploads.begin(); it != m_pendingUploads.end(); ++it) {
+			if (it->page == evictedPage) {
+				m_pendingUploads.erase(it);
+				break;
+			}
+		}
+	}
+
+	if (VirtualPage::mip(page.page) == m_pageFile->getMipCount() - 1) {
+		m_pageCache.lock(page.page);
+	}
+
+	m_pageTable.setResident(page.page, slot);
+	page.slot = slot;
+	m_pendingUploads.push_back(std::move(page));
+}
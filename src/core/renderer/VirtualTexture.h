@@ -0,0 +1,313 @@
+#pragma once
+
+#include "core/pch.h"
+#include "core/profiler/Profiler.h"
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+
+// CPU side of the streaming virtual texture system. Nothing in this file touches OpenGL, the GPU
+// physical cache and indirection textures are owned by MaterialManager and fed from the uploads
+// produced here.
+
+#define VIRTUAL_PAGE_INVALID 0xFFFFFFFF
+#define VIRTUAL_TEXTURE_FILE_MAGIC 0x50545653 // "SVTP"
+#define VIRTUAL_TEXTURE_FILE_VERSION 1
+
+typedef uint32_t VirtualPageId; // 14 bits page x, 14 bits page y, 4 bits mip level
+
+namespace VirtualPage {
+	inline VirtualPageId pack(uint32_t x, uint32_t y, uint32_t mip) {
+		return (x & 0x3FFF) | ((y & 0x3FFF) << 14) | ((mip & 0xF) << 28);
+	}
+
+	inline uint32_t x(VirtualPageId page) {
+		return page & 0x3FFF;
+	}
+
+	inline uint32_t y(VirtualPageId page) {
+		return (page >> 14) & 0x3FFF;
+	}
+
+	inline uint32_t mip(VirtualPageId page) {
+		return (page >> 28) & 0xF;
+	}
+
+	inline VirtualPageId parent(VirtualPageId page) {
+		return VirtualPage::pack(VirtualPage::x(page) >> 1, VirtualPage::y(page) >> 1, VirtualPage::mip(page) + 1);
+	}
+}
+
+struct VirtualTextureFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width; // Texel width of mip 0
+	uint32_t height; // Texel height of mip 0
+	uint32_t pageSize; // Interior texel size of a page, excluding the border
+	uint32_t pageBorder; // Texels duplicated from neighbouring pages on each side, so filtering never reads across a page boundary
+	uint32_t channels; // Bytes per texel, always RGBA8 for now
+	uint32_t mipCount;
+	uint32_t pageCount;
+	uint32_t padding;
+};
+
+struct VirtualTexturePageEntry {
+	uint64_t offset; // Byte offset of the page data from the start of the file
+	uint32_t size; // Byte size of the page data, allows compressed pages later on
+	VirtualPageId page;
+};
+
+struct VirtualTexturePage {
+	VirtualPageId page;
+	uint32_t slot; // Physical cache slot, VIRTUAL_PAGE_INVALID until the page is made resident
+	std::vector<uint8_t> data;
+};
+
+struct VirtualTexturePageRequest {
+	VirtualPageId page;
+	uint32_t count; // Number of feedback samples that referenced this page
+};
+
+// Pages are stored mip by mip, row by row, each page being (pageSize + 2 * pageBorder)^2 texels.
+class VirtualTexturePageFile : private NotCopyable {
+public:
+	VirtualTexturePageFile();
+
+	~VirtualTexturePageFile();
+
+	static bool build(std::string filePath, const uint8_t* data, uint32_t width, uint32_t height, uint32_t pageSize = 128, uint32_t pageBorder = 4);
+
+	static bool buildFromImage(std::string imagePath, std::string filePath, uint32_t pageSize = 128, uint32_t pageBorder = 4);
+
+	bool open(std::string filePath);
+
+	void close();
+
+	bool isOpen() const;
+
+	bool readPage(VirtualPageId page, std::vector<uint8_t>& dst);
+
+	bool isValidPage(VirtualPageId page) const;
+
+	uint32_t getPageIndex(VirtualPageId page) const;
+
+	uint32_t getWidth() const;
+
+	uint32_t getHeight() const;
+
+	uint32_t getPageSize() const;
+
+	uint32_t getPageBorder() const;
+
+	uint32_t getPaddedPageSize() const;
+
+	uint32_t getChannels() const;
+
+	uint32_t getMipCount() const;
+
+	uint32_t getPageCount() const;
+
+	uint32_t getPageCountX(uint32_t mip) const;
+
+	uint32_t getPageCountY(uint32_t mip) const;
+
+	uint64_t getPageDataSize() const;
+
+	static uint32_t calculateMipCount(uint32_t width, uint32_t height, uint32_t pageSize);
+
+private:
+	FILE* m_file;
+	std::mutex m_fileMutex;
+	VirtualTextureFileHeader m_header;
+	std::vector<VirtualTexturePageEntry> m_pageEntries;
+	std::vector<uint32_t> m_mipPageOffsets; // Index of the first page entry of each mip level
+};
+
+// Maps every virtual page to the physical cache slot holding it.
+class VirtualTexturePageTable {
+public:
+	VirtualTexturePageTable(uint32_t pageCountX, uint32_t pageCountY, uint32_t mipCount);
+
+	~VirtualTexturePageTable();
+
+	void setResident(VirtualPageId page, uint32_t slot);
+
+	void setNonResident(VirtualPageId page);
+
+	bool isResident(VirtualPageId page) const;
+
+	uint32_t getSlot(VirtualPageId page) const;
+
+	VirtualPageId findResidentPage(VirtualPageId page) const;
+
+	void buildIndirection(uint32_t mip, uint32_t slotsPerRow, std::vector<uint32_t>& dst) const;
+
+	uint32_t getPageCountX(uint32_t mip) const;
+
+	uint32_t getPageCountY(uint32_t mip) const;
+
+	uint32_t getMipCount() const;
+
+	bool isDirty() const;
+
+	void clearDirty();
+
+private:
+	uint32_t getEntryIndex(VirtualPageId page) const;
+
+	std::vector<uint32_t> m_slots;
+	std::vector<uint32_t> m_mipOffsets;
+	uint32_t m_pageCountX;
+	uint32_t m_pageCountY;
+	uint32_t m_mipCount;
+	bool m_dirty;
+};
+
+// Fixed number of physical slots, least recently used pages are evicted first. Locked pages
+// (typically the coarsest mip, which acts as the fallback for everything else) are never evicted.
+class VirtualTexturePageCache {
+public:
+	VirtualTexturePageCache(uint32_t slotCount);
+
+	~VirtualTexturePageCache();
+
+	uint32_t find(VirtualPageId page) const;
+
+	bool touch(VirtualPageId page, uint64_t frame);
+
+	uint32_t allocate(VirtualPageId page, uint64_t frame, VirtualPageId* evictedPage = NULL);
+
+	void evict(VirtualPageId page);
+
+	void lock(VirtualPageId page);
+
+	void unlock(VirtualPageId page);
+
+	void clear();
+
+	uint32_t getSlotCount() const;
+
+	uint32_t getResidentCount() const;
+
+	uint32_t getAvailableCount(uint64_t frame) const;
+
+private:
+	struct Slot {
+		VirtualPageId page = VIRTUAL_PAGE_INVALID;
+		uint64_t lastUsedFrame = 0;
+		bool locked = false;
+		std::list<uint32_t>::iterator lruIterator;
+	};
+
+	std::vector<Slot> m_slots;
+	std::list<uint32_t> m_lru; // Front is most recently used
+	std::unordered_map<VirtualPageId, uint32_t> m_residentPages;
+};
+
+namespace VirtualTextureFeedback {
+	void analyse(const uint32_t* feedback, size_t count, std::vector<VirtualTexturePageRequest>& dstRequests);
+
+	void sortRequests(std::vector<VirtualTexturePageRequest>& requests);
+}
+
+// Reads pages from a page file on background threads. With a thread count of zero, requests are
+// serviced synchronously inside collect(), which keeps the scheduling deterministic.
+class VirtualTexturePageLoader : private NotCopyable {
+public:
+	VirtualTexturePageLoader(VirtualTexturePageFile* pageFile, uint32_t threadCount = 1);
+
+	~VirtualTexturePageLoader();
+
+	bool request(VirtualPageId page);
+
+	void collect(std::vector<VirtualTexturePage>& dstPages);
+
+	void flush();
+
+	bool isPending(VirtualPageId page);
+
+	uint32_t getPendingCount();
+
+private:
+	void workerThread();
+
+	bool loadNext(std::unique_lock<std::mutex>& lock);
+
+	VirtualTexturePageFile* m_pageFile;
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_requestCondition;
+	std::condition_variable m_idleCondition;
+	std::deque<std::pair<VirtualPageId, ProfileFlow>> m_requests; // Each request is linked to the scope that made it
+	std::set<VirtualPageId> m_pendingPages; // Queued or being read
+	std::vector<VirtualTexturePage> m_completedPages;
+	uint32_t m_activeLoads;
+	bool m_running;
+};
+
+class VirtualTexture : private NotCopyable {
+public:
+	VirtualTexture(VirtualTexturePageFile* pageFile, uint32_t physicalSlotsX, uint32_t physicalSlotsY, uint32_t loaderThreadCount = 1);
+
+	~VirtualTexture();
+
+	static bool load(std::string filePath, VirtualTexture** dstVirtualTexturePtr, uint32_t physicalSlotsX = 16, uint32_t physicalSlotsY = 16, uint32_t loaderThreadCount = 1);
+
+	void update(const uint32_t* feedback, size_t feedbackCount, uint64_t frame);
+
+	std::vector<VirtualTexturePage>& getPendingUploads();
+
+	void clearPendingUploads();
+
+	void buildIndirection(uint32_t mip, std::vector<uint32_t>& dst) const;
+
+	bool isIndirectionDirty() const;
+
+	void clearIndirectionDirty();
+
+	void flushLoader();
+
+	uvec2 getSlotCoord(uint32_t slot) const;
+
+	VirtualTexturePageFile* getPageFile() const;
+
+	const VirtualTexturePageTable& getPageTable() const;
+
+	const VirtualTexturePageCache& getPageCache() const;
+
+	uint32_t getPhysicalSlotsX() const;
+
+	uint32_t getPhysicalSlotsY() const;
+
+	uint32_t getMaxRequestsPerFrame() const;
+
+	void setMaxRequestsPerFrame(uint32_t maxRequestsPerFrame);
+
+	uint32_t getMaxUploadsPerFrame() const;
+
+	void setMaxUploadsPerFrame(uint32_t maxUploadsPerFrame);
+
+	uint64_t getRequestedPageCount() const;
+
+	uint64_t getEvictedPageCount() const;
+
+private:
+	void requestPage(VirtualPageId page, std::vector<VirtualPageId>& dstRequests);
+
+	void makeResident(VirtualTexturePage& page, uint64_t frame);
+
+	VirtualTexturePageFile* m_pageFile;
+	VirtualTexturePageTable m_pageTable;
+	VirtualTexturePageCache m_pageCache;
+	VirtualTexturePageLoader* m_loader;
+	std::vector<VirtualTexturePageRequest> m_feedbackRequests;
+	std::vector<VirtualTexturePage> m_loadedPages; // Read from disk, waiting for an upload budget
+	std::vector<VirtualTexturePage> m_pendingUploads; // Resident in the page table, waiting to be copied to the physical cache
+	uint32_t m_physicalSlotsX;
+	uint32_t m_physicalSlotsY;
+	uint32_t m_maxRequestsPerFrame;
+	uint32_t m_maxUploadsPerFrame;
+	uint64_t m_requestedPageCount;
+	uint64_t m_evictedPageCount;
+};
@@ -6,6 +6,10 @@
 #include "core/scene/Scene.h"
 #include "core/scene/Camera.h"
 #include "core/Engine.h"
+#include "core/voxel/SVOFile.h"
+#include "core/voxel/VoxelFragmentEstimator.h"
+
+#define VOXEL_FRAGMENT_COUNT_READBACK_COUNT 3
 
 struct VoxelLinkedListNode {
 	uint32_t albedo; // rgba8
@@ -48,7 +52,16 @@ struct OctreeConstructionData {
 VoxelGenerator::VoxelGenerator(uint32_t gridSize, double gridScale):
 	m_gridCenter(0.0),
 	m_gridSize(0),
-	m_gridScale(1.0) {
+	m_gridScale(1.0),
+	m_voxelFragmentAllocatedCount(0),
+	m_voxelFragmentCount(0),
+	m_voxelFragmentRequiredCount(0),
+	m_voxelizationFrame(0),
+	m_octreeNodeAllocatedCount(0),
+	m_octreeNodeCount(0),
+	m_bakedOctree(false) {
+
+	m_fragmentEstimator = new VoxelFragmentEstimator();
 
 	int32_t resetBuffer[10] = {0,1,2,3,4,5,6,7,8,9};
 
@@ -75,8 +88,21 @@ VoxelGenerator::VoxelGenerator(uint32_t gridSize, double gridScale):
 	glGenBuffers(5, m_voxelFragmentTextureBuffer);
 	glGenBuffers(1, &m_voxelFragmentCounterBuffer);
 	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, m_voxelFragmentCounterBuffer);
-	glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(uint32_t), NULL, GL_DYNAMIC_DRAW);
+	glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(uint32_t) * 2, NULL, GL_DYNAMIC_DRAW);
 	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+	this->clearVoxelFragmentCounters();
+
+	m_voxelFragmentCountReadbacks.resize(VOXEL_FRAGMENT_COUNT_READBACK_COUNT);
+	for (int i = 0; i < m_voxelFragmentCountReadbacks.size(); i++) {
+		VoxelFragmentCountReadback& readback = m_voxelFragmentCountReadbacks[i];
+		readback.fence = NULL;
+		readback.frame = 0;
+		readback.estimate = 0;
+		glGenBuffers(1, &readback.buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(uint32_t) * 2, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
 	glGenTextures(1, &m_octreeBrickTexture);
 	glGenTextures(5, m_octreeNodeTexture);
@@ -130,6 +156,14 @@ VoxelGenerator::~VoxelGenerator() {
 	glDeleteBuffers(5, m_voxelFragmentTextureBuffer);
 	glDeleteBuffers(1, &m_voxelFragmentCounterBuffer);
 	glDeleteTextures(1, &m_octreeBrickTexture);
+
+	for (int i = 0; i < m_voxelFragmentCountReadbacks.size(); i++) {
+		if (m_voxelFragmentCountReadbacks[i].fence != NULL) {
+			glDeleteSync(m_voxelFragmentCountReadbacks[i].fence);
+		}
+		glDeleteBuffers(1, &m_voxelFragmentCountReadbacks[i].buffer);
+	}
+
 	glDeleteTextures(5, m_octreeNodeTexture);
 	glDeleteBuffers(5, m_octreeNodeTextureBuffer);
 	glDeleteBuffers(1, &m_octreeConstructionDataBuffer);
@@ -138,9 +172,14 @@ VoxelGenerator::~VoxelGenerator() {
 
 	glDeleteVertexArrays(1, &m_visualizationVAO);
 	this->deleteVoxelVisualizationTexture();
+
+	delete m_fragmentEstimator;
 }
 
 void VoxelGenerator::render(double dt, double partialTicks) {
+	if (m_bakedOctree)
+		return;
+
 	//glFinish();
 	//uint64_t a = Engine::instance()->getCurrentTime();
 
@@ -156,9 +195,24 @@ void VoxelGenerator::render(double dt, double partialTicks) {
 	//glEnable(GL_CONSERVATIVE_RASTERIZATION_NV); // TODO: MSAA instead of this
 
 
-	this->voxelFragmentCountPass(dt, partialTicks);
-	this->allocateVoxelFragmentBuffers(false);
-	this->voxelFragmentStoragePass(dt, partialTicks);
+	if (m_fragmentEstimator->hasGeometry()) {
+		// Size the fragment buffers from the estimate, so the scene is only rasterized once. Fragments that
+		// do not fit are dropped and counted on the GPU. The counts reach the CPU a frame or two later,
+		// without waiting, and correct the estimate, so an overflow grows the buffers for a later frame
+		// instead of repeating the pass.
+		this->readVoxelFragmentCounts();
+
+		uint64_t estimate = m_fragmentEstimator->estimate(m_gridCenter, m_gridSize, m_gridScale);
+		uint64_t fragmentCount = glm::max(m_fragmentEstimator->getAllocationCount(estimate), (uint64_t)m_voxelFragmentRequiredCount);
+		this->allocateVoxelFragmentBuffers((uint32_t)glm::min(fragmentCount, (uint64_t)UINT32_MAX), false);
+		this->voxelFragmentStoragePass(dt, partialTicks);
+		this->copyVoxelFragmentCounts(estimate);
+	} else {
+		this->voxelFragmentCountPass(dt, partialTicks);
+		this->allocateVoxelFragmentBuffers(m_voxelFragmentCount, false);
+		this->voxelFragmentStoragePass(dt, partialTicks);
+	}
+
 	this->countOctreeNodes(); // TODO: more exact count
 	this->allocateOctreeNodeBuffers(); // TODO: expand buffer to fit required size without erasing existing data
 	this->octreeConstructionPass(dt, partialTicks);
@@ -179,6 +233,35 @@ void VoxelGenerator::render(double dt, double partialTicks) {
 	//info("Took %.2f msec to voxelize scene\n", (b - a) / 1000000.0);
 }
 
+bool VoxelGenerator::loadOctree(std::string filePath) {
+	SVOFile file;
+	if (!file.open(filePath))
+		return false;
+
+	std::vector<uint32_t> nodeChildIndices;
+	std::vector<uvec4> nodeData;
+	if (!file.readOctree(nodeChildIndices, nodeData))
+		return false;
+
+	this->setGridSize(file.getGridSize());
+	this->setGridScale(file.getGridScale());
+	this->setGridCenter(file.getGridCenter());
+
+	m_octreeNodeCount = (uint32_t)nodeChildIndices.size();
+	this->allocateOctreeNodeBuffers();
+
+	glBindBuffer(GL_TEXTURE_BUFFER, m_octreeNodeTextureBuffer[CHILD_INDEX]);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(uint32_t) * nodeChildIndices.size(), &nodeChildIndices[0]);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_octreeNodeTextureBuffer[DATA_STORAGE]);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(uvec4) * nodeData.size(), &nodeData[0]);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	m_bakedOctree = true;
+
+	info("Loaded %u octree nodes from \"%s\"\n", m_octreeNodeCount, filePath.c_str());
+	return true;
+}
+
 void VoxelGenerator::renderDebug() {
 	info("%d %d\n", m_voxelFragmentCount, m_octreeNodeAllocatedCount);
 
@@ -245,6 +328,7 @@ void VoxelGenerator::applyUniforms(ShaderProgram* shaderProgram) {
 		this->bindVoxelLeafHeadIndexTexture(4, m_voxelFragmentTexture);
 
 		shaderProgram->setUniform("countVoxels", false);
+		shaderProgram->setUniform("voxelFragmentCapacity", (int)m_voxelFragmentAllocatedCount);
 	}
 
 	glBindImageTexture(5, m_axisProjectionMap, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
@@ -290,6 +374,14 @@ uint32_t VoxelGenerator::getOctreeDepth() const {
 	return m_octreeDepth;
 }
 
+VoxelFragmentEstimator* VoxelGenerator::getFragmentEstimator() const {
+	return m_fragmentEstimator;
+}
+
+bool VoxelGenerator::hasBakedOctree() const {
+	return m_bakedOctree;
+}
+
 int32_t VoxelGenerator::getDebugOctreeVisualisationLevel() const {
 	return m_debugOctreeVisualisationLevel;
 }
@@ -307,18 +399,88 @@ void VoxelGenerator::voxelFragmentCountPass(double dt, double partialTicks) {
 	m_voxelizationStage = FRAGMENT_COUNT;
 	ShaderProgram* generationShader = this->voxelFragmentGenerationShader();
 	ShaderProgram::use(generationShader);
+	this->clearVoxelFragmentCounters();
 	Engine::scene()->renderDirect(generationShader, dt, partialTicks);
 	glMemoryBarrier(GL_ALL_BARRIER_BITS);
-	m_voxelFragmentCount = this->readAndClearAtomicCounter(m_voxelFragmentCounterBuffer);
+	m_voxelFragmentCount = this->readAtomicCounter(m_voxelFragmentCounterBuffer);
+	m_voxelFragmentRequiredCount = m_voxelFragmentCount;
 }
 
 void VoxelGenerator::voxelFragmentStoragePass(double dt, double partialTicks) {
 	m_voxelizationStage = FRAGMENT_STORAGE;
 	ShaderProgram* generationShader = this->voxelFragmentGenerationShader();
 	ShaderProgram::use(generationShader);
+	this->clearVoxelFragmentCounters();
 	Engine::scene()->renderDirect(generationShader, dt, partialTicks);
 	glMemoryBarrier(GL_ALL_BARRIER_BITS);
-	m_voxelFragmentCount = this->readAndClearAtomicCounter(m_voxelFragmentCounterBuffer);
+	// The counters are left as they are, the octree construction reads the stored count from them
+}
+
+void VoxelGenerator::clearVoxelFragmentCounters() {
+	uint32_t zero = 0;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_voxelFragmentCounterBuffer);
+	glClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, 0, sizeof(uint32_t) * 2, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void VoxelGenerator::readVoxelFragmentCounts() {
+	std::vector<VoxelFragmentCountReadback*> completed;
+
+	for (int i = 0; i < m_voxelFragmentCountReadbacks.size(); i++) {
+		VoxelFragmentCountReadback& readback = m_voxelFragmentCountReadbacks[i];
+		if (readback.fence != NULL) {
+			GLenum status = glClientWaitSync(readback.fence, 0, 0);
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+				completed.push_back(&readback);
+			}
+		}
+	}
+
+	std::sort(completed.begin(), completed.end(), [](const VoxelFragmentCountReadback* lhs, const VoxelFragmentCountReadback* rhs) {
+		return lhs->frame < rhs->frame;
+	});
+
+	for (int i = 0; i < completed.size(); i++) {
+		glBindBuffer(GL_COPY_READ_BUFFER, completed[i]->buffer);
+		const uint32_t* data = (const uint32_t*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, sizeof(uint32_t) * 2, GL_MAP_READ_BIT);
+		if (data != NULL) {
+			uint32_t storedCount = data[0];
+			uint32_t droppedCount = data[1];
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+			m_voxelFragmentCount = storedCount;
+			m_voxelFragmentRequiredCount = (uint32_t)glm::min((uint64_t)storedCount + droppedCount, (uint64_t)UINT32_MAX);
+			m_fragmentEstimator->reportFragmentCount(completed[i]->estimate, m_voxelFragmentRequiredCount, droppedCount > 0);
+		}
+
+		glDeleteSync(completed[i]->fence);
+		completed[i]->fence = NULL;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void VoxelGenerator::copyVoxelFragmentCounts(uint64_t estimate) {
+	// When the GPU is so far behind that no readback is free, this frame's counts are skipped rather than
+	// waited for. The next copy reports them, and the buffers only grow once it does.
+	VoxelFragmentCountReadback* target = NULL;
+	for (int i = 0; i < m_voxelFragmentCountReadbacks.size() && target == NULL; i++) {
+		if (m_voxelFragmentCountReadbacks[i].fence == NULL) {
+			target = &m_voxelFragmentCountReadbacks[i];
+		}
+	}
+
+	if (target != NULL) {
+		glBindBuffer(GL_COPY_READ_BUFFER, m_voxelFragmentCounterBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, target->buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(uint32_t) * 2);
+		target->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		target->frame = m_voxelizationFrame;
+		target->estimate = estimate;
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	++m_voxelizationFrame;
 }
 
 void VoxelGenerator::octreeConstructionPass(double dt, double partialTicks) {
@@ -334,7 +496,7 @@ void VoxelGenerator::octreeConstructionPass(double dt, double partialTicks) {
 	constructionData.passLevelTileStart = 0;
 	constructionData.passTotalAllocCount = 1;
 	constructionData.flagPassWorkgroupSizeX = DATA_SIZE / LOCAL_SIZE_X;
-	constructionData.flagPassWorkgroupSizeY = ((m_voxelFragmentCount + (DATA_SIZE - 1)) / DATA_SIZE + (LOCAL_SIZE_Y - 1)) / LOCAL_SIZE_Y;
+	constructionData.flagPassWorkgroupSizeY = ((m_voxelFragmentAllocatedCount + (DATA_SIZE - 1)) / DATA_SIZE + (LOCAL_SIZE_Y - 1)) / LOCAL_SIZE_Y; // The stored count is only known on the GPU
 	constructionData.flagPassWorkgroupSizeZ = 1;
 	constructionData.allocPassWorkgroupSizeX = DATA_SIZE / LOCAL_SIZE_X;
 	constructionData.allocPassWorkgroupSizeY = 1;
@@ -344,7 +506,7 @@ void VoxelGenerator::octreeConstructionPass(double dt, double partialTicks) {
 	constructionData.initPassWorkgroupSizeZ = 1;
 
 	constructionData.octreeLevel = 0;
-	constructionData.voxelFragmentCount = (int)m_voxelFragmentCount;
+	constructionData.voxelFragmentCount = 0; // Copied from the fragment counter below
 	constructionData.voxelGridSize = (int)m_gridSize;
 	//constructionData.voxelGridScale = (float)m_gridScale;
 	constructionData.voxelGridCenter = fvec4(floor(m_gridCenter / m_gridScale) * m_gridScale, 0.0F);
@@ -359,6 +521,9 @@ void VoxelGenerator::octreeConstructionPass(double dt, double partialTicks) {
 	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(OctreeConstructionData), &constructionData);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_octreeConstructionDataBuffer);
 
+	glBindBuffer(GL_COPY_READ_BUFFER, m_voxelFragmentCounterBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_SHADER_STORAGE_BUFFER, 0, offsetof(OctreeConstructionData, voxelFragmentCount), sizeof(int32_t));
+
 	glBindBuffer(GL_COPY_READ_BUFFER, m_resetBuffer);
 
 	this->bindVoxelChildIndexTexture(0, m_octreeNodeTexture);
@@ -454,7 +619,7 @@ void VoxelGenerator::countOctreeNodes() {
 	//	m_octreeNodeCount = nodeCount;
 	//}
 
-	m_octreeNodeCount = (uint32_t) (m_voxelFragmentCount * 2.5); // TODO: better way of predicting the required octree nodes...
+	m_octreeNodeCount = (uint32_t) (m_voxelFragmentAllocatedCount * 2.5); // TODO: better way of predicting the required octree nodes...
 }
 
 void VoxelGenerator::octreeNodeFlagPass() {
@@ -514,11 +679,11 @@ void VoxelGenerator::allocateTextureBuffer(uint64_t size, uint32_t format, uint3
 	glBindBuffer(GL_TEXTURE_BUFFER, 0);
 }
 
-void VoxelGenerator::allocateVoxelFragmentBuffers(bool shrinkToFit) {
+void VoxelGenerator::allocateVoxelFragmentBuffers(uint32_t fragmentCount, bool shrinkToFit) {
 	uint64_t allocationCount = 0;
 
-	if (m_voxelFragmentCount > m_voxelFragmentAllocatedCount) {
-		allocationCount = m_voxelFragmentCount + 2000; // allocate space for 2000 more voxels
+	if (fragmentCount > m_voxelFragmentAllocatedCount) {
+		allocationCount = (uint64_t)fragmentCount + 2000; // allocate space for 2000 more voxels
 	}
 
 	if (allocationCount > 0) {
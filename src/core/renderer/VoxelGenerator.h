@@ -3,6 +3,14 @@
 
 class ShaderProgram;
 class Framebuffer;
+class VoxelFragmentEstimator;
+
+struct VoxelFragmentCountReadback {
+	uint32_t buffer; // Copy of the fragment counters, mapped once the copy has completed
+	GLsync fence; // Signalled when the copy has completed, NULL while the readback is unused
+	uint64_t frame; // The voxelization whose counters were copied
+	uint64_t estimate; // The estimate that voxelization was sized from
+};
 
 class VoxelGenerator {
 public:
@@ -35,6 +43,8 @@ public:
 
 	void renderDebug();
 
+	bool loadOctree(std::string filePath);
+
 	void applyUniforms(ShaderProgram* shaderProgram);
 
 	dvec3 getGridCenter() const;
@@ -51,6 +61,10 @@ public:
 
 	uint32_t getOctreeDepth() const;
 
+	VoxelFragmentEstimator* getFragmentEstimator() const;
+
+	bool hasBakedOctree() const;
+
 	int32_t getDebugOctreeVisualisationLevel() const;
 
 	void setDebugOctreeVisualisationLevel(int32_t visualisationLevel);
@@ -62,6 +76,12 @@ private:
 
 	void voxelFragmentStoragePass(double dt, double partialTicks);
 
+	void clearVoxelFragmentCounters();
+
+	void readVoxelFragmentCounts();
+
+	void copyVoxelFragmentCounts(uint64_t estimate);
+
 	void octreeConstructionPass(double dt, double partialTicks);
 
 	void countOctreeNodes();
@@ -80,7 +100,7 @@ private:
 
 	void allocateTextureBuffer(uint64_t size, uint32_t format, uint32_t* textureHandlePtr, uint32_t* textureBufferHandlePtr);
 
-	void allocateVoxelFragmentBuffers(bool shrinkToFit);
+	void allocateVoxelFragmentBuffers(uint32_t fragmentCount, bool shrinkToFit);
 
 	void allocateOctreeNodeBuffers();
 
@@ -132,9 +152,13 @@ private:
 
 	uint32_t m_voxelFragmentTexture[5];
 	uint32_t m_voxelFragmentTextureBuffer[5];
-	uint32_t m_voxelFragmentCounterBuffer;
+	uint32_t m_voxelFragmentCounterBuffer; // Stored fragments, then fragments dropped for lack of room
 	uint32_t m_voxelFragmentAllocatedCount;
-	uint32_t m_voxelFragmentCount;
+	uint32_t m_voxelFragmentCount; // Stored by the last voxelization whose count has reached the CPU
+	uint32_t m_voxelFragmentRequiredCount; // Produced by that voxelization, including the dropped fragments
+	std::vector<VoxelFragmentCountReadback> m_voxelFragmentCountReadbacks;
+	uint64_t m_voxelizationFrame;
+	VoxelFragmentEstimator* m_fragmentEstimator; // Sizes the fragment buffers without a separate counting pass
 
 	uint32_t m_octreeBrickTexture;
 	uint32_t m_octreeNodeTexture[5];
@@ -144,6 +168,7 @@ private:
 	uint32_t m_octreeNodeAllocatedCount;
 	uint32_t m_octreeNodeCount;
 	uint32_t m_octreeDepth;
+	bool m_bakedOctree; // Octree was loaded from an SVO file, the scene is not revoxelized
 
 	uint32_t m_axisProjectionMap;
 
@@ -4,6 +4,10 @@
 #include "core/scene/Scene.h"
 
 GeometryBuffer::GeometryBuffer() {
+	m_gpuEnabled = Engine::isGLAvailable();
+	if (!m_gpuEnabled)
+		return;
+
 	glGenVertexArrays(1, &m_vao);
 	glGenBuffers(1, &m_vertexBuffer);
 	glGenBuffers(1, &m_triangleBuffer);
@@ -13,6 +17,9 @@ GeometryBuffer::GeometryBuffer() {
 }
 
 GeometryBuffer::~GeometryBuffer() {
+	if (!m_gpuEnabled)
+		return;
+
 	glDeleteVertexArrays(1, &m_vao);
 	glDeleteBuffers(1, &m_vertexBuffer);
 	glDeleteBuffers(1, &m_triangleBuffer);
@@ -22,23 +29,28 @@ GeometryBuffer::~GeometryBuffer() {
 }
 
 void GeometryBuffer::bindVertexBuffer(uint32_t index) {
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_vertexBuffer);
+	if (m_gpuEnabled)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_vertexBuffer);
 }
 
 void GeometryBuffer::bindTriangleBuffer(uint32_t index) {
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_triangleBuffer);
+	if (m_gpuEnabled)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_triangleBuffer);
 }
 
 void GeometryBuffer::bindBVHNodeBuffer(uint32_t index) {
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_bvhNodeBuffer);
+	if (m_gpuEnabled)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_bvhNodeBuffer);
 }
 
 void GeometryBuffer::bindBVHReferenceBuffer(uint32_t index) {
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_bvhReferenceBuffer);
+	if (m_gpuEnabled)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_bvhReferenceBuffer);
 }
 
 void GeometryBuffer::bindEmissiveTriangleBuffer(uint32_t index) {
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_emissiveTriangleBuffer);
+	if (m_gpuEnabled)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, m_emissiveTriangleBuffer);
 }
 
 void GeometryBuffer::reset() {
@@ -49,6 +61,9 @@ void GeometryBuffer::reset() {
 }
 
 void GeometryBuffer::initializeBuffers() {
+	if (!m_gpuEnabled)
+		return;
+
 	glBindVertexArray(m_vao);
 	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_triangleBuffer);
@@ -76,6 +91,9 @@ void GeometryBuffer::draw(GeometryRegion geometryRegion) {
 	uint64_t offset = geometryRegion.triangleOffset * 3;
 	uint64_t count = geometryRegion.triangleCount * 3;
 
+	if (!m_gpuEnabled)
+		return;
+
 	glBindVertexArray(m_vao);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_triangleBuffer);
 	glDrawRangeElementsBaseVertex(GL_TRIANGLES, offset, offset + count, count, GL_UNSIGNED_INT, (void*)(offset * sizeof(uint32_t)), baseVertex);
@@ -120,20 +138,22 @@ void GeometryBuffer::upload(const std::vector<Mesh::vertex>& vertices, const std
 			}
 		}
 
-		glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
-		//glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * sizeof(Mesh::vertex), vertices.size() * sizeof(Mesh::vertex), &m_vertices[vertexOffset]);
-		glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Mesh::vertex), &m_vertices[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_triangleBuffer);
-		//glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangleOffset * sizeof(Mesh::triangle), triangles.size() * sizeof(Mesh::triangle), &m_triangles[triangleOffset]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_triangles.size() * sizeof(Mesh::triangle), &m_triangles[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_emissiveTriangleBuffer);
-		//glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangleOffset * sizeof(Mesh::triangle), triangles.size() * sizeof(Mesh::triangle), &m_triangles[triangleOffset]);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, m_emissiveTriangles.size() * sizeof(uint32_t), &m_emissiveTriangles[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		if (m_gpuEnabled) {
+			glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+			//glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * sizeof(Mesh::vertex), vertices.size() * sizeof(Mesh::vertex), &m_vertices[vertexOffset]);
+			glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(Mesh::vertex), &m_vertices[0], GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_triangleBuffer);
+			//glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangleOffset * sizeof(Mesh::triangle), triangles.size() * sizeof(Mesh::triangle), &m_triangles[triangleOffset]);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_triangles.size() * sizeof(Mesh::triangle), &m_triangles[0], GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_emissiveTriangleBuffer);
+			//glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangleOffset * sizeof(Mesh::triangle), triangles.size() * sizeof(Mesh::triangle), &m_triangles[triangleOffset]);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, m_emissiveTriangles.size() * sizeof(uint32_t), &m_emissiveTriangles[0], GL_STATIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
 
 		geometryRegion->vertexOffset = vertexOffset;
 		geometryRegion->triangleOffset = triangleOffset;
@@ -150,6 +170,9 @@ void GeometryBuffer::buildBVH() {
 		const std::vector<BVHBinaryNode>& linearNodes = m_bvh->createLinearNodes();
 		const std::vector<BVH::PrimitiveReference>& primitiveReferences = m_bvh->getPrimitiveReferences();
 
+		if (!m_gpuEnabled)
+			return;
+
 		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_bvhNodeBuffer);
 		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(BVHBinaryNode) * linearNodes.size(), &linearNodes[0], GL_STATIC_DRAW);
 
@@ -172,6 +195,18 @@ uint64_t GeometryBuffer::getAllocatedTriangleCount() const {
 	return m_triangleAllocCount;
 }
 
+const std::vector<Mesh::vertex>& GeometryBuffer::getVertices() const {
+	return m_vertices;
+}
+
+const std::vector<Mesh::triangle>& GeometryBuffer::getTriangles() const {
+	return m_triangles;
+}
+
+const std::vector<uint32_t>& GeometryBuffer::getEmissiveTriangles() const {
+	return m_emissiveTriangles;
+}
+
 BVH* GeometryBuffer::getBVH() const {
 	return m_bvh;
 }
@@ -55,6 +55,12 @@ public:
 
 	uint64_t getAllocatedTriangleCount() const;
 
+	const std::vector<Mesh::vertex>& getVertices() const;
+
+	const std::vector<Mesh::triangle>& getTriangles() const;
+
+	const std::vector<uint32_t>& getEmissiveTriangles() const;
+
 	BVH* getBVH() const;
 
 private:
@@ -77,6 +83,8 @@ private:
 
 	uint32_t m_vao;
 
+	bool m_gpuEnabled = false; // False without a GL context, the geometry is then only kept CPU side
+
 	std::vector<Mesh::vertex> m_vertices;
 	std::vector<Mesh::triangle> m_triangles;
 	std::vector<uint32_t> m_emissiveTriangles;
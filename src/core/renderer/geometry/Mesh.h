@@ -581,9 +581,9 @@ inline void _Mesh<V, I, Q>::Builder::createUVSpheroid(dvec3 radius, dvec3 positi
 			double y = sin(-glm::half_pi<double>() + glm::pi<double>() * v * dv);
 			double z = sin(2.0 * glm::pi<double>() * u * du) * sin(glm::pi<double>() * v * dv);
 
-			double px = x * radius.x;
-			double py = y * radius.y;
-			double pz = z * radius.z;
+			double px = position.x + x * radius.x;
+			double py = position.y + y * radius.y;
+			double pz = position.z + z * radius.z;
 			double nx = x / (radius.x); // ?
 			double ny = y / (radius.y);
 			double nz = z / (radius.z);
@@ -608,7 +608,68 @@ inline void _Mesh<V, I, Q>::Builder::createUVSpheroid(dvec3 radius, dvec3 positi
 
 template<typename V, typename I, qualifier Q>
 inline void _Mesh<V, I, Q>::Builder::createIcoSpheroid(dvec3 radius, dvec3 position, uint32_t isoDivisions) {
+	// Icosahedron, every division splits each triangle into four, so there are 20 * 4^isoDivisions triangles
+	const double t = (1.0 + sqrt(5.0)) * 0.5;
+	std::vector<dvec3> points = {
+		dvec3(-1.0, +t, 0.0), dvec3(+1.0, +t, 0.0), dvec3(-1.0, -t, 0.0), dvec3(+1.0, -t, 0.0),
+		dvec3(0.0, -1.0, +t), dvec3(0.0, +1.0, +t), dvec3(0.0, -1.0, -t), dvec3(0.0, +1.0, -t),
+		dvec3(+t, 0.0, -1.0), dvec3(+t, 0.0, +1.0), dvec3(-t, 0.0, -1.0), dvec3(-t, 0.0, +1.0),
+	};
+
+	std::vector<uvec3> faces = {
+		uvec3(0, 11, 5), uvec3(0, 5, 1), uvec3(0, 1, 7), uvec3(0, 7, 10), uvec3(0, 10, 11),
+		uvec3(1, 5, 9), uvec3(5, 11, 4), uvec3(11, 10, 2), uvec3(10, 7, 6), uvec3(7, 1, 8),
+		uvec3(3, 9, 4), uvec3(3, 4, 2), uvec3(3, 2, 6), uvec3(3, 6, 8), uvec3(3, 8, 9),
+		uvec3(4, 9, 5), uvec3(2, 4, 11), uvec3(6, 2, 10), uvec3(8, 6, 7), uvec3(9, 8, 1),
+	};
+
+	for (int i = 0; i < points.size(); i++) {
+		points[i] = normalize(points[i]);
+	}
+
+	for (uint32_t division = 0; division < isoDivisions; division++) {
+		std::unordered_map<uint64_t, uint32_t> midpoints; // Shared edges get one midpoint, keyed by the sorted point indices
+		std::vector<uvec3> dividedFaces;
+		dividedFaces.reserve(faces.size() * 4);
+
+		auto getMidpoint = [&points, &midpoints](uint32_t a, uint32_t b) {
+			uint64_t key = ((uint64_t)glm::min(a, b) << 32) | (uint64_t)glm::max(a, b);
+			auto it = midpoints.find(key);
+			if (it != midpoints.end())
+				return it->second;
+
+			uint32_t index = (uint32_t)points.size();
+			points.push_back(normalize(points[a] + points[b]));
+			midpoints.insert(std::make_pair(key, index));
+			return index;
+		};
+
+		for (int i = 0; i < faces.size(); i++) {
+			uint32_t m01 = getMidpoint(faces[i].x, faces[i].y);
+			uint32_t m12 = getMidpoint(faces[i].y, faces[i].z);
+			uint32_t m20 = getMidpoint(faces[i].z, faces[i].x);
+			dividedFaces.push_back(uvec3(faces[i].x, m01, m20));
+			dividedFaces.push_back(uvec3(faces[i].y, m12, m01));
+			dividedFaces.push_back(uvec3(faces[i].z, m20, m12));
+			dividedFaces.push_back(uvec3(m01, m12, m20));
+		}
+
+		faces.swap(dividedFaces);
+	}
+
+	std::vector<index> indices(points.size());
+	for (int i = 0; i < points.size(); i++) {
+		dvec3 p = points[i];
+		dvec3 n = normalize(p / radius); // The surface normal of the scaled sphere
+		double u = 0.5 + atan2(p.z, p.x) / (2.0 * glm::pi<double>());
+		double v = 0.5 + asin(glm::clamp(p.y, -1.0, 1.0)) / glm::pi<double>();
+		dvec3 pos = position + p * radius;
+		indices[i] = this->addVertex(pos.x, pos.y, pos.z, n.x, n.y, n.z, 0.0, 0.0, 0.0, 1.0 - u, 1.0 - v);
+	}
 
+	for (int i = 0; i < faces.size(); i++) {
+		this->addTriangle(indices[faces[i].x], indices[faces[i].y], indices[faces[i].z]);
+	}
 }
 
 template<typename V, typename I, qualifier Q>
@@ -1185,6 +1246,10 @@ void _Mesh<V, I, Q>::allocateGPU() {
 		this->deallocateGPU();
 	}
 
+	if (!Engine::isGLAvailable()) {
+		return; // Headless, the mesh stays CPU side only and is never drawn
+	}
+
 	m_renderable = true;
 	m_allocatedVertices = this->getVertexCount();
 	m_allocatedIndices = this->getIndexCount();
@@ -135,9 +135,9 @@ MeshLoader::OBJ* MeshLoader::OBJ::load(std::string file, bool readMdl, bool writ
 }
 
 MeshLoader::OBJ::MaterialSet* MeshLoader::OBJ::readMTL(std::string file) {
-	const char* materialResource = RESOURCE_PATH(file).c_str();
-	info("Parsing MTL file \"%s\"\n", materialResource);
-	std::ifstream stream(materialResource, std::ifstream::in);
+	std::string materialResource = RESOURCE_PATH(file);
+	info("Parsing MTL file \"%s\"\n", materialResource.c_str());
+	std::ifstream stream(materialResource.c_str(), std::ifstream::in);
 
 	if (!stream.is_open()) {
 		return NULL;
@@ -666,8 +666,8 @@ MeshLoader::OBJ* MeshLoader::OBJ::readMDL(std::string file, std::string mtlDir)
 bool MeshLoader::OBJ::writeMDL(std::string file) {
 	// TODO: write file header containing vertex format, face format, and other data so that adding some saved state does not invalidate previously saved MDLs
 	info("Writing MDL file \"%s\" with %d vertices, %d triangles\n", file.c_str(), m_vertices.size(), m_triangles.size());
-	const char* resourcePath = RESOURCE_PATH(file).c_str();
-	std::ofstream stream(resourcePath, std::ofstream::out | std::ofstream::binary);
+	std::string resourcePath = RESOURCE_PATH(file);
+	std::ofstream stream(resourcePath.c_str(), std::ofstream::out | std::ofstream::binary);
 	if (!stream.is_open()) {
 		info("Failed to write MDL file - could not open stream\n");
 		return false;
@@ -687,7 +687,7 @@ bool MeshLoader::OBJ::writeMDL(std::string file) {
 	for (int i = 0; i < m_objects.size(); i++) {
 		if (!m_objects[i]->writeBinaryData(stream)) {
 			stream.close();
-			std::remove(resourcePath);
+			std::remove(resourcePath.c_str());
 			return false;
 		}
 	}
@@ -695,7 +695,7 @@ bool MeshLoader::OBJ::writeMDL(std::string file) {
 	for (int i = 0; i < m_materialSets.size(); i++) {
 		if (!m_materialSets[i]->writeBinaryData(stream)) {
 			stream.close();
-			std::remove(resourcePath);
+			std::remove(resourcePath.c_str());
 			return false;
 		}
 	}
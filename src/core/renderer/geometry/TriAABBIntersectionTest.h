@@ -1,245 +1,93 @@
 #pragma once
 
-/********************************************************/
-/* AABB-triangle overlap headPointerTexture code                      */
-/* by Tomas Akenine-Mller                              */
-/* Function: int triBoxOverlap(float boxcenter[3],      */
-/*          float boxhalfsize[3],float triverts[3][3]); */
-/* History:                                             */
-/*   2001-03-05: released the code in its first version */
-/*   2001-06-18: changed the order of the tests, faster */
-/*                                                      */
-/* Acknowledgement: Many thanks to Pierre Terdiman for  */
-/* suggestions and discussions on how to optimize code. */
-/* Thanks to David Hunt for finding a ">="-bug!         */
-/********************************************************/
-#include <math.h>
-#include <stdio.h>
-
-#define X 0
-#define Y 1
-#define Z 2
-
-void CROSS(float dest[3], float v1[3], float v2[3]) {
-	dest[0] = v1[1] * v2[2] - v1[2] * v2[1];
-	dest[1] = v1[2] * v2[0] - v1[0] * v2[2];
-	dest[2] = v1[0] * v2[1] - v1[1] * v2[0];
-}
-
-float DOT(float v1[3], float v2[3]) {
-	return (v1[0] * v2[0] + v1[1] * v2[1] + v1[2] * v2[2]);
-}
-
-void SUB(float dest[3], float v1[3], float v2[3]) {
-	dest[0] = v1[0] - v2[0];
-	dest[1] = v1[1] - v2[1];
-	dest[2] = v1[2] - v2[2];
-}
-
-void FINDMINMAX(float x0, float x1, float x2, float& min, float& max) {
-	min = max = x0;
-	if (x1 < min) min = x1;
-	if (x1 > max) max = x1;
-	if (x2 < min) min = x2;
-	if (x2 > max) max = x2;
-}
-
-bool planeBoxOverlap(float normal[3], float vert[3], float maxbox[3]) {
-	int q;
-	float vmin[3], vmax[3], v;
-	for (q = X; q <= Z; q++) {
-		v = vert[q];					
-		if (normal[q] > 0.0f) {
-			vmin[q] = -maxbox[q] - v;
-			vmax[q] = maxbox[q] - v;
-		} else {
-			vmin[q] = maxbox[q] - v;
-			vmax[q] = -maxbox[q] - v;
-		}
+#include "core/pch.h"
+#include <emmintrin.h>
+
+// Triangle/AABB overlap test by Tomas Akenine-Moller ("Fast 3D Triangle-Box Overlap Testing", 2001).
+// By the separating axis theorem the two only overlap if none of 13 axes separates them: the three box
+// face normals, the triangle normal, and the nine cross products of the triangle edges with the box
+// axes. Touching counts as overlapping, so anything voxelized with this test is conservative.
+
+// Triangle setup for testing many boxes of the same size. Projecting the triangle and the box extent
+// onto each axis is done once, after which each axis is a single dot product with the box center
+// compared against a precomputed interval.
+struct TriAABBTest {
+	static const int AXIS_COUNT = 13;
+
+	float axisX[AXIS_COUNT];
+	float axisY[AXIS_COUNT];
+	float axisZ[AXIS_COUNT];
+	float minDist[AXIS_COUNT]; // Smallest projected box center that still overlaps the triangle
+	float maxDist[AXIS_COUNT]; // Largest projected box center that still overlaps the triangle
+
+	void init(const vec3& v0, const vec3& v1, const vec3& v2, const vec3& boxHalfSize);
+
+	bool test(const vec3& boxCenter) const;
+
+	int test4(__m128 boxCenterX, __m128 boxCenterY, __m128 boxCenterZ) const; // Returns a bit per overlapping box
+};
+
+inline void TriAABBTest::init(const vec3& v0, const vec3& v1, const vec3& v2, const vec3& boxHalfSize) {
+	vec3 edges[3] = { v1 - v0, v2 - v1, v0 - v2 };
+	vec3 axes[AXIS_COUNT];
+
+	// Ordered by how likely they are to reject a box inside the bounds of the triangle, so the
+	// SIMD test can stop early.
+	axes[0] = cross(edges[0], edges[1]);
+	for (int i = 0; i < 3; i++) {
+		axes[1 + i * 3 + 0] = vec3(0.0F, -edges[i].z, edges[i].y); // cross(X, edge)
+		axes[1 + i * 3 + 1] = vec3(edges[i].z, 0.0F, -edges[i].x); // cross(Y, edge)
+		axes[1 + i * 3 + 2] = vec3(-edges[i].y, edges[i].x, 0.0F); // cross(Z, edge)
+	}
+	axes[10] = vec3(1.0F, 0.0F, 0.0F);
+	axes[11] = vec3(0.0F, 1.0F, 0.0F);
+	axes[12] = vec3(0.0F, 0.0F, 1.0F);
+
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		const vec3& axis = axes[i];
+		float p0 = dot(axis, v0);
+		float p1 = dot(axis, v1);
+		float p2 = dot(axis, v2);
+		float radius = dot(abs(axis), boxHalfSize);
+
+		axisX[i] = axis.x;
+		axisY[i] = axis.y;
+		axisZ[i] = axis.z;
+		minDist[i] = glm::min(p0, glm::min(p1, p2)) - radius;
+		maxDist[i] = glm::max(p0, glm::max(p1, p2)) + radius;
 	}
-	if (DOT(normal, vmin) > 0.0f) return false;	
-	if (DOT(normal, vmax) >= 0.0f) return true;
-
-	return false;
-}
-
-/*======================== X-tests ========================*/
-//#define AXISTEST_X01(a, b, fa, fb)			   \
-//p0 = a * v0[Y] - b * v0[Z];			       	   \
-//p2 = a * v2[Y] - b * v2[Z];			       	   \
-//if (p0 < p2) { min = p0; max = p2; } else { min = p2; max = p0; } \
-//	rad = fa * boxhalfsize[Y] + fb * boxhalfsize[Z];   \
-//	if (min > rad || max < -rad) return 0;
-
-
-bool AXISTEST_X01(float a, float b, float fa, float fb, float boxhalfsize[3], float v0[3], float v1[3], float v2[3], float& min, float& max, float& p0, float& p1, float& p2, float& rad, float& fex, float& fey, float& fez) {
-	p0 = a * v0[Y] - b * v0[Z];
-	p2 = a * v2[Y] - b * v2[Z];
-	if (p0 < p2) { min = p0; max = p2; } else { min = p2; max = p0; }
-	rad = fa * boxhalfsize[Y] + fb * boxhalfsize[Z];
-	if (min > rad || max < -rad) return false;
-	return true;
 }
 
+inline bool TriAABBTest::test(const vec3& boxCenter) const {
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		float d = axisX[i] * boxCenter.x + axisY[i] * boxCenter.y + axisZ[i] * boxCenter.z;
+		if (d < minDist[i] || d > maxDist[i])
+			return false; // Separating axis found
+	}
 
-//#define AXISTEST_X2(a, b, fa, fb)			   \
-//p0 = a * v0[Y] - b * v0[Z];			           \
-//p1 = a * v1[Y] - b * v1[Z];			       	   \
-//if (p0 < p1) { min = p0; max = p1; } else { min = p1; max = p0; } \
-//	rad = fa * boxhalfsize[Y] + fb * boxhalfsize[Z];   \
-//	if (min > rad || max < -rad) return 0;
-
-bool AXISTEST_X2(float a, float b, float fa, float fb, float boxhalfsize[3], float v0[3], float v1[3], float v2[3], float& min, float& max, float& p0, float& p1, float& p2, float& rad, float& fex, float& fey, float& fez) {
-	p0 = a * v0[Y] - b * v0[Z];
-	p1 = a * v1[Y] - b * v1[Z];
-	if (p0 < p1) { min = p0; max = p1; } else { min = p1; max = p0; }
-	rad = fa * boxhalfsize[Y] + fb * boxhalfsize[Z];
-	if (min > rad || max < -rad) return false;
 	return true;
 }
 
-/*======================== Y-tests ========================*/
-//#define AXISTEST_Y02(a, b, fa, fb)			   \
-//p0 = -a * v0[X] + b * v0[Z];		      	   \
-//p2 = -a * v2[X] + b * v2[Z];	       	       	   \
-//if (p0 < p2) { min = p0; max = p2; } else { min = p2; max = p0; } \
-//	rad = fa * boxhalfsize[X] + fb * boxhalfsize[Z];   \
-//	if (min > rad || max < -rad) return 0;
-
-bool AXISTEST_Y02(float a, float b, float fa, float fb, float boxhalfsize[3], float v0[3], float v1[3], float v2[3], float& min, float& max, float& p0, float& p1, float& p2, float& rad, float& fex, float& fey, float& fez) {
-	p0 = -a * v0[X] + b * v0[Z];
-	p2 = -a * v2[X] + b * v2[Z];
-	if (p0 < p2) { min = p0; max = p2; } else { min = p2; max = p0; }
-	rad = fa * boxhalfsize[X] + fb * boxhalfsize[Z];
-	if (min > rad || max < -rad) return false;
-	return true;
-}
+inline int TriAABBTest::test4(__m128 boxCenterX, __m128 boxCenterY, __m128 boxCenterZ) const {
+	__m128 overlapping = _mm_castsi128_ps(_mm_set1_epi32(-1));
 
+	for (int i = 0; i < AXIS_COUNT; i++) {
+		__m128 d = _mm_mul_ps(boxCenterX, _mm_set1_ps(axisX[i]));
+		d = _mm_add_ps(d, _mm_mul_ps(boxCenterY, _mm_set1_ps(axisY[i])));
+		d = _mm_add_ps(d, _mm_mul_ps(boxCenterZ, _mm_set1_ps(axisZ[i])));
 
-//#define AXISTEST_Y1(a, b, fa, fb)			   \
-//p0 = -a * v0[X] + b * v0[Z];		      	   \
-//p1 = -a * v1[X] + b * v1[Z];	     	       	   \
-//if (p0 < p1) { min = p0; max = p1; } else { min = p1; max = p0; } \
-//	rad = fa * boxhalfsize[X] + fb * boxhalfsize[Z];   \
-//	if (min > rad || max < -rad) return 0;
+		__m128 inside = _mm_and_ps(_mm_cmpge_ps(d, _mm_set1_ps(minDist[i])), _mm_cmple_ps(d, _mm_set1_ps(maxDist[i])));
+		overlapping = _mm_and_ps(overlapping, inside);
 
-bool AXISTEST_Y1(float a, float b, float fa, float fb, float boxhalfsize[3], float v0[3], float v1[3], float v2[3], float& min, float& max, float& p0, float& p1, float& p2, float& rad, float& fex, float& fey, float& fez) {
-	p0 = -a * v0[X] + b * v0[Z];
-	p1 = -a * v1[X] + b * v1[Z];
-	if (p0 < p1) { min = p0; max = p1; } else { min = p1; max = p0; }
-	rad = fa * boxhalfsize[X] + fb * boxhalfsize[Z];
-	if (min > rad || max < -rad) return false;
-	return true;
-}
-
-/*======================== Z-tests ========================*/
-
-//#define AXISTEST_Z12(a, b, fa, fb)			   \
-//p1 = a * v1[X] - b * v1[Y];			           \
-//p2 = a * v2[X] - b * v2[Y];			       	   \
-//if (p2 < p1) { min = p2; max = p1; } else { min = p1; max = p2; } \
-//	rad = fa * boxhalfsize[X] + fb * boxhalfsize[Y];   \
-//	if (min > rad || max < -rad) return 0;
-
-bool AXISTEST_Z12(float a, float b, float fa, float fb, float boxhalfsize[3], float v0[3], float v1[3], float v2[3], float& min, float& max, float& p0, float& p1, float& p2, float& rad, float& fex, float& fey, float& fez) {
-	p1 = a * v1[X] - b * v1[Y];
-	p2 = a * v2[X] - b * v2[Y];
-	if (p2 < p1) { min = p2; max = p1; } else { min = p1; max = p2; }
-	rad = fa * boxhalfsize[X] + fb * boxhalfsize[Y];
-	if (min > rad || max < -rad) return false;
-	return true;
-}
-
-
-//#define AXISTEST_Z0(a, b, fa, fb)			   \
-//p0 = a * v0[X] - b * v0[Y];				   \
-//p1 = a * v1[X] - b * v1[Y];			           \
-//if (p0 < p1) { min = p0; max = p1; } else { min = p1; max = p0; } \
-//	rad = fa * boxhalfsize[X] + fb * boxhalfsize[Y];   \
-//	if (min > rad || max < -rad) return 0;
+		if (_mm_movemask_ps(overlapping) == 0)
+			return 0;
+	}
 
-bool AXISTEST_Z0(float a, float b, float fa, float fb, float boxhalfsize[3], float v0[3], float v1[3], float v2[3], float& min, float& max, float& p0, float& p1, float& p2, float& rad, float& fex, float& fey, float& fez) {
-	p0 = a * v0[X] - b * v0[Y];
-	p1 = a * v1[X] - b * v1[Y];
-	if (p0 < p1) { min = p0; max = p1; } else { min = p1; max = p0; }
-	rad = fa * boxhalfsize[X] + fb * boxhalfsize[Y];
-	if (min > rad || max < -rad) return false;
-	return true;
+	return _mm_movemask_ps(overlapping);
 }
 
-int triBoxOverlap(float boxcenter[3], float boxhalfsize[3], float triverts[3][3]) {
-
-	/*    use separating splitAxis theorem to headPointerTexture overlap between triangle and box */
-	/*    need to headPointerTexture for overlap in these directions: */
-	/*    1) the {x,y,z}-directions (actually, since we use the AABB of the triangle */
-	/*       we do not even need to headPointerTexture these) */
-	/*    2) normal of the triangle */
-	/*    3) crossproduct(edge from tri, {x,y,z}-directin) */
-	/*       this gives 3x3=9 more tests */
-	float v0[3], v1[3], v2[3];
-	//   float splitAxis[3];
-	float min, max, p0, p1, p2, rad, fex, fey, fez;	
-	float normal[3], e0[3], e1[3], e2[3];
-
-	/* This is the fastest branch on Sun */
-	/* move everything so that the boxcenter is in (0,0,0) */
-	SUB(v0, triverts[0], boxcenter);
-	SUB(v1, triverts[1], boxcenter);
-	SUB(v2, triverts[2], boxcenter);
-
-	/* compute triangle edges */
-	SUB(e0, v1, v0);      /* tri edge 0 */
-	SUB(e1, v2, v1);      /* tri edge 1 */
-	SUB(e2, v0, v2);      /* tri edge 2 */
-
-	/* Bullet 3:  */
-	/*  headPointerTexture the 9 tests first (this was faster) */
-	fex = fabsf(e0[X]);
-	fey = fabsf(e0[Y]);
-	fez = fabsf(e0[Z]);
-	AXISTEST_X01(e0[Z], e0[Y], fez, fey, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-	AXISTEST_Y02(e0[Z], e0[X], fez, fex, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-	AXISTEST_Z12(e0[Y], e0[X], fey, fex, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-
-	fex = fabsf(e1[X]);
-	fey = fabsf(e1[Y]);
-	fez = fabsf(e1[Z]);
-	AXISTEST_X01(e1[Z], e1[Y], fez, fey, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-	AXISTEST_Y02(e1[Z], e1[X], fez, fex, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-	AXISTEST_Z0(e1[Y], e1[X], fey, fex, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-
-	fex = fabsf(e2[X]);
-	fey = fabsf(e2[Y]);
-	fez = fabsf(e2[Z]);
-	AXISTEST_X2(e2[Z], e2[Y], fez, fey, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-	AXISTEST_Y1(e2[Z], e2[X], fez, fex, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-	AXISTEST_Z12(e2[Y], e2[X], fey, fex, boxhalfsize, v0, v1, v2, min, max, p0, p1, p2, rad, fex, fey, fez);
-
-	/* Bullet 1: */
-	/*  first headPointerTexture overlap in the {x,y,z}-directions */
-	/*  find min, max of the triangle each direction, and headPointerTexture for overlap in */
-	/*  that direction -- this is equivalent to testing a minimal AABB around */
-	/*  the triangle against the AABB */
-
-	/* headPointerTexture in X-direction */
-	FINDMINMAX(v0[X], v1[X], v2[X], min, max);
-	if (min > boxhalfsize[X] || max < -boxhalfsize[X]) return 0;
-
-	/* headPointerTexture in Y-direction */
-	FINDMINMAX(v0[Y], v1[Y], v2[Y], min, max);
-	if (min > boxhalfsize[Y] || max < -boxhalfsize[Y]) return 0;
-
-	/* headPointerTexture in Z-direction */
-	FINDMINMAX(v0[Z], v1[Z], v2[Z], min, max);
-	if (min > boxhalfsize[Z] || max < -boxhalfsize[Z]) return 0;
-
-	/* Bullet 2: */
-	/*  headPointerTexture if the box intersects the plane of the triangle */
-	/*  compute plane equation of triangle: normal*x+d=0 */
-	CROSS(normal, e0, e1);
-
-	if (!planeBoxOverlap(normal, v0, boxhalfsize)) return 0;	
-
-	return 1;   /* box and triangle overlaps */
+inline bool triBoxOverlap(const vec3& boxCenter, const vec3& boxHalfSize, const vec3& v0, const vec3& v1, const vec3& v2) {
+	TriAABBTest test;
+	test.init(v0, v1, v2, boxHalfSize);
+	return test.test(boxCenter);
 }
-
@@ -11,14 +11,61 @@
 #include "core/scene/FirstPersonController.h"
 #include "core/scene/SceneComponents.h"
 #include "core/scene/Camera.h"
+#include "core/voxel/VoxelFragmentEstimator.h"
 #include "core/profiler/Profiler.h"
 #include "core/Engine.h"
 
+const uint32_t TransformSnapshotBuffer::SLOT_COUNT;
+const uint32_t TransformSnapshotBuffer::SLOT_MASK;
+const uint32_t TransformSnapshotBuffer::PUBLISHED_BIT;
+
+TransformSnapshotBuffer::TransformSnapshotBuffer():
+	m_pendingSlot(1),
+	m_writeSlot(0),
+	m_readSlot(2) {
+	for (uint32_t i = 0; i < SLOT_COUNT; i++) {
+		m_tickTimes[i] = 0;
+	}
+}
+
+uint32_t TransformSnapshotBuffer::getWriteSlot() const {
+	return m_writeSlot;
+}
+
+uint32_t TransformSnapshotBuffer::getReadSlot() const {
+	return m_readSlot;
+}
+
+void TransformSnapshotBuffer::publish(uint64_t tickTime) {
+	m_tickTimes[m_writeSlot] = tickTime;
+
+	// The previous pending slot becomes the next write slot, whether or not the renderer saw it
+	m_writeSlot = m_pendingSlot.exchange(m_writeSlot | PUBLISHED_BIT, std::memory_order_acq_rel) & SLOT_MASK;
+}
+
+bool TransformSnapshotBuffer::acquire() {
+	if ((m_pendingSlot.load(std::memory_order_relaxed) & PUBLISHED_BIT) == 0)
+		return false;
+
+	m_readSlot = m_pendingSlot.exchange(m_readSlot, std::memory_order_acq_rel) & SLOT_MASK;
+	return true;
+}
+
+uint64_t TransformSnapshotBuffer::getReadTickTime() const {
+	return m_tickTimes[m_readSlot];
+}
+
+
 
 SceneObject::SceneObject(Transformation transform) :
 	m_currTransform(transform),
 	m_prevTransform(transform),
-	m_boundsNeedUpdate(true) {}
+	m_boundsNeedUpdate(true) {
+	for (uint32_t i = 0; i < TransformSnapshotBuffer::SLOT_COUNT; i++) {
+		m_snapshots[i].prevTransform = transform;
+		m_snapshots[i].currTransform = transform;
+	}
+}
 
 SceneObject::~SceneObject() {
 	//info("Deleting scene mesh with %d components, %d children\n", m_components.size(), m_children.size());
@@ -42,7 +89,7 @@ void SceneObject::updateBoundingTree(TransformChain& parentTransform) {
 
 void SceneObject::preRender(TransformChain& parentTransform, double dt, double partialTicks) {
 	PROFILE_SCOPE("SceneObject::preRender()");
-	dmat4 currTransformation = m_currTransform.getModelMatrix();
+	dmat4 currTransformation = this->getRenderMatrix(partialTicks);
 	TransformChain currTransform;
 	currTransform.previous = &parentTransform;
 	currTransform.sceneObject = this;
@@ -69,7 +116,7 @@ void SceneObject::preRender(TransformChain& parentTransform, double dt, double p
 
 void SceneObject::render(TransformChain& parentTransform, double dt, double partialTicks) {
 	PROFILE_SCOPE("SceneObject::render()");
-	dmat4 currTransformation = m_currTransform.getModelMatrix();
+	dmat4 currTransformation = this->getRenderMatrix(partialTicks);
 	TransformChain currTransform;
 	currTransform.previous = &parentTransform;
 	currTransform.sceneObject = this;
@@ -96,7 +143,7 @@ void SceneObject::render(TransformChain& parentTransform, double dt, double part
 
 void SceneObject::renderDirect(ShaderProgram* shaderProgram, TransformChain& parentTransform, double dt, double partialTicks) {
 	PROFILE_SCOPE("SceneObject::renderDirect()");
-	dmat4 currTransformation = m_currTransform.getModelMatrix();
+	dmat4 currTransformation = this->getRenderMatrix(partialTicks);
 	TransformChain currTransform;
 	currTransform.previous = &parentTransform;
 	currTransform.sceneObject = this;
@@ -138,6 +185,11 @@ void SceneObject::update(TransformChain& parentTransform, double dt) {
 			it->second->object->update(currTransform, dt);
 		}
 	}
+
+	TransformSnapshot& snapshot = m_snapshots[Engine::scene()->getTransformSnapshots().getWriteSlot()];
+	snapshot.prevTransform = m_prevTransform;
+	snapshot.currTransform = m_currTransform;
+	m_prevTransform = m_currTransform;
 }
 
 void SceneObject::allocateStaticSceneGeometry() {
@@ -173,6 +225,25 @@ void SceneObject::uploadStaticSceneGeometry(TransformChain& parentTransform) {
 	}
 }
 
+void SceneObject::addVoxelFragmentEstimate(VoxelFragmentEstimator* estimator, TransformChain& parentTransform) {
+	TransformChain currTransform;
+	currTransform.previous = &parentTransform;
+	currTransform.sceneObject = this;
+	currTransform.transformationMatrix = parentTransform.transformationMatrix * m_currTransform.getModelMatrix();
+
+	for (auto it = m_components.begin(); it != m_components.end(); it++) {
+		if (it->second->enabled) {
+			it->second->component->addVoxelFragmentEstimate(estimator, currTransform);
+		}
+	}
+
+	for (auto it = m_children.begin(); it != m_children.end(); it++) {
+		if (it->second->enabled) {
+			it->second->object->addVoxelFragmentEstimate(estimator, currTransform);
+		}
+	}
+}
+
 void SceneObject::markBoundsNeedUpdate() {
 	m_boundsNeedUpdate = true;
 }
@@ -338,12 +409,21 @@ RaycastResult* SceneObject::raycast(TransformChain& parentTransform, dvec3 rayOr
 	return closestResult;
 }
 
+dmat4 SceneObject::getRenderMatrix(double partialTicks) const {
+	if (!Engine::instance()->isUpdateThreadEnabled())
+		return m_currTransform.getModelMatrix(); // Ticks and frames are interleaved, the current transform is not being written
+
+	// The tick being rendered is the latest one acquired, blended in from the tick before it
+	const TransformSnapshot& snapshot = m_snapshots[Engine::scene()->getTransformSnapshots().getReadSlot()];
+	return Transformation::interpolate(snapshot.prevTransform, snapshot.currTransform, partialTicks).getModelMatrix();
+}
+
 
 
 SceneGraph::SceneGraph() {
 	m_root = new SceneObject();
 	m_camera = new Camera();
-	m_voxelizer = new VoxelGenerator(1024, 0.025);
+	m_voxelizer = Engine::isGLAvailable() ? new VoxelGenerator(1024, 0.025) : NULL; // Voxelization runs on the GPU only
 	m_staticGeometryBuffer = new GeometryBuffer();
 	m_materialManager = new MaterialManager();
 	m_controller = new FirstPersonController();
@@ -475,7 +555,17 @@ void SceneGraph::update(double dt) {
 	//transform.previous = NULL;
 	//transform.sceneObject = NULL;
 	//transform.transformationMatrix = dmat4(1.0); // identity matrix (no-op)
-	m_root->update(transform, dt);
+	{
+		std::lock_guard<std::mutex> lock(m_tickMutex);
+		m_root->update(transform, dt);
+		m_transformSnapshots.publish(Engine::instance()->getCurrentTime());
+	}
+
+	if (!Engine::isGLAvailable() && m_rebuildStaticSceneGeometry) {
+		// Nothing is rendered headless, so the static geometry (and its BVH) is built here instead
+		m_rebuildStaticSceneGeometry = false;
+		this->buildStaticSceneGeometry();
+	}
 }
 
 void SceneGraph::buildStaticSceneGeometry() {
@@ -484,10 +574,23 @@ void SceneGraph::buildStaticSceneGeometry() {
 	info("Building static scene geometry\n");
 	uint64_t t0 = Engine::instance()->getCurrentTime();
 
-	m_staticGeometryBuffer->reset();
-	m_root->allocateStaticSceneGeometry();
-	m_staticGeometryBuffer->initializeBuffers();
-	m_root->uploadStaticSceneGeometry(transform);
+	{
+		// The geometry is baked with the current transforms, which the update thread writes during a tick
+		std::lock_guard<std::mutex> lock(m_tickMutex);
+		m_staticGeometryBuffer->reset();
+		m_root->allocateStaticSceneGeometry();
+		m_staticGeometryBuffer->initializeBuffers();
+		m_root->uploadStaticSceneGeometry(transform);
+
+		if (m_voxelizer != NULL) {
+			// Walked with the same transforms the geometry was just baked with, and the model matrices the
+			// voxelization pass draws it with, so the estimate covers exactly what renderDirect rasterizes
+			VoxelFragmentEstimator* estimator = m_voxelizer->getFragmentEstimator();
+			estimator->clear();
+			m_root->addVoxelFragmentEstimate(estimator, transform);
+			info("Built voxel fragment estimate in %u cells\n", estimator->getCellCount());
+		}
+	}
 	m_staticGeometryBuffer->buildBVH();
 	//m_staticGeometryBuffer->getBVH()->buildDebugMesh();
 
@@ -532,6 +635,7 @@ LightProbe* SceneGraph::getGlobalEnvironmentMap() {
 }
 
 RaycastResult* SceneGraph::raycast(dvec3 rayOrigin, dvec3 rayDirection) {
+	std::lock_guard<std::mutex> lock(m_tickMutex); // Rays test the current transforms, not the rendered snapshot
 	TransformChain transform;
 	return m_root->raycast(transform, rayOrigin, rayDirection);
 }
@@ -641,4 +745,8 @@ void SceneGraph::applyUniforms(ShaderProgram* shaderProgram) {
 
 void SceneGraph::addActiveLight(Light* light) {
 	m_activeLights.push_back(light);
+}
+
+TransformSnapshotBuffer& SceneGraph::getTransformSnapshots() {
+	return m_transformSnapshots;
 }
\ No newline at end of file
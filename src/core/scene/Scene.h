@@ -4,6 +4,8 @@
 #include "core/scene/Transformation.h"
 #include "core/scene/Bounding.h"
 #include "core/renderer/geometry/Mesh.h"
+#include <atomic>
+#include <mutex>
 
 class Transformation;
 class AxisAlignedBB;
@@ -23,6 +25,7 @@ class GeometryBuffer;
 class BoundingVolumeHierarchy;
 class MeshComponent;
 class MaterialManager;
+class VoxelFragmentEstimator;
 
 /**
  * Linked list of the built up chain of transformations while traversing the scene tree.
@@ -33,6 +36,38 @@ struct TransformChain {
 	dmat4 transformationMatrix = dmat4(1.0); // identity matrix (no-op)
 };
 
+/**
+ * Triple buffered hand-off of ticked transforms from the update thread to the renderer. Every scene object
+ * keeps one transform snapshot per slot. A tick writes the write slot and publishes it by swapping it
+ * with the pending slot, and the renderer swaps the pending slot into its read slot once a newer tick was
+ * published, so neither side waits on the other and the renderer always sees one whole tick.
+ */
+class TransformSnapshotBuffer : private NotCopyable {
+public:
+	static const uint32_t SLOT_COUNT = 3;
+
+	TransformSnapshotBuffer();
+
+	uint32_t getWriteSlot() const;
+
+	uint32_t getReadSlot() const;
+
+	void publish(uint64_t tickTime);
+
+	bool acquire();
+
+	uint64_t getReadTickTime() const;
+
+private:
+	static const uint32_t SLOT_MASK = 3;
+	static const uint32_t PUBLISHED_BIT = 4; // The pending slot holds a tick the renderer has not acquired yet
+
+	std::atomic<uint32_t> m_pendingSlot;
+	uint32_t m_writeSlot; // Only used by the updating thread
+	uint32_t m_readSlot; // Only used by the rendering thread
+	uint64_t m_tickTimes[SLOT_COUNT];
+};
+
 struct RaycastResult {
 	double distance = INFINITY;
 	dvec3 barycentric;
@@ -60,6 +95,9 @@ public:
 
 	virtual void uploadStaticSceneGeometry(TransformChain& parentTransform) {};
 
+	// Adds the geometry renderDirect draws to the voxel fragment estimate
+	virtual void addVoxelFragmentEstimate(VoxelFragmentEstimator* estimator, TransformChain& parentTransform) {};
+
 	virtual void onAdded(SceneObject* object, std::string name) {};
 
 	virtual void onRemoved(SceneObject* object, std::string name) {};
@@ -90,6 +128,8 @@ public:
 
 	void uploadStaticSceneGeometry(TransformChain& parentTransform);
 
+	void addVoxelFragmentEstimate(VoxelFragmentEstimator* estimator, TransformChain& parentTransform);
+
 	void markBoundsNeedUpdate();
 
 	bool hasChildren();
@@ -128,8 +168,15 @@ public:
 	void setTransformation(Transformation& transform);
 
 private:
+	struct TransformSnapshot {
+		Transformation prevTransform;
+		Transformation currTransform;
+	};
+
 	bool updateBounds();
 
+	dmat4 getRenderMatrix(double partialTicks) const;
+
 	RaycastResult* raycast(TransformChain& parentTransform, dvec3 rayOrigin, dvec3 rayDirection);
 
 	struct ChildContainer {
@@ -146,7 +193,8 @@ private:
 	AxisAlignedBB m_localBounds; // Bounds of this mesh with no transformation applied. This only changes when the shape of the mesh changes.
 	AxisAlignedBB m_transformedBounds; // Bounds of the mesh updated whenever the objects transformation changes.
 	Transformation m_currTransform; // The current transformation of this mesh.
-	Transformation m_prevTransform; // The transformation of this mesh in the previous frame.
+	Transformation m_prevTransform; // The transformation of this mesh in the previous tick.
+	TransformSnapshot m_snapshots[TransformSnapshotBuffer::SLOT_COUNT]; // Written by every tick, rendered from when ticks run on the update thread
 	std::map<std::string, ChildContainer*> m_children;
 	std::map<std::string, ComponentContainer*> m_components;
 };
@@ -211,6 +259,8 @@ public:
 
 	void addActiveLight(Light* light);
 
+	TransformSnapshotBuffer& getTransformSnapshots();
+
 private:
 	SceneObject* m_root;
 	Camera* m_camera;
@@ -231,6 +281,9 @@ private:
 
 	bool m_rebuildStaticSceneGeometry;
 
+	TransformSnapshotBuffer m_transformSnapshots;
+	std::mutex m_tickMutex; // Held by ticks, and by the traversals outside of ticks that read the current transforms
+
 	std::vector<Light*> m_activeLights;
 
 	double m_voxelizationFrequency;
@@ -12,6 +12,7 @@
 #include "core/renderer/ShaderProgram.h"
 #include "core/renderer/ShadowMapRenderer.h"
 #include "core/renderer/Texture.h"
+#include "core/voxel/VoxelFragmentEstimator.h"
 #include "core/util/FileUtils.h"
 #include "core/Engine.h"
 #include "core/InputHandler.h"
@@ -126,7 +127,7 @@ void RenderComponent::renderDirect(ShaderProgram* shaderProgram, TransformChain&
 	if (shaderProgram != NULL && m_geometryRegion != NULL) {
 		ShaderProgram::use(shaderProgram);
 		Engine::instance()->getScene()->applyUniforms(shaderProgram);
-		shaderProgram->setUniform("modelMatrix", dmat4(1.0));// parentTransform.transformationMatrix);
+		shaderProgram->setUniform("modelMatrix", this->getDirectModelMatrix());// parentTransform.transformationMatrix);
 
 		bool simpleRender = Engine::scene()->isSimpleRenderEnabled();
 
@@ -153,6 +154,7 @@ void RenderComponent::renderDirect(ShaderProgram* shaderProgram, TransformChain&
 		//}
 
 		Engine::scene()->getMaterialManager()->bindMaterialBuffer(3);
+		Engine::scene()->getMaterialManager()->bindVirtualTextureFeedbackBuffer(7); // VIRTUAL_TEXTURE_FEEDBACK_BINDING
 
 		Engine::scene()->getStaticGeometryBuffer()->draw(*m_geometryRegion);
 
@@ -179,6 +181,16 @@ void RenderComponent::uploadStaticSceneGeometry(TransformChain& parentTransform)
 	Engine::scene()->getStaticGeometryBuffer()->upload(m_mesh->getVertices(), m_mesh->getTriangles(), m_geometryRegion, parentTransform.transformationMatrix);
 }
 
+void RenderComponent::addVoxelFragmentEstimate(VoxelFragmentEstimator* estimator, TransformChain& parentTransform) {
+	if (m_geometryRegion != NULL) {
+		estimator->addMesh(m_mesh, this->getDirectModelMatrix() * parentTransform.transformationMatrix);
+	}
+}
+
+dmat4 RenderComponent::getDirectModelMatrix() const {
+	return dmat4(1.0);
+}
+
 void RenderComponent::onAdded(SceneObject* object, std::string name) {
 	MeshComponent* meshComponent = new MeshComponent(m_mesh);
 	object->addComponent(name + "_mesh", meshComponent);
@@ -281,7 +293,7 @@ void MultiRenderComponent::renderDirect(ShaderProgram* shaderProgram, TransformC
 	if (shaderProgram != NULL && m_geometryRegion != NULL) {
 		ShaderProgram::use(shaderProgram);
 		Engine::instance()->getScene()->applyUniforms(shaderProgram);
-		shaderProgram->setUniform("modelMatrix", glm::scale(dmat4(1.0), dvec3(0.5)));// parentTransform.transformationMatrix);
+		shaderProgram->setUniform("modelMatrix", this->getDirectModelMatrix());// parentTransform.transformationMatrix);
 
 		bool simpleRender = Engine::scene()->isSimpleRenderEnabled();
 
@@ -360,6 +372,16 @@ void MultiRenderComponent::uploadStaticSceneGeometry(TransformChain& parentTrans
 	Engine::scene()->getStaticGeometryBuffer()->upload(m_mesh->getVertices(), m_mesh->getTriangles(), m_geometryRegion, parentTransform.transformationMatrix);
 }
 
+void MultiRenderComponent::addVoxelFragmentEstimate(VoxelFragmentEstimator* estimator, TransformChain& parentTransform) {
+	if (m_geometryRegion != NULL) {
+		estimator->addMesh(m_mesh, this->getDirectModelMatrix() * parentTransform.transformationMatrix);
+	}
+}
+
+dmat4 MultiRenderComponent::getDirectModelMatrix() const {
+	return glm::scale(dmat4(1.0), dvec3(0.5));
+}
+
 void MultiRenderComponent::onAdded(SceneObject* object, std::string name) {
 	for (auto it = m_objectSections.begin(); it != m_objectSections.end(); it++) {
 		std::string objectName = it->first;
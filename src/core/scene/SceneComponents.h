@@ -76,6 +76,8 @@ public:
 
 	void uploadStaticSceneGeometry(TransformChain& parentTransform) override;
 
+	void addVoxelFragmentEstimate(VoxelFragmentEstimator* estimator, TransformChain& parentTransform) override;
+
 	void onAdded(SceneObject* object, std::string name) override;
 
 	void onRemoved(SceneObject* object, std::string name) override;
@@ -93,6 +95,9 @@ private:
 
 	void loadMaterial(MaterialConfiguration material);
 
+	// Drawn on top of the transform that was baked into the static geometry
+	dmat4 getDirectModelMatrix() const;
+
 	Mesh* m_mesh;
 	GeometryRegion* m_geometryRegion;
 	Material* m_material;
@@ -131,6 +136,8 @@ public:
 
 	void uploadStaticSceneGeometry(TransformChain& parentTransform) override;
 
+	void addVoxelFragmentEstimate(VoxelFragmentEstimator* estimator, TransformChain& parentTransform) override;
+
 	virtual void onAdded(SceneObject* object, std::string name) override;
 
 	virtual void onRemoved(SceneObject* object, std::string name) override;
@@ -149,6 +156,9 @@ private:
 
 	void loadMaterials(std::vector<MeshMaterialSection> materials);
 
+	// Drawn on top of the transform that was baked into the static geometry
+	dmat4 getDirectModelMatrix() const;
+
 	Mesh* m_mesh;
 	GeometryRegion* m_geometryRegion;
 	std::vector<OwnableMeshMaterialSection> m_materials;
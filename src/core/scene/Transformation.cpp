@@ -227,6 +227,15 @@ dmat4 Transformation::getModelMatrix() const {
 	return m;
 }
 
+Transformation Transformation::interpolate(const Transformation& from, const Transformation& to, double t) {
+	// Interpolates the decomposed translation, orientation and scale, blending the matrices would shear the axes
+	Transformation result(from);
+	result.setTranslation(mix(from.getTranslation(), to.getTranslation(), t));
+	result.setOrientation(slerp(from.getOrientation(), to.getOrientation(), t));
+	result.setScale(mix(from.getScale(), to.getScale(), t));
+	return result;
+}
+
 Transformation Transformation::operator*(const Transformation& t) const {
 	return Transformation(t.getModelMatrix() * this->getModelMatrix());
 }
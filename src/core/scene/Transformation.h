@@ -80,6 +80,8 @@ public:
 
 	dmat4 getModelMatrix() const;
 
+	static Transformation interpolate(const Transformation& from, const Transformation& to, double t);
+
 	Transformation operator*(const Transformation& t) const;
 
 	Transformation& operator*=(const Transformation& t);
@@ -0,0 +1,374 @@
+#include "Benchmark.h"
+
+#define BENCHMARK_MAX_ITERATIONS 1000000000
+
+static uint64_t getRealTime() {
+	return std::chrono::high_resolution_clock::now().time_since_epoch().count();
+}
+
+static std::string getRunName(const std::string& name, int64_t argument, bool hasArgument) {
+	return hasArgument ? name + "/" + std::to_string(argument) : name;
+}
+
+
+
+BenchmarkState::BenchmarkState(uint64_t iterations, int64_t argument):
+	m_iterations(iterations),
+	m_remainingIterations(iterations),
+	m_argument(argument),
+	m_started(false),
+	m_timing(false),
+	m_realTimeStart(0),
+	m_cpuTimeStart(0),
+	m_realTime(0),
+	m_cpuTime(0.0),
+	m_itemsProcessed(0),
+	m_bytesProcessed(0),
+	m_skipped(false) {
+}
+
+bool BenchmarkState::keepRunning() {
+	if (!m_started) {
+		m_started = true;
+		if (!m_error.empty())
+			return false;
+
+		this->startTimer();
+	}
+
+	if (m_remainingIterations == 0 || !m_error.empty()) {
+		if (m_timing)
+			this->stopTimer();
+		return false;
+	}
+
+	--m_remainingIterations;
+	return true;
+}
+
+void BenchmarkState::pauseTiming() {
+	if (m_timing)
+		this->stopTimer();
+}
+
+void BenchmarkState::resumeTiming() {
+	if (!m_timing)
+		this->startTimer();
+}
+
+int64_t BenchmarkState::getArgument() const {
+	return m_argument;
+}
+
+uint64_t BenchmarkState::getIterations() const {
+	return m_iterations;
+}
+
+void BenchmarkState::setItemsProcessed(uint64_t items) {
+	m_itemsProcessed = items;
+}
+
+void BenchmarkState::setBytesProcessed(uint64_t bytes) {
+	m_bytesProcessed = bytes;
+}
+
+void BenchmarkState::setLabel(std::string label) {
+	m_label = label;
+}
+
+void BenchmarkState::skipWithError(std::string message) {
+	m_error = message;
+	m_skipped = false;
+}
+
+void BenchmarkState::skipWithMessage(std::string message) {
+	m_error = message;
+	m_skipped = true;
+}
+
+void BenchmarkState::startTimer() {
+	m_timing = true;
+	m_cpuTimeStart = std::clock();
+	m_realTimeStart = getRealTime();
+}
+
+void BenchmarkState::stopTimer() {
+	uint64_t realTimeEnd = getRealTime();
+	std::clock_t cpuTimeEnd = std::clock();
+	m_realTime += realTimeEnd - m_realTimeStart;
+	m_cpuTime += (double)(cpuTimeEnd - m_cpuTimeStart) / CLOCKS_PER_SEC;
+	m_timing = false;
+}
+
+
+
+BenchmarkRunner::BenchmarkRunner():
+	m_minTime(0.5),
+	m_repetitions(3) {
+}
+
+BenchmarkRunner::~BenchmarkRunner() {
+}
+
+void BenchmarkRunner::add(std::string name, std::function<void(BenchmarkState&)> function, std::vector<int64_t> arguments) {
+	Entry entry;
+	entry.name = name;
+	entry.function = function;
+	entry.arguments = arguments;
+	m_entries.push_back(entry);
+}
+
+uint32_t BenchmarkRunner::run() {
+	uint32_t failedCount = 0;
+	m_results.clear();
+
+	for (int i = 0; i < m_entries.size(); i++) {
+		const Entry& entry = m_entries[i];
+		if (!m_filter.empty() && entry.name.find(m_filter) == std::string::npos)
+			continue;
+
+		bool hasArgument = !entry.arguments.empty();
+		std::vector<int64_t> arguments = hasArgument ? entry.arguments : std::vector<int64_t>{ 0 };
+
+		for (int j = 0; j < arguments.size(); j++) {
+			std::string runName = getRunName(entry.name, arguments[j], hasArgument);
+			info("Running benchmark %s\n", runName.c_str());
+
+			// Grow the iteration count until a run is long enough to time reliably
+			Result result;
+			uint64_t iterations = 1;
+			bool failed = false;
+			while (true) {
+				if (!this->runOnce(entry, arguments[j], iterations, result)) {
+					failed = true;
+					break;
+				}
+
+				double seconds = result.realTime * iterations / 1000000000.0;
+				if (seconds >= m_minTime || iterations >= BENCHMARK_MAX_ITERATIONS)
+					break;
+
+				double scale = seconds > 0.0 ? 1.4 * m_minTime / seconds : 10.0;
+				iterations = (uint64_t)glm::clamp((double)iterations * scale, (double)iterations + 1.0, (double)iterations * 10.0);
+				iterations = glm::min(iterations, (uint64_t)BENCHMARK_MAX_ITERATIONS);
+			}
+
+			if (failed) {
+				result.name = runName;
+				result.runName = runName;
+				result.repetitions = 0;
+				m_results.push_back(result);
+
+				if (result.skipped) {
+					info("Skipped benchmark %s: %s\n", runName.c_str(), result.error.c_str());
+				} else {
+					error("Benchmark %s failed: %s\n", runName.c_str(), result.error.c_str());
+					++failedCount;
+				}
+				continue;
+			}
+
+			std::vector<Result> repetitions;
+			repetitions.push_back(result);
+			for (uint32_t k = 1; k < m_repetitions && !failed; k++) {
+				failed = !this->runOnce(entry, arguments[j], iterations, result);
+				repetitions.push_back(result);
+			}
+
+			if (failed && result.skipped) {
+				info("Skipped benchmark %s: %s\n", runName.c_str(), result.error.c_str());
+			} else if (failed) {
+				error("Benchmark %s failed: %s\n", runName.c_str(), result.error.c_str());
+				++failedCount;
+			}
+
+			std::sort(repetitions.begin(), repetitions.end(), [](const Result& lhs, const Result& rhs) {
+				return lhs.realTime < rhs.realTime;
+			});
+
+			Result median = repetitions[repetitions.size() / 2];
+			median.name = runName;
+			median.runName = runName;
+			median.repetitions = (uint32_t)repetitions.size();
+			m_results.push_back(median);
+
+			info("%s: %.1f ns real, %.1f ns CPU, %llu iterations\n", runName.c_str(), median.realTime, median.cpuTime, (unsigned long long)median.iterations);
+
+			if (repetitions.size() > 1) {
+				Result mean = median;
+				mean.realTime = 0.0;
+				mean.cpuTime = 0.0;
+				for (int k = 0; k < repetitions.size(); k++) {
+					mean.realTime += repetitions[k].realTime / repetitions.size();
+					mean.cpuTime += repetitions[k].cpuTime / repetitions.size();
+				}
+
+				Result stddev = median;
+				stddev.realTime = 0.0;
+				stddev.cpuTime = 0.0;
+				for (int k = 0; k < repetitions.size(); k++) {
+					stddev.realTime += (repetitions[k].realTime - mean.realTime) * (repetitions[k].realTime - mean.realTime);
+					stddev.cpuTime += (repetitions[k].cpuTime - mean.cpuTime) * (repetitions[k].cpuTime - mean.cpuTime);
+				}
+				stddev.realTime = sqrt(stddev.realTime / (repetitions.size() - 1));
+				stddev.cpuTime = sqrt(stddev.cpuTime / (repetitions.size() - 1));
+
+				mean.name = runName + "_mean";
+				mean.aggregateName = "mean";
+				median.name = runName + "_median";
+				median.aggregateName = "median";
+				stddev.name = runName + "_stddev";
+				stddev.aggregateName = "stddev";
+				m_results.push_back(mean);
+				m_results.push_back(median);
+				m_results.push_back(stddev);
+			}
+		}
+	}
+
+	return failedCount;
+}
+
+bool BenchmarkRunner::writeJSON(std::string filePath) const {
+	FILE* file = fopen(filePath.c_str(), "wb");
+	if (file == NULL) {
+		error("Failed to open benchmark results file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	char date[64];
+	std::time_t now = std::time(NULL);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+	fprintf(file, "{\n  \"context\": {\n");
+	fprintf(file, "    \"date\": \"%s\",\n", date);
+	fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef _DEBUG
+	fprintf(file, "    \"library_build_type\": \"debug\"\n");
+#else
+	fprintf(file, "    \"library_build_type\": \"release\"\n");
+#endif
+	fprintf(file, "  },\n  \"benchmarks\": [");
+
+	for (int i = 0; i < m_results.size(); i++) {
+		const Result& result = m_results[i];
+		fprintf(file, "%s\n    {\n      \"name\": ", i == 0 ? "" : ",");
+		this->writeString(file, result.name);
+		fprintf(file, ",\n      \"run_name\": ");
+		this->writeString(file, result.runName);
+		fprintf(file, ",\n      \"run_type\": \"%s\",\n", result.aggregateName.empty() ? "iteration" : "aggregate");
+		if (!result.aggregateName.empty()) {
+			fprintf(file, "      \"aggregate_name\": \"%s\",\n", result.aggregateName.c_str());
+		}
+		fprintf(file, "      \"repetitions\": %u,\n", result.repetitions);
+
+		if (!result.error.empty()) {
+			if (result.skipped) {
+				fprintf(file, "      \"error_occurred\": false,\n      \"skipped\": true,\n      \"skip_message\": ");
+			} else {
+				fprintf(file, "      \"error_occurred\": true,\n      \"error_message\": ");
+			}
+			this->writeString(file, result.error);
+			fprintf(file, "\n    }");
+			continue;
+		}
+
+		fprintf(file, "      \"iterations\": %llu,\n", (unsigned long long)result.iterations);
+		fprintf(file, "      \"real_time\": %.6e,\n", result.realTime);
+		fprintf(file, "      \"cpu_time\": %.6e,\n", result.cpuTime);
+		fprintf(file, "      \"time_unit\": \"ns\"");
+		if (result.itemsPerSecond > 0.0) {
+			fprintf(file, ",\n      \"items_per_second\": %.6e", result.itemsPerSecond);
+		}
+		if (result.bytesPerSecond > 0.0) {
+			fprintf(file, ",\n      \"bytes_per_second\": %.6e", result.bytesPerSecond);
+		}
+		if (!result.label.empty()) {
+			fprintf(file, ",\n      \"label\": ");
+			this->writeString(file, result.label);
+		}
+		fprintf(file, "\n    }");
+	}
+
+	fprintf(file, "\n  ]\n}\n");
+	fclose(file);
+
+	info("Wrote %u benchmark results to \"%s\"\n", (uint32_t)m_results.size(), filePath.c_str());
+	return true;
+}
+
+double BenchmarkRunner::getMinTime() const {
+	return m_minTime;
+}
+
+void BenchmarkRunner::setMinTime(double minTime) {
+	m_minTime = minTime;
+}
+
+uint32_t BenchmarkRunner::getRepetitions() const {
+	return m_repetitions;
+}
+
+void BenchmarkRunner::setRepetitions(uint32_t repetitions) {
+	m_repetitions = glm::max(repetitions, 1u);
+}
+
+std::string BenchmarkRunner::getFilter() const {
+	return m_filter;
+}
+
+void BenchmarkRunner::setFilter(std::string filter) {
+	m_filter = filter;
+}
+
+bool BenchmarkRunner::runOnce(const Entry& entry, int64_t argument, uint64_t iterations, Result& result) const {
+	BenchmarkState state(iterations, argument);
+	entry.function(state);
+
+	result.iterations = iterations;
+	result.label = state.m_label;
+	result.error = state.m_error;
+	result.skipped = state.m_skipped;
+	result.aggregateName = "";
+	result.realTime = 0.0;
+	result.cpuTime = 0.0;
+	result.itemsPerSecond = 0.0;
+	result.bytesPerSecond = 0.0;
+
+	if (!state.m_error.empty())
+		return false;
+
+	if (state.m_remainingIterations != 0) {
+		result.error = "The benchmark returned before finishing its keepRunning() loop";
+		result.skipped = false;
+		return false;
+	}
+
+	double seconds = state.m_realTime / 1000000000.0;
+	result.realTime = (double)state.m_realTime / iterations;
+	result.cpuTime = state.m_cpuTime * 1000000000.0 / iterations;
+	if (seconds > 0.0) {
+		result.itemsPerSecond = state.m_itemsProcessed / seconds;
+		result.bytesPerSecond = state.m_bytesProcessed / seconds;
+	}
+
+	return true;
+}
+
+void BenchmarkRunner::writeString(FILE* file, const std::string& str) {
+	fputc('"', file);
+
+	for (int i = 0; i < str.size(); i++) {
+		char c = str[i];
+		if (c == '"' || c == '\\') {
+			fputc('\\', file);
+			fputc(c, file);
+		} else if ((uint8_t)c < 0x20) {
+			fprintf(file, "\\u%04x", (uint32_t)c);
+		} else {
+			fputc(c, file);
+		}
+	}
+
+	fputc('"', file);
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "core/pch.h"
+#include <functional>
+#include <atomic>
+#include <ctime>
+
+// Passed to every benchmark run. The timed section is the body of a while (state.keepRunning()) loop,
+// setup before it and teardown after it are not timed:
+//
+//     runner.add("AxisAlignedBB::combine", [](BenchmarkState& state) {
+//         std::vector<AxisAlignedBB> boxes = createBoxes(state.getArgument());
+//         while (state.keepRunning()) {
+//             ...
+//             BenchmarkState::doNotOptimize(result);
+//         }
+//         state.setItemsProcessed(state.getIterations() * boxes.size());
+//     }, { 64, 4096 });
+class BenchmarkState : private NotCopyable {
+	friend class BenchmarkRunner;
+public:
+	BenchmarkState(uint64_t iterations, int64_t argument);
+
+	bool keepRunning();
+
+	void pauseTiming();
+
+	void resumeTiming();
+
+	int64_t getArgument() const;
+
+	uint64_t getIterations() const;
+
+	void setItemsProcessed(uint64_t items);
+
+	void setBytesProcessed(uint64_t bytes);
+
+	void setLabel(std::string label);
+
+	void skipWithError(std::string message);
+
+	// Skips a benchmark that cannot run in this environment, such as on a CPU without an instruction set.
+	// Unlike an error, this does not fail the run
+	void skipWithMessage(std::string message);
+
+	// Keeps the compiler from discarding a result that is otherwise unused
+	template <typename T>
+	static void doNotOptimize(const T& value);
+
+private:
+	void startTimer();
+
+	void stopTimer();
+
+	uint64_t m_iterations;
+	uint64_t m_remainingIterations;
+	int64_t m_argument;
+	bool m_started;
+	bool m_timing;
+	uint64_t m_realTimeStart;
+	std::clock_t m_cpuTimeStart;
+	uint64_t m_realTime; // Nanoseconds spent in the timed sections
+	double m_cpuTime; // Seconds of process CPU time spent in the timed sections
+	uint64_t m_itemsProcessed;
+	uint64_t m_bytesProcessed;
+	std::string m_label;
+	std::string m_error;
+	bool m_skipped; // The error is the reason for skipping, not a failure
+};
+
+// Runs registered benchmarks in the style of Google Benchmark and writes the results in its JSON format,
+// so results of two builds can be compared with its compare.py. Every benchmark is run once per argument.
+// The iteration count is grown until one run takes at least the minimum time, and that many iterations are
+// then timed once per repetition. The repetition with the median time is reported, along with the mean,
+// median and standard deviation over all repetitions when there is more than one.
+class BenchmarkRunner : private NotCopyable {
+public:
+	BenchmarkRunner();
+
+	~BenchmarkRunner();
+
+	void add(std::string name, std::function<void(BenchmarkState&)> function, std::vector<int64_t> arguments = std::vector<int64_t>());
+
+	uint32_t run();
+
+	bool writeJSON(std::string filePath) const;
+
+	double getMinTime() const;
+
+	void setMinTime(double minTime);
+
+	uint32_t getRepetitions() const;
+
+	void setRepetitions(uint32_t repetitions);
+
+	std::string getFilter() const;
+
+	void setFilter(std::string filter);
+
+private:
+	struct Entry {
+		std::string name;
+		std::function<void(BenchmarkState&)> function;
+		std::vector<int64_t> arguments;
+	};
+
+	struct Result {
+		std::string name;
+		std::string runName;
+		std::string aggregateName; // Empty for the reported repetition
+		uint64_t iterations;
+		double realTime; // Nanoseconds per iteration
+		double cpuTime;
+		double itemsPerSecond;
+		double bytesPerSecond;
+		uint32_t repetitions;
+		std::string label;
+		std::string error;
+		bool skipped;
+	};
+
+	bool runOnce(const Entry& entry, int64_t argument, uint64_t iterations, Result& result) const;
+
+	static void writeString(FILE* file, const std::string& str);
+
+	std::vector<Entry> m_entries;
+	std::vector<Result> m_results;
+	double m_minTime; // Seconds each repetition runs for at least
+	uint32_t m_repetitions;
+	std::string m_filter; // Only benchmarks whose name contains this are run
+};
+
+template <typename T>
+inline void BenchmarkState::doNotOptimize(const T& value) {
+	static const void* volatile s_sink = NULL; // The value escapes through a pointer a signal handler could read
+	s_sink = &value;
+	std::atomic_signal_fence(std::memory_order_seq_cst); // The value must be complete at this point
+}
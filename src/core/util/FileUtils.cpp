@@ -1,5 +1,6 @@
 #include "core/util/FileUtils.h"
 #include <png.h>
+#include <filesystem>
 
 bool FileUtils::loadPNG(std::string file, PNGFile& dest, bool verticalFlip) {
 	// Copied straight from https://blog.nobel-joergensen.com/2010/11/07/loading-a-png-as-texture-in-opengl-using-libpng/
@@ -146,4 +147,14 @@ bool FileUtils::loadFileAttemptPaths(std::vector<std::string> paths, std::string
 	}
 
 	return false;
+}
+
+bool FileUtils::createDirectories(std::string path) {
+	std::error_code errorCode;
+	std::filesystem::create_directories(path, errorCode);
+	if (errorCode) {
+		error("Failed to create directory \"%s\": %s\n", path.c_str(), errorCode.message().c_str());
+		return false;
+	}
+	return true;
 }
\ No newline at end of file
@@ -4,6 +4,13 @@
 
 #define RESOURCE_PATH(path) (Engine::instance()->getResourceDirectory() + "/" + std::string(path))
 
+// fseek takes a long offset, which is 32 bits on Windows and cannot seek past 2 GiB
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
 struct PNGFile {
 	uint32_t width = 0;
 	uint32_t height = 0;
@@ -43,5 +50,8 @@ namespace FileUtils {
 	bool loadFile(std::string file, std::string& dest, bool logError = true);
 
 	bool loadFileAttemptPaths(std::vector<std::string> paths, std::string& dest, bool logError = true);
+
+	// Creates the directory and any missing parents, succeeding if it already exists
+	bool createDirectories(std::string path);
 }
 
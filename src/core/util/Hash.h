@@ -0,0 +1,52 @@
+#pragma once
+
+#include "core/pch.h"
+
+// Hashes used to key the on-disk caches. hashBytes is 64-bit FNV-1a. hashWords is a faster FNV style hash
+// for the hundreds of megabytes of an environment map, it consumes 64-bit words rather than bytes. A
+// multiply only carries bits upwards, so every step also folds the high half of the hash into the low half,
+// otherwise the top bits of the words would barely affect the hash. Word hashes are not stable across
+// endianness, the caches are local to the machine that wrote them.
+namespace Hash {
+	const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+	const uint64_t FNV_PRIME = 1099511628211ull;
+
+	inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * FNV_PRIME;
+		}
+		return hash;
+	}
+
+	// Any trailing bytes that do not fill a word are hashed with hashBytes
+	inline uint64_t hashWords(const void* data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		size_t wordCount = size / sizeof(uint64_t);
+		for (size_t i = 0; i < wordCount; i++) {
+			uint64_t word;
+			memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+			hash = (hash ^ word) * FNV_PRIME;
+			hash ^= hash >> 32;
+		}
+		return hashBytes(bytes + wordCount * sizeof(uint64_t), size - wordCount * sizeof(uint64_t), hash);
+	}
+
+	inline uint64_t hashString(const std::string& str, uint64_t hash = FNV_OFFSET_BASIS) {
+		// The length is mixed in so consecutive strings hash differently to their concatenation
+		uint64_t length = str.size();
+		hash = hashBytes(&length, sizeof(uint64_t), hash);
+		return hashBytes(str.data(), str.size(), hash);
+	}
+
+	template <typename T>
+	inline uint64_t hashValue(const T& value, uint64_t hash = FNV_OFFSET_BASIS) {
+		return hashBytes(&value, sizeof(T), hash);
+	}
+
+	inline std::string toHexString(uint64_t hash) {
+		char str[17];
+		snprintf(str, sizeof(str), "%016llx", (unsigned long long)hash);
+		return std::string(str);
+	}
+}
@@ -0,0 +1,297 @@
+#include "Morton.h"
+#include <emmintrin.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define BMI2_SUPPORTED
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BMI2_TARGET
+#else
+#include <cpuid.h>
+#define BMI2_TARGET __attribute__((target("bmi2")))
+#endif
+#endif
+
+struct MortonLUT {
+	uint32_t encode[256]; // Byte spread out to every third bit
+	uint16_t decode[512]; // Three 3-bit groups to 3 bits per axis, x in bits 0-2, y in 3-5, z in 6-8
+
+	MortonLUT() {
+		for (uint32_t i = 0; i < 256; i++) {
+			encode[i] = Morton::spreadBits32(i);
+		}
+
+		for (uint32_t i = 0; i < 512; i++) {
+			uvec3 coord = Morton::decode32MagicBits(i);
+			decode[i] = (uint16_t)(coord.x | (coord.y << 3) | (coord.z << 6));
+		}
+	}
+};
+
+static const MortonLUT mortonLUT;
+
+static bool detectBMI2() {
+#ifdef BMI2_SUPPORTED
+	int32_t info[4];
+	auto cpuid = [&info](int32_t leaf) {
+#if defined(_MSC_VER)
+		__cpuidex(info, leaf, 0);
+#else
+		__cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+	};
+
+	cpuid(0);
+	int32_t maxLeaf = info[0];
+	bool amd = info[1] == 0x68747541 && info[3] == 0x69746E65 && info[2] == 0x444D4163; // "AuthenticAMD"
+	if (maxLeaf < 7)
+		return false;
+
+	cpuid(7);
+	if ((info[1] & (1 << 8)) == 0)
+		return false;
+
+	if (amd) {
+		// pdep and pext are microcoded before Zen 3 and much slower than the shifts
+		cpuid(1);
+		uint32_t family = ((info[0] >> 8) & 0xF) + ((info[0] >> 20) & 0xFF);
+		if (family < 0x19)
+			return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+static const bool bmi2Available = detectBMI2();
+
+static uint64_t spreadBitsLUT(uint32_t x) {
+	return (uint64_t)mortonLUT.encode[x & 0xFF] | ((uint64_t)mortonLUT.encode[(x >> 8) & 0xFF] << 24) | ((uint64_t)mortonLUT.encode[(x >> 16) & 0x1F] << 48);
+}
+
+static __m128i spreadBits32SSE(__m128i x) {
+	x = _mm_and_si128(x, _mm_set1_epi32(0x3FF));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 16)), _mm_set1_epi32(0x030000FF));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 8)), _mm_set1_epi32(0x0300F00F));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 4)), _mm_set1_epi32(0x030C30C3));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 2)), _mm_set1_epi32(0x09249249));
+	return x;
+}
+
+static __m128i compactBits32SSE(__m128i x) {
+	x = _mm_and_si128(x, _mm_set1_epi32(0x09249249));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi32(x, 2)), _mm_set1_epi32(0x030C30C3));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi32(x, 4)), _mm_set1_epi32(0x0300F00F));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi32(x, 8)), _mm_set1_epi32(0xFF0000FF));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi32(x, 16)), _mm_set1_epi32(0x000003FF));
+	return x;
+}
+
+static __m128i set1Epi64(uint64_t x) {
+	// _mm_set1_epi64x is missing from some 32-bit toolchains
+	return _mm_setr_epi32((int32_t)(uint32_t)x, (int32_t)(uint32_t)(x >> 32), (int32_t)(uint32_t)x, (int32_t)(uint32_t)(x >> 32));
+}
+
+static __m128i spreadBits64SSE(__m128i x) {
+	x = _mm_and_si128(x, set1Epi64(0x1FFFFF));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi64(x, 32)), set1Epi64(0x1F00000000FFFF));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi64(x, 16)), set1Epi64(0x1F0000FF0000FF));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi64(x, 8)), set1Epi64(0x100F00F00F00F00F));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi64(x, 4)), set1Epi64(0x10C30C30C30C30C3));
+	x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi64(x, 2)), set1Epi64(0x1249249249249249));
+	return x;
+}
+
+static __m128i compactBits64SSE(__m128i x) {
+	x = _mm_and_si128(x, set1Epi64(0x1249249249249249));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 2)), set1Epi64(0x10C30C30C30C30C3));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 4)), set1Epi64(0x100F00F00F00F00F));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 8)), set1Epi64(0x1F0000FF0000FF));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 16)), set1Epi64(0x1F00000000FFFF));
+	x = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 32)), set1Epi64(0x1FFFFF));
+	return x;
+}
+
+#ifdef BMI2_SUPPORTED
+BMI2_TARGET static uint32_t encode32BMI2Impl(uvec3 coord) {
+	return (uint32_t)(_pdep_u32(coord.x, Morton::MASK_32 << 2) | _pdep_u32(coord.y, Morton::MASK_32 << 1) | _pdep_u32(coord.z, Morton::MASK_32));
+}
+
+BMI2_TARGET static uvec3 decode32BMI2Impl(uint32_t code) {
+	return uvec3(_pext_u32(code, Morton::MASK_32 << 2), _pext_u32(code, Morton::MASK_32 << 1), _pext_u32(code, Morton::MASK_32));
+}
+
+BMI2_TARGET static uint64_t encode64BMI2Impl(uvec3 coord) {
+	return _pdep_u64(coord.x, Morton::MASK_64 << 2) | _pdep_u64(coord.y, Morton::MASK_64 << 1) | _pdep_u64(coord.z, Morton::MASK_64);
+}
+
+BMI2_TARGET static uvec3 decode64BMI2Impl(uint64_t code) {
+	return uvec3((uint32_t)_pext_u64(code, Morton::MASK_64 << 2), (uint32_t)_pext_u64(code, Morton::MASK_64 << 1), (uint32_t)_pext_u64(code, Morton::MASK_64));
+}
+
+BMI2_TARGET static void encode64BMI2Batch(const uvec3* coords, uint64_t* codes, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		codes[i] = encode64BMI2Impl(coords[i]);
+	}
+}
+
+BMI2_TARGET static void decode64BMI2Batch(const uint64_t* codes, uvec3* coords, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		coords[i] = decode64BMI2Impl(codes[i]);
+	}
+}
+#endif
+
+
+
+uint32_t Morton::encode32LUT(uvec3 coord) {
+	return (uint32_t)((spreadBitsLUT(coord.x & 0x3FF) << 2) | (spreadBitsLUT(coord.y & 0x3FF) << 1) | spreadBitsLUT(coord.z & 0x3FF));
+}
+
+uvec3 Morton::decode32LUT(uint32_t code) {
+	uvec3 coord = uvec3(0);
+	for (uint32_t i = 0; i < 4; i++) {
+		uint32_t bits = mortonLUT.decode[(code >> (i * 9)) & 0x1FF];
+		coord.x |= (bits & 7) << (i * 3);
+		coord.y |= ((bits >> 3) & 7) << (i * 3);
+		coord.z |= ((bits >> 6) & 7) << (i * 3);
+	}
+	return coord;
+}
+
+uint64_t Morton::encode64LUT(uvec3 coord) {
+	return (spreadBitsLUT(coord.x) << 2) | (spreadBitsLUT(coord.y) << 1) | spreadBitsLUT(coord.z);
+}
+
+uvec3 Morton::decode64LUT(uint64_t code) {
+	uvec3 coord = uvec3(0);
+	for (uint32_t i = 0; i < 7; i++) {
+		uint32_t bits = mortonLUT.decode[(code >> (i * 9)) & 0x1FF];
+		coord.x |= (bits & 7) << (i * 3);
+		coord.y |= ((bits >> 3) & 7) << (i * 3);
+		coord.z |= ((bits >> 6) & 7) << (i * 3);
+	}
+	return coord;
+}
+
+uint32_t Morton::encode32BMI2(uvec3 coord) {
+#ifdef BMI2_SUPPORTED
+	return encode32BMI2Impl(coord);
+#else
+	return encode32MagicBits(coord);
+#endif
+}
+
+uvec3 Morton::decode32BMI2(uint32_t code) {
+#ifdef BMI2_SUPPORTED
+	return decode32BMI2Impl(code);
+#else
+	return decode32MagicBits(code);
+#endif
+}
+
+uint64_t Morton::encode64BMI2(uvec3 coord) {
+#ifdef BMI2_SUPPORTED
+	return encode64BMI2Impl(coord);
+#else
+	return encode64MagicBits(coord);
+#endif
+}
+
+uvec3 Morton::decode64BMI2(uint64_t code) {
+#ifdef BMI2_SUPPORTED
+	return decode64BMI2Impl(code);
+#else
+	return decode64MagicBits(code);
+#endif
+}
+
+bool Morton::hasBMI2() {
+	return bmi2Available;
+}
+
+void Morton::encode32(const uvec3* coords, uint32_t* codes, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const uvec3* c = &coords[i];
+		__m128i x = _mm_setr_epi32(c[0].x, c[1].x, c[2].x, c[3].x);
+		__m128i y = _mm_setr_epi32(c[0].y, c[1].y, c[2].y, c[3].y);
+		__m128i z = _mm_setr_epi32(c[0].z, c[1].z, c[2].z, c[3].z);
+		__m128i code = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(spreadBits32SSE(x), 2), _mm_slli_epi32(spreadBits32SSE(y), 1)), spreadBits32SSE(z));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&codes[i]), code);
+	}
+
+	for (; i < count; i++) {
+		codes[i] = encode32(coords[i]);
+	}
+}
+
+void Morton::decode32(const uint32_t* codes, uvec3* coords, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i code = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&codes[i]));
+		uint32_t x[4], y[4], z[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(x), compactBits32SSE(_mm_srli_epi32(code, 2)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y), compactBits32SSE(_mm_srli_epi32(code, 1)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(z), compactBits32SSE(code));
+
+		for (int j = 0; j < 4; j++) {
+			coords[i + j] = uvec3(x[j], y[j], z[j]);
+		}
+	}
+
+	for (; i < count; i++) {
+		coords[i] = decode32(codes[i]);
+	}
+}
+
+void Morton::encode64(const uvec3* coords, uint64_t* codes, size_t count) {
+#ifdef BMI2_SUPPORTED
+	if (bmi2Available) {
+		encode64BMI2Batch(coords, codes, count);
+		return;
+	}
+#endif
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		const uvec3* c = &coords[i];
+		__m128i x = _mm_setr_epi32(c[0].x, 0, c[1].x, 0);
+		__m128i y = _mm_setr_epi32(c[0].y, 0, c[1].y, 0);
+		__m128i z = _mm_setr_epi32(c[0].z, 0, c[1].z, 0);
+		__m128i code = _mm_or_si128(_mm_or_si128(_mm_slli_epi64(spreadBits64SSE(x), 2), _mm_slli_epi64(spreadBits64SSE(y), 1)), spreadBits64SSE(z));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&codes[i]), code);
+	}
+
+	for (; i < count; i++) {
+		codes[i] = encode64MagicBits(coords[i]);
+	}
+}
+
+void Morton::decode64(const uint64_t* codes, uvec3* coords, size_t count) {
+#ifdef BMI2_SUPPORTED
+	if (bmi2Available) {
+		decode64BMI2Batch(codes, coords, count);
+		return;
+	}
+#endif
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m128i code = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&codes[i]));
+		uint64_t x[2], y[2], z[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(x), compactBits64SSE(_mm_srli_epi64(code, 2)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(y), compactBits64SSE(_mm_srli_epi64(code, 1)));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(z), compactBits64SSE(code));
+
+		coords[i + 0] = uvec3((uint32_t)x[0], (uint32_t)y[0], (uint32_t)z[0]);
+		coords[i + 1] = uvec3((uint32_t)x[1], (uint32_t)y[1], (uint32_t)z[1]);
+	}
+
+	for (; i < count; i++) {
+		coords[i] = decode64MagicBits(codes[i]);
+	}
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "core/pch.h"
+
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+#if defined(_M_X64) || defined(__x86_64__)
+#define MORTON_BMI2_ENABLED // The whole build targets BMI2, so the scalar paths use it directly
+#include <immintrin.h>
+#endif
+#endif
+
+// Morton (Z-order) codes of 3D voxel coordinates. The bits of the three axes are interleaved so every
+// 3-bit group of a code is the octant index (x << 2) | (y << 1) | z used by the octree shaders and the
+// CPU octree, which makes code >> (3 * n) the code of the node n levels up. 32-bit codes hold 10 bits
+// per axis, 64-bit codes 21 bits, higher coordinate bits are ignored.
+// encode/decode use pdep/pext when the build targets BMI2 and the magic bits shifts otherwise. Every
+// implementation is also available on its own, so they can be compared against each other. The batch
+// functions pick the fastest one for the CPU they run on at runtime.
+namespace Morton {
+	const uint32_t MAX_BITS_32 = 10;
+	const uint32_t MAX_BITS_64 = 21;
+
+	const uint32_t MASK_32 = 0x09249249; // Bit 0 of every group, the z bits
+	const uint64_t MASK_64 = 0x1249249249249249;
+
+	inline uint32_t spreadBits32(uint32_t x) {
+		x &= 0x3FF;
+		x = (x | x << 16) & 0x030000FF;
+		x = (x | x << 8) & 0x0300F00F;
+		x = (x | x << 4) & 0x030C30C3;
+		x = (x | x << 2) & 0x09249249;
+		return x;
+	}
+
+	inline uint32_t compactBits32(uint32_t x) {
+		x &= 0x09249249;
+		x = (x ^ (x >> 2)) & 0x030C30C3;
+		x = (x ^ (x >> 4)) & 0x0300F00F;
+		x = (x ^ (x >> 8)) & 0xFF0000FF;
+		x = (x ^ (x >> 16)) & 0x000003FF;
+		return x;
+	}
+
+	inline uint64_t spreadBits64(uint64_t x) {
+		x &= 0x1FFFFF;
+		x = (x | x << 32) & 0x1F00000000FFFF;
+		x = (x | x << 16) & 0x1F0000FF0000FF;
+		x = (x | x << 8) & 0x100F00F00F00F00F;
+		x = (x | x << 4) & 0x10C30C30C30C30C3;
+		x = (x | x << 2) & 0x1249249249249249;
+		return x;
+	}
+
+	inline uint64_t compactBits64(uint64_t x) {
+		x &= 0x1249249249249249;
+		x = (x ^ (x >> 2)) & 0x10C30C30C30C30C3;
+		x = (x ^ (x >> 4)) & 0x100F00F00F00F00F;
+		x = (x ^ (x >> 8)) & 0x1F0000FF0000FF;
+		x = (x ^ (x >> 16)) & 0x1F00000000FFFF;
+		x = (x ^ (x >> 32)) & 0x1FFFFF;
+		return x;
+	}
+
+	inline uint32_t encode32MagicBits(uvec3 coord) {
+		return (spreadBits32(coord.x) << 2) | (spreadBits32(coord.y) << 1) | spreadBits32(coord.z);
+	}
+
+	inline uvec3 decode32MagicBits(uint32_t code) {
+		return uvec3(compactBits32(code >> 2), compactBits32(code >> 1), compactBits32(code));
+	}
+
+	inline uint64_t encode64MagicBits(uvec3 coord) {
+		return (spreadBits64(coord.x) << 2) | (spreadBits64(coord.y) << 1) | spreadBits64(coord.z);
+	}
+
+	inline uvec3 decode64MagicBits(uint64_t code) {
+		return uvec3((uint32_t)compactBits64(code >> 2), (uint32_t)compactBits64(code >> 1), (uint32_t)compactBits64(code));
+	}
+
+	uint32_t encode32LUT(uvec3 coord);
+
+	uvec3 decode32LUT(uint32_t code);
+
+	uint64_t encode64LUT(uvec3 coord);
+
+	uvec3 decode64LUT(uint64_t code);
+
+	// Only valid when hasBMI2() is true
+	uint32_t encode32BMI2(uvec3 coord);
+
+	uvec3 decode32BMI2(uint32_t code);
+
+	uint64_t encode64BMI2(uvec3 coord);
+
+	uvec3 decode64BMI2(uint64_t code);
+
+	bool hasBMI2();
+
+	inline uint32_t encode32(uvec3 coord) {
+#ifdef MORTON_BMI2_ENABLED
+		return (uint32_t)(_pdep_u32(coord.x, MASK_32 << 2) | _pdep_u32(coord.y, MASK_32 << 1) | _pdep_u32(coord.z, MASK_32));
+#else
+		return encode32MagicBits(coord);
+#endif
+	}
+
+	inline uvec3 decode32(uint32_t code) {
+#ifdef MORTON_BMI2_ENABLED
+		return uvec3(_pext_u32(code, MASK_32 << 2), _pext_u32(code, MASK_32 << 1), _pext_u32(code, MASK_32));
+#else
+		return decode32MagicBits(code);
+#endif
+	}
+
+	inline uint64_t encode64(uvec3 coord) {
+#ifdef MORTON_BMI2_ENABLED
+		return _pdep_u64(coord.x, MASK_64 << 2) | _pdep_u64(coord.y, MASK_64 << 1) | _pdep_u64(coord.z, MASK_64);
+#else
+		return encode64MagicBits(coord);
+#endif
+	}
+
+	inline uvec3 decode64(uint64_t code) {
+#ifdef MORTON_BMI2_ENABLED
+		return uvec3((uint32_t)_pext_u64(code, MASK_64 << 2), (uint32_t)_pext_u64(code, MASK_64 << 1), (uint32_t)_pext_u64(code, MASK_64));
+#else
+		return decode64MagicBits(code);
+#endif
+	}
+
+	// Batches, four (32-bit) or two (64-bit) coordinates per SSE2 instruction, or pdep/pext when available
+	void encode32(const uvec3* coords, uint32_t* codes, size_t count);
+
+	void decode32(const uint32_t* codes, uvec3* coords, size_t count);
+
+	void encode64(const uvec3* coords, uint64_t* codes, size_t count);
+
+	void decode64(const uint64_t* codes, uvec3* coords, size_t count);
+}
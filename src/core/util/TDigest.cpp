@@ -0,0 +1,151 @@
+#include "core/util/TDigest.h"
+
+TDigest::TDigest(double compression):
+	m_compression(compression),
+	m_totalWeight(0.0),
+	m_min(INFINITY),
+	m_max(-INFINITY),
+	m_sum(0.0) {
+}
+
+TDigest::~TDigest() {}
+
+void TDigest::add(double value, double weight) {
+	if (weight <= 0.0 || value != value) // Ignore NaN samples
+		return;
+
+	Centroid centroid;
+	centroid.mean = value;
+	centroid.weight = weight;
+	m_buffer.push_back(centroid);
+
+	m_totalWeight += weight;
+	m_sum += value * weight;
+	m_min = glm::min(m_min, value);
+	m_max = glm::max(m_max, value);
+
+	if (m_buffer.size() >= (size_t)(m_compression * 5.0)) {
+		this->compress();
+	}
+}
+
+void TDigest::merge(const TDigest& digest) {
+	for (int i = 0; i < digest.m_centroids.size(); i++) {
+		m_buffer.push_back(digest.m_centroids[i]);
+	}
+
+	for (int i = 0; i < digest.m_buffer.size(); i++) {
+		m_buffer.push_back(digest.m_buffer[i]);
+	}
+
+	m_totalWeight += digest.m_totalWeight;
+	m_sum += digest.m_sum;
+	m_min = glm::min(m_min, digest.m_min);
+	m_max = glm::max(m_max, digest.m_max);
+
+	this->compress();
+}
+
+void TDigest::clear() {
+	m_centroids.clear();
+	m_buffer.clear();
+	m_totalWeight = 0.0;
+	m_min = INFINITY;
+	m_max = -INFINITY;
+	m_sum = 0.0;
+}
+
+double TDigest::quantile(double q) {
+	this->compress();
+
+	if (m_centroids.empty())
+		return NAN;
+
+	if (m_centroids.size() == 1)
+		return m_centroids[0].mean;
+
+	q = glm::clamp(q, 0.0, 1.0);
+	double index = q * m_totalWeight;
+
+	// Each centroid is treated as centred on its cumulative weight, values are interpolated
+	// between neighbouring centres, and towards the exact min and max at either end.
+	double left = m_centroids[0].weight * 0.5;
+	if (index < left) {
+		return m_min + (m_centroids[0].mean - m_min) * (index / left);
+	}
+
+	for (int i = 0; i < m_centroids.size() - 1; i++) {
+		double right = left + (m_centroids[i].weight + m_centroids[i + 1].weight) * 0.5;
+		if (index < right) {
+			double t = (index - left) / (right - left);
+			return m_centroids[i].mean + (m_centroids[i + 1].mean - m_centroids[i].mean) * t;
+		}
+		left = right;
+	}
+
+	double lastWeight = m_centroids.back().weight * 0.5;
+	double t = glm::min((index - left) / lastWeight, 1.0);
+	return m_centroids.back().mean + (m_max - m_centroids.back().mean) * t;
+}
+
+double TDigest::getCompression() const {
+	return m_compression;
+}
+
+double TDigest::getCount() const {
+	return m_totalWeight;
+}
+
+double TDigest::getMin() const {
+	return m_totalWeight > 0.0 ? m_min : NAN;
+}
+
+double TDigest::getMax() const {
+	return m_totalWeight > 0.0 ? m_max : NAN;
+}
+
+double TDigest::getMean() const {
+	return m_totalWeight > 0.0 ? m_sum / m_totalWeight : NAN;
+}
+
+uint32_t TDigest::getCentroidCount() {
+	this->compress();
+	return m_centroids.size();
+}
+
+void TDigest::compress() {
+	if (m_buffer.empty())
+		return;
+
+	m_buffer.insert(m_buffer.end(), m_centroids.begin(), m_centroids.end());
+	std::sort(m_buffer.begin(), m_buffer.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+
+	m_centroids.clear();
+
+	Centroid current = m_buffer[0];
+	double weightSoFar = 0.0;
+
+	for (int i = 1; i < m_buffer.size(); i++) {
+		double proposedWeight = current.weight + m_buffer[i].weight;
+		double q0 = weightSoFar / m_totalWeight;
+		double q1 = (weightSoFar + proposedWeight) / m_totalWeight;
+
+		if (this->scale(q1) - this->scale(q0) <= 1.0) {
+			// Still small enough for its position in the distribution, absorb the next centroid
+			current.mean += (m_buffer[i].mean - current.mean) * (m_buffer[i].weight / proposedWeight);
+			current.weight = proposedWeight;
+		} else {
+			weightSoFar += current.weight;
+			m_centroids.push_back(current);
+			current = m_buffer[i];
+		}
+	}
+
+	m_centroids.push_back(current);
+	m_buffer.clear();
+}
+
+double TDigest::scale(double q) const {
+	// k1 scale function, centroids near q = 0 and q = 1 are limited to very few samples
+	return m_compression / (2.0 * glm::pi<double>()) * asin(2.0 * glm::clamp(q, 0.0, 1.0) - 1.0);
+}
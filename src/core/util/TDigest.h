@@ -0,0 +1,51 @@
+#pragma once
+
+#include "core/pch.h"
+
+// Streaming quantile sketch (merging t-digest). Samples are summarized into a bounded number of
+// weighted centroids, which are small near the tails and large around the median, so extreme
+// percentiles stay accurate while memory use does not grow with the number of samples.
+class TDigest {
+public:
+	TDigest(double compression = 100.0);
+
+	~TDigest();
+
+	void add(double value, double weight = 1.0);
+
+	void merge(const TDigest& digest);
+
+	void clear();
+
+	double quantile(double q);
+
+	double getCompression() const;
+
+	double getCount() const;
+
+	double getMin() const;
+
+	double getMax() const;
+
+	double getMean() const;
+
+	uint32_t getCentroidCount();
+
+private:
+	struct Centroid {
+		double mean;
+		double weight;
+	};
+
+	void compress();
+
+	double scale(double q) const;
+
+	std::vector<Centroid> m_centroids; // Sorted by mean after compress()
+	std::vector<Centroid> m_buffer; // Samples not yet merged into the centroids
+	double m_compression;
+	double m_totalWeight; // Weight of the centroids and the buffer
+	double m_min;
+	double m_max;
+	double m_sum;
+};
@@ -0,0 +1,97 @@
+#include "Test.h"
+#include "core/util/FileUtils.h"
+#include <filesystem>
+
+TestState::TestState(std::string name, std::string tempDirectory):
+	m_name(name),
+	m_tempDirectory(tempDirectory),
+	m_failureCount(0) {
+}
+
+bool TestState::expect(bool condition, const char* expression, const char* file, int line) {
+	if (condition)
+		return true;
+
+	error("%s:%d: %s: Expected %s\n", file, line, m_name.c_str(), expression);
+	++m_failureCount;
+	return false;
+}
+
+void TestState::fail(std::string message) {
+	error("%s: %s\n", m_name.c_str(), message.c_str());
+	++m_failureCount;
+}
+
+uint32_t TestState::getFailureCount() const {
+	return m_failureCount;
+}
+
+std::string TestState::getTempFilePath(std::string fileName) const {
+	std::string prefix = m_name;
+	for (int i = 0; i < prefix.size(); i++) {
+		if (!isalnum((unsigned char)prefix[i]))
+			prefix[i] = '_';
+	}
+
+	return m_tempDirectory + "/" + prefix + "_" + fileName;
+}
+
+
+
+TestRunner::TestRunner(std::string tempDirectory):
+	m_tempDirectory(tempDirectory) {
+}
+
+TestRunner::~TestRunner() {
+}
+
+void TestRunner::add(std::string name, std::function<void(TestState&)> function) {
+	Entry entry;
+	entry.name = name;
+	entry.function = function;
+	m_entries.push_back(entry);
+}
+
+uint32_t TestRunner::run() {
+	std::error_code errorCode;
+	std::filesystem::remove_all(m_tempDirectory, errorCode);
+	if (!FileUtils::createDirectories(m_tempDirectory)) {
+		error("Unable to create the test directory \"%s\"\n", m_tempDirectory.c_str());
+		return (uint32_t)m_entries.size();
+	}
+
+	uint32_t runCount = 0;
+	uint32_t failedCount = 0;
+
+	for (int i = 0; i < m_entries.size(); i++) {
+		const Entry& entry = m_entries[i];
+		if (!m_filter.empty() && entry.name.find(m_filter) == std::string::npos)
+			continue;
+
+		TestState state(entry.name, m_tempDirectory);
+		try {
+			entry.function(state);
+		} catch (std::exception e) {
+			state.fail(std::string("Threw an exception: ") + e.what());
+		}
+
+		++runCount;
+		if (state.getFailureCount() != 0) {
+			error("Test %s failed with %u failed expectations\n", entry.name.c_str(), state.getFailureCount());
+			++failedCount;
+		} else {
+			info("Test %s passed\n", entry.name.c_str());
+		}
+	}
+
+	info("%u of %u tests passed\n", runCount - failedCount, runCount);
+	return failedCount;
+}
+
+std::string TestRunner::getFilter() const {
+	return m_filter;
+}
+
+void TestRunner::setFilter(std::string filter) {
+	m_filter = filter;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "core/pch.h"
+#include <functional>
+
+#define TEST_EXPECT(state, condition) (state).expect((condition), #condition, __FILE__, __LINE__)
+#define TEST_EXPECT_EQUAL(state, expected, actual) (state).expectEqual((expected), (actual), #expected " == " #actual, __FILE__, __LINE__)
+
+// Passed to every test. A failed expectation is logged and counted, and the test carries on, so one run
+// reports everything that is broken rather than only the first failure:
+//
+//     runner.add("BrickPool::allocate", [](TestState& state) {
+//         BrickPool pool(4, 8);
+//         TEST_EXPECT_EQUAL(state, 0u, pool.allocate());
+//         TEST_EXPECT(state, pool.isAllocated(0));
+//     });
+class TestState : private NotCopyable {
+	friend class TestRunner;
+public:
+	TestState(std::string name, std::string tempDirectory);
+
+	bool expect(bool condition, const char* expression, const char* file, int line);
+
+	template <typename T, typename U>
+	bool expectEqual(const T& expected, const U& actual, const char* expression, const char* file, int line);
+
+	void fail(std::string message);
+
+	uint32_t getFailureCount() const;
+
+	// Path of a scratch file for this test. The directory is emptied before the tests run, not after,
+	// so the files of a failed test can be looked at
+	std::string getTempFilePath(std::string fileName) const;
+
+private:
+	std::string m_name;
+	std::string m_tempDirectory;
+	uint32_t m_failureCount;
+};
+
+// Runs registered tests one after another and reports the ones that failed. A test fails when any of
+// its expectations does not hold, or when it throws.
+class TestRunner : private NotCopyable {
+public:
+	TestRunner(std::string tempDirectory);
+
+	~TestRunner();
+
+	void add(std::string name, std::function<void(TestState&)> function);
+
+	// Returns the number of failed tests
+	uint32_t run();
+
+	std::string getFilter() const;
+
+	void setFilter(std::string filter);
+
+private:
+	struct Entry {
+		std::string name;
+		std::function<void(TestState&)> function;
+	};
+
+	std::vector<Entry> m_entries;
+	std::string m_tempDirectory;
+	std::string m_filter; // Only tests whose name contains this are run
+};
+
+template <typename T, typename U>
+inline bool TestState::expectEqual(const T& expected, const U& actual, const char* expression, const char* file, int line) {
+	if (expected == actual)
+		return true;
+
+	std::stringstream message;
+	message << expression << " (expected " << expected << ", got " << actual << ")";
+	return this->expect(false, message.str().c_str(), file, line);
+}
@@ -0,0 +1,590 @@
+#include "BrickPool.h"
+#include <functional>
+
+const uint32_t BrickPool::INVALID_BRICK;
+const uint32_t BrickPool::BORDER_SIZE;
+
+static uint16_t packRGB565(uvec3 colour) {
+	return (uint16_t)(((colour.r >> 3) << 11) | ((colour.g >> 2) << 5) | (colour.b >> 3));
+}
+
+static uvec3 unpackRGB565(uint16_t colour) {
+	uint32_t r = (colour >> 11) & 0x1F;
+	uint32_t g = (colour >> 5) & 0x3F;
+	uint32_t b = colour & 0x1F;
+	return uvec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+static uvec4 unpackRGBA8(uint32_t colour) {
+	return uvec4(colour & 0xFF, (colour >> 8) & 0xFF, (colour >> 16) & 0xFF, colour >> 24);
+}
+
+static uint32_t packRGBA8(uvec4 colour) {
+	return colour.r | (colour.g << 8) | (colour.b << 16) | (colour.a << 24);
+}
+
+
+
+BrickPool::BrickPool(uint32_t brickSize, uint32_t capacity, bool compressed):
+	m_brickSize(brickSize),
+	m_paddedBrickSize(brickSize + BORDER_SIZE * 2),
+	m_blocksPerRow((brickSize + BORDER_SIZE * 2 + 3) / 4),
+	m_bricksPerAxis(0),
+	m_compressed(compressed),
+	m_allocatedCount(0) {
+	assert(brickSize >= 2);
+	this->setCapacity(capacity);
+}
+
+BrickPool::~BrickPool() {
+}
+
+uint32_t BrickPool::allocate() {
+	if (m_freeList.empty())
+		return INVALID_BRICK;
+
+	uint32_t brick = m_freeList.back();
+	m_freeList.pop_back();
+
+	std::vector<uint32_t> emptyVoxels(m_paddedBrickSize * m_paddedBrickSize * m_paddedBrickSize, 0);
+	m_bricks[brick].allocated = true;
+	this->storePaddedBrick(m_bricks[brick], &emptyVoxels[0], &emptyVoxels[0]);
+
+	++m_allocatedCount;
+	return brick;
+}
+
+bool BrickPool::free(uint32_t brick) {
+	if (!this->isAllocated(brick))
+		return false;
+
+	Brick emptyBrick;
+	m_bricks[brick] = std::move(emptyBrick);
+
+	// Keep the free list sorted from the highest slot to the lowest
+	m_freeList.insert(std::lower_bound(m_freeList.begin(), m_freeList.end(), brick, std::greater<uint32_t>()), brick);
+
+	--m_allocatedCount;
+	return true;
+}
+
+void BrickPool::clear() {
+	for (int i = 0; i < m_bricks.size(); i++) {
+		Brick emptyBrick;
+		m_bricks[i] = std::move(emptyBrick);
+	}
+
+	m_allocatedCount = 0;
+	this->resetFreeList();
+}
+
+uint32_t BrickPool::defragment(std::vector<uint32_t>& brickRemap) {
+	brickRemap.assign(m_bricks.size(), INVALID_BRICK);
+
+	if (m_bricks.empty())
+		return 0;
+
+	// Fill the lowest hole with the highest brick until every brick is in front of every hole
+	uint32_t movedCount = 0;
+	uint32_t low = 0;
+	uint32_t high = (uint32_t)m_bricks.size() - 1;
+
+	while (true) {
+		while (low < m_bricks.size() && m_bricks[low].allocated) {
+			brickRemap[low] = low;
+			++low;
+		}
+
+		while (high > low && !m_bricks[high].allocated) {
+			--high;
+		}
+
+		if (low >= high)
+			break;
+
+		std::swap(m_bricks[low], m_bricks[high]);
+		m_bricks[low].dirty = true;
+		brickRemap[high] = low;
+		++movedCount;
+		++low;
+	}
+
+	this->resetFreeList();
+	return movedCount;
+}
+
+bool BrickPool::setCapacity(uint32_t capacity) {
+	for (uint32_t i = capacity; i < m_bricks.size(); i++) {
+		if (m_bricks[i].allocated) {
+			error("Unable to shrink brick pool to %u bricks, brick %u is still allocated\n", capacity, i);
+			return false;
+		}
+	}
+
+	m_bricks.resize(capacity);
+
+	uint32_t bricksPerAxis = 1;
+	while (bricksPerAxis * bricksPerAxis * bricksPerAxis < capacity) {
+		++bricksPerAxis;
+	}
+
+	if (bricksPerAxis != m_bricksPerAxis) {
+		// Every brick moved to a different place in the texture
+		m_bricksPerAxis = bricksPerAxis;
+		for (int i = 0; i < m_bricks.size(); i++) {
+			m_bricks[i].dirty = m_bricks[i].allocated;
+		}
+	}
+
+	this->resetFreeList();
+	return true;
+}
+
+void BrickPool::writeBrick(uint32_t brick, const uint32_t* albedo, const uint32_t* normal) {
+	assert(this->isAllocated(brick));
+
+	// The border repeats the edge voxels until the brick is linked to its neighbours
+	std::vector<uint32_t> paddedAlbedo(m_paddedBrickSize * m_paddedBrickSize * m_paddedBrickSize);
+	std::vector<uint32_t> paddedNormal(m_paddedBrickSize * m_paddedBrickSize * m_paddedBrickSize);
+	int32_t maxCoord = (int32_t)m_brickSize - 1;
+
+	for (int32_t z = 0; z < (int32_t)m_paddedBrickSize; z++) {
+		for (int32_t y = 0; y < (int32_t)m_paddedBrickSize; y++) {
+			for (int32_t x = 0; x < (int32_t)m_paddedBrickSize; x++) {
+				ivec3 coord = clamp(ivec3(x, y, z) - (int32_t)BORDER_SIZE, ivec3(0), ivec3(maxCoord));
+				uint32_t index = (coord.z * m_brickSize + coord.y) * m_brickSize + coord.x;
+				uint32_t paddedIndex = (z * m_paddedBrickSize + y) * m_paddedBrickSize + x;
+				paddedAlbedo[paddedIndex] = albedo[index];
+				paddedNormal[paddedIndex] = normal[index];
+			}
+		}
+	}
+
+	this->storePaddedBrick(m_bricks[brick], &paddedAlbedo[0], &paddedNormal[0]);
+}
+
+void BrickPool::readBrick(uint32_t brick, uint32_t* albedo, uint32_t* normal) const {
+	std::vector<uint32_t> paddedAlbedo(m_paddedBrickSize * m_paddedBrickSize * m_paddedBrickSize);
+	std::vector<uint32_t> paddedNormal(m_paddedBrickSize * m_paddedBrickSize * m_paddedBrickSize);
+	this->readPaddedBrick(brick, &paddedAlbedo[0], &paddedNormal[0]);
+
+	for (uint32_t z = 0; z < m_brickSize; z++) {
+		for (uint32_t y = 0; y < m_brickSize; y++) {
+			for (uint32_t x = 0; x < m_brickSize; x++) {
+				uint32_t index = (z * m_brickSize + y) * m_brickSize + x;
+				uint32_t paddedIndex = this->getPaddedIndex(ivec3(x, y, z) + (int32_t)BORDER_SIZE);
+				albedo[index] = paddedAlbedo[paddedIndex];
+				normal[index] = paddedNormal[paddedIndex];
+			}
+		}
+	}
+}
+
+void BrickPool::readPaddedBrick(uint32_t brick, uint32_t* albedo, uint32_t* normal) const {
+	assert(this->isAllocated(brick));
+	const Brick& poolBrick = m_bricks[brick];
+
+	if (!m_compressed) {
+		std::copy(poolBrick.albedo.begin(), poolBrick.albedo.end(), albedo);
+		std::copy(poolBrick.normal.begin(), poolBrick.normal.end(), normal);
+		return;
+	}
+
+	uint32_t albedoTexels[16];
+	uint8_t normalX[16];
+	uint8_t normalY[16];
+
+	for (uint32_t z = 0; z < m_paddedBrickSize; z++) {
+		for (uint32_t by = 0; by < m_blocksPerRow; by++) {
+			for (uint32_t bx = 0; bx < m_blocksPerRow; bx++) {
+				uint32_t blockIndex = (z * m_blocksPerRow + by) * m_blocksPerRow + bx;
+				decodeBC1Block(poolBrick.albedoBlocks[blockIndex], albedoTexels);
+				decodeBC4Block(poolBrick.normalBlocks[blockIndex * 2 + 0], normalX);
+				decodeBC4Block(poolBrick.normalBlocks[blockIndex * 2 + 1], normalY);
+
+				for (uint32_t i = 0; i < 16; i++) {
+					uint32_t x = bx * 4 + (i & 3);
+					uint32_t y = by * 4 + (i >> 2);
+					if (x >= m_paddedBrickSize || y >= m_paddedBrickSize)
+						continue; // Padding of a partial block
+
+					uint32_t paddedIndex = (z * m_paddedBrickSize + y) * m_paddedBrickSize + x;
+					albedo[paddedIndex] = albedoTexels[i];
+					normal[paddedIndex] = (normalX[i] * 257u) | ((normalY[i] * 257u) << 16);
+				}
+			}
+		}
+	}
+}
+
+void BrickPool::linkBricks(uint32_t brick, uint32_t neighbourBrick, uint32_t axis) {
+	assert(this->isAllocated(brick) && this->isAllocated(neighbourBrick) && axis < 3);
+
+	uint32_t paddedVoxelCount = m_paddedBrickSize * m_paddedBrickSize * m_paddedBrickSize;
+	std::vector<uint32_t> albedo(paddedVoxelCount), normal(paddedVoxelCount);
+	std::vector<uint32_t> neighbourAlbedo(paddedVoxelCount), neighbourNormal(paddedVoxelCount);
+	this->readPaddedBrick(brick, &albedo[0], &normal[0]);
+	this->readPaddedBrick(neighbourBrick, &neighbourAlbedo[0], &neighbourNormal[0]);
+
+	// The neighbour lies on the positive side of the brick along the axis. The border layer of each
+	// brick receives the first interior layer of the other.
+	uint32_t u = (axis + 1) % 3;
+	uint32_t v = (axis + 2) % 3;
+
+	for (int32_t j = 0; j < (int32_t)m_paddedBrickSize; j++) {
+		for (int32_t i = 0; i < (int32_t)m_paddedBrickSize; i++) {
+			ivec3 coord;
+			coord[u] = i;
+			coord[v] = j;
+
+			coord[axis] = m_paddedBrickSize - 1;
+			uint32_t brickBorder = this->getPaddedIndex(coord);
+			coord[axis] = m_paddedBrickSize - 1 - BORDER_SIZE;
+			uint32_t brickEdge = this->getPaddedIndex(coord);
+			coord[axis] = 0;
+			uint32_t neighbourBorder = this->getPaddedIndex(coord);
+			coord[axis] = BORDER_SIZE;
+			uint32_t neighbourEdge = this->getPaddedIndex(coord);
+
+			albedo[brickBorder] = neighbourAlbedo[neighbourEdge];
+			normal[brickBorder] = neighbourNormal[neighbourEdge];
+			neighbourAlbedo[neighbourBorder] = albedo[brickEdge];
+			neighbourNormal[neighbourBorder] = normal[brickEdge];
+		}
+	}
+
+	this->storePaddedBrick(m_bricks[brick], &albedo[0], &normal[0]);
+	this->storePaddedBrick(m_bricks[neighbourBrick], &neighbourAlbedo[0], &neighbourNormal[0]);
+}
+
+uint32_t BrickPool::getVoxelAlbedo(uint32_t brick, ivec3 voxelCoord) const {
+	assert(this->isAllocated(brick));
+	ivec3 paddedCoord = voxelCoord + (int32_t)BORDER_SIZE;
+
+	if (!m_compressed)
+		return m_bricks[brick].albedo[this->getPaddedIndex(paddedCoord)];
+
+	uint32_t texels[16];
+	uint32_t blockIndex = (paddedCoord.z * m_blocksPerRow + paddedCoord.y / 4) * m_blocksPerRow + paddedCoord.x / 4;
+	decodeBC1Block(m_bricks[brick].albedoBlocks[blockIndex], texels);
+	return texels[(paddedCoord.y & 3) * 4 + (paddedCoord.x & 3)];
+}
+
+uint32_t BrickPool::getVoxelNormal(uint32_t brick, ivec3 voxelCoord) const {
+	assert(this->isAllocated(brick));
+	ivec3 paddedCoord = voxelCoord + (int32_t)BORDER_SIZE;
+
+	if (!m_compressed)
+		return m_bricks[brick].normal[this->getPaddedIndex(paddedCoord)];
+
+	uint8_t normalX[16];
+	uint8_t normalY[16];
+	uint32_t blockIndex = (paddedCoord.z * m_blocksPerRow + paddedCoord.y / 4) * m_blocksPerRow + paddedCoord.x / 4;
+	decodeBC4Block(m_bricks[brick].normalBlocks[blockIndex * 2 + 0], normalX);
+	decodeBC4Block(m_bricks[brick].normalBlocks[blockIndex * 2 + 1], normalY);
+
+	uint32_t texel = (paddedCoord.y & 3) * 4 + (paddedCoord.x & 3);
+	return (normalX[texel] * 257u) | ((normalY[texel] * 257u) << 16);
+}
+
+bool BrickPool::isAllocated(uint32_t brick) const {
+	return brick < m_bricks.size() && m_bricks[brick].allocated;
+}
+
+bool BrickPool::isDirty(uint32_t brick) const {
+	return this->isAllocated(brick) && m_bricks[brick].dirty;
+}
+
+void BrickPool::getDirtyBricks(std::vector<uint32_t>& bricks) const {
+	bricks.clear();
+
+	for (uint32_t i = 0; i < m_bricks.size(); i++) {
+		if (m_bricks[i].allocated && m_bricks[i].dirty) {
+			bricks.push_back(i);
+		}
+	}
+}
+
+void BrickPool::clearDirty() {
+	for (int i = 0; i < m_bricks.size(); i++) {
+		m_bricks[i].dirty = false;
+	}
+}
+
+uvec3 BrickPool::getBrickTexelOrigin(uint32_t brick) const {
+	uvec3 brickCoord = uvec3(brick % m_bricksPerAxis, (brick / m_bricksPerAxis) % m_bricksPerAxis, brick / (m_bricksPerAxis * m_bricksPerAxis));
+	return brickCoord * m_paddedBrickSize;
+}
+
+uvec3 BrickPool::getTextureSize() const {
+	return uvec3(m_bricksPerAxis * m_paddedBrickSize);
+}
+
+uint32_t BrickPool::getBricksPerAxis() const {
+	return m_bricksPerAxis;
+}
+
+uint32_t BrickPool::getBrickSize() const {
+	return m_brickSize;
+}
+
+uint32_t BrickPool::getPaddedBrickSize() const {
+	return m_paddedBrickSize;
+}
+
+uint32_t BrickPool::getCapacity() const {
+	return (uint32_t)m_bricks.size();
+}
+
+uint32_t BrickPool::getAllocatedCount() const {
+	return m_allocatedCount;
+}
+
+uint32_t BrickPool::getFreeCount() const {
+	return (uint32_t)m_freeList.size();
+}
+
+bool BrickPool::isCompressed() const {
+	return m_compressed;
+}
+
+uint64_t BrickPool::getMemoryUsage() const {
+	uint64_t memoryUsage = 0;
+
+	for (int i = 0; i < m_bricks.size(); i++) {
+		const Brick& brick = m_bricks[i];
+		memoryUsage += (brick.albedo.size() + brick.normal.size()) * sizeof(uint32_t);
+		memoryUsage += (brick.albedoBlocks.size() + brick.normalBlocks.size()) * sizeof(uint64_t);
+	}
+
+	return memoryUsage;
+}
+
+uint64_t BrickPool::encodeBC1Block(const uint32_t texels[16]) {
+	// Endpoints are the corners of the opaque colours' bounding box, with the green and blue ranges
+	// flipped when they fall while red rises, so the line follows the colours rather than the box.
+	ivec3 minColour = ivec3(255);
+	ivec3 maxColour = ivec3(0);
+	ivec3 colourSum = ivec3(0);
+	int32_t opaqueCount = 0;
+	bool hasTransparent = false;
+
+	for (int i = 0; i < 16; i++) {
+		uvec4 colour = unpackRGBA8(texels[i]);
+		if (colour.a < 128) {
+			hasTransparent = true;
+			continue;
+		}
+
+		minColour = min(minColour, ivec3(colour));
+		maxColour = max(maxColour, ivec3(colour));
+		colourSum += ivec3(colour);
+		++opaqueCount;
+	}
+
+	if (opaqueCount == 0)
+		return 0xFFFFFFFF00000000ull; // Three colour mode with equal endpoints, every texel transparent
+
+	ivec3 mean = colourSum / opaqueCount;
+	int32_t covarianceG = 0;
+	int32_t covarianceB = 0;
+
+	for (int i = 0; i < 16; i++) {
+		ivec3 colour = ivec3(unpackRGBA8(texels[i]));
+		if ((texels[i] >> 24) >= 128) {
+			covarianceG += (colour.r - mean.r) * (colour.g - mean.g);
+			covarianceB += (colour.r - mean.r) * (colour.b - mean.b);
+		}
+	}
+
+	if (covarianceG < 0) std::swap(minColour.g, maxColour.g);
+	if (covarianceB < 0) std::swap(minColour.b, maxColour.b);
+
+	uint16_t colour0 = packRGB565(uvec3(maxColour));
+	uint16_t colour1 = packRGB565(uvec3(minColour));
+
+	// colour0 > colour1 selects four colours, otherwise three colours and transparent black
+	if (hasTransparent ? colour0 > colour1 : colour0 < colour1) {
+		std::swap(colour0, colour1);
+	}
+
+	uvec3 endpoint0 = unpackRGB565(colour0);
+	uvec3 endpoint1 = unpackRGB565(colour1);
+	ivec3 palette[4];
+	palette[0] = ivec3(endpoint0);
+	palette[1] = ivec3(endpoint1);
+
+	uint32_t paletteSize;
+	if (colour0 > colour1) {
+		palette[2] = ivec3((endpoint0 * 2u + endpoint1) / 3u);
+		palette[3] = ivec3((endpoint0 + endpoint1 * 2u) / 3u);
+		paletteSize = 4;
+	} else {
+		palette[2] = ivec3((endpoint0 + endpoint1) / 2u);
+		paletteSize = 3; // Index 3 is transparent
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		uvec4 colour = unpackRGBA8(texels[i]);
+		uint64_t index = 3;
+
+		if (colour.a >= 128) {
+			int32_t bestDistance = INT32_MAX;
+			for (uint32_t j = 0; j < paletteSize; j++) {
+				ivec3 delta = ivec3(colour) - palette[j];
+				int32_t distance = delta.r * delta.r + delta.g * delta.g + delta.b * delta.b;
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					index = j;
+				}
+			}
+		}
+
+		indices |= index << (i * 2);
+	}
+
+	return (uint64_t)colour0 | ((uint64_t)colour1 << 16) | (indices << 32);
+}
+
+void BrickPool::decodeBC1Block(uint64_t block, uint32_t texels[16]) {
+	uint16_t colour0 = (uint16_t)(block & 0xFFFF);
+	uint16_t colour1 = (uint16_t)((block >> 16) & 0xFFFF);
+	uvec3 endpoint0 = unpackRGB565(colour0);
+	uvec3 endpoint1 = unpackRGB565(colour1);
+
+	uint32_t palette[4];
+	palette[0] = packRGBA8(uvec4(endpoint0, 255));
+	palette[1] = packRGBA8(uvec4(endpoint1, 255));
+
+	if (colour0 > colour1) {
+		palette[2] = packRGBA8(uvec4((endpoint0 * 2u + endpoint1) / 3u, 255));
+		palette[3] = packRGBA8(uvec4((endpoint0 + endpoint1 * 2u) / 3u, 255));
+	} else {
+		palette[2] = packRGBA8(uvec4((endpoint0 + endpoint1) / 2u, 255));
+		palette[3] = 0;
+	}
+
+	for (int i = 0; i < 16; i++) {
+		texels[i] = palette[(block >> (32 + i * 2)) & 3];
+	}
+}
+
+uint64_t BrickPool::encodeBC4Block(const uint8_t values[16]) {
+	uint8_t minValue = 255;
+	uint8_t maxValue = 0;
+
+	for (int i = 0; i < 16; i++) {
+		minValue = glm::min(minValue, values[i]);
+		maxValue = glm::max(maxValue, values[i]);
+	}
+
+	if (minValue == maxValue)
+		return (uint64_t)maxValue | ((uint64_t)minValue << 8); // Every index 0
+
+	// endpoint0 > endpoint1 selects eight interpolated values, index 0 and 1 are the endpoints
+	uint8_t palette[8];
+	palette[0] = maxValue;
+	palette[1] = minValue;
+	for (int i = 2; i < 8; i++) {
+		palette[i] = (uint8_t)(((8 - i) * maxValue + (i - 1) * minValue) / 7);
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; i++) {
+		uint64_t bestIndex = 0;
+		int32_t bestDistance = INT32_MAX;
+
+		for (int j = 0; j < 8; j++) {
+			int32_t distance = glm::abs((int32_t)values[i] - (int32_t)palette[j]);
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				bestIndex = j;
+			}
+		}
+
+		indices |= bestIndex << (i * 3);
+	}
+
+	return (uint64_t)maxValue | ((uint64_t)minValue << 8) | (indices << 16);
+}
+
+void BrickPool::decodeBC4Block(uint64_t block, uint8_t values[16]) {
+	uint32_t endpoint0 = (uint32_t)(block & 0xFF);
+	uint32_t endpoint1 = (uint32_t)((block >> 8) & 0xFF);
+
+	uint8_t palette[8];
+	palette[0] = (uint8_t)endpoint0;
+	palette[1] = (uint8_t)endpoint1;
+
+	if (endpoint0 > endpoint1) {
+		for (int i = 2; i < 8; i++) {
+			palette[i] = (uint8_t)(((8 - i) * endpoint0 + (i - 1) * endpoint1) / 7);
+		}
+	} else {
+		for (int i = 2; i < 6; i++) {
+			palette[i] = (uint8_t)(((6 - i) * endpoint0 + (i - 1) * endpoint1) / 5);
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	for (int i = 0; i < 16; i++) {
+		values[i] = palette[(block >> (16 + i * 3)) & 7];
+	}
+}
+
+void BrickPool::storePaddedBrick(Brick& brick, const uint32_t* albedo, const uint32_t* normal) {
+	uint32_t paddedVoxelCount = m_paddedBrickSize * m_paddedBrickSize * m_paddedBrickSize;
+	brick.dirty = true;
+
+	if (!m_compressed) {
+		brick.albedo.assign(albedo, albedo + paddedVoxelCount);
+		brick.normal.assign(normal, normal + paddedVoxelCount);
+		return;
+	}
+
+	uint32_t blockCount = m_blocksPerRow * m_blocksPerRow * m_paddedBrickSize;
+	brick.albedoBlocks.resize(blockCount);
+	brick.normalBlocks.resize(blockCount * 2);
+
+	uint32_t albedoTexels[16];
+	uint8_t normalX[16];
+	uint8_t normalY[16];
+
+	for (uint32_t z = 0; z < m_paddedBrickSize; z++) {
+		for (uint32_t by = 0; by < m_blocksPerRow; by++) {
+			for (uint32_t bx = 0; bx < m_blocksPerRow; bx++) {
+				for (uint32_t i = 0; i < 16; i++) {
+					// Partial blocks at the end of a row repeat the last voxel
+					uint32_t x = glm::min(bx * 4 + (i & 3), m_paddedBrickSize - 1);
+					uint32_t y = glm::min(by * 4 + (i >> 2), m_paddedBrickSize - 1);
+					uint32_t paddedIndex = (z * m_paddedBrickSize + y) * m_paddedBrickSize + x;
+					albedoTexels[i] = albedo[paddedIndex];
+					normalX[i] = (uint8_t)(((normal[paddedIndex] & 0xFFFF) + 128) / 257);
+					normalY[i] = (uint8_t)(((normal[paddedIndex] >> 16) + 128) / 257);
+				}
+
+				uint32_t blockIndex = (z * m_blocksPerRow + by) * m_blocksPerRow + bx;
+				brick.albedoBlocks[blockIndex] = encodeBC1Block(albedoTexels);
+				brick.normalBlocks[blockIndex * 2 + 0] = encodeBC4Block(normalX);
+				brick.normalBlocks[blockIndex * 2 + 1] = encodeBC4Block(normalY);
+			}
+		}
+	}
+}
+
+void BrickPool::resetFreeList() {
+	m_freeList.clear();
+
+	for (int32_t i = (int32_t)m_bricks.size() - 1; i >= 0; i--) {
+		if (!m_bricks[i].allocated) {
+			m_freeList.push_back((uint32_t)i);
+		}
+	}
+}
+
+uint32_t BrickPool::getPaddedIndex(ivec3 paddedCoord) const {
+	assert(all(greaterThanEqual(paddedCoord, ivec3(0))) && all(lessThan(paddedCoord, ivec3(m_paddedBrickSize))));
+	return (paddedCoord.z * m_paddedBrickSize + paddedCoord.y) * m_paddedBrickSize + paddedCoord.x;
+}
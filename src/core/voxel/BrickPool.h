@@ -0,0 +1,110 @@
+#pragma once
+
+#include "core/pch.h"
+
+// Pool of fixed size voxel bricks, laid out like the 3D texture they are uploaded to. Every brick stores
+// brickSize^3 voxels (4 or 8) plus a one voxel border on each side, so hardware trilinear filtering inside
+// a brick never reads from an unrelated brick. The border starts out as a copy of the brick's own edge, and
+// linkBricks() replaces it with the neighbouring brick's edge voxels, making filtering seamless across them.
+// Bricks are handed out from a free list, lowest slot first. defragment() moves the bricks at the end of
+// the pool into the holes freed bricks left behind and reports where every brick went, so the pool can be
+// shrunk and the nodes referencing the bricks can be patched.
+// Voxels hold a packed rgba8 albedo (alpha 0 for empty voxels) and a packed unorm2x16 normal, like the
+// octree node data. A compressed pool keeps bricks in BC1 (albedo) and BC5 (normal) style 4x4 blocks per
+// z slice instead, at 0.5 and 1 byte per voxel rather than 4 each. Normals are quantized to 8 bits per
+// component in that case, and since every brick is encoded on its own, linked borders only match their
+// neighbour's voxels to within the block compression error.
+// The pool is CPU side only for now: octree nodes do not reference bricks yet, and no shader samples them.
+class BrickPool : private NotCopyable {
+public:
+	static const uint32_t INVALID_BRICK = 0xFFFFFFFF;
+	static const uint32_t BORDER_SIZE = 1;
+
+	BrickPool(uint32_t brickSize, uint32_t capacity, bool compressed = false);
+
+	~BrickPool();
+
+	uint32_t allocate();
+
+	bool free(uint32_t brick);
+
+	void clear();
+
+	uint32_t defragment(std::vector<uint32_t>& brickRemap);
+
+	bool setCapacity(uint32_t capacity);
+
+	void writeBrick(uint32_t brick, const uint32_t* albedo, const uint32_t* normal);
+
+	void readBrick(uint32_t brick, uint32_t* albedo, uint32_t* normal) const;
+
+	void readPaddedBrick(uint32_t brick, uint32_t* albedo, uint32_t* normal) const;
+
+	void linkBricks(uint32_t brick, uint32_t neighbourBrick, uint32_t axis);
+
+	uint32_t getVoxelAlbedo(uint32_t brick, ivec3 voxelCoord) const;
+
+	uint32_t getVoxelNormal(uint32_t brick, ivec3 voxelCoord) const;
+
+	bool isAllocated(uint32_t brick) const;
+
+	bool isDirty(uint32_t brick) const;
+
+	void getDirtyBricks(std::vector<uint32_t>& bricks) const;
+
+	void clearDirty();
+
+	uvec3 getBrickTexelOrigin(uint32_t brick) const;
+
+	uvec3 getTextureSize() const;
+
+	uint32_t getBricksPerAxis() const;
+
+	uint32_t getBrickSize() const;
+
+	uint32_t getPaddedBrickSize() const;
+
+	uint32_t getCapacity() const;
+
+	uint32_t getAllocatedCount() const;
+
+	uint32_t getFreeCount() const;
+
+	bool isCompressed() const;
+
+	uint64_t getMemoryUsage() const;
+
+	static uint64_t encodeBC1Block(const uint32_t texels[16]);
+
+	static void decodeBC1Block(uint64_t block, uint32_t texels[16]);
+
+	static uint64_t encodeBC4Block(const uint8_t values[16]);
+
+	static void decodeBC4Block(uint64_t block, uint8_t values[16]);
+
+private:
+	struct Brick {
+		bool allocated = false;
+		bool dirty = false; // Changed since the last clearDirty()
+		std::vector<uint32_t> albedo; // Padded voxels, uncompressed pools only
+		std::vector<uint32_t> normal;
+		std::vector<uint64_t> albedoBlocks; // BC1 blocks, compressed pools only
+		std::vector<uint64_t> normalBlocks; // Pairs of BC4 blocks (x, y), compressed pools only
+	};
+
+	void storePaddedBrick(Brick& brick, const uint32_t* albedo, const uint32_t* normal);
+
+	void resetFreeList();
+
+	uint32_t getPaddedIndex(ivec3 paddedCoord) const;
+
+	uint32_t m_brickSize;
+	uint32_t m_paddedBrickSize;
+	uint32_t m_blocksPerRow; // 4x4 blocks per row of a padded z slice
+	uint32_t m_bricksPerAxis;
+	bool m_compressed;
+
+	std::vector<Brick> m_bricks;
+	std::vector<uint32_t> m_freeList; // Free slots, the lowest at the back
+	uint32_t m_allocatedCount;
+};
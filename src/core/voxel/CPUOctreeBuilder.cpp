@@ -0,0 +1,336 @@
+#include "CPUOctreeBuilder.h"
+#include "core/util/Morton.h"
+#include "core/Engine.h"
+#include "core/JobSystem.h"
+#include <glm/gtc/packing.hpp>
+#include <functional>
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+// Runs task(threadIndex) for every index below threadCount on the engine's job system, one of them on
+// the calling thread.
+static void parallelFor(uint32_t threadCount, const std::function<void(uint32_t)>& task) {
+	Engine::jobSystem()->parallelFor(threadCount, 1, [&task](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			task((uint32_t)i);
+		}
+	});
+}
+
+
+
+CPUOctreeBuilder::CPUOctreeBuilder(uint32_t gridSize):
+	m_gridSize(0),
+	m_octreeDepth(0),
+	m_threadCount(0) {
+	this->setGridSize(gridSize);
+}
+
+CPUOctreeBuilder::~CPUOctreeBuilder() {
+}
+
+bool CPUOctreeBuilder::build(const std::vector<u16vec4>& fragmentPositions, const std::vector<uvec4>& fragmentData) {
+	uint64_t startTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+	this->clear();
+
+	if (m_gridSize < 2 || m_gridSize > 0x10000 || (m_gridSize & (m_gridSize - 1)) != 0) {
+		error("Unable to build an octree for a grid of size %u, the size must be a power of two no larger than 65536\n", m_gridSize);
+		return false;
+	}
+
+	if (fragmentPositions.size() != fragmentData.size()) {
+		error("Unable to build an octree from %llu fragment positions and %llu fragment data entries\n", (unsigned long long)fragmentPositions.size(), (unsigned long long)fragmentData.size());
+		return false;
+	}
+
+	if (fragmentPositions.size() > UINT32_MAX) {
+		error("Unable to build an octree from %llu fragments\n", (unsigned long long)fragmentPositions.size());
+		return false;
+	}
+
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> indices;
+	this->sortFragments(fragmentPositions, keys, indices);
+
+	// The deepest stored level averages every fragment inside it, like the GPU leaf linked lists do.
+	// Each level above averages its occupied children.
+	m_levels.resize(m_octreeDepth);
+	this->reduceLevel(keys, indices.data(), fragmentData, m_levels[m_octreeDepth - 1]);
+
+	keys.clear();
+	keys.shrink_to_fit();
+	indices.clear();
+	indices.shrink_to_fit();
+
+	for (int level = (int)m_octreeDepth - 2; level >= 0; level--) {
+		this->reduceLevel(m_levels[level + 1].keys, NULL, m_levels[level + 1].data, m_levels[level]);
+	}
+
+	uint64_t nodeCount = 8; // Root tile
+	for (int i = 0; i < m_levels.size(); i++) {
+		nodeCount += m_levels[i].keys.size() * 8;
+	}
+
+	if (nodeCount > (uint64_t)CHILD_INDEX_MASK + 1) {
+		error("Unable to build an octree with %llu nodes, child indices are limited to 30 bits\n", (unsigned long long)nodeCount);
+		this->clear();
+		return false;
+	}
+
+	this->allocateNodes();
+
+	uint64_t endTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+	info("Built %u octree nodes from %llu fragments, took %.2f msec\n", this->getNodeCount(), (unsigned long long)fragmentPositions.size(), (endTime - startTime) / 1000000.0);
+	return true;
+}
+
+void CPUOctreeBuilder::clear() {
+	m_levels.clear();
+	m_nodeChildIndices.clear();
+	m_nodeData.clear();
+}
+
+const std::vector<uint32_t>& CPUOctreeBuilder::getNodeChildIndices() const {
+	return m_nodeChildIndices;
+}
+
+const std::vector<uvec4>& CPUOctreeBuilder::getNodeData() const {
+	return m_nodeData;
+}
+
+uint32_t CPUOctreeBuilder::getNodeCount() const {
+	return (uint32_t)m_nodeChildIndices.size();
+}
+
+uint32_t CPUOctreeBuilder::getLevelNodeCount(uint32_t level) const {
+	if (level >= m_levels.size())
+		return 0;
+
+	return (uint32_t)m_levels[level].keys.size();
+}
+
+uint32_t CPUOctreeBuilder::getOctreeDepth() const {
+	return m_octreeDepth;
+}
+
+uint32_t CPUOctreeBuilder::getGridSize() const {
+	return m_gridSize;
+}
+
+void CPUOctreeBuilder::setGridSize(uint32_t gridSize) {
+	m_gridSize = gridSize;
+	m_octreeDepth = 0;
+	while ((2u << m_octreeDepth) <= gridSize && m_octreeDepth < 31) {
+		++m_octreeDepth;
+	}
+}
+
+uint32_t CPUOctreeBuilder::getThreadCount() const {
+	return m_threadCount;
+}
+
+void CPUOctreeBuilder::setThreadCount(uint32_t threadCount) {
+	m_threadCount = threadCount;
+}
+
+void CPUOctreeBuilder::sortFragments(const std::vector<u16vec4>& fragmentPositions, std::vector<uint64_t>& keys, std::vector<uint32_t>& indices) const {
+	const size_t count = fragmentPositions.size();
+	const uint32_t keyBits = m_octreeDepth * 3;
+	const uint64_t invalidKey = 1ull << keyBits; // Sorts after every valid key
+
+	uint32_t threadCount = m_threadCount != 0 ? m_threadCount : Engine::jobSystem()->getThreadCount();
+	threadCount = (uint32_t)glm::clamp<size_t>(count / 65536, 1, threadCount); // Small inputs are not worth the threads
+
+	keys.resize(count);
+	indices.resize(count);
+	std::vector<uint64_t> tempKeys(count);
+	std::vector<uint32_t> tempIndices(count);
+
+	parallelFor(threadCount, [&](uint32_t thread) {
+		size_t begin = count * thread / threadCount;
+		size_t end = count * (thread + 1) / threadCount;
+
+		for (size_t i = begin; i < end; i++) {
+			uvec3 coord = uvec3(fragmentPositions[i]);
+			keys[i] = all(lessThan(coord, uvec3(m_gridSize))) ? Morton::encode64(coord) : invalidKey;
+			indices[i] = (uint32_t)i;
+		}
+	});
+
+	// LSD radix sort. Every thread histograms and then scatters its own contiguous range, and the
+	// ranges are laid out in thread order within each digit, so the sort stays stable.
+	std::vector<size_t> histograms(threadCount * RADIX_SIZE);
+
+	for (uint32_t shift = 0; shift <= keyBits; shift += RADIX_BITS) {
+		std::fill(histograms.begin(), histograms.end(), 0);
+
+		parallelFor(threadCount, [&](uint32_t thread) {
+			size_t* histogram = &histograms[thread * RADIX_SIZE];
+			size_t begin = count * thread / threadCount;
+			size_t end = count * (thread + 1) / threadCount;
+
+			for (size_t i = begin; i < end; i++) {
+				++histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)];
+			}
+		});
+
+		size_t offset = 0;
+		bool sorted = false;
+		for (uint32_t digit = 0; digit < RADIX_SIZE; digit++) {
+			size_t digitCount = 0;
+			for (uint32_t thread = 0; thread < threadCount; thread++) {
+				size_t& entry = histograms[thread * RADIX_SIZE + digit];
+				size_t entryCount = entry;
+				entry = offset;
+				offset += entryCount;
+				digitCount += entryCount;
+			}
+
+			if (digitCount == count) {
+				sorted = true; // Every key shares this digit, the pass would not move anything
+				break;
+			}
+		}
+
+		if (sorted)
+			continue;
+
+		parallelFor(threadCount, [&](uint32_t thread) {
+			size_t* histogram = &histograms[thread * RADIX_SIZE];
+			size_t begin = count * thread / threadCount;
+			size_t end = count * (thread + 1) / threadCount;
+
+			for (size_t i = begin; i < end; i++) {
+				size_t destination = histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+				tempKeys[destination] = keys[i];
+				tempIndices[destination] = indices[i];
+			}
+		});
+
+		keys.swap(tempKeys);
+		indices.swap(tempIndices);
+	}
+
+	// Fragments outside the grid were sorted to the end
+	size_t validCount = std::lower_bound(keys.begin(), keys.end(), invalidKey) - keys.begin();
+	if (validCount != count) {
+		warn("Ignoring %llu voxel fragments outside the %u^3 octree grid\n", (unsigned long long)(count - validCount), m_gridSize);
+		keys.resize(validCount);
+		indices.resize(validCount);
+	}
+}
+
+void CPUOctreeBuilder::reduceLevel(const std::vector<uint64_t>& keys, const uint32_t* indices, const std::vector<uvec4>& data, Level& parentLevel) const {
+	const size_t count = keys.size();
+
+	uint32_t threadCount = m_threadCount != 0 ? m_threadCount : Engine::jobSystem()->getThreadCount();
+	threadCount = (uint32_t)glm::clamp<size_t>(count / 65536, 1, threadCount);
+
+	// Split the input into one range per thread, moving each split forward so that all children of a
+	// parent end up in the same range.
+	std::vector<size_t> splits(threadCount + 1);
+	splits[0] = 0;
+	splits[threadCount] = count;
+	for (uint32_t i = 1; i < threadCount; i++) {
+		size_t split = glm::max(count * i / threadCount, splits[i - 1]);
+		while (split > 0 && split < count && (keys[split] >> 3) == (keys[split - 1] >> 3)) {
+			++split;
+		}
+		splits[i] = split;
+	}
+
+	std::vector<Level> threadLevels(threadCount);
+
+	parallelFor(threadCount, [&](uint32_t thread) {
+		Level& output = threadLevels[thread];
+		size_t i = splits[thread];
+		size_t end = splits[thread + 1];
+
+		while (i < end) {
+			uint64_t parentKey = keys[i] >> 3;
+			vec4 albedo = vec4(0.0F);
+			vec2 normal = vec2(0.0F);
+			vec4 emissive = vec4(0.0F);
+			uint32_t childCount = 0;
+			uint32_t staticFlag = STATIC_FLAG_BIT;
+
+			// The encoded normals are averaged as they are, the same as the GPU passes do.
+			for (; i < end && (keys[i] >> 3) == parentKey; i++) {
+				const uvec4& childData = data[indices != NULL ? indices[i] : i];
+				albedo += unpackUnorm4x8(childData[0]);
+				normal += unpackUnorm2x16(childData[1]);
+				emissive += unpackUnorm4x8(childData[2]);
+				staticFlag &= childData[3];
+				++childCount;
+			}
+
+			float invSum = 1.0F / childCount;
+			output.keys.push_back(parentKey);
+			output.data.push_back(uvec4(packUnorm4x8(albedo * invSum), packUnorm2x16(normal * invSum), packUnorm4x8(emissive * invSum), staticFlag));
+		}
+	});
+
+	size_t parentCount = 0;
+	for (uint32_t i = 0; i < threadCount; i++) {
+		parentCount += threadLevels[i].keys.size();
+	}
+
+	parentLevel.keys.clear();
+	parentLevel.data.clear();
+	parentLevel.keys.reserve(parentCount);
+	parentLevel.data.reserve(parentCount);
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		parentLevel.keys.insert(parentLevel.keys.end(), threadLevels[i].keys.begin(), threadLevels[i].keys.end());
+		parentLevel.data.insert(parentLevel.data.end(), threadLevels[i].data.begin(), threadLevels[i].data.end());
+	}
+}
+
+void CPUOctreeBuilder::allocateNodes() {
+	// Tiles are handed out breadth first, so the tiles of each level are contiguous, the same as the
+	// GPU alloc pass. Nodes of the deepest level get a child tile too, which stays zeroed.
+	uint32_t nodeCount = 8;
+	for (int i = 0; i < m_levels.size(); i++) {
+		nodeCount += (uint32_t)m_levels[i].keys.size() * 8;
+	}
+
+	m_nodeChildIndices.assign(nodeCount, 0u);
+	m_nodeData.assign(nodeCount, uvec4(0u));
+
+	std::vector<uint32_t> levelNodeIndices(1, 0u); // The root is node 0
+	std::vector<uint32_t> childNodeIndices;
+	uint32_t nextTile = 1;
+
+	for (int level = 0; level < m_levels.size(); level++) {
+		const Level& currLevel = m_levels[level];
+		uint32_t firstTile = nextTile;
+
+		for (size_t i = 0; i < currLevel.keys.size(); i++) {
+			uint32_t nodeIndex = levelNodeIndices[i];
+			const uvec4& data = currLevel.data[i];
+			m_nodeChildIndices[nodeIndex] = CHILD_FLAG_BIT | (data.w & STATIC_FLAG_BIT) | (nextTile * 8);
+			m_nodeData[nodeIndex] = uvec4(data.x, data.y, data.z, 0u);
+			++nextTile;
+		}
+
+		if (level + 1 == m_levels.size())
+			break;
+
+		// Both levels are sorted, so each child's parent is found by walking along the parent level.
+		const Level& nextLevel = m_levels[level + 1];
+		childNodeIndices.resize(nextLevel.keys.size());
+
+		size_t parent = 0;
+		for (size_t i = 0; i < nextLevel.keys.size(); i++) {
+			while ((nextLevel.keys[i] >> 3) != currLevel.keys[parent]) {
+				++parent;
+			}
+
+			childNodeIndices[i] = (firstTile + (uint32_t)parent) * 8 + (uint32_t)(nextLevel.keys[i] & 7);
+		}
+
+		levelNodeIndices.swap(childNodeIndices);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "core/pch.h"
+
+// Builds a sparse voxel octree from voxel fragments on the CPU. The node buffers use the same layout
+// VoxelGenerator::octreeConstructionPass produces in octreeChildIndexStorage and octreeDataStorage, so
+// they can be uploaded directly in place of the GPU construction passes:
+//  - Nodes are allocated in tiles of 8 siblings, ordered by octant (x << 2) | (y << 1) | z. The root
+//    is node 0, alone in tile 0.
+//  - A subdivided node stores CHILD_FLAG_BIT | (index of its first child). Unsubdivided nodes are 0.
+//  - Every level down to gridSize / 2 is subdivided where occupied. Those deepest nodes hold the
+//    average of the fragments inside them, and their child tiles are allocated but left empty.
+//  - Node data is the packed albedo, normal and emissive of the fragments, averaged on the way up.
+//  - Fragments may set STATIC_FLAG_BIT in the unused w component of their data. Nodes containing only
+//    such fragments get STATIC_FLAG_BIT in their child index, the w component of node data stays 0.
+// Fragments are sorted by Morton code with a parallel radix sort, after which each level is built from
+// the one below by merging runs of siblings, so tiles come out in Morton order rather than in the
+// order the GPU happens to allocate them.
+class CPUOctreeBuilder : private NotCopyable {
+public:
+	static const uint32_t CHILD_FLAG_BIT = 0x80000000;
+	static const uint32_t STATIC_FLAG_BIT = 0x40000000;
+	static const uint32_t CHILD_INDEX_MASK = 0x3FFFFFFF;
+
+	CPUOctreeBuilder(uint32_t gridSize);
+
+	~CPUOctreeBuilder();
+
+	bool build(const std::vector<u16vec4>& fragmentPositions, const std::vector<uvec4>& fragmentData);
+
+	void clear();
+
+	const std::vector<uint32_t>& getNodeChildIndices() const;
+
+	const std::vector<uvec4>& getNodeData() const;
+
+	uint32_t getNodeCount() const;
+
+	uint32_t getLevelNodeCount(uint32_t level) const;
+
+	uint32_t getOctreeDepth() const;
+
+	uint32_t getGridSize() const;
+
+	void setGridSize(uint32_t gridSize);
+
+	uint32_t getThreadCount() const;
+
+	void setThreadCount(uint32_t threadCount);
+
+private:
+	struct Level {
+		std::vector<uint64_t> keys; // Morton code of each occupied node, sorted
+		std::vector<uvec4> data;
+	};
+
+	void sortFragments(const std::vector<u16vec4>& fragmentPositions, std::vector<uint64_t>& keys, std::vector<uint32_t>& indices) const;
+
+	void reduceLevel(const std::vector<uint64_t>& keys, const uint32_t* indices, const std::vector<uvec4>& data, Level& parentLevel) const;
+
+	void allocateNodes();
+
+	std::vector<Level> m_levels;
+	std::vector<uint32_t> m_nodeChildIndices; // octreeChildIndexStorage
+	std::vector<uvec4> m_nodeData; // octreeDataStorage
+
+	uint32_t m_gridSize;
+	uint32_t m_octreeDepth;
+	uint32_t m_threadCount; // 0 uses every thread of the job system
+};
@@ -0,0 +1,371 @@
+#include "CPUOctreeTracer.h"
+#include "CPUOctreeBuilder.h"
+#include "CPUVoxelizer.h"
+#include "core/Engine.h"
+#include "core/JobSystem.h"
+#include <glm/gtc/packing.hpp>
+#include <emmintrin.h>
+
+#define CONE_STEP_SCALE 0.5 // Step length relative to the cone diameter
+#define CONE_MAX_OCCLUSION 0.99F
+
+CPUOctreeTracer::CPUOctreeTracer(const std::vector<uint32_t>& nodeChildIndices, const std::vector<uvec4>& nodeData, uint32_t gridSize, dvec3 gridCenter, double gridScale):
+	m_nodeChildIndices(nodeChildIndices),
+	m_nodeData(nodeData),
+	m_gridCenter(gridCenter),
+	m_gridSize(gridSize),
+	m_octreeDepth(0),
+	m_gridScale(gridScale),
+	m_threadCount(0),
+	m_batchSize(256) {
+
+	while ((2u << m_octreeDepth) <= gridSize) {
+		++m_octreeDepth;
+	}
+
+	// Same snapping as VoxelGenerator::updateAxisProjections
+	m_gridOrigin = floor(gridCenter / (gridScale * 2)) * (gridScale * 2) - dvec3(gridSize * gridScale * 0.5);
+
+	if (m_octreeDepth == 0 || nodeChildIndices.size() < 8 || nodeChildIndices.size() != nodeData.size()) {
+		error("Unable to trace an octree with %llu nodes and %llu node data entries in a grid of size %u\n", (unsigned long long)nodeChildIndices.size(), (unsigned long long)nodeData.size(), gridSize);
+		m_octreeDepth = 0;
+	}
+}
+
+CPUOctreeTracer::CPUOctreeTracer(const CPUOctreeBuilder& octree, dvec3 gridCenter, double gridScale):
+	CPUOctreeTracer(octree.getNodeChildIndices(), octree.getNodeData(), octree.getGridSize(), gridCenter, gridScale) {
+}
+
+CPUOctreeTracer::~CPUOctreeTracer() {
+}
+
+bool CPUOctreeTracer::traceRay(const OctreeRay& ray, OctreeRayHit& hit) const {
+	hit = OctreeRayHit();
+
+	if (m_octreeDepth == 0 || (m_nodeChildIndices[0] & CPUOctreeBuilder::CHILD_FLAG_BIT) == 0)
+		return false;
+
+	uint32_t targetLevel = glm::min(ray.maxLevel, m_octreeDepth - 1);
+
+	// Traverse in grid space, where voxels are one unit wide
+	dvec3 direction = normalize(ray.direction);
+	vec3 origin = vec3((ray.origin - m_gridOrigin) / m_gridScale);
+	float maxDistance = (float)glm::min(ray.maxDistance / m_gridScale, 1e30);
+
+	vec3 invDirection;
+	uint32_t directionMask = 0; // Octant bits the ray travels against
+	for (int i = 0; i < 3; i++) {
+		float d = direction[i] != 0.0 ? (float)direction[i] : 1e-30F;
+		invDirection[i] = 1.0F / d;
+		if (d < 0.0F) {
+			directionMask |= 4 >> i;
+		}
+	}
+
+	vec3 rootNear = (vec3(0.0F) - origin) * invDirection;
+	vec3 rootFar = (vec3((float)m_gridSize) - origin) * invDirection;
+	vec3 rootMin = min(rootNear, rootFar);
+	vec3 rootMax = max(rootNear, rootFar);
+	float rootDistance = glm::max(glm::max(rootMin.x, rootMin.y), glm::max(rootMin.z, 0.0F));
+	if (rootDistance > glm::min(glm::min(rootMax.x, rootMax.y), glm::min(rootMax.z, maxDistance)))
+		return false;
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 originX = _mm_set1_ps(origin.x);
+	const __m128 originY = _mm_set1_ps(origin.y);
+	const __m128 originZ = _mm_set1_ps(origin.z);
+	const __m128 invDirectionX = _mm_set1_ps(invDirection.x);
+	const __m128 invDirectionY = _mm_set1_ps(invDirection.y);
+	const __m128 invDirectionZ = _mm_set1_ps(invDirection.z);
+	const __m128 offsetY = _mm_setr_ps(0.0F, 0.0F, 1.0F, 1.0F); // Octants 0-3 and 4-7 share their y and z offsets
+	const __m128 offsetZ = _mm_setr_ps(0.0F, 1.0F, 0.0F, 1.0F);
+	const __m128 maxDistance4 = _mm_set1_ps(maxDistance);
+
+	// Children are pushed back to front, so they pop front to back. Flipping the octant bits the ray
+	// travels against makes increasing index order a valid front to back order.
+	StackEntry stack[32 * 8]; // At most 7 pending siblings per level
+	uint32_t stackSize = 0;
+
+	StackEntry root;
+	root.nodeIndex = 0;
+	root.level = 0;
+	root.position = uvec3(0);
+	root.distance = rootDistance;
+	stack[stackSize++] = root;
+
+	alignas(16) float childDistances[8];
+
+	while (stackSize > 0) {
+		StackEntry entry = stack[--stackSize];
+
+		if (entry.level == targetLevel) {
+			float childSize = (float)(m_gridSize >> entry.level);
+			vec3 boxMin = vec3(entry.position) * childSize;
+			vec3 t0 = (boxMin - origin) * invDirection;
+			vec3 t1 = (boxMin + childSize - origin) * invDirection;
+			vec3 tMin = min(t0, t1);
+
+			hit.hit = true;
+			hit.distance = entry.distance * m_gridScale;
+			hit.level = entry.level;
+			hit.position = entry.position;
+
+			if (entry.distance > 0.0F) {
+				int axis = tMin.x > tMin.y ? (tMin.x > tMin.z ? 0 : 2) : (tMin.y > tMin.z ? 1 : 2);
+				hit.faceNormal[axis] = direction[axis] < 0.0 ? 1.0 : -1.0;
+			}
+
+			this->fillHit(entry.nodeIndex, hit);
+			return true;
+		}
+
+		uint32_t childIndex = m_nodeChildIndices[entry.nodeIndex] & CPUOctreeBuilder::CHILD_INDEX_MASK;
+		if ((size_t)childIndex + 8 > m_nodeChildIndices.size())
+			continue;
+
+		// CHILD_FLAG_BIT is the sign bit of each child word
+		const __m128i* childWords = reinterpret_cast<const __m128i*>(&m_nodeChildIndices[childIndex]);
+		uint32_t occupiedMask = _mm_movemask_ps(_mm_castsi128_ps(_mm_loadu_si128(childWords))) |
+			(_mm_movemask_ps(_mm_castsi128_ps(_mm_loadu_si128(childWords + 1))) << 4);
+
+		if (occupiedMask == 0)
+			continue;
+
+		float childSize = (float)(m_gridSize >> (entry.level + 1));
+		__m128 size = _mm_set1_ps(childSize);
+		__m128 sizeX = _mm_mul_ps(size, invDirectionX);
+		__m128 sizeY = _mm_mul_ps(size, invDirectionY);
+		__m128 sizeZ = _mm_mul_ps(size, invDirectionZ);
+
+		vec3 base = vec3(entry.position * 2u) * childSize;
+		__m128 nearX0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(base.x), originX), invDirectionX);
+		__m128 nearX1 = _mm_add_ps(nearX0, sizeX);
+		__m128 farX1 = _mm_add_ps(nearX1, sizeX);
+		__m128 nearY = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(base.y), _mm_mul_ps(offsetY, size)), originY), invDirectionY);
+		__m128 farY = _mm_add_ps(nearY, sizeY);
+		__m128 nearZ = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(base.z), _mm_mul_ps(offsetZ, size)), originZ), invDirectionZ);
+		__m128 farZ = _mm_add_ps(nearZ, sizeZ);
+
+		__m128 minYZ = _mm_max_ps(_mm_max_ps(_mm_min_ps(nearY, farY), _mm_min_ps(nearZ, farZ)), zero);
+		__m128 maxYZ = _mm_min_ps(_mm_min_ps(_mm_max_ps(nearY, farY), _mm_max_ps(nearZ, farZ)), maxDistance4);
+
+		__m128 tNear0 = _mm_max_ps(_mm_min_ps(nearX0, nearX1), minYZ);
+		__m128 tFar0 = _mm_min_ps(_mm_max_ps(nearX0, nearX1), maxYZ);
+		__m128 tNear1 = _mm_max_ps(_mm_min_ps(nearX1, farX1), minYZ);
+		__m128 tFar1 = _mm_min_ps(_mm_max_ps(nearX1, farX1), maxYZ);
+
+		uint32_t hitMask = _mm_movemask_ps(_mm_cmple_ps(tNear0, tFar0)) | (_mm_movemask_ps(_mm_cmple_ps(tNear1, tFar1)) << 4);
+		hitMask &= occupiedMask;
+
+		if (hitMask == 0)
+			continue;
+
+		_mm_store_ps(childDistances, tNear0);
+		_mm_store_ps(childDistances + 4, tNear1);
+
+		for (int i = 7; i >= 0; i--) {
+			uint32_t octant = i ^ directionMask;
+			if ((hitMask & (1 << octant)) == 0)
+				continue;
+
+			StackEntry child;
+			child.nodeIndex = childIndex + octant;
+			child.level = entry.level + 1;
+			child.position = entry.position * 2u + uvec3((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+			child.distance = childDistances[octant];
+			stack[stackSize++] = child;
+		}
+	}
+
+	return false;
+}
+
+void CPUOctreeTracer::traceCone(const OctreeCone& cone, OctreeConeResult& result) const {
+	result = OctreeConeResult();
+
+	if (m_octreeDepth == 0 || (m_nodeChildIndices[0] & CPUOctreeBuilder::CHILD_FLAG_BIT) == 0)
+		return;
+
+	dvec3 direction = normalize(cone.direction);
+	dvec3 origin = (cone.origin - m_gridOrigin) / m_gridScale;
+	double maxDistance = glm::min(cone.maxDistance / m_gridScale, (double)m_gridSize * 2.0);
+	double minDiameter = 2.0; // Leaf nodes cover 2^3 voxels
+	double distance = cone.startDistance / m_gridScale;
+
+	// Skip ahead to where the cone enters the grid
+	for (int i = 0; i < 3; i++) {
+		if (direction[i] == 0.0)
+			continue;
+
+		double t0 = (0.0 - origin[i]) / direction[i];
+		double t1 = (m_gridSize - origin[i]) / direction[i];
+		distance = glm::max(distance, glm::min(t0, t1));
+		maxDistance = glm::min(maxDistance, glm::max(t0, t1));
+	}
+
+	// Node opacity blends the coverage along each axis by how closely the cone follows it
+	vec3 axisWeights = vec3(abs(direction) / (abs(direction.x) + abs(direction.y) + abs(direction.z)));
+
+	while (distance < maxDistance && result.occlusion < CONE_MAX_OCCLUSION) {
+		double diameter = glm::max(minDiameter, 2.0 * cone.aperture * distance);
+		vec3 position = vec3(origin + direction * distance);
+
+		// Nodes on level L are 2^(depth - L) voxels wide
+		double level = glm::clamp((double)m_octreeDepth - log2(diameter), 0.0, (double)(m_octreeDepth - 1));
+		uint32_t coarseLevel = (uint32_t)level;
+		uint32_t fineLevel = glm::min(coarseLevel + 1, m_octreeDepth - 1);
+		float fineWeight = (float)(level - coarseLevel);
+
+		vec4 coarseAlbedo, fineAlbedo;
+		vec3 coarseEmission, fineEmission;
+		this->sampleLevel(position, axisWeights, coarseLevel, coarseAlbedo, coarseEmission);
+		this->sampleLevel(position, axisWeights, fineLevel, fineAlbedo, fineEmission);
+
+		vec4 albedo = mix(coarseAlbedo, fineAlbedo, fineWeight);
+		vec3 emission = mix(coarseEmission, fineEmission, fineWeight);
+
+		double step = diameter * CONE_STEP_SCALE;
+
+		if (albedo.a > 0.0F) {
+			// Opacity is for a sample as deep as the node is wide, correct it for the step length
+			float alpha = 1.0F - (float)pow(1.0 - glm::min(albedo.a, 0.9999F), step / diameter);
+			float weight = (1.0F - result.occlusion) * alpha;
+			result.albedo += vec3(albedo) * weight;
+			result.emission += emission * weight;
+			result.occlusion += weight;
+		}
+
+		distance += step;
+	}
+}
+
+void CPUOctreeTracer::traceRays(const std::vector<OctreeRay>& rays, std::vector<OctreeRayHit>& hits) const {
+	hits.resize(rays.size());
+
+	this->runBatches(rays.size(), [this, &rays, &hits](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			this->traceRay(rays[i], hits[i]);
+		}
+	});
+}
+
+void CPUOctreeTracer::traceCones(const std::vector<OctreeCone>& cones, std::vector<OctreeConeResult>& results) const {
+	results.resize(cones.size());
+
+	this->runBatches(cones.size(), [this, &cones, &results](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			this->traceCone(cones[i], results[i]);
+		}
+	});
+}
+
+uint32_t CPUOctreeTracer::getGridSize() const {
+	return m_gridSize;
+}
+
+uint32_t CPUOctreeTracer::getOctreeDepth() const {
+	return m_octreeDepth;
+}
+
+dvec3 CPUOctreeTracer::getGridCenter() const {
+	return m_gridCenter;
+}
+
+double CPUOctreeTracer::getGridScale() const {
+	return m_gridScale;
+}
+
+dvec3 CPUOctreeTracer::getGridOrigin() const {
+	return m_gridOrigin;
+}
+
+uint32_t CPUOctreeTracer::getThreadCount() const {
+	return m_threadCount;
+}
+
+void CPUOctreeTracer::setThreadCount(uint32_t threadCount) {
+	m_threadCount = threadCount;
+}
+
+uint32_t CPUOctreeTracer::getBatchSize() const {
+	return m_batchSize;
+}
+
+void CPUOctreeTracer::setBatchSize(uint32_t batchSize) {
+	m_batchSize = glm::max(batchSize, 1u);
+}
+
+bool CPUOctreeTracer::findNode(vec3 gridPosition, uint32_t level, uint32_t& nodeIndex, uint32_t& childMask) const {
+	if (any(lessThan(gridPosition, vec3(0.0F))) || any(greaterThanEqual(gridPosition, vec3((float)m_gridSize))))
+		return false;
+
+	uvec3 coord = uvec3(gridPosition);
+	nodeIndex = 0;
+
+	for (uint32_t i = 0; i < level; i++) {
+		uvec3 bit = (coord >> (m_octreeDepth - i - 1)) & 1u;
+		uint32_t childIndex = m_nodeChildIndices[nodeIndex] & CPUOctreeBuilder::CHILD_INDEX_MASK;
+		nodeIndex = childIndex + ((bit.x << 2) | (bit.y << 1) | bit.z);
+
+		if (nodeIndex >= m_nodeChildIndices.size() || (m_nodeChildIndices[nodeIndex] & CPUOctreeBuilder::CHILD_FLAG_BIT) == 0)
+			return false;
+	}
+
+	if ((m_nodeChildIndices[nodeIndex] & CPUOctreeBuilder::CHILD_FLAG_BIT) == 0)
+		return false;
+
+	childMask = 0xFF; // Leaves are solid
+
+	if (level < m_octreeDepth - 1) {
+		uint32_t childIndex = m_nodeChildIndices[nodeIndex] & CPUOctreeBuilder::CHILD_INDEX_MASK;
+		childMask = 0;
+		for (uint32_t i = 0; i < 8; i++) {
+			if ((m_nodeChildIndices[childIndex + i] & CPUOctreeBuilder::CHILD_FLAG_BIT) != 0) {
+				childMask |= 1 << i;
+			}
+		}
+	}
+
+	return true;
+}
+
+void CPUOctreeTracer::sampleLevel(vec3 gridPosition, vec3 axisWeights, uint32_t level, vec4& albedo, vec3& emission) const {
+	uint32_t nodeIndex;
+	uint32_t childMask;
+
+	if (!this->findNode(gridPosition, level, nodeIndex, childMask)) {
+		albedo = vec4(0.0F);
+		emission = vec3(0.0F);
+		return;
+	}
+
+	// Coverage along an axis is the fraction of the four child columns along it that are blocked
+	float opacity = 0.0F;
+	for (int axis = 0; axis < 3; axis++) {
+		uint32_t axisBit = 4 >> axis;
+		uint32_t blockedCount = 0;
+		for (uint32_t i = 0; i < 8; i++) {
+			if ((i & axisBit) == 0 && (childMask & ((1 << i) | (1 << (i | axisBit)))) != 0) {
+				++blockedCount;
+			}
+		}
+
+		opacity += axisWeights[axis] * (blockedCount / 4.0F);
+	}
+
+	const uvec4& data = m_nodeData[nodeIndex];
+	albedo = vec4(vec3(unpackUnorm4x8(data.x)), opacity);
+	emission = vec3(unpackUnorm4x8(data.z));
+}
+
+void CPUOctreeTracer::fillHit(uint32_t nodeIndex, OctreeRayHit& hit) const {
+	const uvec4& data = m_nodeData[nodeIndex];
+	hit.nodeIndex = nodeIndex;
+	hit.albedo = unpackUnorm4x8(data.x);
+	hit.normal = CPUVoxelizer::unpackNormal(data.y);
+	hit.emission = vec3(unpackUnorm4x8(data.z));
+}
+
+void CPUOctreeTracer::runBatches(size_t count, const std::function<void(size_t, size_t)>& batchTask) const {
+	Engine::jobSystem()->parallelFor(count, m_batchSize, batchTask, m_threadCount);
+}
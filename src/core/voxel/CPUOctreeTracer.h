@@ -0,0 +1,114 @@
+#pragma once
+
+#include "core/pch.h"
+#include <functional>
+
+class CPUOctreeBuilder;
+
+struct OctreeRay {
+	dvec3 origin; // World space
+	dvec3 direction; // Normalized internally, distances are in world units
+	double maxDistance = INFINITY;
+	uint32_t maxLevel = UINT32_MAX; // Nodes on this level are treated as solid, for coarse queries
+};
+
+struct OctreeRayHit {
+	bool hit = false;
+	double distance = INFINITY; // Where the ray enters the voxel, 0 if it starts inside
+	dvec3 faceNormal = dvec3(0.0); // Normal of the face the ray entered through, zero if it starts inside
+	uint32_t nodeIndex = 0; // Index into the octree node buffers
+	uint32_t level = 0;
+	uvec3 position = uvec3(0); // Node coordinate on its level
+	vec4 albedo = vec4(0.0F);
+	vec3 normal = vec3(0.0F); // Averaged surface normal stored in the node
+	vec3 emission = vec3(0.0F);
+};
+
+struct OctreeCone {
+	dvec3 origin; // World space
+	dvec3 direction;
+	double aperture = 0.577; // Tangent of the half angle, the default is a 60 degree cone
+	double startDistance = 0.0; // Offset from the origin, so surface cones do not sample their own voxel
+	double maxDistance = INFINITY;
+};
+
+struct OctreeConeResult {
+	vec3 albedo = vec3(0.0F); // Albedo of everything the cone passed, weighted by visibility
+	vec3 emission = vec3(0.0F);
+	float occlusion = 0.0F; // 0 when nothing blocks the cone, 1 when fully blocked
+};
+
+// Ray and cone queries against an octree in the GPU node layout (see CPUOctreeBuilder), for offline
+// baking and for checking the GPU traversal against. The node buffers are not copied, they must
+// outlive the tracer.
+// Rays are traversed depth first with an explicit stack, visiting children front to back so the first
+// leaf reached is the closest hit. The eight child boxes of a node are intersected together with SSE,
+// and their occupancy is read from the sign bits of the child words in the same way.
+// Cones are marched front to back, sampling the level whose node size matches the cone diameter and
+// blending with the next finer level. A node's opacity is how much of it its occupied children cover
+// when seen along the cone, so a thin wall facing the cone is opaque while one seen edge-on is not.
+// Leaves are opaque.
+// The batch functions split rays into fixed size batches that threads claim one at a time, results
+// are written in place, so the output does not depend on the thread count.
+class CPUOctreeTracer : private NotCopyable {
+public:
+	CPUOctreeTracer(const std::vector<uint32_t>& nodeChildIndices, const std::vector<uvec4>& nodeData, uint32_t gridSize, dvec3 gridCenter, double gridScale);
+
+	CPUOctreeTracer(const CPUOctreeBuilder& octree, dvec3 gridCenter, double gridScale);
+
+	~CPUOctreeTracer();
+
+	bool traceRay(const OctreeRay& ray, OctreeRayHit& hit) const;
+
+	void traceCone(const OctreeCone& cone, OctreeConeResult& result) const;
+
+	void traceRays(const std::vector<OctreeRay>& rays, std::vector<OctreeRayHit>& hits) const;
+
+	void traceCones(const std::vector<OctreeCone>& cones, std::vector<OctreeConeResult>& results) const;
+
+	uint32_t getGridSize() const;
+
+	uint32_t getOctreeDepth() const;
+
+	dvec3 getGridCenter() const;
+
+	double getGridScale() const;
+
+	dvec3 getGridOrigin() const;
+
+	uint32_t getThreadCount() const;
+
+	void setThreadCount(uint32_t threadCount);
+
+	uint32_t getBatchSize() const;
+
+	void setBatchSize(uint32_t batchSize);
+
+private:
+	struct StackEntry {
+		uint32_t nodeIndex;
+		uint32_t level;
+		uvec3 position;
+		float distance;
+	};
+
+	bool findNode(vec3 gridPosition, uint32_t level, uint32_t& nodeIndex, uint32_t& childMask) const;
+
+	void sampleLevel(vec3 gridPosition, vec3 axisWeights, uint32_t level, vec4& albedo, vec3& emission) const;
+
+	void fillHit(uint32_t nodeIndex, OctreeRayHit& hit) const;
+
+	void runBatches(size_t count, const std::function<void(size_t, size_t)>& batchTask) const;
+
+	const std::vector<uint32_t>& m_nodeChildIndices;
+	const std::vector<uvec4>& m_nodeData;
+
+	dvec3 m_gridCenter;
+	uint32_t m_gridSize;
+	uint32_t m_octreeDepth;
+	double m_gridScale;
+	dvec3 m_gridOrigin; // World position of grid coordinate 0
+
+	uint32_t m_threadCount; // 0 uses every thread of the job system
+	uint32_t m_batchSize; // Rays or cones per batch
+};
@@ -0,0 +1,321 @@
+#include "CPUVoxelizer.h"
+#include "core/renderer/geometry/Mesh.h"
+#include "core/renderer/geometry/TriAABBIntersectionTest.h"
+#include "core/util/FileUtils.h"
+#include "core/Engine.h"
+#include "core/JobSystem.h"
+#include <glm/gtc/packing.hpp>
+
+CPUVoxelizer::CPUVoxelizer(uint32_t gridSize, double gridScale):
+	m_gridCenter(0.0),
+	m_gridSize(gridSize),
+	m_gridScale(gridScale),
+	m_threadCount(0),
+	m_batchSize(1024) {
+}
+
+CPUVoxelizer::~CPUVoxelizer() {
+}
+
+void CPUVoxelizer::addMesh(const Mesh* mesh, dmat4 modelMatrix, const CPUVoxelizerMaterial& material) {
+	if (mesh == NULL)
+		return;
+
+	MeshInstance instance;
+	instance.mesh = mesh;
+	instance.modelMatrix = modelMatrix;
+	instance.normalMatrix = inverse(transpose(dmat3(modelMatrix)));
+	instance.material = material;
+	m_meshes.push_back(instance);
+}
+
+void CPUVoxelizer::clearMeshes() {
+	m_meshes.clear();
+}
+
+uint32_t CPUVoxelizer::voxelize() {
+	uint64_t startTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+	this->clearFragments();
+
+	if (m_gridSize == 0 || m_gridSize > 0x10000) {
+		error("Unable to voxelize into a grid of size %u, voxel coordinates are stored as 16-bit integers\n", m_gridSize);
+		return 0;
+	}
+
+	std::vector<TriangleBatch> batches;
+	for (uint32_t i = 0; i < m_meshes.size(); i++) {
+		uint32_t triangleCount = m_meshes[i].mesh->getTriangleCount();
+
+		for (uint32_t j = 0; j < triangleCount; j += m_batchSize) {
+			TriangleBatch batch;
+			batch.meshIndex = i;
+			batch.firstTriangle = j;
+			batch.triangleCount = glm::min(m_batchSize, triangleCount - j);
+			batches.push_back(std::move(batch));
+		}
+	}
+
+	JobSystem* jobSystem = Engine::jobSystem();
+	uint32_t threadCount = m_threadCount != 0 ? glm::min(m_threadCount, jobSystem->getThreadCount()) : jobSystem->getThreadCount();
+	threadCount = glm::min(threadCount, (uint32_t)batches.size());
+
+	jobSystem->parallelFor(batches.size(), 1, [this, &batches](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			this->voxelizeBatch(batches[i]);
+		}
+	}, threadCount);
+
+	size_t fragmentCount = 0;
+	for (int i = 0; i < batches.size(); i++) {
+		fragmentCount += batches[i].positions.size();
+	}
+
+	m_fragmentPositions.reserve(fragmentCount);
+	m_fragmentData.reserve(fragmentCount);
+
+	for (int i = 0; i < batches.size(); i++) {
+		m_fragmentPositions.insert(m_fragmentPositions.end(), batches[i].positions.begin(), batches[i].positions.end());
+		m_fragmentData.insert(m_fragmentData.end(), batches[i].data.begin(), batches[i].data.end());
+	}
+
+	uint64_t endTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+	info("Voxelized %llu triangles into %u fragments on %u threads, took %.2f msec\n", (unsigned long long)this->getTriangleCount(), this->getFragmentCount(), glm::max(threadCount, 1u), (endTime - startTime) / 1000000.0);
+
+	return this->getFragmentCount();
+}
+
+void CPUVoxelizer::clearFragments() {
+	m_fragmentPositions.clear();
+	m_fragmentData.clear();
+}
+
+const std::vector<u16vec4>& CPUVoxelizer::getFragmentPositions() const {
+	return m_fragmentPositions;
+}
+
+const std::vector<uvec4>& CPUVoxelizer::getFragmentData() const {
+	return m_fragmentData;
+}
+
+uint32_t CPUVoxelizer::getFragmentCount() const {
+	return (uint32_t)m_fragmentPositions.size();
+}
+
+uint64_t CPUVoxelizer::getTriangleCount() const {
+	uint64_t triangleCount = 0;
+	for (int i = 0; i < m_meshes.size(); i++) {
+		triangleCount += m_meshes[i].mesh->getTriangleCount();
+	}
+
+	return triangleCount;
+}
+
+dvec3 CPUVoxelizer::getGridCenter() const {
+	return m_gridCenter;
+}
+
+void CPUVoxelizer::setGridCenter(dvec3 gridCenter) {
+	m_gridCenter = gridCenter;
+}
+
+uint32_t CPUVoxelizer::getGridSize() const {
+	return m_gridSize;
+}
+
+void CPUVoxelizer::setGridSize(uint32_t gridSize) {
+	m_gridSize = gridSize;
+}
+
+double CPUVoxelizer::getGridScale() const {
+	return m_gridScale;
+}
+
+void CPUVoxelizer::setGridScale(double gridScale) {
+	m_gridScale = gridScale;
+}
+
+dvec3 CPUVoxelizer::getGridOrigin() const {
+	// Same snapping as VoxelGenerator::updateAxisProjections, so both voxelizers address the same cells.
+	dvec3 center = floor(m_gridCenter / (m_gridScale * 2)) * (m_gridScale * 2);
+	return center - dvec3(m_gridSize * m_gridScale * 0.5);
+}
+
+uint32_t CPUVoxelizer::getThreadCount() const {
+	return m_threadCount;
+}
+
+void CPUVoxelizer::setThreadCount(uint32_t threadCount) {
+	m_threadCount = threadCount;
+}
+
+uint32_t CPUVoxelizer::getBatchSize() const {
+	return m_batchSize;
+}
+
+void CPUVoxelizer::setBatchSize(uint32_t batchSize) {
+	m_batchSize = glm::max(batchSize, 1u);
+}
+
+uint32_t CPUVoxelizer::packAlbedo(vec3 albedo) {
+	return packUnorm4x8(vec4(albedo, 1.0F));
+}
+
+uint32_t CPUVoxelizer::packNormal(vec3 normal) {
+	// encodeNormal from globals.glsl (spherical encoding)
+	vec2 encoded = (vec2(atan2(normal.y, normal.x) / glm::pi<float>(), normal.z) + 1.0F) * 0.5F;
+	return packUnorm2x16(encoded);
+}
+
+uint32_t CPUVoxelizer::packEmissive(vec3 emissive) {
+	return packUnorm4x8(vec4(emissive, 1.0F));
+}
+
+vec3 CPUVoxelizer::unpackNormal(uint32_t packedNormal) {
+	// decodeNormal from globals.glsl. Averaged octree normals are not unit length, so renormalize.
+	vec2 angles = unpackUnorm2x16(packedNormal) * 2.0F - 1.0F;
+	float theta = angles.x * glm::pi<float>();
+	float sinPhi = sqrt(glm::max(1.0F - angles.y * angles.y, 0.0F));
+	return normalize(vec3(cos(theta) * sinPhi, sin(theta) * sinPhi, angles.y));
+}
+
+void CPUVoxelizer::voxelizeBatch(TriangleBatch& batch) const {
+	const MeshInstance& instance = m_meshes[batch.meshIndex];
+	const std::vector<Mesh::vertex>& vertices = instance.mesh->getVertices();
+	const std::vector<Mesh::triangle>& triangles = instance.mesh->getTriangles();
+
+	const dvec3 gridOrigin = this->getGridOrigin();
+	const double invGridScale = 1.0 / m_gridScale;
+	const int32_t maxCoord = (int32_t)m_gridSize - 1;
+	const vec3 voxelHalfSize = vec3(0.5F);
+	const __m128 laneOffset = _mm_set_ps(3.5F, 2.5F, 1.5F, 0.5F);
+
+	TriAABBTest triangleTest;
+
+	for (uint32_t i = batch.firstTriangle; i < batch.firstTriangle + batch.triangleCount; i++) {
+		const Mesh::triangle& tri = triangles[i];
+		const Mesh::vertex& vertex0 = vertices[tri.i0];
+		const Mesh::vertex& vertex1 = vertices[tri.i1];
+		const Mesh::vertex& vertex2 = vertices[tri.i2];
+
+		// Everything below works in grid space, where voxel (x, y, z) spans [x, x + 1] etc.
+		vec3 p0 = vec3((dvec3(instance.modelMatrix * dvec4(dvec3(vertex0.position), 1.0)) - gridOrigin) * invGridScale);
+		vec3 p1 = vec3((dvec3(instance.modelMatrix * dvec4(dvec3(vertex1.position), 1.0)) - gridOrigin) * invGridScale);
+		vec3 p2 = vec3((dvec3(instance.modelMatrix * dvec4(dvec3(vertex2.position), 1.0)) - gridOrigin) * invGridScale);
+
+		// Voxels that merely touch the triangle bounds are included, as the overlap test accepts touching.
+		ivec3 voxelMin = max(ivec3(ceil(min(p0, min(p1, p2)))) - 1, ivec3(0));
+		ivec3 voxelMax = min(ivec3(floor(max(p0, max(p1, p2)))), ivec3(maxCoord));
+
+		if (any(greaterThan(voxelMin, voxelMax)))
+			continue; // Outside the grid
+
+		vec3 faceNormal = cross(p1 - p0, p2 - p0);
+		vec3 absNormal = abs(faceNormal);
+
+		// Walk columns along the dominant axis, like the projection the generation shader rasterizes with,
+		// and only test the few voxels in each column that the triangle plane passes through.
+		int w = absNormal.x > absNormal.y ? 0 : 1;
+		w = absNormal.z > absNormal[w] ? 2 : w;
+		int u = (w + 1) % 3;
+		int v = (w + 2) % 3;
+
+		if (absNormal[w] <= 0.0F)
+			continue; // Degenerate, the generation shader does not rasterize these either
+
+		triangleTest.init(p0, p1, p2, voxelHalfSize);
+
+		float planeDist = dot(faceNormal, p0);
+		float columnExtent = (absNormal[u] + absNormal[v]) * 0.5F / absNormal[w];
+
+		vec3 edge0 = p1 - p0;
+		vec3 edge1 = p2 - p0;
+		float d00 = dot(edge0, edge0);
+		float d01 = dot(edge0, edge1);
+		float d11 = dot(edge1, edge1);
+		float invDenom = 1.0F / (d00 * d11 - d01 * d01);
+
+		vec3 normal0 = vec3(instance.normalMatrix * dvec3(vertex0.normal));
+		vec3 normal1 = vec3(instance.normalMatrix * dvec3(vertex1.normal));
+		vec3 normal2 = vec3(instance.normalMatrix * dvec3(vertex2.normal));
+		vec3 worldFaceNormal = normalize(vec3(instance.normalMatrix * dvec3(faceNormal)));
+
+		__m128 centers[3];
+
+		for (int32_t cu = voxelMin[u]; cu <= voxelMax[u]; cu++) {
+			centers[u] = _mm_set1_ps(cu + 0.5F);
+
+			for (int32_t cv = voxelMin[v]; cv <= voxelMax[v]; cv++) {
+				centers[v] = _mm_set1_ps(cv + 0.5F);
+
+				float columnCenter = (planeDist - faceNormal[u] * (cu + 0.5F) - faceNormal[v] * (cv + 0.5F)) / faceNormal[w];
+				int32_t cw0 = glm::max((int32_t)ceil(columnCenter - columnExtent) - 1, voxelMin[w]);
+				int32_t cw1 = glm::min((int32_t)floor(columnCenter + columnExtent), voxelMax[w]);
+
+				for (int32_t cw = cw0; cw <= cw1; cw += 4) {
+					centers[w] = _mm_add_ps(_mm_set1_ps((float)cw), laneOffset);
+
+					int overlapMask = triangleTest.test4(centers[0], centers[1], centers[2]);
+					overlapMask &= (1 << glm::min(cw1 - cw + 1, 4)) - 1; // Lanes past the end of the column
+
+					for (int lane = 0; overlapMask != 0; lane++, overlapMask >>= 1) {
+						if ((overlapMask & 1) == 0)
+							continue;
+
+						ivec3 voxelCoord;
+						voxelCoord[u] = cu;
+						voxelCoord[v] = cv;
+						voxelCoord[w] = cw + lane;
+
+						// Attributes are interpolated at the voxel center projected onto the triangle. Near
+						// the edges that point can fall outside, so the weights are clamped.
+						vec3 d2 = vec3(voxelCoord) + 0.5F - p0;
+						float d20 = dot(d2, edge0);
+						float d21 = dot(d2, edge1);
+						vec3 barycentric;
+						barycentric.y = (d11 * d20 - d01 * d21) * invDenom;
+						barycentric.z = (d00 * d21 - d01 * d20) * invDenom;
+						barycentric.x = 1.0F - barycentric.y - barycentric.z;
+						barycentric = max(barycentric, vec3(0.0F));
+						barycentric /= barycentric.x + barycentric.y + barycentric.z;
+
+						vec3 albedo = vec3(instance.material.albedo);
+						if (instance.material.albedoMap != NULL) {
+							vec2 textureCoord = vertex0.texture * barycentric.x + vertex1.texture * barycentric.y + vertex2.texture * barycentric.z;
+							vec4 albedoColour = this->sampleAlbedoMap(instance.material.albedoMap, textureCoord);
+							if (albedoColour.a < 0.5F)
+								continue; // Discarded, same as the generation shader
+							albedo *= vec3(albedoColour);
+						}
+
+						vec3 normal = normal0 * barycentric.x + normal1 * barycentric.y + normal2 * barycentric.z;
+						float normalLength = length(normal);
+						normal = normalLength > 1e-6F ? normal / normalLength : worldFaceNormal;
+
+						batch.positions.push_back(u16vec4(voxelCoord, 0));
+						batch.data.push_back(uvec4(packAlbedo(albedo), packNormal(normal), packEmissive(vec3(instance.material.emission)), 0));
+					}
+				}
+			}
+		}
+	}
+}
+
+vec4 CPUVoxelizer::sampleAlbedoMap(const Image* image, vec2 textureCoord) const {
+	if (image->data == NULL || image->width == 0 || image->height == 0 || image->channels == 0)
+		return vec4(1.0F);
+
+	// Nearest texel with repeat wrapping. Row 0 is the bottom of the image, matching the GL textures.
+	textureCoord -= floor(textureCoord);
+	uint32_t x = glm::min((uint32_t)(textureCoord.x * image->width), image->width - 1);
+	uint32_t y = glm::min((uint32_t)(textureCoord.y * image->height), image->height - 1);
+
+	const uint8_t* texel = image->data + ((size_t)y * image->width + x) * image->channels;
+
+	switch (image->channels) {
+	case 1: return vec4(vec3(texel[0] / 255.0F), 1.0F);
+	case 2: return vec4(vec3(texel[0] / 255.0F), texel[1] / 255.0F);
+	case 3: return vec4(texel[0] / 255.0F, texel[1] / 255.0F, texel[2] / 255.0F, 1.0F);
+	default: return vec4(texel[0] / 255.0F, texel[1] / 255.0F, texel[2] / 255.0F, texel[3] / 255.0F);
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "core/pch.h"
+
+struct Image;
+
+struct CPUVoxelizerMaterial {
+	dvec3 albedo = dvec3(1.0); // Multiplied with the albedo map, like the material albedo in the generation shader
+	dvec3 emission = dvec3(0.0); // The generation shader currently always stores zero emission
+	Image* albedoMap = NULL; // Optional 8-bit image, loaded vertically flipped like the GL textures. Not owned.
+};
+
+// Conservative surface voxelizer running entirely on the CPU. Every voxel a triangle touches receives a
+// fragment, in exactly the packed format VoxelGenerator stores in its fragment position (RGBA16UI) and
+// data (RGBA32UI) texture buffers, so the result can be uploaded in place of the GPU fragment pass or
+// compared against it. Triangles are split into batches that are voxelized in parallel, and the batch
+// outputs are joined in submission order, so the fragment list does not depend on the thread count.
+class CPUVoxelizer : private NotCopyable {
+public:
+	CPUVoxelizer(uint32_t gridSize, double gridScale);
+
+	~CPUVoxelizer();
+
+	void addMesh(const Mesh* mesh, dmat4 modelMatrix, const CPUVoxelizerMaterial& material = CPUVoxelizerMaterial());
+
+	void clearMeshes();
+
+	uint32_t voxelize();
+
+	void clearFragments();
+
+	const std::vector<u16vec4>& getFragmentPositions() const;
+
+	const std::vector<uvec4>& getFragmentData() const;
+
+	uint32_t getFragmentCount() const;
+
+	uint64_t getTriangleCount() const;
+
+	dvec3 getGridCenter() const;
+
+	void setGridCenter(dvec3 gridCenter);
+
+	uint32_t getGridSize() const;
+
+	void setGridSize(uint32_t gridSize);
+
+	double getGridScale() const;
+
+	void setGridScale(double gridScale);
+
+	dvec3 getGridOrigin() const;
+
+	uint32_t getThreadCount() const;
+
+	void setThreadCount(uint32_t threadCount);
+
+	uint32_t getBatchSize() const;
+
+	void setBatchSize(uint32_t batchSize);
+
+	static uint32_t packAlbedo(vec3 albedo);
+
+	static uint32_t packNormal(vec3 normal);
+
+	static uint32_t packEmissive(vec3 emissive);
+
+	static vec3 unpackNormal(uint32_t packedNormal);
+
+private:
+	struct MeshInstance {
+		const Mesh* mesh;
+		dmat4 modelMatrix;
+		dmat3 normalMatrix;
+		CPUVoxelizerMaterial material;
+	};
+
+	struct TriangleBatch {
+		uint32_t meshIndex;
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		std::vector<u16vec4> positions;
+		std::vector<uvec4> data;
+	};
+
+	void voxelizeBatch(TriangleBatch& batch) const;
+
+	vec4 sampleAlbedoMap(const Image* image, vec2 textureCoord) const;
+
+	std::vector<MeshInstance> m_meshes;
+	std::vector<u16vec4> m_fragmentPositions; // Voxel coordinate, w unused (voxelPositionStorage)
+	std::vector<uvec4> m_fragmentData; // Packed albedo, normal, emissive, unused (voxelDataStorage)
+
+	dvec3 m_gridCenter;
+	uint32_t m_gridSize;
+	double m_gridScale;
+
+	uint32_t m_threadCount; // 0 uses every thread of the job system
+	uint32_t m_batchSize; // Triangles per batch
+};
@@ -0,0 +1,316 @@
+#include "IncrementalVoxelizer.h"
+#include "CPUOctreeBuilder.h"
+#include "core/scene/Transformation.h"
+#include "core/renderer/geometry/Mesh.h"
+
+IncrementalVoxelizer::IncrementalVoxelizer(uint32_t gridSize, double gridScale, uint32_t brickSize):
+	m_gridCenter(0.0),
+	m_gridSize(gridSize),
+	m_gridScale(gridScale),
+	m_brickSize(glm::max(brickSize, 1u)),
+	m_lastUpdateBrickCount(0),
+	m_threadCount(0) {
+	m_fragmentCount[STATIC_LAYER] = 0;
+	m_fragmentCount[DYNAMIC_LAYER] = 0;
+}
+
+IncrementalVoxelizer::~IncrementalVoxelizer() {
+}
+
+uint32_t IncrementalVoxelizer::addStaticMesh(const Mesh* mesh, dmat4 modelMatrix, const CPUVoxelizerMaterial& material) {
+	return this->addMesh(mesh, NULL, modelMatrix, material, STATIC_LAYER);
+}
+
+uint32_t IncrementalVoxelizer::addDynamicMesh(const Mesh* mesh, Transformation* transform, const CPUVoxelizerMaterial& material) {
+	assert(transform != NULL);
+	return this->addMesh(mesh, transform, transform->getModelMatrix(), material, DYNAMIC_LAYER);
+}
+
+bool IncrementalVoxelizer::removeMesh(uint32_t meshHandle) {
+	if (meshHandle >= m_meshes.size() || m_meshes[meshHandle].mesh == NULL)
+		return false;
+
+	MeshEntry& entry = m_meshes[meshHandle];
+	if (entry.voxelized) {
+		m_removedRanges[entry.layer].push_back(entry.footprint);
+	}
+
+	entry.mesh = NULL;
+	entry.transform = NULL;
+	return true;
+}
+
+void IncrementalVoxelizer::clear() {
+	m_meshes.clear();
+	m_bricks.clear();
+	m_removedRanges[STATIC_LAYER].clear();
+	m_removedRanges[DYNAMIC_LAYER].clear();
+	m_fragmentCount[STATIC_LAYER] = 0;
+	m_fragmentCount[DYNAMIC_LAYER] = 0;
+	m_lastUpdateBrickCount = 0;
+}
+
+uint32_t IncrementalVoxelizer::update() {
+	std::vector<BrickRange> dirtyRanges[LAYER_COUNT];
+	dirtyRanges[STATIC_LAYER].swap(m_removedRanges[STATIC_LAYER]);
+	dirtyRanges[DYNAMIC_LAYER].swap(m_removedRanges[DYNAMIC_LAYER]);
+
+	for (int i = 0; i < m_meshes.size(); i++) {
+		MeshEntry& entry = m_meshes[i];
+		if (entry.mesh == NULL)
+			continue;
+
+		if (!entry.voxelized) {
+			entry.footprint = this->getFootprint(entry);
+			dirtyRanges[entry.layer].push_back(entry.footprint);
+			continue;
+		}
+
+		if (entry.transform == NULL || !entry.transform->didChange())
+			continue;
+
+		entry.transform->setChanged(false);
+
+		dmat4 modelMatrix = entry.transform->getModelMatrix();
+		if (modelMatrix == entry.modelMatrix)
+			continue;
+
+		// Clear where the mesh was, and fill where it is now
+		dirtyRanges[entry.layer].push_back(entry.footprint);
+		entry.modelMatrix = modelMatrix;
+		entry.footprint = this->getFootprint(entry);
+		dirtyRanges[entry.layer].push_back(entry.footprint);
+	}
+
+	m_lastUpdateBrickCount = 0;
+	for (int layer = 0; layer < LAYER_COUNT; layer++) {
+		if (!dirtyRanges[layer].empty()) {
+			m_lastUpdateBrickCount += this->rebuildLayer((Layer)layer, dirtyRanges[layer]);
+		}
+	}
+
+	return m_lastUpdateBrickCount;
+}
+
+void IncrementalVoxelizer::getFragments(std::vector<u16vec4>& fragmentPositions, std::vector<uvec4>& fragmentData) const {
+	fragmentPositions.clear();
+	fragmentData.clear();
+	fragmentPositions.reserve(this->getFragmentCount());
+	fragmentData.reserve(this->getFragmentCount());
+
+	for (auto it = m_bricks.begin(); it != m_bricks.end(); it++) {
+		for (int layer = 0; layer < LAYER_COUNT; layer++) {
+			fragmentPositions.insert(fragmentPositions.end(), it->second.positions[layer].begin(), it->second.positions[layer].end());
+			fragmentData.insert(fragmentData.end(), it->second.data[layer].begin(), it->second.data[layer].end());
+		}
+	}
+}
+
+uint32_t IncrementalVoxelizer::getFragmentCount() const {
+	return m_fragmentCount[STATIC_LAYER] + m_fragmentCount[DYNAMIC_LAYER];
+}
+
+uint32_t IncrementalVoxelizer::getStaticFragmentCount() const {
+	return m_fragmentCount[STATIC_LAYER];
+}
+
+uint32_t IncrementalVoxelizer::getBrickCount() const {
+	return (uint32_t)m_bricks.size();
+}
+
+uint32_t IncrementalVoxelizer::getBrickSize() const {
+	return m_brickSize;
+}
+
+uint32_t IncrementalVoxelizer::getLastUpdateBrickCount() const {
+	return m_lastUpdateBrickCount;
+}
+
+dvec3 IncrementalVoxelizer::getGridCenter() const {
+	return m_gridCenter;
+}
+
+void IncrementalVoxelizer::setGridCenter(dvec3 gridCenter) {
+	dvec3 prevOrigin = this->getGridOrigin();
+	m_gridCenter = gridCenter;
+
+	if (this->getGridOrigin() == prevOrigin)
+		return;
+
+	// Every voxel coordinate moved, so everything is voxelized again on the next update
+	m_bricks.clear();
+	m_removedRanges[STATIC_LAYER].clear();
+	m_removedRanges[DYNAMIC_LAYER].clear();
+	m_fragmentCount[STATIC_LAYER] = 0;
+	m_fragmentCount[DYNAMIC_LAYER] = 0;
+
+	for (int i = 0; i < m_meshes.size(); i++) {
+		m_meshes[i].voxelized = false;
+	}
+}
+
+uint32_t IncrementalVoxelizer::getGridSize() const {
+	return m_gridSize;
+}
+
+double IncrementalVoxelizer::getGridScale() const {
+	return m_gridScale;
+}
+
+dvec3 IncrementalVoxelizer::getGridOrigin() const {
+	// Same snapping as VoxelGenerator::updateAxisProjections
+	return floor(m_gridCenter / (m_gridScale * 2)) * (m_gridScale * 2) - dvec3(m_gridSize * m_gridScale * 0.5);
+}
+
+uint32_t IncrementalVoxelizer::getThreadCount() const {
+	return m_threadCount;
+}
+
+void IncrementalVoxelizer::setThreadCount(uint32_t threadCount) {
+	m_threadCount = threadCount;
+}
+
+uint32_t IncrementalVoxelizer::addMesh(const Mesh* mesh, Transformation* transform, dmat4 modelMatrix, const CPUVoxelizerMaterial& material, Layer layer) {
+	assert(mesh != NULL);
+
+	MeshEntry entry;
+	entry.mesh = mesh;
+	entry.transform = transform;
+	entry.modelMatrix = modelMatrix;
+	entry.material = material;
+	entry.localMin = dvec3(+INFINITY);
+	entry.localMax = dvec3(-INFINITY);
+	entry.layer = layer;
+	entry.voxelized = false;
+
+	const std::vector<Mesh::vertex>& vertices = mesh->getVertices();
+	for (int i = 0; i < vertices.size(); i++) {
+		entry.localMin = min(entry.localMin, dvec3(vertices[i].position));
+		entry.localMax = max(entry.localMax, dvec3(vertices[i].position));
+	}
+
+	entry.footprint = this->getFootprint(entry);
+
+	if (transform != NULL) {
+		transform->setChanged(false); // The first update voxelizes the mesh where it is anyway
+	}
+
+	m_meshes.push_back(entry);
+	return (uint32_t)m_meshes.size() - 1;
+}
+
+IncrementalVoxelizer::BrickRange IncrementalVoxelizer::getFootprint(const MeshEntry& entry) const {
+	BrickRange range;
+	range.min = ivec3(0);
+	range.max = ivec3(-1);
+
+	if (any(greaterThan(entry.localMin, entry.localMax)))
+		return range; // No vertices
+
+	dvec3 gridOrigin = this->getGridOrigin();
+	dvec3 boundMin = dvec3(+INFINITY);
+	dvec3 boundMax = dvec3(-INFINITY);
+
+	for (int i = 0; i < 8; i++) {
+		dvec3 corner = dvec3((i & 4) ? entry.localMax.x : entry.localMin.x, (i & 2) ? entry.localMax.y : entry.localMin.y, (i & 1) ? entry.localMax.z : entry.localMin.z);
+		dvec3 gridPosition = (dvec3(entry.modelMatrix * dvec4(corner, 1.0)) - gridOrigin) / m_gridScale;
+		boundMin = min(boundMin, gridPosition);
+		boundMax = max(boundMax, gridPosition);
+	}
+
+	// The voxelizer also accepts voxels that only touch a triangle's bounds
+	dvec3 maxCoord = dvec3(m_gridSize - 1);
+	dvec3 voxelMin = clamp(ceil(boundMin) - 1.0, dvec3(0.0), maxCoord + 1.0);
+	dvec3 voxelMax = clamp(floor(boundMax), dvec3(-1.0), maxCoord);
+
+	if (any(greaterThan(voxelMin, voxelMax)))
+		return range; // Outside the grid
+
+	range.min = ivec3(voxelMin) / (int32_t)m_brickSize;
+	range.max = ivec3(voxelMax) / (int32_t)m_brickSize;
+	return range;
+}
+
+uint32_t IncrementalVoxelizer::rebuildLayer(Layer layer, const std::vector<BrickRange>& dirtyRanges) {
+	std::unordered_set<uint64_t> dirtyBricks;
+
+	for (int i = 0; i < dirtyRanges.size(); i++) {
+		const BrickRange& range = dirtyRanges[i];
+		for (int32_t x = range.min.x; x <= range.max.x; x++) {
+			for (int32_t y = range.min.y; y <= range.max.y; y++) {
+				for (int32_t z = range.min.z; z <= range.max.z; z++) {
+					dirtyBricks.insert(getBrickKey(ivec3(x, y, z)));
+				}
+			}
+		}
+	}
+
+	if (dirtyBricks.empty())
+		return 0;
+
+	for (auto it = dirtyBricks.begin(); it != dirtyBricks.end(); it++) {
+		auto brick = m_bricks.find(*it);
+		if (brick != m_bricks.end()) {
+			m_fragmentCount[layer] -= (uint32_t)brick->second.positions[layer].size();
+			brick->second.positions[layer].clear();
+			brick->second.data[layer].clear();
+		}
+	}
+
+	// Everything of this layer that overlaps a cleared brick has to be put back
+	CPUVoxelizer voxelizer(m_gridSize, m_gridScale);
+	voxelizer.setGridCenter(m_gridCenter);
+	voxelizer.setThreadCount(m_threadCount);
+
+	for (int i = 0; i < m_meshes.size(); i++) {
+		MeshEntry& entry = m_meshes[i];
+		if (entry.mesh == NULL || entry.layer != layer)
+			continue;
+
+		bool overlapsDirty = false;
+		for (int j = 0; j < dirtyRanges.size() && !overlapsDirty; j++) {
+			overlapsDirty = overlaps(entry.footprint, dirtyRanges[j]);
+		}
+
+		if (overlapsDirty) {
+			voxelizer.addMesh(entry.mesh, entry.modelMatrix, entry.material);
+		}
+
+		entry.voxelized = true;
+	}
+
+	voxelizer.voxelize();
+
+	const std::vector<u16vec4>& positions = voxelizer.getFragmentPositions();
+	const std::vector<uvec4>& data = voxelizer.getFragmentData();
+	uint32_t flags = layer == STATIC_LAYER ? CPUOctreeBuilder::STATIC_FLAG_BIT : 0;
+
+	for (size_t i = 0; i < positions.size(); i++) {
+		uint64_t key = getBrickKey(ivec3(uvec3(positions[i])) / (int32_t)m_brickSize);
+		if (dirtyBricks.count(key) == 0)
+			continue; // Belongs to a brick that was left as it was
+
+		Brick& brick = m_bricks[key];
+		brick.positions[layer].push_back(positions[i]);
+		brick.data[layer].push_back(uvec4(data[i].x, data[i].y, data[i].z, flags));
+		++m_fragmentCount[layer];
+	}
+
+	for (auto it = dirtyBricks.begin(); it != dirtyBricks.end(); it++) {
+		auto brick = m_bricks.find(*it);
+		if (brick != m_bricks.end() && brick->second.positions[STATIC_LAYER].empty() && brick->second.positions[DYNAMIC_LAYER].empty()) {
+			m_bricks.erase(brick);
+		}
+	}
+
+	return (uint32_t)dirtyBricks.size();
+}
+
+bool IncrementalVoxelizer::overlaps(const BrickRange& a, const BrickRange& b) {
+	return all(lessThanEqual(a.min, a.max)) && all(lessThanEqual(b.min, b.max)) &&
+		all(lessThanEqual(a.min, b.max)) && all(lessThanEqual(b.min, a.max));
+}
+
+uint64_t IncrementalVoxelizer::getBrickKey(ivec3 brickCoord) {
+	return (uint64_t)brickCoord.x | ((uint64_t)brickCoord.y << 21) | ((uint64_t)brickCoord.z << 42);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "core/pch.h"
+#include "core/voxel/CPUVoxelizer.h"
+#include <unordered_map>
+#include <unordered_set>
+
+class Transformation;
+
+// Keeps the voxel fragments of a scene up to date by only revoxelizing what moved. The grid is split
+// into bricks of brickSize^3 voxels, and every brick keeps its static and dynamic fragments apart.
+// Static meshes are voxelized once, when they are added. Dynamic meshes follow a Transformation, and
+// when its didChange() flag is set the bricks the mesh covered before and covers now are cleared and
+// every dynamic mesh overlapping them is voxelized again, keeping only fragments inside those bricks.
+// The cost of an update is proportional to the moving content rather than to the whole scene.
+// The change flag is consumed, update() clears it after reading it.
+// Static fragments carry CPUOctreeBuilder::STATIC_FLAG_BIT in the unused w component of their data,
+// which the octree builder turns into STATIC_FLAG_BIT on nodes containing only static geometry.
+// Like the rest of the CPU voxelization path, this is not driven by the scene yet. The owner adds the
+// meshes, calls update() once per tick and builds the octree from getFragments(). SceneGraph renders
+// with the GPU voxelizer, and has no CPU octree upload to feed these fragments to.
+class IncrementalVoxelizer : private NotCopyable {
+public:
+	IncrementalVoxelizer(uint32_t gridSize, double gridScale, uint32_t brickSize = 8);
+
+	~IncrementalVoxelizer();
+
+	uint32_t addStaticMesh(const Mesh* mesh, dmat4 modelMatrix, const CPUVoxelizerMaterial& material = CPUVoxelizerMaterial());
+
+	uint32_t addDynamicMesh(const Mesh* mesh, Transformation* transform, const CPUVoxelizerMaterial& material = CPUVoxelizerMaterial());
+
+	bool removeMesh(uint32_t meshHandle);
+
+	void clear();
+
+	uint32_t update();
+
+	void getFragments(std::vector<u16vec4>& fragmentPositions, std::vector<uvec4>& fragmentData) const;
+
+	uint32_t getFragmentCount() const;
+
+	uint32_t getStaticFragmentCount() const;
+
+	uint32_t getBrickCount() const;
+
+	uint32_t getBrickSize() const;
+
+	uint32_t getLastUpdateBrickCount() const;
+
+	dvec3 getGridCenter() const;
+
+	void setGridCenter(dvec3 gridCenter);
+
+	uint32_t getGridSize() const;
+
+	double getGridScale() const;
+
+	dvec3 getGridOrigin() const;
+
+	uint32_t getThreadCount() const;
+
+	void setThreadCount(uint32_t threadCount);
+
+private:
+	enum Layer {
+		STATIC_LAYER = 0,
+		DYNAMIC_LAYER = 1,
+		LAYER_COUNT = 2
+	};
+
+	struct BrickRange {
+		ivec3 min; // Inclusive brick coordinates, empty when any min component exceeds max
+		ivec3 max;
+	};
+
+	struct MeshEntry {
+		const Mesh* mesh; // NULL once removed
+		Transformation* transform; // NULL for static meshes
+		dmat4 modelMatrix; // Transformation the current fragments were voxelized with
+		CPUVoxelizerMaterial material;
+		dvec3 localMin; // Mesh bounds before transformation
+		dvec3 localMax;
+		BrickRange footprint; // Bricks the current fragments may occupy
+		Layer layer;
+		bool voxelized;
+	};
+
+	struct Brick {
+		std::vector<u16vec4> positions[LAYER_COUNT];
+		std::vector<uvec4> data[LAYER_COUNT];
+	};
+
+	uint32_t addMesh(const Mesh* mesh, Transformation* transform, dmat4 modelMatrix, const CPUVoxelizerMaterial& material, Layer layer);
+
+	BrickRange getFootprint(const MeshEntry& entry) const;
+
+	uint32_t rebuildLayer(Layer layer, const std::vector<BrickRange>& dirtyRanges);
+
+	static bool overlaps(const BrickRange& a, const BrickRange& b);
+
+	static uint64_t getBrickKey(ivec3 brickCoord);
+
+	std::vector<MeshEntry> m_meshes;
+	std::unordered_map<uint64_t, Brick> m_bricks;
+	std::vector<BrickRange> m_removedRanges[LAYER_COUNT]; // Footprints of meshes removed since the last update
+
+	dvec3 m_gridCenter;
+	uint32_t m_gridSize;
+	double m_gridScale;
+	uint32_t m_brickSize;
+
+	uint32_t m_fragmentCount[LAYER_COUNT];
+	uint32_t m_lastUpdateBrickCount; // Bricks rebuilt by the last update
+	uint32_t m_threadCount; // 0 uses every thread of the job system
+};
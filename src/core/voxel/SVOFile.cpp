@@ -0,0 +1,390 @@
+#include "SVOFile.h"
+#include "CPUOctreeBuilder.h"
+#include "core/util/FileUtils.h"
+
+struct SubtreeNode {
+	uint32_t source; // Node index in the source octree
+	uint32_t destination; // Node index in the chunk
+	uvec3 origin; // Grid coordinate of the minimum corner of the node
+};
+
+// Copies the subtree below source node rootIndex into its own node array, breadth first so the tiles
+// of each level stay contiguous. Occupied nodes at maxLevel below the root are not descended into,
+// they are added to frontier instead.
+static bool extractSubtree(const std::vector<uint32_t>& srcNodes, const std::vector<uvec4>& srcData, uint32_t rootIndex, uvec3 rootOrigin, uint32_t rootSize, uint32_t maxLevel, std::vector<uint32_t>& dstNodes, std::vector<uvec4>& dstData, std::vector<SubtreeNode>* frontier) {
+	dstNodes.assign(8, 0u);
+	dstData.assign(8, uvec4(0u));
+
+	std::vector<SubtreeNode> level(1);
+	std::vector<SubtreeNode> nextLevel;
+	level[0].source = rootIndex;
+	level[0].destination = 0;
+	level[0].origin = rootOrigin;
+
+	for (uint32_t depth = 0; !level.empty(); depth++) {
+		uint32_t childSize = (rootSize >> depth) >> 1;
+		nextLevel.clear();
+
+		for (int i = 0; i < level.size(); i++) {
+			const SubtreeNode& node = level[i];
+			uint32_t childIndex = srcNodes[node.source];
+			dstData[node.destination] = srcData[node.source];
+
+			if ((childIndex & CPUOctreeBuilder::CHILD_FLAG_BIT) == 0)
+				continue;
+
+			if (depth == maxLevel) {
+				if (frontier != NULL)
+					frontier->push_back(node);
+				continue;
+			}
+
+			uint32_t srcChild = childIndex & CPUOctreeBuilder::CHILD_INDEX_MASK;
+			if ((uint64_t)srcChild + 8 > srcNodes.size()) {
+				error("Octree node %u references child tile %u which is out of range\n", node.source, srcChild / 8);
+				return false;
+			}
+
+			uint32_t dstChild = (uint32_t)dstNodes.size();
+			dstNodes[node.destination] = (childIndex & ~CPUOctreeBuilder::CHILD_INDEX_MASK) | dstChild;
+			dstNodes.resize(dstChild + 8, 0u);
+			dstData.resize(dstChild + 8, uvec4(0u));
+
+			for (uint32_t j = 0; j < 8; j++) {
+				SubtreeNode child;
+				child.source = srcChild + j;
+				child.destination = dstChild + j;
+				child.origin = node.origin + uvec3((j >> 2) & 1, (j >> 1) & 1, j & 1) * childSize;
+				nextLevel.push_back(child);
+			}
+		}
+
+		level.swap(nextLevel);
+	}
+
+	return true;
+}
+
+static void writePadding(FILE* file, uint64_t& offset) {
+	static const uint8_t zeros[SVO_FILE_SECTION_ALIGNMENT] = {};
+	uint64_t padding = (SVO_FILE_SECTION_ALIGNMENT - offset % SVO_FILE_SECTION_ALIGNMENT) % SVO_FILE_SECTION_ALIGNMENT;
+	fwrite(zeros, 1, (size_t)padding, file);
+	offset += padding;
+}
+
+
+
+SVOFile::SVOFile():
+	m_file(NULL) {
+	memset(&m_header, 0, sizeof(SVOFileHeader));
+}
+
+SVOFile::~SVOFile() {
+	this->close();
+}
+
+bool SVOFile::write(std::string filePath, const CPUOctreeBuilder& octree, dvec3 gridCenter, double gridScale, uint32_t subtreeLevel) {
+	return SVOFile::write(filePath, octree.getNodeChildIndices(), octree.getNodeData(), octree.getGridSize(), gridCenter, gridScale, subtreeLevel);
+}
+
+bool SVOFile::write(std::string filePath, const std::vector<uint32_t>& nodeChildIndices, const std::vector<uvec4>& nodeData, uint32_t gridSize, dvec3 gridCenter, double gridScale, uint32_t subtreeLevel) {
+	if (gridSize < 2 || (gridSize & (gridSize - 1)) != 0) {
+		error("Unable to write SVO file \"%s\": Grid size %u is not a power of two\n", filePath.c_str(), gridSize);
+		return false;
+	}
+
+	if (nodeChildIndices.size() < 8 || nodeChildIndices.size() != nodeData.size()) {
+		error("Unable to write SVO file \"%s\": Invalid node buffers\n", filePath.c_str());
+		return false;
+	}
+
+	uint32_t octreeDepth = 0;
+	while ((2u << octreeDepth) <= gridSize) {
+		++octreeDepth;
+	}
+
+	// Same snapping as VoxelGenerator::updateAxisProjections
+	dvec3 gridOrigin = floor(gridCenter / (gridScale * 2)) * (gridScale * 2) - dvec3(gridSize * gridScale * 0.5);
+
+	SVOFileHeader header;
+	memset(&header, 0, sizeof(SVOFileHeader));
+	header.magic = SVO_FILE_MAGIC;
+	header.version = SVO_FILE_VERSION;
+	header.gridSize = gridSize;
+	header.octreeDepth = octreeDepth;
+	header.gridScale = gridScale;
+	header.gridCenter[0] = gridCenter.x;
+	header.gridCenter[1] = gridCenter.y;
+	header.gridCenter[2] = gridCenter.z;
+	header.gridOrigin[0] = gridOrigin.x;
+	header.gridOrigin[1] = gridOrigin.y;
+	header.gridOrigin[2] = gridOrigin.z;
+	header.nodeFormat = SVO_FORMAT_R32UI_CHILD_INDEX;
+	header.albedoFormat = SVO_FORMAT_RGBA8_UNORM;
+	header.normalFormat = SVO_FORMAT_RG16_UNORM_SPHERICAL;
+	header.emissiveFormat = SVO_FORMAT_RGBA8_UNORM;
+	header.subtreeLevel = glm::clamp(subtreeLevel, 1u, octreeDepth);
+
+	std::vector<uint32_t> chunkNodes;
+	std::vector<uvec4> chunkData;
+	std::vector<SubtreeNode> subtreeRoots;
+
+	if (!extractSubtree(nodeChildIndices, nodeData, 0, uvec3(0), gridSize, header.subtreeLevel, chunkNodes, chunkData, &subtreeRoots)) {
+		error("Unable to write SVO file \"%s\": Invalid octree\n", filePath.c_str());
+		return false;
+	}
+
+	header.chunkCount = 1 + (uint32_t)subtreeRoots.size();
+
+	FILE* file = fopen(filePath.c_str(), "wb");
+	if (file == NULL) {
+		error("Unable to write SVO file \"%s\": Failed to open file for writing\n", filePath.c_str());
+		return false;
+	}
+
+	// The chunk table is written last, once every section offset is known
+	std::vector<SVOFileChunkEntry> chunks(header.chunkCount);
+	memset(&chunks[0], 0, sizeof(SVOFileChunkEntry) * chunks.size());
+
+	uint64_t offset = sizeof(SVOFileHeader) + sizeof(SVOFileChunkEntry) * chunks.size();
+	fwrite(&header, sizeof(SVOFileHeader), 1, file);
+	fwrite(&chunks[0], sizeof(SVOFileChunkEntry), chunks.size(), file);
+
+	bool success = true;
+
+	for (uint32_t i = 0; i < header.chunkCount && success; i++) {
+		SVOFileChunkEntry& chunk = chunks[i];
+
+		if (i == 0) {
+			chunk.rootNodeIndex = 0;
+			chunk.size = gridSize;
+		} else {
+			const SubtreeNode& root = subtreeRoots[i - 1];
+			chunk.rootNodeIndex = root.destination;
+			chunk.origin[0] = root.origin.x;
+			chunk.origin[1] = root.origin.y;
+			chunk.origin[2] = root.origin.z;
+			chunk.size = gridSize >> header.subtreeLevel;
+
+			success = extractSubtree(nodeChildIndices, nodeData, root.source, root.origin, chunk.size, UINT32_MAX, chunkNodes, chunkData, NULL);
+		}
+
+		chunk.nodeCount = (uint32_t)chunkNodes.size();
+		header.nodeCount += i == 0 ? chunk.nodeCount : chunk.nodeCount - 8; // readOctree drops the root tile of each subtree
+
+		writePadding(file, offset);
+		chunk.nodeOffset = offset;
+		fwrite(&chunkNodes[0], sizeof(uint32_t), chunkNodes.size(), file);
+		offset += sizeof(uint32_t) * chunkNodes.size();
+
+		writePadding(file, offset);
+		chunk.dataOffset = offset;
+		fwrite(&chunkData[0], sizeof(uvec4), chunkData.size(), file);
+		offset += sizeof(uvec4) * chunkData.size();
+	}
+
+	if (success && fseek64(file, 0, SEEK_SET) == 0) {
+		fwrite(&header, sizeof(SVOFileHeader), 1, file);
+		fwrite(&chunks[0], sizeof(SVOFileChunkEntry), chunks.size(), file);
+	} else {
+		success = false;
+	}
+
+	success = success && ferror(file) == 0;
+	fclose(file);
+
+	if (!success) {
+		error("Unable to write SVO file \"%s\": Failed to write octree data\n", filePath.c_str());
+		return false;
+	}
+
+	info("Wrote SVO file \"%s\" - %u^3 grid, %llu nodes in %u chunks, %.2f MiB\n", filePath.c_str(), gridSize, (unsigned long long)header.nodeCount, header.chunkCount, offset / (1024.0 * 1024.0));
+	return true;
+}
+
+bool SVOFile::open(std::string filePath) {
+	this->close();
+
+	FILE* file = fopen(filePath.c_str(), "rb");
+	if (file == NULL) {
+		error("Unable to open SVO file \"%s\"\n", filePath.c_str());
+		return false;
+	}
+
+	SVOFileHeader header;
+	if (fread(&header, sizeof(SVOFileHeader), 1, file) != 1 || header.magic != SVO_FILE_MAGIC) {
+		error("Unable to open SVO file \"%s\": Invalid header\n", filePath.c_str());
+		fclose(file);
+		return false;
+	}
+
+	if (header.version != SVO_FILE_VERSION) {
+		error("Unable to open SVO file \"%s\": Unsupported version %u\n", filePath.c_str(), header.version);
+		fclose(file);
+		return false;
+	}
+
+	if (header.nodeFormat != SVO_FORMAT_R32UI_CHILD_INDEX || header.albedoFormat != SVO_FORMAT_RGBA8_UNORM ||
+		header.normalFormat != SVO_FORMAT_RG16_UNORM_SPHERICAL || header.emissiveFormat != SVO_FORMAT_RGBA8_UNORM) {
+		error("Unable to open SVO file \"%s\": Unsupported node or attribute format\n", filePath.c_str());
+		fclose(file);
+		return false;
+	}
+
+	std::vector<SVOFileChunkEntry> chunks(header.chunkCount);
+	if (header.chunkCount == 0 || fread(&chunks[0], sizeof(SVOFileChunkEntry), header.chunkCount, file) != header.chunkCount) {
+		error("Unable to open SVO file \"%s\": Truncated chunk table\n", filePath.c_str());
+		fclose(file);
+		return false;
+	}
+
+	m_file = file;
+	m_header = header;
+	m_chunks.swap(chunks);
+	return true;
+}
+
+void SVOFile::close() {
+	std::lock_guard<std::mutex> lock(m_fileMutex);
+	if (m_file != NULL) {
+		fclose(m_file);
+		m_file = NULL;
+	}
+
+	m_chunks.clear();
+}
+
+bool SVOFile::isOpen() const {
+	return m_file != NULL;
+}
+
+bool SVOFile::readChunk(uint32_t chunk, std::vector<uint32_t>& nodeChildIndices, std::vector<uvec4>& nodeData) {
+	if (!this->readChunkNodes(chunk, nodeChildIndices))
+		return false;
+
+	const SVOFileChunkEntry& entry = m_chunks[chunk];
+	nodeData.resize(entry.nodeCount);
+
+	if (!this->readSection(entry.dataOffset, &nodeData[0], sizeof(uvec4) * entry.nodeCount)) {
+		error("Failed to read the attributes of SVO chunk %u\n", chunk);
+		return false;
+	}
+
+	return true;
+}
+
+bool SVOFile::readChunkNodes(uint32_t chunk, std::vector<uint32_t>& nodeChildIndices) {
+	if (chunk >= m_chunks.size()) {
+		return false;
+	}
+
+	const SVOFileChunkEntry& entry = m_chunks[chunk];
+	if (entry.nodeCount < 8) {
+		error("SVO chunk %u is invalid\n", chunk);
+		return false;
+	}
+
+	nodeChildIndices.resize(entry.nodeCount);
+
+	if (!this->readSection(entry.nodeOffset, &nodeChildIndices[0], sizeof(uint32_t) * entry.nodeCount)) {
+		error("Failed to read the nodes of SVO chunk %u\n", chunk);
+		return false;
+	}
+
+	return true;
+}
+
+bool SVOFile::readOctree(std::vector<uint32_t>& nodeChildIndices, std::vector<uvec4>& nodeData) {
+	if (!this->readChunk(0, nodeChildIndices, nodeData))
+		return false;
+
+	if (m_header.nodeCount > (uint64_t)CPUOctreeBuilder::CHILD_INDEX_MASK + 1) {
+		error("Unable to load the SVO with %llu nodes, child indices are limited to 30 bits\n", (unsigned long long)m_header.nodeCount);
+		return false;
+	}
+
+	nodeChildIndices.reserve(m_header.nodeCount);
+	nodeData.reserve(m_header.nodeCount);
+
+	std::vector<uint32_t> chunkNodes;
+	std::vector<uvec4> chunkData;
+
+	for (uint32_t i = 1; i < m_chunks.size(); i++) {
+		if (!this->readChunk(i, chunkNodes, chunkData))
+			return false;
+
+		const SVOFileChunkEntry& entry = m_chunks[i];
+		if (entry.rootNodeIndex >= nodeChildIndices.size()) {
+			error("SVO chunk %u has an invalid root node\n", i);
+			return false;
+		}
+
+		// The chunk root is already in the top chunk, and its unused tile siblings are dropped, so
+		// local node index n ends up at base + n.
+		uint32_t base = (uint32_t)nodeChildIndices.size() - 8;
+
+		for (uint32_t j = 0; j < entry.nodeCount; j++) {
+			uint32_t& childIndex = chunkNodes[j];
+			if ((childIndex & CPUOctreeBuilder::CHILD_FLAG_BIT) != 0) {
+				childIndex = (childIndex & ~CPUOctreeBuilder::CHILD_INDEX_MASK) | ((childIndex & CPUOctreeBuilder::CHILD_INDEX_MASK) + base);
+			}
+		}
+
+		nodeChildIndices[entry.rootNodeIndex] = chunkNodes[0];
+		nodeChildIndices.insert(nodeChildIndices.end(), chunkNodes.begin() + 8, chunkNodes.end());
+		nodeData.insert(nodeData.end(), chunkData.begin() + 8, chunkData.end());
+	}
+
+	return true;
+}
+
+void SVOFile::findChunksNear(dvec3 position, double radius, std::vector<uint32_t>& chunks) const {
+	dvec3 gridOrigin = this->getGridOrigin();
+
+	for (uint32_t i = 1; i < m_chunks.size(); i++) {
+		const SVOFileChunkEntry& entry = m_chunks[i];
+		dvec3 boundMin = gridOrigin + dvec3(entry.origin[0], entry.origin[1], entry.origin[2]) * m_header.gridScale;
+		dvec3 boundMax = boundMin + dvec3(entry.size * m_header.gridScale);
+		dvec3 closest = clamp(position, boundMin, boundMax);
+
+		if (dot(closest - position, closest - position) <= radius * radius) {
+			chunks.push_back(i);
+		}
+	}
+}
+
+const SVOFileHeader& SVOFile::getHeader() const {
+	return m_header;
+}
+
+const SVOFileChunkEntry& SVOFile::getChunk(uint32_t chunk) const {
+	return m_chunks[chunk];
+}
+
+uint32_t SVOFile::getChunkCount() const {
+	return (uint32_t)m_chunks.size();
+}
+
+uint32_t SVOFile::getGridSize() const {
+	return m_header.gridSize;
+}
+
+double SVOFile::getGridScale() const {
+	return m_header.gridScale;
+}
+
+dvec3 SVOFile::getGridCenter() const {
+	return dvec3(m_header.gridCenter[0], m_header.gridCenter[1], m_header.gridCenter[2]);
+}
+
+dvec3 SVOFile::getGridOrigin() const {
+	return dvec3(m_header.gridOrigin[0], m_header.gridOrigin[1], m_header.gridOrigin[2]);
+}
+
+bool SVOFile::readSection(uint64_t offset, void* dst, uint64_t size) {
+	std::lock_guard<std::mutex> lock(m_fileMutex);
+	if (m_file == NULL)
+		return false;
+
+	return fseek64(m_file, offset, SEEK_SET) == 0 && fread(dst, 1, (size_t)size, m_file) == size;
+}
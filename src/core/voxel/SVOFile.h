@@ -0,0 +1,97 @@
+#pragma once
+
+#include "core/pch.h"
+#include <mutex>
+
+class CPUOctreeBuilder;
+
+#define SVO_FILE_MAGIC 0x464F5653 // "SVOF"
+#define SVO_FILE_VERSION 1
+#define SVO_FILE_SECTION_ALIGNMENT 4096 // Sections start on page boundaries so they can be mapped individually
+
+enum SVOAttributeFormat {
+	SVO_FORMAT_NONE = 0,
+	SVO_FORMAT_R32UI_CHILD_INDEX = 1, // CHILD_FLAG_BIT | index of the first child, see CPUOctreeBuilder
+	SVO_FORMAT_RGBA8_UNORM = 2,
+	SVO_FORMAT_RG16_UNORM_SPHERICAL = 3, // encodeNormal from globals.glsl
+};
+
+struct SVOFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t gridSize;
+	uint32_t octreeDepth;
+	double gridScale;
+	double gridCenter[3];
+	double gridOrigin[3]; // World position of the minimum corner of voxel (0, 0, 0)
+	uint32_t nodeFormat;
+	uint32_t albedoFormat; // Node data is four uint32 words per node: albedo, normal, emissive, unused
+	uint32_t normalFormat;
+	uint32_t emissiveFormat;
+	uint32_t subtreeLevel; // Octree level of the subtree chunk roots
+	uint32_t chunkCount; // Including the top chunk
+	uint64_t nodeCount; // Nodes across all chunks
+};
+
+struct SVOFileChunkEntry {
+	uint64_t nodeOffset; // Byte offset of the child index section from the start of the file
+	uint64_t dataOffset; // Byte offset of the attribute section from the start of the file
+	uint32_t nodeCount;
+	uint32_t rootNodeIndex; // Index of the subtree root within the top chunk, 0 for the top chunk itself
+	uint32_t origin[3]; // Grid coordinate of the minimum corner of the subtree
+	uint32_t size; // Voxels along each side of the subtree
+};
+
+// Serialised sparse voxel octree. Chunk 0 is the top of the tree, down to and including the nodes at
+// subtreeLevel. Every occupied node at that level roots a subtree, which is stored as its own chunk.
+// Each chunk is a complete octree in the GPU node layout, with its root at local node 0 and child
+// indices relative to the chunk, so it can be uploaded and traversed by itself. In the top chunk the
+// subtree roots keep their data but have a zero child index; readOctree links the chunks back up.
+// Node (R32UI) and attribute (RGBA32UI) sections are stored separately for every chunk, so a viewer
+// can map only the subtrees near the camera, and skip attributes it does not need.
+class SVOFile : private NotCopyable {
+public:
+	SVOFile();
+
+	~SVOFile();
+
+	static bool write(std::string filePath, const CPUOctreeBuilder& octree, dvec3 gridCenter, double gridScale, uint32_t subtreeLevel = 4);
+
+	static bool write(std::string filePath, const std::vector<uint32_t>& nodeChildIndices, const std::vector<uvec4>& nodeData, uint32_t gridSize, dvec3 gridCenter, double gridScale, uint32_t subtreeLevel = 4);
+
+	bool open(std::string filePath);
+
+	void close();
+
+	bool isOpen() const;
+
+	bool readChunk(uint32_t chunk, std::vector<uint32_t>& nodeChildIndices, std::vector<uvec4>& nodeData);
+
+	bool readChunkNodes(uint32_t chunk, std::vector<uint32_t>& nodeChildIndices);
+
+	bool readOctree(std::vector<uint32_t>& nodeChildIndices, std::vector<uvec4>& nodeData);
+
+	void findChunksNear(dvec3 position, double radius, std::vector<uint32_t>& chunks) const;
+
+	const SVOFileHeader& getHeader() const;
+
+	const SVOFileChunkEntry& getChunk(uint32_t chunk) const;
+
+	uint32_t getChunkCount() const;
+
+	uint32_t getGridSize() const;
+
+	double getGridScale() const;
+
+	dvec3 getGridCenter() const;
+
+	dvec3 getGridOrigin() const;
+
+private:
+	bool readSection(uint64_t offset, void* dst, uint64_t size);
+
+	FILE* m_file;
+	std::mutex m_fileMutex; // Chunks may be streamed in from a loader thread
+	SVOFileHeader m_header;
+	std::vector<SVOFileChunkEntry> m_chunks;
+};
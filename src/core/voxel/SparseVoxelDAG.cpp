@@ -0,0 +1,402 @@
+#include "SparseVoxelDAG.h"
+#include "CPUOctreeBuilder.h"
+#include <unordered_map>
+
+#define CHILD_MASK_WORD 0
+#define SUBTREE_SIZE_WORD 1
+#define CHILD_POINTER_WORD 2
+
+struct DAGNodeKey {
+	uint32_t words[CHILD_POINTER_WORD + 8];
+	uint32_t wordCount;
+
+	bool operator==(const DAGNodeKey& other) const {
+		return wordCount == other.wordCount && memcmp(words, other.words, sizeof(uint32_t) * wordCount) == 0;
+	}
+};
+
+struct DAGNodeKeyHash {
+	size_t operator()(const DAGNodeKey& key) const {
+		uint64_t hash = 14695981039346656037ull; // FNV-1a
+		for (uint32_t i = 0; i < key.wordCount; i++) {
+			hash = (hash ^ key.words[i]) * 1099511628211ull;
+		}
+		return (size_t)hash;
+	}
+};
+
+static bool intersectBox(dvec3 rayOrigin, dvec3 invDirection, dvec3 boxMin, dvec3 boxMax, double& tNear, double& tFar) {
+	dvec3 t0 = (boxMin - rayOrigin) * invDirection;
+	dvec3 t1 = (boxMax - rayOrigin) * invDirection;
+	dvec3 tMin = min(t0, t1);
+	dvec3 tMax = max(t0, t1);
+	tNear = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.0));
+	tFar = glm::min(glm::min(tMax.x, tMax.y), tMax.z);
+	return tNear <= tFar;
+}
+
+
+
+SparseVoxelDAG::SparseVoxelDAG():
+	m_rootIndex(INVALID_NODE),
+	m_nodeCount(0),
+	m_sourceNodeCount(0),
+	m_uncompressedWordCount(0),
+	m_octreeDepth(0),
+	m_gridSize(0) {
+}
+
+SparseVoxelDAG::~SparseVoxelDAG() {
+}
+
+bool SparseVoxelDAG::build(const CPUOctreeBuilder& octree) {
+	return this->build(octree.getNodeChildIndices(), octree.getNodeData(), octree.getGridSize());
+}
+
+bool SparseVoxelDAG::build(const std::vector<uint32_t>& nodeChildIndices, const std::vector<uvec4>& nodeData, uint32_t gridSize) {
+	uint64_t startTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+	this->clear();
+
+	if (gridSize < 4 || (gridSize & (gridSize - 1)) != 0) {
+		error("Unable to build a sparse voxel DAG for a grid of size %u, the size must be a power of two of at least 4\n", gridSize);
+		return false;
+	}
+
+	if (nodeChildIndices.size() < 8 || nodeChildIndices.size() != nodeData.size()) {
+		error("Unable to build a sparse voxel DAG from %llu nodes and %llu node data entries\n", (unsigned long long)nodeChildIndices.size(), (unsigned long long)nodeData.size());
+		return false;
+	}
+
+	m_gridSize = gridSize;
+	while ((2u << m_octreeDepth) <= gridSize) {
+		++m_octreeDepth;
+	}
+
+	if ((nodeChildIndices[0] & CPUOctreeBuilder::CHILD_FLAG_BIT) == 0) {
+		return true; // Empty octree
+	}
+
+	// Gather the occupied nodes of every level above the leaves, and the attributes in depth-first order
+	std::vector<std::vector<uint32_t>> levels(m_octreeDepth - 1);
+	std::vector<std::pair<uint32_t, uint32_t>> stack; // (node, level)
+	stack.push_back(std::make_pair(0u, 0u));
+
+	while (!stack.empty()) {
+		uint32_t node = stack.back().first;
+		uint32_t level = stack.back().second;
+		stack.pop_back();
+
+		m_attributes.push_back(nodeData[node]);
+
+		if (level == m_octreeDepth - 1)
+			continue;
+
+		levels[level].push_back(node);
+
+		uint32_t child = nodeChildIndices[node] & CPUOctreeBuilder::CHILD_INDEX_MASK;
+		if ((uint64_t)child + 8 > nodeChildIndices.size()) {
+			error("Unable to build a sparse voxel DAG, octree node %u references child tile %u which is out of range\n", node, child / 8);
+			this->clear();
+			return false;
+		}
+
+		for (int i = 7; i >= 0; i--) {
+			if ((nodeChildIndices[child + i] & CPUOctreeBuilder::CHILD_FLAG_BIT) != 0) {
+				stack.push_back(std::make_pair(child + i, level + 1));
+			}
+		}
+	}
+
+	// Merge bottom-up. Children are deduplicated before their parents, so identical subtrees end up with
+	// identical child pointers, and comparing a single node's words is enough to find a match.
+	std::unordered_map<uint32_t, uint32_t> dagNodes; // octree node -> DAG node, for the level below
+	std::unordered_map<uint32_t, uint32_t> parentDagNodes;
+	std::unordered_map<DAGNodeKey, uint32_t, DAGNodeKeyHash> uniqueNodes;
+
+	for (int level = (int)m_octreeDepth - 2; level >= 0; level--) {
+		bool hasChildNodes = level < (int)m_octreeDepth - 2;
+		uniqueNodes.clear();
+		parentDagNodes.clear();
+
+		for (int i = 0; i < levels[level].size(); i++) {
+			uint32_t node = levels[level][i];
+			uint32_t child = nodeChildIndices[node] & CPUOctreeBuilder::CHILD_INDEX_MASK;
+
+			DAGNodeKey key;
+			key.words[CHILD_MASK_WORD] = 0;
+			key.words[SUBTREE_SIZE_WORD] = 1;
+			key.wordCount = CHILD_POINTER_WORD;
+
+			for (uint32_t j = 0; j < 8; j++) {
+				if ((nodeChildIndices[child + j] & CPUOctreeBuilder::CHILD_FLAG_BIT) == 0)
+					continue;
+
+				key.words[CHILD_MASK_WORD] |= 1 << j;
+
+				if (hasChildNodes) {
+					uint32_t dagChild = dagNodes[child + j];
+					key.words[key.wordCount++] = dagChild;
+					key.words[SUBTREE_SIZE_WORD] += m_nodes[dagChild + SUBTREE_SIZE_WORD];
+				} else {
+					key.words[SUBTREE_SIZE_WORD] += 1;
+				}
+			}
+
+			m_uncompressedWordCount += key.wordCount;
+
+			auto it = uniqueNodes.find(key);
+			if (it == uniqueNodes.end()) {
+				it = uniqueNodes.insert(std::make_pair(key, (uint32_t)m_nodes.size())).first;
+				m_nodes.insert(m_nodes.end(), key.words, key.words + key.wordCount);
+				++m_nodeCount;
+			}
+
+			parentDagNodes[node] = it->second;
+		}
+
+		m_sourceNodeCount += (uint32_t)levels[level].size();
+		dagNodes.swap(parentDagNodes);
+	}
+
+	m_rootIndex = dagNodes[0];
+
+	uint64_t endTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+	info("Compressed %u octree nodes into %u DAG nodes (%.2f MiB to %.2f MiB, %.2fx, %.2f MiB of attributes), took %.2f msec\n",
+		m_sourceNodeCount, m_nodeCount, (m_uncompressedWordCount * 4) / (1024.0 * 1024.0), (m_nodes.size() * 4) / (1024.0 * 1024.0),
+		this->getCompressionRatio(), (m_attributes.size() * sizeof(uvec4)) / (1024.0 * 1024.0), (endTime - startTime) / 1000000.0);
+	return true;
+}
+
+void SparseVoxelDAG::clear() {
+	m_nodes.clear();
+	m_attributes.clear();
+	m_rootIndex = INVALID_NODE;
+	m_nodeCount = 0;
+	m_sourceNodeCount = 0;
+	m_uncompressedWordCount = 0;
+	m_octreeDepth = 0;
+	m_gridSize = 0;
+}
+
+bool SparseVoxelDAG::raycast(dvec3 rayOrigin, dvec3 rayDirection, double maxDistance, uint32_t maxLevel, RayHit& hit) const {
+	if (m_rootIndex == INVALID_NODE)
+		return false;
+
+	maxLevel = glm::min(maxLevel, m_octreeDepth - 1);
+
+	dvec3 invDirection;
+	uint32_t directionMask = 0; // Octant bits the ray travels against
+	for (int i = 0; i < 3; i++) {
+		double d = rayDirection[i] != 0.0 ? rayDirection[i] : 1e-30;
+		invDirection[i] = 1.0 / d;
+		if (d < 0.0) {
+			directionMask |= 4 >> i;
+		}
+	}
+
+	StackEntry root;
+	root.node = m_rootIndex;
+	root.attributeIndex = 0;
+	root.position = uvec3(0);
+	root.level = 0;
+
+	double tFar;
+	if (!intersectBox(rayOrigin, invDirection, dvec3(0.0), dvec3(m_gridSize), root.distance, tFar) || root.distance > maxDistance)
+		return false;
+
+	// Depth first, with the children of each node pushed so they pop front to back. Flipping the octant
+	// bits the ray travels against makes increasing index order a valid front to back order, so the
+	// first voxel reached is the closest one.
+	StackEntry stack[32 * 8]; // At most 7 pending siblings per level
+	uint32_t stackSize = 0;
+	stack[stackSize++] = root;
+
+	uint32_t childNodes[8];
+	uint32_t childAttributes[8];
+
+	while (stackSize > 0) {
+		StackEntry entry = stack[--stackSize];
+
+		if (entry.level == maxLevel) {
+			hit.voxel.position = entry.position;
+			hit.voxel.level = entry.level;
+			hit.voxel.attributeIndex = entry.attributeIndex;
+			hit.distance = entry.distance;
+			return true;
+		}
+
+		uint32_t childMask = this->getChildren(entry, childNodes, childAttributes);
+		double childSize = (double)(m_gridSize >> (entry.level + 1));
+
+		for (int i = 7; i >= 0; i--) {
+			uint32_t octant = i ^ directionMask;
+			if ((childMask & (1 << octant)) == 0)
+				continue;
+
+			StackEntry child;
+			child.node = childNodes[octant];
+			child.attributeIndex = childAttributes[octant];
+			child.position = entry.position * 2u + uvec3((octant >> 2) & 1, (octant >> 1) & 1, octant & 1);
+			child.level = entry.level + 1;
+
+			dvec3 boxMin = dvec3(child.position) * childSize;
+			if (!intersectBox(rayOrigin, invDirection, boxMin, boxMin + childSize, child.distance, tFar) || child.distance > maxDistance)
+				continue;
+
+			stack[stackSize++] = child;
+		}
+	}
+
+	return false;
+}
+
+bool SparseVoxelDAG::lookup(uvec3 gridPosition, uint32_t level, Voxel& voxel) const {
+	if (m_rootIndex == INVALID_NODE || any(greaterThanEqual(gridPosition, uvec3(m_gridSize))))
+		return false;
+
+	level = glm::min(level, m_octreeDepth - 1);
+
+	StackEntry entry;
+	entry.node = m_rootIndex;
+	entry.attributeIndex = 0;
+	entry.position = uvec3(0);
+	entry.level = 0;
+
+	uint32_t childNodes[8];
+	uint32_t childAttributes[8];
+
+	while (entry.level < level) {
+		uint32_t childMask = this->getChildren(entry, childNodes, childAttributes);
+		uint32_t shift = m_octreeDepth - entry.level - 1;
+		uvec3 bit = (gridPosition >> shift) & 1u;
+		uint32_t octant = (bit.x << 2) | (bit.y << 1) | bit.z;
+
+		if ((childMask & (1 << octant)) == 0)
+			return false;
+
+		entry.node = childNodes[octant];
+		entry.attributeIndex = childAttributes[octant];
+		entry.position = entry.position * 2u + bit;
+		entry.level++;
+	}
+
+	voxel.position = entry.position;
+	voxel.level = entry.level;
+	voxel.attributeIndex = entry.attributeIndex;
+	return true;
+}
+
+void SparseVoxelDAG::getLevelVoxels(uint32_t level, std::vector<Voxel>& voxels) const {
+	if (m_rootIndex == INVALID_NODE)
+		return;
+
+	level = glm::min(level, m_octreeDepth - 1);
+
+	std::vector<StackEntry> stack;
+	StackEntry root;
+	root.node = m_rootIndex;
+	root.attributeIndex = 0;
+	root.position = uvec3(0);
+	root.level = 0;
+	root.distance = 0.0;
+	stack.push_back(root);
+
+	uint32_t childNodes[8];
+	uint32_t childAttributes[8];
+
+	while (!stack.empty()) {
+		StackEntry entry = stack.back();
+		stack.pop_back();
+
+		if (entry.level == level) {
+			Voxel voxel;
+			voxel.position = entry.position;
+			voxel.level = entry.level;
+			voxel.attributeIndex = entry.attributeIndex;
+			voxels.push_back(voxel);
+			continue;
+		}
+
+		uint32_t childMask = this->getChildren(entry, childNodes, childAttributes);
+
+		for (int i = 7; i >= 0; i--) {
+			if ((childMask & (1 << i)) == 0)
+				continue;
+
+			StackEntry child = entry;
+			child.node = childNodes[i];
+			child.attributeIndex = childAttributes[i];
+			child.position = entry.position * 2u + uvec3((i >> 2) & 1, (i >> 1) & 1, i & 1);
+			child.level = entry.level + 1;
+			stack.push_back(child);
+		}
+	}
+}
+
+const std::vector<uint32_t>& SparseVoxelDAG::getNodes() const {
+	return m_nodes;
+}
+
+const std::vector<uvec4>& SparseVoxelDAG::getAttributes() const {
+	return m_attributes;
+}
+
+uvec4 SparseVoxelDAG::getAttribute(uint32_t attributeIndex) const {
+	if (attributeIndex >= m_attributes.size())
+		return uvec4(0);
+
+	return m_attributes[attributeIndex];
+}
+
+uint32_t SparseVoxelDAG::getRootIndex() const {
+	return m_rootIndex;
+}
+
+uint32_t SparseVoxelDAG::getNodeCount() const {
+	return m_nodeCount;
+}
+
+uint32_t SparseVoxelDAG::getSourceNodeCount() const {
+	return m_sourceNodeCount;
+}
+
+double SparseVoxelDAG::getCompressionRatio() const {
+	if (m_nodes.empty())
+		return 1.0;
+
+	return (double)m_uncompressedWordCount / (double)m_nodes.size();
+}
+
+uint32_t SparseVoxelDAG::getOctreeDepth() const {
+	return m_octreeDepth;
+}
+
+uint32_t SparseVoxelDAG::getGridSize() const {
+	return m_gridSize;
+}
+
+uint32_t SparseVoxelDAG::getChildren(const StackEntry& entry, uint32_t childNodes[8], uint32_t childAttributes[8]) const {
+	// Leaf children (one level below the deepest DAG nodes) have no node or child words
+	bool hasChildNodes = entry.level + 2 < m_octreeDepth;
+	uint32_t childMask = m_nodes[entry.node + CHILD_MASK_WORD];
+	uint32_t pointer = entry.node + CHILD_POINTER_WORD;
+	uint32_t attributeIndex = entry.attributeIndex + 1;
+
+	for (uint32_t i = 0; i < 8; i++) {
+		if ((childMask & (1 << i)) == 0)
+			continue;
+
+		childAttributes[i] = attributeIndex;
+
+		if (hasChildNodes) {
+			childNodes[i] = m_nodes[pointer++];
+			attributeIndex += m_nodes[childNodes[i] + SUBTREE_SIZE_WORD];
+		} else {
+			childNodes[i] = INVALID_NODE;
+			attributeIndex += 1;
+		}
+	}
+
+	return childMask;
+}
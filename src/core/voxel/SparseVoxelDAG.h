@@ -0,0 +1,88 @@
+#pragma once
+
+#include "core/pch.h"
+
+class CPUOctreeBuilder;
+
+// Sparse voxel DAG (Kampe et al. 2013) built from the GPU octree layout. The geometry of the octree is
+// rebuilt bottom-up, and every subtree that is identical to one already emitted on its level is
+// replaced by a pointer to it, so repeated structure is only stored once.
+// Each DAG node is a run of words in a single buffer:
+//  - word 0 is the 8-bit mask of occupied children, ordered by octant (x << 2) | (y << 1) | z.
+//  - word 1 is the number of occupied octree nodes in the subtree, including the node itself.
+//  - one word per occupied child follows, the index of the child node. Nodes one level above the
+//    leaves have no child words, their occupied children are leaf voxels.
+// A shared node cannot hold per-node attributes, so they are stored separately, one entry per octree
+// node in depth-first order. Traversal recovers the attribute index of a child by adding the subtree
+// sizes of the siblings before it (Dado et al. 2016).
+// Positions are in grid space: the root spans [0, gridSize]^3, and a node on level L is gridSize >> L
+// voxels wide. The leaf level is octreeDepth - 1, matching the data-holding nodes of the octree.
+class SparseVoxelDAG : private NotCopyable {
+public:
+	static const uint32_t INVALID_NODE = 0xFFFFFFFF;
+
+	struct Voxel {
+		uvec3 position; // Node coordinate on its level, grid position divided by the node size
+		uint32_t level;
+		uint32_t attributeIndex;
+	};
+
+	struct RayHit {
+		Voxel voxel;
+		double distance; // Ray parameter where the ray enters the voxel
+	};
+
+	SparseVoxelDAG();
+
+	~SparseVoxelDAG();
+
+	bool build(const CPUOctreeBuilder& octree);
+
+	bool build(const std::vector<uint32_t>& nodeChildIndices, const std::vector<uvec4>& nodeData, uint32_t gridSize);
+
+	void clear();
+
+	bool raycast(dvec3 rayOrigin, dvec3 rayDirection, double maxDistance, uint32_t maxLevel, RayHit& hit) const;
+
+	bool lookup(uvec3 gridPosition, uint32_t level, Voxel& voxel) const;
+
+	void getLevelVoxels(uint32_t level, std::vector<Voxel>& voxels) const;
+
+	const std::vector<uint32_t>& getNodes() const;
+
+	const std::vector<uvec4>& getAttributes() const;
+
+	uvec4 getAttribute(uint32_t attributeIndex) const;
+
+	uint32_t getRootIndex() const;
+
+	uint32_t getNodeCount() const;
+
+	uint32_t getSourceNodeCount() const;
+
+	double getCompressionRatio() const;
+
+	uint32_t getOctreeDepth() const;
+
+	uint32_t getGridSize() const;
+
+private:
+	struct StackEntry {
+		uint32_t node;
+		uint32_t attributeIndex;
+		uvec3 position;
+		uint32_t level;
+		double distance;
+	};
+
+	uint32_t getChildren(const StackEntry& entry, uint32_t childNodes[8], uint32_t childAttributes[8]) const;
+
+	std::vector<uint32_t> m_nodes;
+	std::vector<uvec4> m_attributes; // Depth-first order, parallel to the traversal
+	uint32_t m_rootIndex;
+	uint32_t m_nodeCount; // Number of unique DAG nodes
+	uint32_t m_sourceNodeCount; // Occupied octree nodes above the leaf level
+	uint64_t m_uncompressedWordCount; // Words the same encoding uses without merging subtrees
+	uint32_t m_octreeDepth;
+	uint32_t m_gridSize;
+};
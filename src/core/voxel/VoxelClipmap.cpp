@@ -0,0 +1,461 @@
+#include "VoxelClipmap.h"
+#include "core/renderer/geometry/Mesh.h"
+
+VoxelClipmap::VoxelClipmap(uint32_t levelCount, uint32_t levelSize, double baseScale):
+	m_center(0.0),
+	m_levelSize(levelSize),
+	m_baseScale(baseScale),
+	m_updateBudget(0),
+	m_lastUpdateVoxelCount(0),
+	m_threadCount(0) {
+	assert(levelCount > 0);
+
+	m_levels.resize(levelCount);
+	for (uint32_t i = 0; i < levelCount; i++) {
+		m_levels[i].scale = baseScale * (double)(1u << i);
+		m_levels[i].memoryBudget = 0;
+		this->resizeLevel(i);
+	}
+
+	this->setCenter(m_center);
+}
+
+VoxelClipmap::~VoxelClipmap() {
+}
+
+uint32_t VoxelClipmap::addMesh(const Mesh* mesh, dmat4 modelMatrix, const CPUVoxelizerMaterial& material) {
+	assert(mesh != NULL);
+
+	MeshEntry entry;
+	entry.mesh = mesh;
+	entry.modelMatrix = modelMatrix;
+	entry.material = material;
+	entry.boundMin = dvec3(+INFINITY);
+	entry.boundMax = dvec3(-INFINITY);
+
+	const std::vector<Mesh::vertex>& vertices = mesh->getVertices();
+	for (int i = 0; i < vertices.size(); i++) {
+		dvec3 position = dvec3(modelMatrix * dvec4(dvec3(vertices[i].position), 1.0));
+		entry.boundMin = min(entry.boundMin, position);
+		entry.boundMax = max(entry.boundMax, position);
+	}
+
+	this->invalidateBounds(entry.boundMin, entry.boundMax);
+
+	m_meshes.push_back(entry);
+	return (uint32_t)m_meshes.size() - 1;
+}
+
+bool VoxelClipmap::removeMesh(uint32_t meshHandle) {
+	if (meshHandle >= m_meshes.size() || m_meshes[meshHandle].mesh == NULL)
+		return false;
+
+	MeshEntry& entry = m_meshes[meshHandle];
+	entry.mesh = NULL;
+	this->invalidateBounds(entry.boundMin, entry.boundMax);
+	return true;
+}
+
+void VoxelClipmap::clearMeshes() {
+	for (int i = 0; i < m_meshes.size(); i++) {
+		if (m_meshes[i].mesh != NULL) {
+			this->invalidateBounds(m_meshes[i].boundMin, m_meshes[i].boundMax);
+		}
+	}
+
+	m_meshes.clear();
+}
+
+uint64_t VoxelClipmap::update() {
+	uint64_t remainingBudget = m_updateBudget != 0 ? m_updateBudget : UINT64_MAX;
+	m_lastUpdateVoxelCount = 0;
+
+	// Finest level first, it covers what is closest to the camera
+	for (uint32_t i = 0; i < m_levels.size(); i++) {
+		std::vector<ClipmapSlab>& pendingSlabs = m_levels[i].pendingSlabs;
+
+		while (!pendingSlabs.empty()) {
+			ClipmapSlab& slab = pendingSlabs.back();
+			uint64_t voxelCount = getSlabVoxelCount(slab);
+
+			if (voxelCount <= remainingBudget) {
+				ClipmapSlab completeSlab = slab;
+				pendingSlabs.pop_back();
+
+				this->voxelizeSlab(completeSlab);
+				m_lastUpdateVoxelCount += voxelCount;
+				remainingBudget -= voxelCount;
+				continue;
+			}
+
+			// Too large for what is left of the budget, split off as many whole layers along the longest
+			// axis as fit. At least one layer is done per update, so a tiny budget still makes progress.
+			ivec3 extent = slab.max - slab.min;
+			int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+			uint64_t layerVoxelCount = voxelCount / (uint64_t)extent[axis];
+			uint64_t layerCount = remainingBudget / layerVoxelCount;
+
+			if (layerCount == 0) {
+				if (m_lastUpdateVoxelCount != 0)
+					return m_lastUpdateVoxelCount;
+				layerCount = 1;
+			}
+
+			ClipmapSlab partialSlab = slab;
+			partialSlab.max[axis] = slab.min[axis] + (int32_t)layerCount;
+			slab.min[axis] = partialSlab.max[axis];
+
+			this->voxelizeSlab(partialSlab);
+			m_lastUpdateVoxelCount += layerCount * layerVoxelCount;
+			return m_lastUpdateVoxelCount;
+		}
+	}
+
+	return m_lastUpdateVoxelCount;
+}
+
+uvec4 VoxelClipmap::getVoxel(uint32_t level, ivec3 voxelCoord) const {
+	assert(level < m_levels.size());
+	const Level& clipmapLevel = m_levels[level];
+
+	if (any(lessThan(voxelCoord, clipmapLevel.origin)) || any(greaterThanEqual(voxelCoord, clipmapLevel.origin + ivec3(clipmapLevel.size))))
+		return uvec4(0); // Outside the level
+
+	return clipmapLevel.data[getVoxelIndex(voxelCoord, clipmapLevel.size)];
+}
+
+const std::vector<uvec4>& VoxelClipmap::getLevelData(uint32_t level) const {
+	assert(level < m_levels.size());
+	return m_levels[level].data;
+}
+
+const std::vector<ClipmapSlab>& VoxelClipmap::getPendingSlabs(uint32_t level) const {
+	assert(level < m_levels.size());
+	return m_levels[level].pendingSlabs;
+}
+
+uint64_t VoxelClipmap::getPendingVoxelCount(uint32_t level) const {
+	assert(level < m_levels.size());
+
+	uint64_t voxelCount = 0;
+	for (int i = 0; i < m_levels[level].pendingSlabs.size(); i++) {
+		voxelCount += getSlabVoxelCount(m_levels[level].pendingSlabs[i]);
+	}
+
+	return voxelCount;
+}
+
+bool VoxelClipmap::isLevelComplete(uint32_t level) const {
+	assert(level < m_levels.size());
+	return m_levels[level].pendingSlabs.empty();
+}
+
+dvec3 VoxelClipmap::getCenter() const {
+	return m_center;
+}
+
+void VoxelClipmap::setCenter(dvec3 center) {
+	m_center = center;
+
+	for (uint32_t i = 0; i < m_levels.size(); i++) {
+		Level& level = m_levels[i];
+		ivec3 origin = getLevelOrigin(center, level.scale, level.size);
+
+		if (level.valid && origin == level.origin)
+			continue;
+
+		std::vector<ClipmapSlab> exposedSlabs;
+
+		if (!level.valid) {
+			level.pendingSlabs.clear();
+			ClipmapSlab slab;
+			slab.level = i;
+			slab.min = origin;
+			slab.max = origin + ivec3(level.size);
+			exposedSlabs.push_back(slab);
+		} else {
+			// Pending work that scrolled out of the level is dropped, the rest still has to be done
+			for (int j = (int)level.pendingSlabs.size() - 1; j >= 0; j--) {
+				if (!clipSlab(level.pendingSlabs[j], origin, origin + ivec3(level.size))) {
+					level.pendingSlabs.erase(level.pendingSlabs.begin() + j);
+				}
+			}
+
+			getExposedSlabs(i, level.origin, origin, level.size, exposedSlabs);
+		}
+
+		level.origin = origin;
+		level.valid = true;
+
+		// The exposed voxels still hold what scrolled out on the opposite side, clear them right away
+		// so nothing stale is visible while they are pending.
+		for (int j = 0; j < exposedSlabs.size(); j++) {
+			const ClipmapSlab& slab = exposedSlabs[j];
+			this->clearSlab(slab);
+			level.pendingSlabs.push_back(slab);
+		}
+	}
+}
+
+uint32_t VoxelClipmap::getLevelCount() const {
+	return (uint32_t)m_levels.size();
+}
+
+uint32_t VoxelClipmap::getLevelSize(uint32_t level) const {
+	assert(level < m_levels.size());
+	return m_levels[level].size;
+}
+
+double VoxelClipmap::getLevelScale(uint32_t level) const {
+	assert(level < m_levels.size());
+	return m_levels[level].scale;
+}
+
+ivec3 VoxelClipmap::getLevelOrigin(uint32_t level) const {
+	assert(level < m_levels.size());
+	return m_levels[level].origin;
+}
+
+dvec3 VoxelClipmap::getLevelWorldOrigin(uint32_t level) const {
+	assert(level < m_levels.size());
+	return dvec3(m_levels[level].origin) * m_levels[level].scale;
+}
+
+uint64_t VoxelClipmap::getLevelMemoryUsage(uint32_t level) const {
+	assert(level < m_levels.size());
+	return (uint64_t)m_levels[level].data.size() * sizeof(uvec4);
+}
+
+uint64_t VoxelClipmap::getLevelMemoryBudget(uint32_t level) const {
+	assert(level < m_levels.size());
+	return m_levels[level].memoryBudget;
+}
+
+void VoxelClipmap::setLevelMemoryBudget(uint32_t level, uint64_t memoryBudget) {
+	assert(level < m_levels.size());
+	m_levels[level].memoryBudget = memoryBudget;
+
+	if (getBudgetedLevelSize(m_levelSize, memoryBudget) != m_levels[level].size) {
+		this->resizeLevel(level);
+		this->setCenter(m_center);
+	}
+}
+
+uint64_t VoxelClipmap::getUpdateBudget() const {
+	return m_updateBudget;
+}
+
+void VoxelClipmap::setUpdateBudget(uint64_t updateBudget) {
+	m_updateBudget = updateBudget;
+}
+
+uint64_t VoxelClipmap::getLastUpdateVoxelCount() const {
+	return m_lastUpdateVoxelCount;
+}
+
+uint32_t VoxelClipmap::getThreadCount() const {
+	return m_threadCount;
+}
+
+void VoxelClipmap::setThreadCount(uint32_t threadCount) {
+	m_threadCount = threadCount;
+}
+
+ivec3 VoxelClipmap::getLevelOrigin(dvec3 center, double levelScale, uint32_t levelSize) {
+	// Same snapping as VoxelGenerator::updateAxisProjections, the centre moves in steps of two voxels,
+	// which is one voxel of the next level, so the levels stay aligned with each other.
+	return ivec3(floor(center / (levelScale * 2))) * 2 - ivec3(levelSize / 2);
+}
+
+ivec3 VoxelClipmap::getToroidalCoord(ivec3 voxelCoord, uint32_t levelSize) {
+	ivec3 size = ivec3(levelSize);
+	return ((voxelCoord % size) + size) % size;
+}
+
+void VoxelClipmap::getExposedSlabs(uint32_t level, ivec3 prevOrigin, ivec3 origin, uint32_t levelSize, std::vector<ClipmapSlab>& slabs) {
+	ClipmapSlab remaining;
+	remaining.level = level;
+	remaining.min = origin;
+	remaining.max = origin + ivec3(levelSize);
+
+	if (any(greaterThanEqual(abs(origin - prevOrigin), ivec3(levelSize)))) {
+		slabs.push_back(remaining); // Moved further than the level is wide, nothing carries over
+		return;
+	}
+
+	// Cut one slab off per axis that moved, and shrink what is left to the part the previous volume
+	// also covered on that axis, so the slabs do not overlap and together cover exactly what is new.
+	for (int axis = 0; axis < 3; axis++) {
+		int32_t delta = origin[axis] - prevOrigin[axis];
+		if (delta == 0)
+			continue;
+
+		ClipmapSlab slab = remaining;
+		if (delta > 0) {
+			slab.min[axis] = prevOrigin[axis] + (int32_t)levelSize;
+			remaining.max[axis] = slab.min[axis];
+		} else {
+			slab.max[axis] = prevOrigin[axis];
+			remaining.min[axis] = slab.max[axis];
+		}
+
+		slabs.push_back(slab);
+	}
+}
+
+bool VoxelClipmap::clipSlab(ClipmapSlab& slab, ivec3 boundMin, ivec3 boundMax) {
+	slab.min = max(slab.min, boundMin);
+	slab.max = min(slab.max, boundMax);
+	return all(lessThan(slab.min, slab.max));
+}
+
+size_t VoxelClipmap::getVoxelIndex(ivec3 voxelCoord, uint32_t levelSize) {
+	ivec3 texel = getToroidalCoord(voxelCoord, levelSize);
+	return ((size_t)texel.z * levelSize + texel.y) * levelSize + texel.x;
+}
+
+uint64_t VoxelClipmap::getSlabVoxelCount(const ClipmapSlab& slab) {
+	if (any(greaterThanEqual(slab.min, slab.max)))
+		return 0;
+
+	ivec3 extent = slab.max - slab.min;
+	return (uint64_t)extent.x * (uint64_t)extent.y * (uint64_t)extent.z;
+}
+
+void VoxelClipmap::resizeLevel(uint32_t level) {
+	Level& clipmapLevel = m_levels[level];
+	clipmapLevel.size = getBudgetedLevelSize(m_levelSize, clipmapLevel.memoryBudget);
+	clipmapLevel.origin = ivec3(0);
+	clipmapLevel.valid = false;
+	clipmapLevel.pendingSlabs.clear();
+	clipmapLevel.data.clear();
+	clipmapLevel.data.shrink_to_fit();
+	clipmapLevel.data.resize((size_t)clipmapLevel.size * clipmapLevel.size * clipmapLevel.size, uvec4(0));
+}
+
+void VoxelClipmap::invalidateBounds(dvec3 boundMin, dvec3 boundMax) {
+	if (any(greaterThan(boundMin, boundMax)))
+		return; // No vertices
+
+	for (uint32_t i = 0; i < m_levels.size(); i++) {
+		Level& level = m_levels[i];
+
+		// The voxelizer also accepts voxels that only touch the bounds
+		ClipmapSlab slab;
+		slab.level = i;
+		slab.min = ivec3(ceil(boundMin / level.scale)) - 1;
+		slab.max = ivec3(floor(boundMax / level.scale)) + 1;
+
+		if (!clipSlab(slab, level.origin, level.origin + ivec3(level.size)))
+			continue;
+
+		bool pending = false; // Already covered by pending work, e.g. the whole level after it was placed
+		for (int j = 0; j < level.pendingSlabs.size() && !pending; j++) {
+			const ClipmapSlab& pendingSlab = level.pendingSlabs[j];
+			pending = all(greaterThanEqual(slab.min, pendingSlab.min)) && all(lessThanEqual(slab.max, pendingSlab.max));
+		}
+
+		if (!pending) {
+			level.pendingSlabs.push_back(slab);
+		}
+	}
+}
+
+void VoxelClipmap::clearSlab(const ClipmapSlab& slab) {
+	Level& level = m_levels[slab.level];
+
+	for (int32_t z = slab.min.z; z < slab.max.z; z++) {
+		for (int32_t y = slab.min.y; y < slab.max.y; y++) {
+			for (int32_t x = slab.min.x; x < slab.max.x; x++) {
+				level.data[getVoxelIndex(ivec3(x, y, z), level.size)] = uvec4(0);
+			}
+		}
+	}
+}
+
+void VoxelClipmap::voxelizeSlab(const ClipmapSlab& slab) {
+	Level& level = m_levels[slab.level];
+	this->clearSlab(slab);
+
+	// The CPU voxelizer works on a cubic grid snapped like VoxelGenerator's, so pick a grid that is large
+	// enough to contain the slab and whose snapped origin lands on (or one voxel below) the slab's minimum.
+	ivec3 extent = slab.max - slab.min;
+	uint32_t gridSize = 2;
+	while (gridSize < (uint32_t)glm::max(extent.x, glm::max(extent.y, extent.z)) + 1) {
+		gridSize <<= 1;
+	}
+
+	int32_t halfGridSize = (int32_t)gridSize / 2;
+	ivec3 gridStart = slab.min - ((slab.min + halfGridSize) & 1);
+	dvec3 slabWorldMin = dvec3(slab.min) * level.scale;
+	dvec3 slabWorldMax = dvec3(slab.max) * level.scale;
+
+	CPUVoxelizer voxelizer(gridSize, level.scale);
+	voxelizer.setGridCenter((dvec3(gridStart + halfGridSize) + 0.5) * level.scale);
+	voxelizer.setThreadCount(m_threadCount);
+
+	for (int i = 0; i < m_meshes.size(); i++) {
+		const MeshEntry& entry = m_meshes[i];
+		if (entry.mesh == NULL)
+			continue;
+
+		if (any(greaterThan(entry.boundMin, slabWorldMax + level.scale)) || any(lessThan(entry.boundMax, slabWorldMin - level.scale)))
+			continue; // Nowhere near the slab
+
+		voxelizer.addMesh(entry.mesh, entry.modelMatrix, entry.material);
+	}
+
+	if (voxelizer.getTriangleCount() == 0)
+		return;
+
+	voxelizer.voxelize();
+
+	const std::vector<u16vec4>& positions = voxelizer.getFragmentPositions();
+	const std::vector<uvec4>& data = voxelizer.getFragmentData();
+
+	// Group the fragments by voxel, a voxel touched by several triangles gets their average, like the
+	// octree leaves in CPUOctreeBuilder.
+	std::vector<std::pair<size_t, uint32_t>> voxelFragments;
+	voxelFragments.reserve(positions.size());
+
+	for (uint32_t i = 0; i < positions.size(); i++) {
+		ivec3 voxelCoord = gridStart + ivec3(uvec3(positions[i]));
+		if (any(lessThan(voxelCoord, slab.min)) || any(greaterThanEqual(voxelCoord, slab.max)))
+			continue; // Outside the slab, this voxel is either up to date or pending in another slab
+
+		voxelFragments.push_back(std::make_pair(getVoxelIndex(voxelCoord, level.size), i));
+	}
+
+	std::sort(voxelFragments.begin(), voxelFragments.end());
+
+	for (size_t i = 0; i < voxelFragments.size();) {
+		size_t voxelIndex = voxelFragments[i].first;
+		vec4 albedo = vec4(0.0F);
+		vec2 normal = vec2(0.0F);
+		vec4 emissive = vec4(0.0F);
+		uint32_t fragmentCount = 0;
+
+		for (; i < voxelFragments.size() && voxelFragments[i].first == voxelIndex; i++, fragmentCount++) {
+			const uvec4& fragmentData = data[voxelFragments[i].second];
+			albedo += unpackUnorm4x8(fragmentData.x);
+			normal += unpackUnorm2x16(fragmentData.y);
+			emissive += unpackUnorm4x8(fragmentData.z);
+		}
+
+		float invCount = 1.0F / fragmentCount;
+		level.data[voxelIndex] = uvec4(packUnorm4x8(albedo * invCount), packUnorm2x16(normal * invCount), packUnorm4x8(emissive * invCount), fragmentCount);
+	}
+}
+
+uint32_t VoxelClipmap::getBudgetedLevelSize(uint32_t requestedSize, uint64_t memoryBudget) {
+	uint32_t size = 2;
+	while (size * 2 <= requestedSize) {
+		size <<= 1;
+	}
+
+	while (memoryBudget != 0 && size > 2 && (uint64_t)size * size * size * sizeof(uvec4) > memoryBudget) {
+		size >>= 1;
+	}
+
+	return size;
+}
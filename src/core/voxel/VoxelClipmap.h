@@ -0,0 +1,126 @@
+#pragma once
+
+#include "core/pch.h"
+#include "core/voxel/CPUVoxelizer.h"
+
+// Box of voxels on one clipmap level that has to be voxelized again. Coordinates are on the level's
+// lattice, voxel (x, y, z) spans [x, x + 1] * levelScale in world space.
+struct ClipmapSlab {
+	uint32_t level;
+	ivec3 min; // Inclusive
+	ivec3 max; // Exclusive
+};
+
+// Nested voxel volumes centred on the camera. Level 0 has the finest voxels, and every level doubles
+// the voxel scale of the one below it, so a handful of small dense volumes covers a large view range.
+// Voxels are addressed toroidally, world voxel v of a level lives at v mod levelSize, so when the
+// centre moves only the slabs that were newly exposed are voxelized, everything else stays in place.
+// Every level has a memory budget that limits its resolution, and update() only voxelizes up to the
+// update budget worth of voxels per call, finest level first, leaving the rest pending for later calls.
+// Voxels hold the same packed data as the octree nodes, w is non-zero for occupied voxels.
+class VoxelClipmap : private NotCopyable {
+public:
+	VoxelClipmap(uint32_t levelCount, uint32_t levelSize, double baseScale);
+
+	~VoxelClipmap();
+
+	uint32_t addMesh(const Mesh* mesh, dmat4 modelMatrix, const CPUVoxelizerMaterial& material = CPUVoxelizerMaterial());
+
+	bool removeMesh(uint32_t meshHandle);
+
+	void clearMeshes();
+
+	uint64_t update();
+
+	uvec4 getVoxel(uint32_t level, ivec3 voxelCoord) const;
+
+	const std::vector<uvec4>& getLevelData(uint32_t level) const;
+
+	const std::vector<ClipmapSlab>& getPendingSlabs(uint32_t level) const;
+
+	uint64_t getPendingVoxelCount(uint32_t level) const;
+
+	bool isLevelComplete(uint32_t level) const;
+
+	dvec3 getCenter() const;
+
+	void setCenter(dvec3 center);
+
+	uint32_t getLevelCount() const;
+
+	uint32_t getLevelSize(uint32_t level) const;
+
+	double getLevelScale(uint32_t level) const;
+
+	ivec3 getLevelOrigin(uint32_t level) const;
+
+	dvec3 getLevelWorldOrigin(uint32_t level) const;
+
+	uint64_t getLevelMemoryUsage(uint32_t level) const;
+
+	uint64_t getLevelMemoryBudget(uint32_t level) const;
+
+	void setLevelMemoryBudget(uint32_t level, uint64_t memoryBudget);
+
+	uint64_t getUpdateBudget() const;
+
+	void setUpdateBudget(uint64_t updateBudget);
+
+	uint64_t getLastUpdateVoxelCount() const;
+
+	uint32_t getThreadCount() const;
+
+	void setThreadCount(uint32_t threadCount);
+
+	static ivec3 getLevelOrigin(dvec3 center, double levelScale, uint32_t levelSize);
+
+	static ivec3 getToroidalCoord(ivec3 voxelCoord, uint32_t levelSize);
+
+	static size_t getVoxelIndex(ivec3 voxelCoord, uint32_t levelSize);
+
+	static void getExposedSlabs(uint32_t level, ivec3 prevOrigin, ivec3 origin, uint32_t levelSize, std::vector<ClipmapSlab>& slabs);
+
+	static bool clipSlab(ClipmapSlab& slab, ivec3 boundMin, ivec3 boundMax);
+
+	static uint64_t getSlabVoxelCount(const ClipmapSlab& slab);
+
+private:
+	struct Level {
+		uint32_t size; // Voxels per axis, a power of two
+		double scale;
+		ivec3 origin; // Lattice coordinate of the lowest voxel
+		uint64_t memoryBudget; // 0 is unlimited
+		bool valid; // False until the level was placed for the first time
+		std::vector<uvec4> data; // size^3 voxels, toroidally addressed, x varies fastest
+		std::vector<ClipmapSlab> pendingSlabs;
+	};
+
+	struct MeshEntry {
+		const Mesh* mesh; // NULL once removed
+		dmat4 modelMatrix;
+		CPUVoxelizerMaterial material;
+		dvec3 boundMin; // World space bounds
+		dvec3 boundMax;
+	};
+
+	void resizeLevel(uint32_t level);
+
+	void invalidateBounds(dvec3 boundMin, dvec3 boundMax);
+
+	void clearSlab(const ClipmapSlab& slab);
+
+	void voxelizeSlab(const ClipmapSlab& slab);
+
+	static uint32_t getBudgetedLevelSize(uint32_t requestedSize, uint64_t memoryBudget);
+
+	std::vector<Level> m_levels;
+	std::vector<MeshEntry> m_meshes;
+
+	dvec3 m_center;
+	uint32_t m_levelSize; // Size every level gets when its budget allows it
+	double m_baseScale; // Voxel scale of level 0
+
+	uint64_t m_updateBudget; // Voxels revoxelized per update, 0 is unlimited
+	uint64_t m_lastUpdateVoxelCount;
+	uint32_t m_threadCount; // 0 uses every thread of the job system
+};
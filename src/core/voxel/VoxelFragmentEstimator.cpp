@@ -0,0 +1,201 @@
+#include "VoxelFragmentEstimator.h"
+
+#define MAX_SUBDIVISION_DEPTH 12
+#define CELL_COORD_BIAS 0x100000 // Cell coordinates are stored as 21-bit unsigned integers
+
+VoxelFragmentEstimator::VoxelFragmentEstimator(double cellSize):
+	m_cellSize(cellSize),
+	m_lastEstimate(0),
+	m_headroom(0.15),
+	m_correction(1.0),
+	m_minRatio(INFINITY),
+	m_maxRatio(0.0),
+	m_reportCount(0),
+	m_overflowCount(0) {
+	m_lastAxisEstimate[0] = 0;
+	m_lastAxisEstimate[1] = 0;
+	m_lastAxisEstimate[2] = 0;
+}
+
+VoxelFragmentEstimator::~VoxelFragmentEstimator() {
+}
+
+void VoxelFragmentEstimator::build(const std::vector<Mesh::vertex>& vertices, const std::vector<Mesh::triangle>& triangles) {
+	uint64_t startTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+
+	m_cellAreas.clear();
+
+	for (size_t i = 0; i < triangles.size(); i++) {
+		this->addTriangle(dvec3(vertices[triangles[i].i0].position), dvec3(vertices[triangles[i].i1].position), dvec3(vertices[triangles[i].i2].position));
+	}
+
+	uint64_t endTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+	info("Built voxel fragment estimate of %llu triangles in %u cells, took %.2f msec\n", (unsigned long long)triangles.size(), this->getCellCount(), (endTime - startTime) / 1000000.0);
+}
+
+void VoxelFragmentEstimator::addMesh(const Mesh* mesh, dmat4 modelMatrix) {
+	const std::vector<Mesh::vertex>& vertices = mesh->getVertices();
+	const std::vector<Mesh::triangle>& triangles = mesh->getTriangles();
+
+	for (size_t i = 0; i < triangles.size(); i++) {
+		dvec3 p0 = dvec3(modelMatrix * dvec4(dvec3(vertices[triangles[i].i0].position), 1.0));
+		dvec3 p1 = dvec3(modelMatrix * dvec4(dvec3(vertices[triangles[i].i1].position), 1.0));
+		dvec3 p2 = dvec3(modelMatrix * dvec4(dvec3(vertices[triangles[i].i2].position), 1.0));
+		this->addTriangle(p0, p1, p2);
+	}
+}
+
+void VoxelFragmentEstimator::clear() {
+	m_cellAreas.clear();
+	m_lastEstimate = 0;
+	m_lastAxisEstimate[0] = 0;
+	m_lastAxisEstimate[1] = 0;
+	m_lastAxisEstimate[2] = 0;
+}
+
+uint64_t VoxelFragmentEstimator::estimate(dvec3 gridCenter, uint32_t gridSize, double gridScale) {
+	// Same snapping as VoxelGenerator::updateAxisProjections
+	dvec3 gridMin = floor(gridCenter / (gridScale * 2)) * (gridScale * 2) - dvec3(gridSize * gridScale * 0.5);
+	dvec3 gridMax = gridMin + dvec3(gridSize * gridScale);
+	double invCellVolume = 1.0 / (m_cellSize * m_cellSize * m_cellSize);
+
+	dvec3 area = dvec3(0.0);
+
+	for (auto it = m_cellAreas.begin(); it != m_cellAreas.end(); it++) {
+		dvec3 cellMin = dvec3(getCellCoord(it->first)) * m_cellSize;
+		dvec3 cellMax = cellMin + m_cellSize;
+
+		dvec3 overlap = min(cellMax, gridMax) - max(cellMin, gridMin);
+		if (any(lessThanEqual(overlap, dvec3(0.0))))
+			continue;
+
+		// Surfaces are assumed to be spread evenly through the cell
+		area += it->second * (overlap.x * overlap.y * overlap.z * invCellVolume);
+	}
+
+	dvec3 fragmentCount = area / (gridScale * gridScale);
+	m_lastAxisEstimate[0] = (uint64_t)ceil(fragmentCount.x);
+	m_lastAxisEstimate[1] = (uint64_t)ceil(fragmentCount.y);
+	m_lastAxisEstimate[2] = (uint64_t)ceil(fragmentCount.z);
+	m_lastEstimate = m_lastAxisEstimate[0] + m_lastAxisEstimate[1] + m_lastAxisEstimate[2];
+	return m_lastEstimate;
+}
+
+uint64_t VoxelFragmentEstimator::getAllocationCount(uint64_t estimate) const {
+	return (uint64_t)ceil(estimate * m_correction * (1.0 + m_headroom));
+}
+
+void VoxelFragmentEstimator::reportFragmentCount(uint64_t estimate, uint64_t fragmentCount, bool overflowed) {
+	if (overflowed) {
+		++m_overflowCount;
+		info("Voxel fragment estimate of %llu overflowed, the scene produced %llu fragments (%llu overflows in %llu frames)\n",
+			(unsigned long long)estimate, (unsigned long long)fragmentCount, (unsigned long long)m_overflowCount, (unsigned long long)(m_reportCount + 1));
+	}
+
+	if (estimate == 0)
+		return; // Says nothing about the error of the estimate
+
+	double ratio = (double)fragmentCount / (double)estimate;
+	m_minRatio = glm::min(m_minRatio, ratio);
+	m_maxRatio = glm::max(m_maxRatio, ratio);
+
+	// Running average that follows the scene as it changes, but reacts to an overflow right away
+	if (m_reportCount == 0 || ratio > m_correction) {
+		m_correction = ratio;
+	} else {
+		m_correction += (ratio - m_correction) * 0.05;
+	}
+
+	++m_reportCount;
+}
+
+bool VoxelFragmentEstimator::hasGeometry() const {
+	return !m_cellAreas.empty();
+}
+
+uint32_t VoxelFragmentEstimator::getCellCount() const {
+	return (uint32_t)m_cellAreas.size();
+}
+
+double VoxelFragmentEstimator::getCellSize() const {
+	return m_cellSize;
+}
+
+uint64_t VoxelFragmentEstimator::getLastEstimate() const {
+	return m_lastEstimate;
+}
+
+uint64_t VoxelFragmentEstimator::getLastAxisEstimate(uint32_t axis) const {
+	assert(axis < 3);
+	return m_lastAxisEstimate[axis];
+}
+
+double VoxelFragmentEstimator::getHeadroom() const {
+	return m_headroom;
+}
+
+void VoxelFragmentEstimator::setHeadroom(double headroom) {
+	m_headroom = glm::max(headroom, 0.0);
+}
+
+double VoxelFragmentEstimator::getCorrection() const {
+	return m_correction;
+}
+
+double VoxelFragmentEstimator::getMinRatio() const {
+	return m_reportCount > 0 ? m_minRatio : NAN;
+}
+
+double VoxelFragmentEstimator::getMaxRatio() const {
+	return m_reportCount > 0 ? m_maxRatio : NAN;
+}
+
+uint64_t VoxelFragmentEstimator::getReportCount() const {
+	return m_reportCount;
+}
+
+uint64_t VoxelFragmentEstimator::getOverflowCount() const {
+	return m_overflowCount;
+}
+
+void VoxelFragmentEstimator::addTriangle(dvec3 p0, dvec3 p1, dvec3 p2) {
+	// The generation shader picks the projection axis with the largest normal component
+	dvec3 absNormal = abs(cross(p1 - p0, p2 - p0));
+	uint32_t axis = absNormal.x > absNormal.y ? 0 : 1;
+	axis = absNormal.z > absNormal[axis] ? 2 : axis;
+
+	if (absNormal[axis] <= 0.0)
+		return; // Degenerate, never rasterized
+
+	this->addTriangleArea(p0, p1, p2, axis, absNormal[axis] * 0.5, 0);
+}
+
+void VoxelFragmentEstimator::addTriangleArea(dvec3 p0, dvec3 p1, dvec3 p2, uint32_t axis, double projectedArea, uint32_t depth) {
+	double maxEdgeLength2 = glm::max(dot(p1 - p0, p1 - p0), glm::max(dot(p2 - p1, p2 - p1), dot(p0 - p2, p0 - p2)));
+
+	if (maxEdgeLength2 > m_cellSize * m_cellSize && depth < MAX_SUBDIVISION_DEPTH) {
+		// Larger than a cell, split into four so the area ends up in the cells the triangle actually spans
+		dvec3 m01 = (p0 + p1) * 0.5;
+		dvec3 m12 = (p1 + p2) * 0.5;
+		dvec3 m20 = (p2 + p0) * 0.5;
+		double quarterArea = projectedArea * 0.25;
+		this->addTriangleArea(p0, m01, m20, axis, quarterArea, depth + 1);
+		this->addTriangleArea(m01, p1, m12, axis, quarterArea, depth + 1);
+		this->addTriangleArea(m20, m12, p2, axis, quarterArea, depth + 1);
+		this->addTriangleArea(m01, m12, m20, axis, quarterArea, depth + 1);
+		return;
+	}
+
+	ivec3 cellCoord = ivec3(floor((p0 + p1 + p2) / (3.0 * m_cellSize)));
+	m_cellAreas[getCellKey(cellCoord)][axis] += projectedArea;
+}
+
+uint64_t VoxelFragmentEstimator::getCellKey(ivec3 cellCoord) {
+	uvec3 coord = uvec3(clamp(cellCoord + CELL_COORD_BIAS, ivec3(0), ivec3(CELL_COORD_BIAS * 2 - 1)));
+	return (uint64_t)coord.x | ((uint64_t)coord.y << 21) | ((uint64_t)coord.z << 42);
+}
+
+ivec3 VoxelFragmentEstimator::getCellCoord(uint64_t cellKey) {
+	ivec3 coord = ivec3((int32_t)(cellKey & 0x1FFFFF), (int32_t)((cellKey >> 21) & 0x1FFFFF), (int32_t)((cellKey >> 42) & 0x1FFFFF));
+	return coord - CELL_COORD_BIAS;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "core/pch.h"
+#include "core/renderer/geometry/Mesh.h"
+#include <unordered_map>
+
+// Predicts how many fragments the voxel generation pass will produce, so its buffers can be sized before
+// the scene is rasterized instead of after a separate counting pass. The generation shader projects each
+// triangle along its dominant axis and emits one fragment per covered pixel of gridScale^2, so the count
+// is close to the sum of the triangles' projected areas divided by gridScale^2. Those areas are summed
+// once per cell of a coarse world space grid when the geometry is built, which makes an estimate for any
+// grid placement a walk over the occupied cells, weighted by how much of each cell the voxel grid covers.
+// The remaining error (rasterization rules, clipped triangles, uneven distribution within a cell) is
+// tracked by comparing estimates with the counts the GPU reported, and corrected for over time.
+class VoxelFragmentEstimator : private NotCopyable {
+public:
+	VoxelFragmentEstimator(double cellSize = 1.0);
+
+	~VoxelFragmentEstimator();
+
+	void build(const std::vector<Mesh::vertex>& vertices, const std::vector<Mesh::triangle>& triangles);
+
+	void addMesh(const Mesh* mesh, dmat4 modelMatrix);
+
+	void clear();
+
+	uint64_t estimate(dvec3 gridCenter, uint32_t gridSize, double gridScale);
+
+	uint64_t getAllocationCount(uint64_t estimate) const;
+
+	void reportFragmentCount(uint64_t estimate, uint64_t fragmentCount, bool overflowed);
+
+	bool hasGeometry() const;
+
+	uint32_t getCellCount() const;
+
+	double getCellSize() const;
+
+	uint64_t getLastEstimate() const;
+
+	uint64_t getLastAxisEstimate(uint32_t axis) const;
+
+	double getHeadroom() const;
+
+	void setHeadroom(double headroom);
+
+	double getCorrection() const;
+
+	double getMinRatio() const;
+
+	double getMaxRatio() const;
+
+	uint64_t getReportCount() const;
+
+	uint64_t getOverflowCount() const;
+
+private:
+	void addTriangle(dvec3 p0, dvec3 p1, dvec3 p2);
+
+	void addTriangleArea(dvec3 p0, dvec3 p1, dvec3 p2, uint32_t axis, double projectedArea, uint32_t depth);
+
+	static uint64_t getCellKey(ivec3 cellCoord);
+
+	static ivec3 getCellCoord(uint64_t cellKey);
+
+	std::unordered_map<uint64_t, dvec3> m_cellAreas; // Projected area per dominant axis of the triangles in each cell
+	double m_cellSize;
+
+	uint64_t m_lastEstimate;
+	uint64_t m_lastAxisEstimate[3];
+
+	double m_headroom; // Fraction allocated on top of the corrected estimate
+	double m_correction; // Running average of reported count / estimate
+	double m_minRatio;
+	double m_maxRatio;
+	uint64_t m_reportCount;
+	uint64_t m_overflowCount;
+};
@@ -0,0 +1,564 @@
+#include "core/pch.h"
+#include "core/Engine.h"
+#include "core/scene/Scene.h"
+#include "core/scene/SceneComponents.h"
+#include "core/scene/Bounding.h"
+#include "core/scene/BVH.h"
+#include "core/scene/Transformation.h"
+#include "core/renderer/geometry/Mesh.h"
+#include "core/renderer/geometry/MeshLoader.h"
+#include "core/util/Benchmark.h"
+#include "core/util/FileUtils.h"
+#include "core/util/Morton.h"
+#include "core/profiler/Profiler.h"
+
+// Every benchmark seeds its own generator, so the inputs are the same in every build being compared
+struct BenchmarkRandom {
+	uint64_t state;
+
+	BenchmarkRandom(uint64_t seed = 0x2545F4914F6CDD1DULL):
+		state(seed) {
+	}
+
+	uint64_t next() {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	double nextDouble(double min = 0.0, double max = 1.0) {
+		return min + (max - min) * ((next() >> 11) * (1.0 / 9007199254740992.0));
+	}
+
+	dvec3 nextVec3(double min = 0.0, double max = 1.0) {
+		double x = nextDouble(min, max);
+		double y = nextDouble(min, max);
+		double z = nextDouble(min, max);
+		return dvec3(x, y, z);
+	}
+
+	dvec3 nextDirection() {
+		dvec3 direction;
+		do {
+			direction = nextVec3(-1.0, 1.0);
+		} while (dot(direction, direction) < 1e-6 || dot(direction, direction) > 1.0);
+		return normalize(direction);
+	}
+};
+
+
+
+Mesh* createScatteredSpheroids(uint32_t count, uint32_t isoDivisions, double extent) {
+	BenchmarkRandom random;
+	Mesh::Builder builder;
+	for (uint32_t i = 0; i < count; i++) {
+		dvec3 radius = random.nextVec3(0.25, 1.0);
+		dvec3 position = random.nextVec3(-extent, extent);
+		builder.createIcoSpheroid(radius, position, isoDivisions);
+	}
+
+	Mesh* mesh = NULL;
+	builder.build(&mesh);
+	return mesh;
+}
+
+bool writeSpheroidOBJ(std::string file, uint32_t divisions) {
+	Mesh::Builder builder;
+	builder.createUVSpheroid(dvec3(1.0), dvec3(0.0), divisions, divisions);
+
+	Mesh* mesh = NULL;
+	builder.build(&mesh);
+
+	std::ofstream stream(RESOURCE_PATH(file).c_str(), std::ofstream::out);
+	if (!stream.is_open()) {
+		delete mesh;
+		return false;
+	}
+
+	const std::vector<Mesh::vertex>& vertices = mesh->getVertices();
+	const std::vector<Mesh::triangle>& triangles = mesh->getTriangles();
+
+	stream << "o spheroid\n";
+	for (int i = 0; i < vertices.size(); i++) {
+		stream << "v " << vertices[i].px << " " << vertices[i].py << " " << vertices[i].pz << "\n";
+	}
+	for (int i = 0; i < vertices.size(); i++) {
+		stream << "vt " << vertices[i].tx << " " << vertices[i].ty << "\n";
+	}
+	for (int i = 0; i < vertices.size(); i++) {
+		stream << "vn " << vertices[i].nx << " " << vertices[i].ny << " " << vertices[i].nz << "\n";
+	}
+	for (int i = 0; i < triangles.size(); i++) {
+		stream << "f";
+		for (int j = 0; j < 3; j++) {
+			uint32_t index = triangles[i].indices[j] + 1;
+			stream << " " << index << "/" << index << "/" << index;
+		}
+		stream << "\n";
+	}
+
+	delete mesh;
+	return stream.good();
+}
+
+uint64_t getFileSize(std::string file) {
+	std::ifstream stream(RESOURCE_PATH(file).c_str(), std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+	return stream.is_open() ? (uint64_t)stream.tellg() : 0;
+}
+
+
+
+void benchmarkBVHBuild(BenchmarkState& state) {
+	Mesh* mesh = createScatteredSpheroids((uint32_t)state.getArgument(), 3, 50.0);
+
+	while (state.keepRunning()) {
+		BVH* bvh = BVH::build(mesh->getVertices(), mesh->getTriangles());
+		BenchmarkState::doNotOptimize(bvh);
+
+		state.pauseTiming();
+		delete bvh;
+		state.resumeTiming();
+	}
+
+	state.setItemsProcessed(state.getIterations() * mesh->getTriangleCount());
+	delete mesh;
+}
+
+void benchmarkReadOBJ(BenchmarkState& state) {
+	std::string file = "benchmark_spheroid.obj";
+	if (!writeSpheroidOBJ(file, (uint32_t)state.getArgument())) {
+		state.skipWithError("Failed to write " + file);
+		return;
+	}
+
+	while (state.keepRunning()) {
+		MeshLoader::OBJ* obj = MeshLoader::OBJ::readOBJ(file);
+		BenchmarkState::doNotOptimize(obj);
+
+		state.pauseTiming();
+		if (obj == NULL)
+			state.skipWithError("Failed to read " + file);
+		delete obj;
+		state.resumeTiming();
+	}
+
+	state.setBytesProcessed(state.getIterations() * getFileSize(file));
+	std::remove(RESOURCE_PATH(file).c_str());
+}
+
+void benchmarkReadMDL(BenchmarkState& state) {
+	std::string objFile = "benchmark_spheroid.obj";
+	std::string file = "benchmark_spheroid.mdl";
+	if (!writeSpheroidOBJ(objFile, (uint32_t)state.getArgument())) {
+		state.skipWithError("Failed to write " + objFile);
+		return;
+	}
+
+	MeshLoader::OBJ* source = MeshLoader::OBJ::readOBJ(objFile);
+	std::remove(RESOURCE_PATH(objFile).c_str());
+	if (source == NULL || !source->writeMDL(file)) {
+		state.skipWithError("Failed to write " + file);
+		delete source;
+		return;
+	}
+	delete source;
+
+	while (state.keepRunning()) {
+		MeshLoader::OBJ* obj = MeshLoader::OBJ::readMDL(file);
+		BenchmarkState::doNotOptimize(obj);
+
+		state.pauseTiming();
+		if (obj == NULL)
+			state.skipWithError("Failed to read " + file);
+		delete obj;
+		state.resumeTiming();
+	}
+
+	state.setBytesProcessed(state.getIterations() * getFileSize(file));
+	std::remove(RESOURCE_PATH(file).c_str());
+}
+
+void benchmarkMeshOptimise(BenchmarkState& state) {
+	uint32_t divisions = (uint32_t)state.getArgument();
+	int32_t triangleCount = 0;
+
+	while (state.keepRunning()) {
+		state.pauseTiming();
+		Mesh::Builder builder;
+		builder.createUVSpheroid(dvec3(1.0), dvec3(0.0), divisions, divisions);
+		triangleCount = builder.getTriangleCount();
+		state.resumeTiming();
+
+		builder.optimise();
+		BenchmarkState::doNotOptimize(builder);
+	}
+
+	state.setItemsProcessed(state.getIterations() * triangleCount);
+}
+
+void benchmarkAABBCombine(BenchmarkState& state) {
+	BenchmarkRandom random;
+	std::vector<AxisAlignedBB> boxes;
+	for (int64_t i = 0; i < state.getArgument(); i++) {
+		dvec3 center = random.nextVec3(-100.0, 100.0);
+		dvec3 halfExtent = random.nextVec3(0.1, 5.0);
+		boxes.push_back(AxisAlignedBB(center - halfExtent, center + halfExtent));
+	}
+
+	while (state.keepRunning()) {
+		AxisAlignedBB combined = boxes[0];
+		for (int i = 1; i < boxes.size(); i++) {
+			combined = AxisAlignedBB::combine(combined, boxes[i]);
+		}
+		BenchmarkState::doNotOptimize(combined);
+	}
+
+	state.setItemsProcessed(state.getIterations() * boxes.size());
+}
+
+void benchmarkAABBIntersectsRay(BenchmarkState& state) {
+	BenchmarkRandom random;
+	std::vector<AxisAlignedBB> boxes;
+	std::vector<dvec3> origins;
+	std::vector<dvec3> directions;
+	for (int64_t i = 0; i < state.getArgument(); i++) {
+		dvec3 center = random.nextVec3(-10.0, 10.0);
+		dvec3 halfExtent = random.nextVec3(0.1, 5.0);
+		boxes.push_back(AxisAlignedBB(center - halfExtent, center + halfExtent));
+		origins.push_back(random.nextVec3(-20.0, 20.0));
+		directions.push_back(random.nextDirection());
+	}
+
+	while (state.keepRunning()) {
+		uint32_t hitCount = 0;
+		for (int i = 0; i < boxes.size(); i++) {
+			double t0, t1;
+			if (boxes[i].intersectsRay(origins[i], directions[i], &t0, &t1))
+				++hitCount;
+		}
+		BenchmarkState::doNotOptimize(hitCount);
+	}
+
+	state.setItemsProcessed(state.getIterations() * boxes.size());
+}
+
+void benchmarkTransformationComposition(BenchmarkState& state) {
+	BenchmarkRandom random;
+	std::vector<Transformation> transforms;
+	for (int64_t i = 0; i < state.getArgument(); i++) {
+		dvec3 translation = random.nextVec3(-10.0, 10.0);
+		dquat orientation = angleAxis(random.nextDouble(0.0, M_PI * 2.0), random.nextDirection());
+		dvec3 scale = random.nextVec3(0.5, 2.0);
+		transforms.push_back(Transformation(translation, orientation, scale));
+	}
+
+	while (state.keepRunning()) {
+		Transformation combined = transforms[0];
+		for (int i = 1; i < transforms.size(); i++) {
+			combined = combined * transforms[i];
+		}
+		BenchmarkState::doNotOptimize(combined);
+	}
+
+	state.setItemsProcessed(state.getIterations() * transforms.size());
+}
+
+void benchmarkTransformationModelMatrix(BenchmarkState& state) {
+	BenchmarkRandom random;
+	std::vector<Transformation> transforms;
+	for (int64_t i = 0; i < state.getArgument(); i++) {
+		dvec3 translation = random.nextVec3(-10.0, 10.0);
+		dquat orientation = angleAxis(random.nextDouble(0.0, M_PI * 2.0), random.nextDirection());
+		dvec3 scale = random.nextVec3(0.5, 2.0);
+		transforms.push_back(Transformation(translation, orientation, scale));
+	}
+
+	while (state.keepRunning()) {
+		dmat4 sum = dmat4(0.0);
+		for (int i = 0; i < transforms.size(); i++) {
+			sum += transforms[i].getModelMatrix();
+		}
+		BenchmarkState::doNotOptimize(sum);
+	}
+
+	state.setItemsProcessed(state.getIterations() * transforms.size());
+}
+
+void benchmarkMeshRayIntersection(BenchmarkState& state) {
+	uint32_t divisions = (uint32_t)state.getArgument();
+	Mesh::Builder builder;
+	builder.createUVSpheroid(dvec3(1.0), dvec3(0.0), divisions, divisions);
+
+	Mesh* mesh = NULL;
+	builder.build(&mesh);
+
+	// Rays from outside the sphere towards random points around it, so roughly half of them hit
+	BenchmarkRandom random;
+	std::vector<dvec3> origins;
+	std::vector<dvec3> directions;
+	for (int i = 0; i < 64; i++) {
+		dvec3 origin = random.nextDirection() * 3.0;
+		origins.push_back(origin);
+		directions.push_back(normalize(random.nextVec3(-1.4, 1.4) - origin));
+	}
+
+	while (state.keepRunning()) {
+		uint32_t hitCount = 0;
+		for (int i = 0; i < origins.size(); i++) {
+			double distance = INFINITY;
+			dvec3 barycentric;
+			Mesh::index triangleIndex;
+			if (mesh->getRayIntersection(origins[i], directions[i], distance, barycentric, triangleIndex))
+				++hitCount;
+		}
+		BenchmarkState::doNotOptimize(hitCount);
+	}
+
+	state.setItemsProcessed(state.getIterations() * origins.size());
+	state.setLabel(std::to_string(mesh->getTriangleCount()) + " triangles");
+	delete mesh;
+}
+
+void benchmarkSceneGraphRaycast(BenchmarkState& state) {
+	BenchmarkRandom random;
+	Mesh::Builder builder;
+	builder.createIcoSpheroid(dvec3(1.0), dvec3(0.0), 2);
+
+	Mesh* mesh = NULL;
+	builder.build(&mesh);
+
+	SceneObject* benchmarkRoot = new SceneObject();
+	for (int64_t i = 0; i < state.getArgument(); i++) {
+		dvec3 translation = random.nextVec3(-20.0, 20.0);
+		SceneObject* object = new SceneObject(Transformation(translation, dquat(), random.nextVec3(0.25, 1.0)));
+		object->addComponent("mesh", new MeshComponent(mesh));
+		benchmarkRoot->addChild("spheroid_" + std::to_string(i), object);
+	}
+	Engine::scene()->getRoot()->addChild("benchmark_raycast", benchmarkRoot);
+
+	std::vector<dvec3> origins;
+	std::vector<dvec3> directions;
+	for (int i = 0; i < 16; i++) {
+		dvec3 origin = random.nextDirection() * 40.0;
+		origins.push_back(origin);
+		directions.push_back(normalize(random.nextVec3(-20.0, 20.0) - origin));
+	}
+
+	while (state.keepRunning()) {
+		for (int i = 0; i < origins.size(); i++) {
+			RaycastResult* result = Engine::scene()->raycast(origins[i], directions[i]);
+			BenchmarkState::doNotOptimize(result);
+			delete result;
+		}
+	}
+
+	state.setItemsProcessed(state.getIterations() * origins.size());
+
+	Engine::scene()->getRoot()->removeChild("benchmark_raycast");
+	delete benchmarkRoot;
+	delete mesh;
+}
+
+std::vector<uvec3> createMortonCoords(int64_t count, uint32_t bits) {
+	BenchmarkRandom random;
+	std::vector<uvec3> coords;
+	uint32_t mask = (1u << bits) - 1;
+	for (int64_t i = 0; i < count; i++) {
+		uint64_t value = random.next();
+		coords.push_back(uvec3(value & mask, (value >> 21) & mask, (value >> 42) & mask));
+	}
+	return coords;
+}
+
+// The implementation is a template argument rather than a function pointer, so inline ones stay inline
+template <typename Code, Code(*Encode)(uvec3), bool RequiresBMI2 = false>
+void benchmarkMortonEncode(BenchmarkState& state) {
+	if (RequiresBMI2 && !Morton::hasBMI2()) {
+		state.skipWithMessage("The CPU does not support BMI2");
+		return;
+	}
+
+	std::vector<uvec3> coords = createMortonCoords(state.getArgument(), sizeof(Code) == 4 ? Morton::MAX_BITS_32 : Morton::MAX_BITS_64);
+
+	while (state.keepRunning()) {
+		Code combined = 0;
+		for (int i = 0; i < coords.size(); i++) {
+			combined ^= Encode(coords[i]);
+		}
+		BenchmarkState::doNotOptimize(combined);
+	}
+
+	state.setItemsProcessed(state.getIterations() * coords.size());
+}
+
+template <typename Code, uvec3(*Decode)(Code), bool RequiresBMI2 = false>
+void benchmarkMortonDecode(BenchmarkState& state) {
+	if (RequiresBMI2 && !Morton::hasBMI2()) {
+		state.skipWithMessage("The CPU does not support BMI2");
+		return;
+	}
+
+	BenchmarkRandom random;
+	std::vector<Code> codes;
+	for (int64_t i = 0; i < state.getArgument(); i++) {
+		codes.push_back((Code)(random.next() & (sizeof(Code) == 4 ? 0x3FFFFFFFULL : 0x7FFFFFFFFFFFFFFFULL)));
+	}
+
+	while (state.keepRunning()) {
+		uvec3 combined = uvec3(0);
+		for (int i = 0; i < codes.size(); i++) {
+			combined ^= Decode(codes[i]);
+		}
+		BenchmarkState::doNotOptimize(combined);
+	}
+
+	state.setItemsProcessed(state.getIterations() * codes.size());
+}
+
+void benchmarkMortonEncode64Batch(BenchmarkState& state) {
+	std::vector<uvec3> coords = createMortonCoords(state.getArgument(), Morton::MAX_BITS_64);
+	std::vector<uint64_t> codes(coords.size());
+
+	while (state.keepRunning()) {
+		Morton::encode64(&coords[0], &codes[0], coords.size());
+		BenchmarkState::doNotOptimize(codes[0]);
+	}
+
+	state.setItemsProcessed(state.getIterations() * coords.size());
+	state.setBytesProcessed(state.getIterations() * coords.size() * (sizeof(uvec3) + sizeof(uint64_t)));
+}
+
+void benchmarkMortonDecode64Batch(BenchmarkState& state) {
+	std::vector<uvec3> coords = createMortonCoords(state.getArgument(), Morton::MAX_BITS_64);
+	std::vector<uint64_t> codes(coords.size());
+	Morton::encode64(&coords[0], &codes[0], coords.size());
+
+	while (state.keepRunning()) {
+		Morton::decode64(&codes[0], &coords[0], codes.size());
+		BenchmarkState::doNotOptimize(coords[0]);
+	}
+
+	state.setItemsProcessed(state.getIterations() * codes.size());
+	state.setBytesProcessed(state.getIterations() * codes.size() * (sizeof(uvec3) + sizeof(uint64_t)));
+}
+
+// The cost of entering and leaving one scope on the calling thread, which is added to every profiled
+// scope in every frame. Should stay under 50 ns per scope. The events are collected between iterations,
+// untimed, so the event buffer never fills and no scope is dropped.
+void benchmarkProfilerScope(BenchmarkState& state) {
+	Profiler* profiler = Profiler::currentProfiler();
+	if (profiler == NULL) {
+		state.skipWithError("Not profiling");
+		return;
+	}
+
+	if (state.getArgument() * 2 + 2 > Profiler::getEventBufferCapacity()) {
+		state.skipWithError("Too many scopes for the event buffer");
+		return;
+	}
+
+	bool gpuProfilingEnabled = profiler->isGPUProfilingEnabled();
+	profiler->setGPUProfilingEnabled(false);
+	profiler->collect();
+	uint64_t droppedEventCount = profiler->getDroppedEventCount();
+
+	while (state.keepRunning()) {
+		{
+			PROFILE_SCOPE("benchmarkProfilerScope");
+			for (int64_t i = 0; i < state.getArgument(); i++) {
+				PROFILE_SCOPE("scope");
+			}
+		}
+
+		state.pauseTiming();
+		profiler->collect();
+		state.resumeTiming();
+	}
+
+	if (profiler->getDroppedEventCount() != droppedEventCount) {
+		state.skipWithError("Dropped profile events");
+	}
+
+	// The benchmark scopes were recorded as frames of the engine thread
+	profiler->resetStatistics();
+	profiler->setGPUProfilingEnabled(gpuProfilingEnabled);
+	state.setItemsProcessed(state.getIterations() * state.getArgument());
+}
+
+
+
+// Runs the CPU benchmarks without a window and writes Google Benchmark compatible JSON, so builds can be
+// compared with its tools/compare.py:
+//     SVOEngine --benchmark results.json [--benchmarkfilter BVH] [--benchmarkrepetitions 5] [--benchmarkmintime 500]
+int start_benchmarks(int argc, char** argv) {
+	std::string outputFile = "";
+	std::string filter = "";
+	int32_t repetitions = 3;
+	int32_t minTime = 500; // Milliseconds
+
+	std::vector<char*> engineArgs;
+	for (int i = 0; i < argc; i++) {
+		if (i + 1 < argc && std::strcmp(argv[i], "--benchmark") == 0) {
+			outputFile = argv[++i];
+		} else if (i + 1 < argc && std::strcmp(argv[i], "--benchmarkfilter") == 0) {
+			filter = argv[++i];
+		} else if (i + 1 < argc && std::strcmp(argv[i], "--benchmarkrepetitions") == 0) {
+			repetitions = std::stoi(argv[++i]);
+		} else if (i + 1 < argc && std::strcmp(argv[i], "--benchmarkmintime") == 0) {
+			minTime = std::stoi(argv[++i]);
+		} else {
+			engineArgs.push_back(argv[i]);
+		}
+	}
+
+	char headlessArg[] = "--headless";
+	engineArgs.push_back(headlessArg);
+
+	uint32_t failedCount = 0;
+	try {
+		Engine::create((int)engineArgs.size(), &engineArgs[0]);
+
+		BenchmarkRunner runner;
+		runner.setFilter(filter);
+		runner.setRepetitions((uint32_t)glm::max(repetitions, 1));
+		runner.setMinTime(glm::max(minTime, 1) / 1000.0);
+
+		runner.add("BVH::build", benchmarkBVHBuild, { 4, 32, 256 });
+		runner.add("MeshLoader::OBJ::readOBJ", benchmarkReadOBJ, { 32, 256 });
+		runner.add("MeshLoader::OBJ::readMDL", benchmarkReadMDL, { 32, 256 });
+		runner.add("Mesh::Builder::optimise", benchmarkMeshOptimise, { 8, 16, 32 });
+		runner.add("AxisAlignedBB::combine", benchmarkAABBCombine, { 64, 4096 });
+		runner.add("AxisAlignedBB::intersectsRay", benchmarkAABBIntersectsRay, { 64, 4096 });
+		runner.add("Transformation::operator*", benchmarkTransformationComposition, { 64, 4096 });
+		runner.add("Transformation::getModelMatrix", benchmarkTransformationModelMatrix, { 64, 4096 });
+		runner.add("Mesh::getRayIntersection", benchmarkMeshRayIntersection, { 16, 64 });
+		runner.add("SceneGraph::raycast", benchmarkSceneGraphRaycast, { 16, 128 });
+		runner.add("Morton::encode32MagicBits", benchmarkMortonEncode<uint32_t, Morton::encode32MagicBits>, { 4096 });
+		runner.add("Morton::encode32LUT", benchmarkMortonEncode<uint32_t, Morton::encode32LUT>, { 4096 });
+		runner.add("Morton::encode32BMI2", benchmarkMortonEncode<uint32_t, Morton::encode32BMI2, true>, { 4096 });
+		runner.add("Morton::encode64MagicBits", benchmarkMortonEncode<uint64_t, Morton::encode64MagicBits>, { 4096 });
+		runner.add("Morton::encode64LUT", benchmarkMortonEncode<uint64_t, Morton::encode64LUT>, { 4096 });
+		runner.add("Morton::encode64BMI2", benchmarkMortonEncode<uint64_t, Morton::encode64BMI2, true>, { 4096 });
+		runner.add("Morton::decode32MagicBits", benchmarkMortonDecode<uint32_t, Morton::decode32MagicBits>, { 4096 });
+		runner.add("Morton::decode32LUT", benchmarkMortonDecode<uint32_t, Morton::decode32LUT>, { 4096 });
+		runner.add("Morton::decode32BMI2", benchmarkMortonDecode<uint32_t, Morton::decode32BMI2, true>, { 4096 });
+		runner.add("Morton::decode64MagicBits", benchmarkMortonDecode<uint64_t, Morton::decode64MagicBits>, { 4096 });
+		runner.add("Morton::decode64LUT", benchmarkMortonDecode<uint64_t, Morton::decode64LUT>, { 4096 });
+		runner.add("Morton::decode64BMI2", benchmarkMortonDecode<uint64_t, Morton::decode64BMI2, true>, { 4096 });
+		runner.add("Morton::encode64 (batch)", benchmarkMortonEncode64Batch, { 4096, 1048576 });
+		runner.add("Morton::decode64 (batch)", benchmarkMortonDecode64Batch, { 4096, 1048576 });
+		runner.add("Profiler::scope", benchmarkProfilerScope, { 64, 4096 });
+
+		failedCount = runner.run();
+		if (!runner.writeJSON(outputFile))
+			++failedCount;
+
+		Engine::destroy();
+	} catch (std::exception e) {
+		error("Engine threw a fatal exception: %s\n", e.what());
+		return -1;
+	}
+
+	return failedCount == 0 ? 0 : 1;
+}
@@ -210,12 +210,13 @@ int start_raytracer(int argc, char** argv) {
 			}
 		}
 
+		int exitCode = Engine::instance()->getExitCode();
 		Engine::destroy();
+		return exitCode;
 	} catch (std::exception e) {
 		error("Engine threw a fatal exception: %s\n", e.what());
 		return -1;
 	}
-	return 0;
 }
 
 int start_rasterizer(int argc, char** argv) {
@@ -279,7 +280,8 @@ int start_rasterizer(int argc, char** argv) {
 		//cubemapConfig.frontFilePath = RESOURCE_PATH("environments/headPointerTexture/posz.bmp");
 		//cubemapConfig.backFilePath = RESOURCE_PATH("environments/headPointerTexture/negz.bmp");
 		cubemapConfig.floatingPoint = true;
-		Engine::scene()->setGlobalEnvironmentMap((new LightProbe(cubemapConfig))->calculateDiffuseIrradianceMap()->calculateSpecularReflectionMap());
+		if (Engine::isGLAvailable()) // The probe maps are baked on the CPU but only sampled on the GPU, headless runs skip loading the environment
+			Engine::scene()->setGlobalEnvironmentMap((new LightProbe(cubemapConfig))->calculateDiffuseIrradianceMap()->calculateSpecularReflectionMap());
 
 
 		//SceneObject* galleryObject = new SceneObject(Transformation(dvec3(0.0, 0.0, 0.0), dquat(), dvec3(1.0)));
@@ -431,15 +433,27 @@ int start_rasterizer(int argc, char** argv) {
 			}
 		}
 
+		int exitCode = Engine::instance()->getExitCode();
 		Engine::destroy();
+		return exitCode;
 	} catch (std::exception e) {
 		error("Engine threw a fatal exception: %s\n", e.what());
 		return -1;
 	}
-	return 0;
 }
 
+int start_benchmarks(int argc, char** argv);
+
+int start_tests(int argc, char** argv);
+
 int main(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--benchmark") == 0)
+			return start_benchmarks(argc, argv);
+		if (std::strcmp(argv[i], "--test") == 0)
+			return start_tests(argc, argv);
+	}
+
 	return start_rasterizer(argc, argv);
 	//return start_raytracer(argc, argv);
 }
\ No newline at end of file
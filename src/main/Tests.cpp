@@ -0,0 +1,772 @@
+#include "core/pch.h"
+#include "core/Engine.h"
+#include "core/renderer/VirtualTexture.h"
+#include "core/voxel/VoxelClipmap.h"
+#include "core/voxel/BrickPool.h"
+#include "core/renderer/ShaderSourceCache.h"
+#include "core/renderer/ProgramBinaryCache.h"
+#include "core/util/Test.h"
+#include <filesystem>
+
+static uint32_t getTestTexel(uint32_t x, uint32_t y) {
+	return (x & 0xFF) | ((y & 0xFF) << 8) | (((x >> 8) | ((y >> 8) << 4)) << 16) | (0xFFu << 24);
+}
+
+static std::vector<uint8_t> createTestImage(uint32_t width, uint32_t height) {
+	std::vector<uint8_t> data((size_t)width * height * 4);
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t texel = getTestTexel(x, y);
+			memcpy(&data[((size_t)y * width + x) * 4], &texel, 4);
+		}
+	}
+	return data;
+}
+
+static void writeTestBrick(BrickPool& pool, uint32_t brick, uint32_t seed) {
+	uint32_t voxelCount = pool.getBrickSize() * pool.getBrickSize() * pool.getBrickSize();
+	std::vector<uint32_t> albedo(voxelCount);
+	std::vector<uint32_t> normal(voxelCount);
+	for (uint32_t i = 0; i < voxelCount; i++) {
+		albedo[i] = seed * 1000 + i;
+		normal[i] = ~(seed * 1000 + i);
+	}
+	pool.writeBrick(brick, &albedo[0], &normal[0]);
+}
+
+static bool isTestBrick(const BrickPool& pool, uint32_t brick, uint32_t seed) {
+	uint32_t voxelCount = pool.getBrickSize() * pool.getBrickSize() * pool.getBrickSize();
+	std::vector<uint32_t> albedo(voxelCount);
+	std::vector<uint32_t> normal(voxelCount);
+	pool.readBrick(brick, &albedo[0], &normal[0]);
+	for (uint32_t i = 0; i < voxelCount; i++) {
+		if (albedo[i] != seed * 1000 + i || normal[i] != ~(seed * 1000 + i))
+			return false;
+	}
+	return true;
+}
+
+// Writes the file and moves its last write time forward, so the change is seen even when the file
+// system only keeps whole seconds
+static void writeTestFile(std::string path, std::string text) {
+	bool existed = std::filesystem::exists(path);
+	std::filesystem::file_time_type lastWriteTime;
+	if (existed) {
+		lastWriteTime = std::filesystem::last_write_time(path);
+	}
+
+	std::ofstream stream(path.c_str(), std::ofstream::out | std::ofstream::trunc);
+	stream << text;
+	stream.close();
+
+	if (existed) {
+		std::filesystem::last_write_time(path, lastWriteTime + std::chrono::seconds(5));
+	}
+}
+
+static std::vector<uint8_t> readTestFileBytes(std::string path) {
+	std::ifstream stream(path.c_str(), std::ifstream::in | std::ifstream::binary);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+static void writeTestFileBytes(std::string path, const std::vector<uint8_t>& bytes) {
+	std::ofstream stream(path.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	stream.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+static uint32_t getPageTexel(const std::vector<uint8_t>& page, uint32_t paddedPageSize, uint32_t x, uint32_t y) {
+	uint32_t texel;
+	memcpy(&texel, &page[((size_t)y * paddedPageSize + x) * 4], 4);
+	return texel;
+}
+
+
+
+void testVirtualTexturePageFile(TestState& state) {
+	const uint32_t width = 300;
+	const uint32_t height = 200;
+	const uint32_t pageSize = 64;
+	const uint32_t pageBorder = 4;
+	std::vector<uint8_t> image = createTestImage(width, height);
+
+	std::string filePath = state.getTempFilePath("texture.svtp");
+	if (!TEST_EXPECT(state, VirtualTexturePageFile::build(filePath, &image[0], width, height, pageSize, pageBorder)))
+		return;
+
+	VirtualTexturePageFile pageFile;
+	if (!TEST_EXPECT(state, pageFile.open(filePath)))
+		return;
+
+	// 5 x 4 pages at mip 0, halved and rounded up per mip until a single page is left
+	TEST_EXPECT_EQUAL(state, width, pageFile.getWidth());
+	TEST_EXPECT_EQUAL(state, height, pageFile.getHeight());
+	TEST_EXPECT_EQUAL(state, 4u, pageFile.getMipCount());
+	TEST_EXPECT_EQUAL(state, 5u * 4u + 3u * 2u + 2u * 1u + 1u, pageFile.getPageCount());
+	TEST_EXPECT_EQUAL(state, 1u, pageFile.getPageCountX(3));
+	TEST_EXPECT_EQUAL(state, 72u, pageFile.getPaddedPageSize());
+
+	TEST_EXPECT(state, pageFile.isValidPage(VirtualPage::pack(4, 3, 0)));
+	TEST_EXPECT(state, !pageFile.isValidPage(VirtualPage::pack(5, 0, 0)));
+	TEST_EXPECT(state, !pageFile.isValidPage(VirtualPage::pack(0, 0, 4)));
+
+	std::vector<uint8_t> page;
+	TEST_EXPECT(state, !pageFile.readPage(VirtualPage::pack(0, 4, 0), page));
+
+	// An interior page holds its texels plus the border copied from the neighbouring pages
+	if (TEST_EXPECT(state, pageFile.readPage(VirtualPage::pack(1, 2, 0), page))) {
+		TEST_EXPECT_EQUAL(state, pageFile.getPageDataSize(), (uint64_t)page.size());
+		TEST_EXPECT_EQUAL(state, getTestTexel(64, 128), getPageTexel(page, 72, 4, 4));
+		TEST_EXPECT_EQUAL(state, getTestTexel(127, 191), getPageTexel(page, 72, 67, 67));
+		TEST_EXPECT_EQUAL(state, getTestTexel(60, 124), getPageTexel(page, 72, 0, 0));
+		TEST_EXPECT_EQUAL(state, getTestTexel(131, 195), getPageTexel(page, 72, 71, 71));
+	}
+
+	// Pages hanging over the edge of the image repeat its edge texels
+	if (TEST_EXPECT(state, pageFile.readPage(VirtualPage::pack(4, 3, 0), page))) {
+		TEST_EXPECT_EQUAL(state, getTestTexel(299, 199), getPageTexel(page, 72, 71, 71));
+		TEST_EXPECT_EQUAL(state, getTestTexel(256, 192), getPageTexel(page, 72, 4, 4));
+	}
+
+	if (TEST_EXPECT(state, pageFile.readPage(VirtualPage::pack(0, 0, 0), page))) {
+		TEST_EXPECT_EQUAL(state, getTestTexel(0, 0), getPageTexel(page, 72, 0, 0));
+	}
+
+	// Mip texels are the rounded average of the 2x2 texels below them
+	if (TEST_EXPECT(state, pageFile.readPage(VirtualPage::pack(0, 0, 1), page))) {
+		uint32_t expected = 0;
+		for (uint32_t c = 0; c < 4; c++) {
+			uint32_t sum = 2;
+			for (uint32_t i = 0; i < 4; i++) {
+				sum += (getTestTexel(10 + (i & 1), 20 + (i >> 1)) >> (c * 8)) & 0xFF;
+			}
+			expected |= (sum / 4) << (c * 8);
+		}
+		TEST_EXPECT_EQUAL(state, expected, getPageTexel(page, 72, 4 + 5, 4 + 10));
+	}
+
+	pageFile.close();
+	TEST_EXPECT(state, !pageFile.isOpen());
+
+	// A truncated page index is rejected when the file is opened, not when a page is read
+	std::string truncatedPath = state.getTempFilePath("truncated.svtp");
+	{
+		std::ifstream src(filePath.c_str(), std::ifstream::binary);
+		std::ofstream dst(truncatedPath.c_str(), std::ofstream::binary);
+		std::vector<char> header(sizeof(VirtualTextureFileHeader) + sizeof(VirtualTexturePageEntry) * 3);
+		src.read(&header[0], header.size());
+		dst.write(&header[0], header.size());
+	}
+
+	TEST_EXPECT(state, !pageFile.open(truncatedPath));
+	TEST_EXPECT(state, !pageFile.isOpen());
+	TEST_EXPECT(state, !pageFile.open(state.getTempFilePath("missing.svtp")));
+}
+
+void testVirtualTexturePageCacheEviction(TestState& state) {
+	VirtualPageId a = VirtualPage::pack(0, 0, 0);
+	VirtualPageId b = VirtualPage::pack(1, 0, 0);
+	VirtualPageId c = VirtualPage::pack(2, 0, 0);
+	VirtualPageId d = VirtualPage::pack(3, 0, 0);
+	VirtualPageId e = VirtualPage::pack(4, 0, 0);
+	VirtualPageId f = VirtualPage::pack(5, 0, 0);
+
+	VirtualTexturePageCache cache(3);
+	VirtualPageId evicted;
+	TEST_EXPECT(state, cache.allocate(a, 1, &evicted) != VIRTUAL_PAGE_INVALID);
+	TEST_EXPECT_EQUAL(state, VIRTUAL_PAGE_INVALID, evicted);
+	TEST_EXPECT(state, cache.allocate(b, 2) != VIRTUAL_PAGE_INVALID);
+	TEST_EXPECT(state, cache.allocate(c, 3) != VIRTUAL_PAGE_INVALID);
+	TEST_EXPECT_EQUAL(state, 3u, cache.getResidentCount());
+
+	// Allocating a resident page hands back its slot
+	uint32_t slotA = cache.find(a);
+	TEST_EXPECT_EQUAL(state, slotA, cache.allocate(a, 3));
+
+	// a was used last, so b is the least recently used and goes first
+	TEST_EXPECT(state, cache.touch(a, 4));
+	uint32_t slotB = cache.find(b);
+	TEST_EXPECT_EQUAL(state, slotB, cache.allocate(d, 5, &evicted));
+	TEST_EXPECT_EQUAL(state, b, evicted);
+	TEST_EXPECT_EQUAL(state, VIRTUAL_PAGE_INVALID, cache.find(b));
+
+	// Locked pages are skipped, however long ago they were used
+	cache.lock(c);
+	TEST_EXPECT_EQUAL(state, slotA, cache.allocate(e, 6, &evicted));
+	TEST_EXPECT_EQUAL(state, a, evicted);
+
+	// d was used in an earlier frame and can still go, but pages used this frame never are
+	TEST_EXPECT_EQUAL(state, 1u, cache.getAvailableCount(6));
+	TEST_EXPECT(state, cache.allocate(f, 6, &evicted) != VIRTUAL_PAGE_INVALID);
+	TEST_EXPECT_EQUAL(state, d, evicted);
+	TEST_EXPECT_EQUAL(state, 0u, cache.getAvailableCount(6));
+	TEST_EXPECT_EQUAL(state, VIRTUAL_PAGE_INVALID, cache.allocate(a, 6));
+
+	cache.unlock(c);
+	TEST_EXPECT_EQUAL(state, 1u, cache.getAvailableCount(6));
+
+	cache.evict(f);
+	TEST_EXPECT_EQUAL(state, 2u, cache.getResidentCount());
+	TEST_EXPECT_EQUAL(state, VIRTUAL_PAGE_INVALID, cache.find(f));
+	TEST_EXPECT_EQUAL(state, 2u, cache.getAvailableCount(6));
+}
+
+void testVirtualTextureRequestScheduling(TestState& state) {
+	// Feedback is sorted coarse pages first, then by how often each page was sampled
+	uint32_t feedback[] = {
+		VirtualPage::pack(1, 1, 0), VirtualPage::pack(2, 2, 0), VirtualPage::pack(2, 2, 0),
+		VIRTUAL_PAGE_INVALID, VirtualPage::pack(0, 0, 1), VirtualPage::pack(2, 2, 0),
+	};
+	std::vector<VirtualTexturePageRequest> requests;
+	VirtualTextureFeedback::analyse(feedback, 6, requests);
+	if (TEST_EXPECT_EQUAL(state, (size_t)3, requests.size())) {
+		TEST_EXPECT_EQUAL(state, VirtualPage::pack(0, 0, 1), requests[0].page);
+		TEST_EXPECT_EQUAL(state, VirtualPage::pack(2, 2, 0), requests[1].page);
+		TEST_EXPECT_EQUAL(state, 3u, requests[1].count);
+		TEST_EXPECT_EQUAL(state, VirtualPage::pack(1, 1, 0), requests[2].page);
+	}
+
+	// 4 x 4 pages and 3 mips in a cache of 4 slots, loaded synchronously so every step is deterministic
+	std::vector<uint8_t> image = createTestImage(256, 256);
+	std::string filePath = state.getTempFilePath("texture.svtp");
+	if (!TEST_EXPECT(state, VirtualTexturePageFile::build(filePath, &image[0], 256, 256, 64, 4)))
+		return;
+
+	VirtualTexture* virtualTexture = NULL;
+	if (!TEST_EXPECT(state, VirtualTexture::load(filePath, &virtualTexture, 2, 2, 0)))
+		return;
+
+	const VirtualTexturePageTable& pageTable = virtualTexture->getPageTable();
+	VirtualPageId topPage = VirtualPage::pack(0, 0, 2);
+	VirtualPageId parentPage = VirtualPage::pack(1, 1, 1);
+	VirtualPageId page = VirtualPage::pack(3, 3, 0);
+
+	// The coarsest mip is loaded without any feedback, as the fallback for everything else
+	virtualTexture->update(NULL, 0, 1);
+	TEST_EXPECT(state, pageTable.isResident(topPage));
+	TEST_EXPECT_EQUAL(state, (size_t)1, virtualTexture->getPendingUploads().size());
+	virtualTexture->clearPendingUploads();
+
+	// A page missing its parent is requested after the parent, one request per frame here
+	virtualTexture->setMaxRequestsPerFrame(1);
+	uint32_t pageFeedback[] = { page, page };
+	virtualTexture->update(pageFeedback, 2, 2);
+	TEST_EXPECT(state, pageTable.isResident(parentPage));
+	TEST_EXPECT(state, !pageTable.isResident(page));
+	TEST_EXPECT_EQUAL(state, topPage, pageTable.findResidentPage(VirtualPage::pack(0, 0, 0)));
+	TEST_EXPECT_EQUAL(state, parentPage, pageTable.findResidentPage(page));
+
+	virtualTexture->update(pageFeedback, 2, 3);
+	TEST_EXPECT(state, pageTable.isResident(page));
+	TEST_EXPECT_EQUAL(state, (uint64_t)2, virtualTexture->getRequestedPageCount());
+
+	// Pages already resident are not requested again
+	virtualTexture->update(pageFeedback, 2, 4);
+	TEST_EXPECT_EQUAL(state, (uint64_t)2, virtualTexture->getRequestedPageCount());
+
+	// One more page fills the cache, and the one after evicts the least recently used page that is not
+	// locked, which is the parent page last sampled in frame 3. The locked top page survives
+	virtualTexture->setMaxRequestsPerFrame(32);
+	uint32_t fillFeedback[] = { VirtualPage::pack(0, 0, 1) };
+	virtualTexture->update(fillFeedback, 1, 5);
+	TEST_EXPECT_EQUAL(state, 4u, virtualTexture->getPageCache().getResidentCount());
+	TEST_EXPECT_EQUAL(state, (uint64_t)0, virtualTexture->getEvictedPageCount());
+
+	uint32_t evictFeedback[] = { VirtualPage::pack(0, 1, 1) };
+	virtualTexture->update(evictFeedback, 1, 6);
+	TEST_EXPECT(state, pageTable.isResident(VirtualPage::pack(0, 1, 1)));
+	TEST_EXPECT(state, !pageTable.isResident(parentPage));
+	TEST_EXPECT(state, pageTable.isResident(page));
+	TEST_EXPECT(state, pageTable.isResident(topPage));
+	TEST_EXPECT_EQUAL(state, (uint64_t)1, virtualTexture->getEvictedPageCount());
+	TEST_EXPECT_EQUAL(state, 4u, virtualTexture->getPageCache().getResidentCount());
+
+	delete virtualTexture;
+}
+
+void testBrickPoolAllocate(TestState& state) {
+	BrickPool pool(4, 8);
+	TEST_EXPECT_EQUAL(state, 6u, pool.getPaddedBrickSize());
+	TEST_EXPECT_EQUAL(state, 2u, pool.getBricksPerAxis());
+	TEST_EXPECT(state, pool.getTextureSize() == uvec3(12));
+
+	// Bricks are handed out lowest slot first, until the pool is full
+	for (uint32_t i = 0; i < 8; i++) {
+		TEST_EXPECT_EQUAL(state, i, pool.allocate());
+	}
+	TEST_EXPECT_EQUAL(state, BrickPool::INVALID_BRICK, pool.allocate());
+	TEST_EXPECT_EQUAL(state, 8u, pool.getAllocatedCount());
+	TEST_EXPECT_EQUAL(state, 0u, pool.getFreeCount());
+
+	// Every brick has its own place in the texture
+	std::set<uint32_t> origins;
+	for (uint32_t i = 0; i < 8; i++) {
+		uvec3 origin = pool.getBrickTexelOrigin(i);
+		TEST_EXPECT(state, all(lessThan(origin + pool.getPaddedBrickSize() - 1u, pool.getTextureSize())));
+		origins.insert((origin.z * 12 + origin.y) * 12 + origin.x);
+	}
+	TEST_EXPECT_EQUAL(state, (size_t)8, origins.size());
+
+	// New bricks are empty, written voxels read back as they were written, border included
+	TEST_EXPECT_EQUAL(state, 0u, pool.getVoxelAlbedo(2, ivec3(1, 2, 3)));
+	writeTestBrick(pool, 2, 2);
+	TEST_EXPECT(state, isTestBrick(pool, 2, 2));
+	TEST_EXPECT_EQUAL(state, 2000u + (3 * 4 + 2) * 4 + 1, pool.getVoxelAlbedo(2, ivec3(1, 2, 3)));
+
+	std::vector<uint32_t> paddedAlbedo(6 * 6 * 6);
+	std::vector<uint32_t> paddedNormal(6 * 6 * 6);
+	pool.readPaddedBrick(2, &paddedAlbedo[0], &paddedNormal[0]);
+	TEST_EXPECT_EQUAL(state, 2000u, paddedAlbedo[0]);
+	TEST_EXPECT_EQUAL(state, 2000u + 63, paddedAlbedo[6 * 6 * 6 - 1]);
+}
+
+void testBrickPoolFree(TestState& state) {
+	BrickPool pool(4, 8);
+	for (uint32_t i = 0; i < 8; i++) {
+		pool.allocate();
+	}
+
+	TEST_EXPECT(state, pool.free(5));
+	TEST_EXPECT(state, pool.free(3));
+	TEST_EXPECT(state, !pool.free(3));
+	TEST_EXPECT(state, !pool.free(8));
+	TEST_EXPECT(state, !pool.free(BrickPool::INVALID_BRICK));
+	TEST_EXPECT(state, !pool.isAllocated(3));
+	TEST_EXPECT_EQUAL(state, 6u, pool.getAllocatedCount());
+	TEST_EXPECT_EQUAL(state, 2u, pool.getFreeCount());
+
+	// Freed slots are reused lowest first, and come back empty
+	writeTestBrick(pool, 1, 1);
+	TEST_EXPECT(state, pool.free(1));
+	TEST_EXPECT_EQUAL(state, 1u, pool.allocate());
+	TEST_EXPECT_EQUAL(state, 0u, pool.getVoxelAlbedo(1, ivec3(0)));
+	TEST_EXPECT_EQUAL(state, 3u, pool.allocate());
+	TEST_EXPECT_EQUAL(state, 5u, pool.allocate());
+	TEST_EXPECT_EQUAL(state, BrickPool::INVALID_BRICK, pool.allocate());
+
+	pool.clear();
+	TEST_EXPECT_EQUAL(state, 0u, pool.getAllocatedCount());
+	TEST_EXPECT_EQUAL(state, 0u, pool.allocate());
+}
+
+void testBrickPoolDefragment(TestState& state) {
+	bool compressedPools[] = { false, true };
+	for (bool compressed : compressedPools) {
+		BrickPool pool(4, 8, compressed);
+		for (uint32_t i = 0; i < 8; i++) {
+			pool.allocate();
+			if (!compressed) {
+				writeTestBrick(pool, i, i + 1);
+			}
+		}
+
+		pool.free(3);
+		pool.free(5);
+		pool.clearDirty();
+
+		// The highest bricks move into the lowest holes, everything in front of the holes stays put
+		std::vector<uint32_t> remap;
+		TEST_EXPECT_EQUAL(state, 2u, pool.defragment(remap));
+		if (!TEST_EXPECT_EQUAL(state, (size_t)8, remap.size()))
+			continue;
+
+		uint32_t expectedRemap[] = { 0, 1, 2, BrickPool::INVALID_BRICK, 4, BrickPool::INVALID_BRICK, 5, 3 };
+		for (uint32_t i = 0; i < 8; i++) {
+			TEST_EXPECT_EQUAL(state, expectedRemap[i], remap[i]);
+		}
+
+		for (uint32_t i = 0; i < 6; i++) {
+			TEST_EXPECT(state, pool.isAllocated(i));
+		}
+		TEST_EXPECT(state, !pool.isAllocated(6) && !pool.isAllocated(7));
+		TEST_EXPECT_EQUAL(state, 6u, pool.getAllocatedCount());
+
+		// Moved bricks keep their voxels and have to be uploaded again at their new place
+		if (!compressed) {
+			TEST_EXPECT(state, isTestBrick(pool, 3, 8));
+			TEST_EXPECT(state, isTestBrick(pool, 5, 7));
+			TEST_EXPECT(state, isTestBrick(pool, 4, 5));
+		}
+
+		std::vector<uint32_t> dirtyBricks;
+		pool.getDirtyBricks(dirtyBricks);
+		TEST_EXPECT(state, dirtyBricks == std::vector<uint32_t>({ 3, 5 }));
+
+		// A defragmented pool shrinks to its allocated bricks, but not below them
+		TEST_EXPECT(state, !pool.setCapacity(5));
+		TEST_EXPECT(state, pool.setCapacity(6));
+		TEST_EXPECT_EQUAL(state, 6u, pool.getCapacity());
+		TEST_EXPECT_EQUAL(state, BrickPool::INVALID_BRICK, pool.allocate());
+
+		// Defragmenting a pool without holes moves nothing
+		TEST_EXPECT_EQUAL(state, 0u, pool.defragment(remap));
+		TEST_EXPECT_EQUAL(state, 5u, remap[5]);
+	}
+}
+
+void testVoxelClipmapToroidalAddressing(TestState& state) {
+	TEST_EXPECT(state, VoxelClipmap::getToroidalCoord(ivec3(0, 7, 8), 8) == ivec3(0, 7, 0));
+	TEST_EXPECT(state, VoxelClipmap::getToroidalCoord(ivec3(-1, -8, -9), 8) == ivec3(7, 0, 7));
+	TEST_EXPECT(state, VoxelClipmap::getToroidalCoord(ivec3(-17, 23, -1000001), 8) == ivec3(7, 7, 7));
+
+	// Any window of the level's size maps onto every voxel exactly once, wherever it is placed
+	ivec3 origins[] = { ivec3(0), ivec3(-13, -3, 5), ivec3(-8, -16, -1), ivec3(1000003, -999999, 7) };
+	for (int i = 0; i < 4; i++) {
+		std::vector<bool> visited(8 * 8 * 8, false);
+		uint32_t duplicateCount = 0;
+		for (int32_t z = 0; z < 8; z++) {
+			for (int32_t y = 0; y < 8; y++) {
+				for (int32_t x = 0; x < 8; x++) {
+					size_t index = VoxelClipmap::getVoxelIndex(origins[i] + ivec3(x, y, z), 8);
+					if (index >= visited.size() || visited[index]) {
+						++duplicateCount;
+					} else {
+						visited[index] = true;
+					}
+				}
+			}
+		}
+		TEST_EXPECT_EQUAL(state, 0u, duplicateCount);
+	}
+}
+
+void testVoxelClipmapLevelOrigin(TestState& state) {
+	// The origin moves in steps of two voxels, rounding towards negative infinity on both sides of zero
+	TEST_EXPECT(state, VoxelClipmap::getLevelOrigin(dvec3(0.0), 1.0, 16) == ivec3(-8));
+	TEST_EXPECT(state, VoxelClipmap::getLevelOrigin(dvec3(1.99), 1.0, 16) == ivec3(-8));
+	TEST_EXPECT(state, VoxelClipmap::getLevelOrigin(dvec3(2.0), 1.0, 16) == ivec3(-6));
+	TEST_EXPECT(state, VoxelClipmap::getLevelOrigin(dvec3(-0.01), 1.0, 16) == ivec3(-10));
+	TEST_EXPECT(state, VoxelClipmap::getLevelOrigin(dvec3(-2.0), 1.0, 16) == ivec3(-10));
+	TEST_EXPECT(state, VoxelClipmap::getLevelOrigin(dvec3(-2.01), 1.0, 16) == ivec3(-12));
+	TEST_EXPECT(state, VoxelClipmap::getLevelOrigin(dvec3(1.0, -1.0, 5.0), 0.25, 8) == ivec3(0, -8, 16));
+
+	// Every level lies inside the next coarser one, wherever the centre is
+	dvec3 centers[] = { dvec3(0.0), dvec3(0.3, -0.3, 7.9), dvec3(-1234.56, 987.65, -0.001), dvec3(-3.0, -5.0, -7.0) };
+	for (int i = 0; i < 4; i++) {
+		for (uint32_t level = 0; level < 5; level++) {
+			double scale = 0.5 * (double)(1u << level);
+			dvec3 min = dvec3(VoxelClipmap::getLevelOrigin(centers[i], scale, 16)) * scale;
+			dvec3 max = min + 16.0 * scale;
+			dvec3 parentMin = dvec3(VoxelClipmap::getLevelOrigin(centers[i], scale * 2.0, 16)) * scale * 2.0;
+			dvec3 parentMax = parentMin + 16.0 * scale * 2.0;
+			TEST_EXPECT(state, all(greaterThanEqual(min, parentMin)) && all(lessThanEqual(max, parentMax)));
+			TEST_EXPECT(state, all(lessThanEqual(min, centers[i])) && all(greaterThan(max, centers[i])));
+		}
+	}
+}
+
+void testVoxelClipmapExposedSlabs(TestState& state) {
+	const uint32_t size = 8;
+	const int32_t deltas[] = { 0, 1, -1, 3, -5, 7, -7, 8, -8, 13, -21 };
+	const ivec3 prevOrigin = ivec3(-5, -12, 3);
+
+	// Compared against the brute force answer: the slabs cover every voxel of the new volume that was
+	// not in the old one, once, and nothing else
+	uint32_t failedMoveCount = 0;
+	for (int32_t dx : deltas) {
+		for (int32_t dy : deltas) {
+			for (int32_t dz : deltas) {
+				ivec3 origin = prevOrigin + ivec3(dx, dy, dz);
+				std::vector<ClipmapSlab> slabs;
+				VoxelClipmap::getExposedSlabs(2, prevOrigin, origin, size, slabs);
+
+				bool valid = true;
+				uint64_t slabVoxelCount = 0;
+				for (int i = 0; i < slabs.size(); i++) {
+					valid &= slabs[i].level == 2;
+					slabVoxelCount += VoxelClipmap::getSlabVoxelCount(slabs[i]);
+				}
+
+				uint64_t exposedVoxelCount = 0;
+				for (int32_t z = origin.z; z < origin.z + (int32_t)size; z++) {
+					for (int32_t y = origin.y; y < origin.y + (int32_t)size; y++) {
+						for (int32_t x = origin.x; x < origin.x + (int32_t)size; x++) {
+							ivec3 voxel = ivec3(x, y, z);
+							bool exposed = any(lessThan(voxel, prevOrigin)) || any(greaterThanEqual(voxel, prevOrigin + (int32_t)size));
+							uint32_t coverCount = 0;
+							for (int i = 0; i < slabs.size(); i++) {
+								coverCount += all(greaterThanEqual(voxel, slabs[i].min)) && all(lessThan(voxel, slabs[i].max)) ? 1 : 0;
+							}
+							valid &= coverCount == (exposed ? 1u : 0u);
+							exposedVoxelCount += exposed ? 1 : 0;
+						}
+					}
+				}
+
+				// Voxels outside the new volume are never part of a slab
+				valid &= slabVoxelCount == exposedVoxelCount;
+
+				// Moving a whole level or further replaces everything in one slab
+				bool replaced = glm::max(abs(dx), glm::max(abs(dy), abs(dz))) >= (int32_t)size;
+				if (replaced) {
+					valid &= slabs.size() == 1 && slabs[0].min == origin && slabs[0].max == origin + (int32_t)size;
+				}
+
+				if (!valid) {
+					state.fail("Wrong slabs exposed moving by [" + std::to_string(dx) + ", " + std::to_string(dy) + ", " + std::to_string(dz) + "]");
+					++failedMoveCount;
+				}
+			}
+		}
+	}
+
+	TEST_EXPECT_EQUAL(state, 0u, failedMoveCount);
+}
+
+void testVoxelClipmapPendingSlabs(TestState& state) {
+	VoxelClipmap clipmap(2, 8, 1.0);
+	clipmap.setThreadCount(1);
+
+	// Both levels start out pending as a whole
+	TEST_EXPECT_EQUAL(state, (uint64_t)512, clipmap.getPendingVoxelCount(0));
+	TEST_EXPECT_EQUAL(state, (uint64_t)512, clipmap.getPendingVoxelCount(1));
+	TEST_EXPECT(state, clipmap.getLevelOrigin(0) == ivec3(-4));
+	TEST_EXPECT(state, clipmap.getLevelOrigin(1) == ivec3(-4));
+
+	// A budgeted update does whole layers of the finest level first
+	clipmap.setUpdateBudget(100);
+	TEST_EXPECT_EQUAL(state, (uint64_t)64, clipmap.update());
+	TEST_EXPECT_EQUAL(state, (uint64_t)448, clipmap.getPendingVoxelCount(0));
+	TEST_EXPECT_EQUAL(state, (uint64_t)512, clipmap.getPendingVoxelCount(1));
+
+	clipmap.setUpdateBudget(0);
+	TEST_EXPECT_EQUAL(state, (uint64_t)960, clipmap.update());
+	TEST_EXPECT(state, clipmap.isLevelComplete(0) && clipmap.isLevelComplete(1));
+
+	// Two voxels along x exposes two layers of level 0, level 1 only moves every four
+	clipmap.setCenter(dvec3(2.0, 0.0, 0.0));
+	TEST_EXPECT(state, clipmap.getLevelOrigin(0) == ivec3(-2, -4, -4));
+	TEST_EXPECT_EQUAL(state, (uint64_t)128, clipmap.getPendingVoxelCount(0));
+	TEST_EXPECT(state, clipmap.isLevelComplete(1));
+
+	// Moving back past the start drops the pending layers that scrolled out again
+	clipmap.setCenter(dvec3(-2.0, 0.0, 0.0));
+	TEST_EXPECT(state, clipmap.getLevelOrigin(0) == ivec3(-6, -4, -4));
+	TEST_EXPECT_EQUAL(state, (uint64_t)256, clipmap.getPendingVoxelCount(0));
+	TEST_EXPECT(state, clipmap.getLevelOrigin(1) == ivec3(-6, -4, -4));
+	TEST_EXPECT_EQUAL(state, (uint64_t)128, clipmap.getPendingVoxelCount(1));
+
+	// Jumping further than a level is wide replaces the whole level
+	clipmap.setCenter(dvec3(-20.5, 3.0, 100.0));
+	TEST_EXPECT_EQUAL(state, (uint64_t)512, clipmap.getPendingVoxelCount(0));
+	TEST_EXPECT_EQUAL(state, (uint64_t)512, clipmap.getPendingVoxelCount(1));
+	TEST_EXPECT(state, clipmap.getVoxel(0, ivec3(0)) == uvec4(0));
+}
+
+void testShaderSourceCacheChangeDetection(TestState& state) {
+	std::string globals = state.getTempFilePath("globals.glsl");
+	std::string lighting = state.getTempFilePath("lighting.glsl");
+	std::string shaderA = state.getTempFilePath("a.glsl");
+	std::string shaderB = state.getTempFilePath("b.glsl");
+	writeTestFile(globals, "float globalValue;\n");
+	writeTestFile(lighting, "#include \"" + globals + "\"\nfloat lightingValue;\n");
+	writeTestFile(shaderA, "#include \"" + globals + "\"\n  #include \"" + lighting + "\"\nvoid main() {}\n");
+	writeTestFile(shaderB, "#include \"" + globals + "\"\nvoid mainB() {}\n");
+
+	ShaderSourceCache cache;
+	std::string source, preprocessed;
+
+	// Includes are expanded in place, each file at most once per shader, followed by a #line reset
+	TEST_EXPECT(state, cache.getPreprocessedSource(shaderA, source, preprocessed));
+	TEST_EXPECT_EQUAL(state, std::string("float globalValue;\n#line 2\nfloat lightingValue;\n#line 2\nvoid main() {}\n"), preprocessed);
+	TEST_EXPECT(state, cache.getPreprocessedSource(shaderB, source, preprocessed));
+	TEST_EXPECT_EQUAL(state, (uint64_t)4, cache.getFileReadCount());
+	TEST_EXPECT_EQUAL(state, 4u, cache.getFileCount());
+
+	// Nothing is read again until a file changes on disk
+	for (int i = 0; i < 8; i++) {
+		cache.getPreprocessedSource(shaderA, source, preprocessed);
+	}
+	std::vector<std::string> changedShaders;
+	TEST_EXPECT_EQUAL(state, 0u, cache.update(&changedShaders));
+	TEST_EXPECT(state, changedShaders.empty());
+	TEST_EXPECT_EQUAL(state, (uint64_t)4, cache.getFileReadCount());
+
+	// A changed include is the only file read again, and only the shaders including it are reported
+	writeTestFile(lighting, "#include \"" + globals + "\"\nfloat lightingValue2;\n");
+	TEST_EXPECT_EQUAL(state, 1u, cache.update(&changedShaders));
+	TEST_EXPECT_EQUAL(state, (size_t)1, changedShaders.size());
+	TEST_EXPECT(state, changedShaders.size() == 1 && changedShaders[0] == shaderA);
+	TEST_EXPECT_EQUAL(state, (uint64_t)5, cache.getFileReadCount());
+	TEST_EXPECT(state, cache.getPreprocessedSource(shaderA, source, preprocessed));
+	TEST_EXPECT_EQUAL(state, std::string("float globalValue;\n#line 2\nfloat lightingValue2;\n#line 2\nvoid main() {}\n"), preprocessed);
+
+	// A shader requested again after the change is not reported, it already has the new source
+	writeTestFile(globals, "float globalValue2;\n");
+	TEST_EXPECT(state, cache.getPreprocessedSource(shaderB, source, preprocessed));
+	TEST_EXPECT(state, preprocessed.find("globalValue2") != std::string::npos);
+	changedShaders.clear();
+	cache.update(&changedShaders);
+	TEST_EXPECT(state, changedShaders.size() == 1 && changedShaders[0] == shaderA);
+	TEST_EXPECT(state, cache.getPreprocessedSource(shaderA, source, preprocessed));
+	TEST_EXPECT(state, preprocessed.find("globalValue2") != std::string::npos);
+
+	// Missing files fail, and so do shaders with a missing include
+	std::string shaderC = state.getTempFilePath("c.glsl");
+	writeTestFile(shaderC, "#include \"" + state.getTempFilePath("missing.glsl") + "\"\nvoid mainC() {}\n");
+	TEST_EXPECT(state, !cache.getPreprocessedSource(state.getTempFilePath("missing.glsl"), source, preprocessed));
+	TEST_EXPECT(state, !cache.getPreprocessedSource(shaderC, source, preprocessed));
+}
+
+void testProgramBinaryCacheKey(TestState& state) {
+	// Reloading a changed shader links it through the binary cache, so a changed include has to change
+	// the key, or the program would be loaded from the binary of the old source
+	std::string globals = state.getTempFilePath("globals.glsl");
+	std::string shader = state.getTempFilePath("shader.glsl");
+	writeTestFile(globals, "float globalValue;\n");
+	writeTestFile(shader, "#include \"" + globals + "\"\nvoid main() {}\n");
+
+	ShaderSourceCache cache;
+	std::string source, preprocessed;
+	std::map<uint32_t, std::string> sources;
+	std::map<std::string, int32_t> attributes = { { "position", 0 }, { "normal", 1 } };
+	std::map<std::string, int32_t> dataLocations = { { "color", 0 } };
+
+	TEST_EXPECT(state, cache.getPreprocessedSource(shader, source, preprocessed));
+	sources[GL_VERTEX_SHADER] = preprocessed;
+	sources[GL_FRAGMENT_SHADER] = "void main() {}\n";
+	uint64_t key = ProgramBinaryCache::getProgramKey(sources, attributes, dataLocations, "driver 1");
+	TEST_EXPECT_EQUAL(state, key, ProgramBinaryCache::getProgramKey(sources, attributes, dataLocations, "driver 1"));
+
+	writeTestFile(globals, "float globalValue2;\n");
+	cache.update();
+	TEST_EXPECT(state, cache.getPreprocessedSource(shader, source, preprocessed));
+	sources[GL_VERTEX_SHADER] = preprocessed;
+	uint64_t changedKey = ProgramBinaryCache::getProgramKey(sources, attributes, dataLocations, "driver 1");
+	TEST_EXPECT(state, changedKey != key);
+
+	// Everything bound before linking, and the driver, is part of the key as well
+	std::map<uint32_t, std::string> swappedStages = { { GL_VERTEX_SHADER, sources[GL_FRAGMENT_SHADER] }, { GL_FRAGMENT_SHADER, sources[GL_VERTEX_SHADER] } };
+	std::map<std::string, int32_t> movedAttributes = { { "position", 1 }, { "normal", 0 } };
+	std::map<std::string, int32_t> movedDataLocations = { { "color", 1 } };
+	TEST_EXPECT(state, ProgramBinaryCache::getProgramKey(swappedStages, attributes, dataLocations, "driver 1") != changedKey);
+	TEST_EXPECT(state, ProgramBinaryCache::getProgramKey(sources, movedAttributes, dataLocations, "driver 1") != changedKey);
+	TEST_EXPECT(state, ProgramBinaryCache::getProgramKey(sources, attributes, movedDataLocations, "driver 1") != changedKey);
+	TEST_EXPECT(state, ProgramBinaryCache::getProgramKey(sources, attributes, dataLocations, "driver 2") != changedKey);
+}
+
+void testProgramBinaryCacheLoad(TestState& state) {
+	const size_t headerSize = 36; // magic, version, key, format, size, hash
+	const size_t sizeOffset = 20;
+	const uint64_t key = 0x0123456789ABCDEF;
+	std::string path = state.getTempFilePath("program.bin");
+	std::string brokenPath = state.getTempFilePath("broken.bin");
+
+	std::vector<uint8_t> binary(1000);
+	for (int i = 0; i < binary.size(); i++) {
+		binary[i] = (uint8_t)(i * 7 + 3);
+	}
+
+	uint32_t format = 0;
+	std::vector<uint8_t> loaded;
+	TEST_EXPECT(state, !ProgramBinaryCache::load(path, key, format, loaded)); // Not cached yet
+
+	// Round trip
+	TEST_EXPECT(state, ProgramBinaryCache::save(path, key, 0x8741, binary));
+	TEST_EXPECT(state, ProgramBinaryCache::load(path, key, format, loaded));
+	TEST_EXPECT_EQUAL(state, 0x8741u, format);
+	TEST_EXPECT(state, loaded == binary);
+
+	// Another program, or the same one for another driver, does not use the binary
+	TEST_EXPECT(state, !ProgramBinaryCache::load(path, key + 1, format, loaded));
+
+	std::vector<uint8_t> file = readTestFileBytes(path);
+	TEST_EXPECT_EQUAL(state, headerSize + binary.size(), file.size());
+
+	// Truncated, with the size still claiming the whole binary
+	std::vector<uint8_t> broken(file.begin(), file.end() - 1);
+	writeTestFileBytes(brokenPath, broken);
+	TEST_EXPECT(state, !ProgramBinaryCache::load(brokenPath, key, format, loaded));
+
+	// Cut inside the header
+	broken.assign(file.begin(), file.begin() + sizeOffset + 4);
+	writeTestFileBytes(brokenPath, broken);
+	TEST_EXPECT(state, !ProgramBinaryCache::load(brokenPath, key, format, loaded));
+
+	// A size larger than the file is rejected before anything is allocated for it
+	broken = file;
+	uint64_t hugeSize = (uint64_t)1 << 62;
+	std::memcpy(&broken[sizeOffset], &hugeSize, sizeof(uint64_t));
+	writeTestFileBytes(brokenPath, broken);
+	TEST_EXPECT(state, !ProgramBinaryCache::load(brokenPath, key, format, loaded));
+
+	// A zero size, and a size smaller than the file
+	for (uint64_t size : { (uint64_t)0, (uint64_t)(binary.size() - 8) }) {
+		broken = file;
+		std::memcpy(&broken[sizeOffset], &size, sizeof(uint64_t));
+		writeTestFileBytes(brokenPath, broken);
+		TEST_EXPECT(state, !ProgramBinaryCache::load(brokenPath, key, format, loaded));
+	}
+
+	// Corrupted bytes do not match the stored hash
+	broken = file;
+	broken[headerSize + binary.size() / 2] ^= 0x10;
+	writeTestFileBytes(brokenPath, broken);
+	TEST_EXPECT(state, !ProgramBinaryCache::load(brokenPath, key, format, loaded));
+	TEST_EXPECT(state, loaded.empty());
+
+	// A wrong magic or version
+	for (size_t offset : { (size_t)0, (size_t)4 }) {
+		broken = file;
+		broken[offset] ^= 0xFF;
+		writeTestFileBytes(brokenPath, broken);
+		TEST_EXPECT(state, !ProgramBinaryCache::load(brokenPath, key, format, loaded));
+	}
+
+	// Empty binaries are never written
+	std::string emptyPath = state.getTempFilePath("empty.bin");
+	TEST_EXPECT(state, !ProgramBinaryCache::save(emptyPath, key, 0x8741, std::vector<uint8_t>()));
+	TEST_EXPECT(state, !std::filesystem::exists(emptyPath));
+}
+
+
+
+// Runs the CPU side tests without a window, returning a non-zero exit code if any test failed:
+//     SVOEngine --test [--testfilter VirtualTexture]
+int start_tests(int argc, char** argv) {
+	std::string filter = "";
+
+	std::vector<char*> engineArgs;
+	for (int i = 0; i < argc; i++) {
+		if (std::strcmp(argv[i], "--test") == 0) {
+			continue;
+		} else if (i + 1 < argc && std::strcmp(argv[i], "--testfilter") == 0) {
+			filter = argv[++i];
+		} else {
+			engineArgs.push_back(argv[i]);
+		}
+	}
+
+	char headlessArg[] = "--headless";
+	engineArgs.push_back(headlessArg);
+
+	uint32_t failedCount = 0;
+	try {
+		Engine::create((int)engineArgs.size(), &engineArgs[0]);
+
+		TestRunner runner(Engine::instance()->getCacheDirectory() + "/tests");
+		runner.setFilter(filter);
+
+		runner.add("VirtualTexturePageFile", testVirtualTexturePageFile);
+		runner.add("VirtualTexturePageCache::eviction", testVirtualTexturePageCacheEviction);
+		runner.add("VirtualTexture::requestScheduling", testVirtualTextureRequestScheduling);
+		runner.add("BrickPool::allocate", testBrickPoolAllocate);
+		runner.add("BrickPool::free", testBrickPoolFree);
+		runner.add("BrickPool::defragment", testBrickPoolDefragment);
+		runner.add("VoxelClipmap::toroidalAddressing", testVoxelClipmapToroidalAddressing);
+		runner.add("VoxelClipmap::getLevelOrigin", testVoxelClipmapLevelOrigin);
+		runner.add("VoxelClipmap::getExposedSlabs", testVoxelClipmapExposedSlabs);
+		runner.add("VoxelClipmap::pendingSlabs", testVoxelClipmapPendingSlabs);
+		runner.add("ShaderSourceCache::changeDetection", testShaderSourceCacheChangeDetection);
+		runner.add("ProgramBinaryCache::getProgramKey", testProgramBinaryCacheKey);
+		runner.add("ProgramBinaryCache::load", testProgramBinaryCacheLoad);
+
+		failedCount = runner.run();
+
+		Engine::destroy();
+	} catch (std::exception e) {
+		error("Engine threw a fatal exception: %s\n", e.what());
+		return -1;
+	}
+
+	return failedCount == 0 ? 0 : 1;
+}